@@ -41,6 +41,7 @@
 
 
 #include "hyscan-cairo.h"
+#include <math.h>
 
 /*
  * Clipping routines for line.
@@ -258,3 +259,87 @@ hyscan_cairo_line_to (cairo_t *cairo,
   cairo_move_to (cairo, x1, y1);
   cairo_line_to (cairo, x2, y2);
 }
+
+/**
+ * hyscan_cairo_fill_convex:
+ * @data: данные изображения в формате %CAIRO_FORMAT_ARGB32
+ * @stride: размер строки изображения в байтах
+ * @width: ширина изображения
+ * @height: высота изображения
+ * @points: (array length=n_points): координаты вершин многоугольника x0, y0, x1, y1, ...
+ * @n_points: число вершин многоугольника
+ * @pixel: значение пикселя в формате %CAIRO_FORMAT_ARGB32
+ *
+ * Функция закрашивает выпуклый многоугольник, записывая значение @pixel
+ * напрямую в данные изображения, что соответствует рисованию с оператором
+ * %CAIRO_OPERATOR_SOURCE без сглаживания. Закрашиваются пиксели, центры
+ * которых лежат внутри многоугольника.
+ *
+ * Функция работает с данными изображения, полученными через
+ * cairo_image_surface_get_data(). Перед её вызовом необходимо вызвать
+ * cairo_surface_flush(), а после завершения рисования - cairo_surface_mark_dirty().
+ */
+void
+hyscan_cairo_fill_convex (guchar        *data,
+                          gint           stride,
+                          gint           width,
+                          gint           height,
+                          const gdouble *points,
+                          guint          n_points,
+                          guint32        pixel)
+{
+  gdouble min_y = G_MAXDOUBLE, max_y = -G_MAXDOUBLE;
+  gdouble row_from, row_to;
+  gint row;
+  guint i;
+
+  if (n_points < 3)
+    return;
+
+  for (i = 0; i < n_points; i++)
+    {
+      if (!isfinite (points[2 * i]) || !isfinite (points[2 * i + 1]))
+        return;
+
+      min_y = MIN (min_y, points[2 * i + 1]);
+      max_y = MAX (max_y, points[2 * i + 1]);
+    }
+
+  /* Строки, центры которых попадают в многоугольник. */
+  row_from = CLAMP (ceil (min_y - 0.5), 0.0, (gdouble) height);
+  row_to = CLAMP (ceil (max_y - 0.5) - 1.0, -1.0, height - 1.0);
+
+  for (row = row_from; row <= row_to; row++)
+    {
+      gdouble y = row + 0.5;
+      gdouble left = G_MAXDOUBLE, right = -G_MAXDOUBLE;
+      gdouble column_from, column_to;
+      guint32 *line;
+      gint column;
+
+      /* Пересечения центральной линии строки с рёбрами многоугольника. */
+      for (i = 0; i < n_points; i++)
+        {
+          const gdouble *p0 = &points[2 * i];
+          const gdouble *p1 = &points[2 * ((i + 1) % n_points)];
+          gdouble x;
+
+          if (!((p0[1] <= y && y < p1[1]) || (p1[1] <= y && y < p0[1])))
+            continue;
+
+          x = p0[0] + (y - p0[1]) * (p1[0] - p0[0]) / (p1[1] - p0[1]);
+          left = MIN (left, x);
+          right = MAX (right, x);
+        }
+
+      if (left > right)
+        continue;
+
+      column_from = CLAMP (ceil (left - 0.5), 0.0, (gdouble) width);
+      column_to = CLAMP (ceil (right - 0.5) - 1.0, -1.0, width - 1.0);
+
+      line = (guint32 *) (data + row * stride);
+      for (column = column_from; column <= column_to; column++)
+        line[column] = pixel;
+    }
+}
@@ -47,6 +47,15 @@ void         hyscan_cairo_line_to      (cairo_t     *cairo,
                                         gdouble      x2,
                                         gdouble      y2);
 
+HYSCAN_API
+void         hyscan_cairo_fill_convex  (guchar        *data,
+                                        gint           stride,
+                                        gint           width,
+                                        gint           height,
+                                        const gdouble *points,
+                                        guint          n_points,
+                                        guint32        pixel);
+
 G_END_DECLS
 
 
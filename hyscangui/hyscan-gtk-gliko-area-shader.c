@@ -7,15 +7,14 @@ uniform sampler2DArray data1;
 uniform sampler2DArray data2;
 uniform sampler1DArray beam1;
 uniform sampler1DArray beam2;
-uniform sampler1DArray fade1;
-uniform sampler1DArray fade2;
+uniform sampler1DArray stamp1;
+uniform sampler1DArray stamp2;
 uniform float contrast;
 uniform float bright;
 uniform float balance;
 uniform float amprange;
 uniform float ampoffset;
 uniform float gamma;
-uniform float rotate;
 uniform float bottom;
 uniform float distance;
 uniform float freq1;
@@ -25,11 +24,39 @@ uniform int tnd;
 uniform vec4 background;
 uniform vec4 colorr;
 uniform vec4 colorg;
+uniform float now;
+uniform float cleared;
+uniform float fade_coef;
+// восстановление амплитуд из текстур: amp = value * scale + offset,
+// (scale, offset) канала 1 в xy, канала 2 в zw
+uniform vec4 dequant;
 //uniform float noise;
 
+// параметры отображения, совпадает с VIEW_BLOCK_SOURCE в hyscan-gtk-gliko-view-block.h
+layout (std140) uniform ViewState
+{
+  vec2 center;
+  vec2 size;
+  float scale;
+  float rotate;
+};
+
 #define PIx2 6.283185307
 #define PI2 1.570796327
 
+// коэффициент гашения азимута, записанного на итерации stamp
+float
+fade (float stamp)
+{
+  float n = now - stamp;
+
+  if (stamp < cleared)
+    return 0.0;
+  if (n <= 0.0)
+    return 1.0;
+  return pow (fade_coef, n);
+}
+
 void
 main ()
 {
@@ -80,18 +107,18 @@ main ()
 
   // note: mix(x,y,a) = x*(1-a) + y*a
 
-  r = (texture (data1, vec3 (r, y, zr1)).r - ampoffset) * amprange;
+  r = (texture (data1, vec3 (r, y, zr1)).r * dequant.x + dequant.y - ampoffset) * amprange;
   r = pow (r, gamma);
   r = bright + contrast * r;
   r = 2.0 * r * balance;
-  c.r = texture (fade1, vec2 (y, z2)).r;
+  c.r = fade (texture (stamp1, vec2 (y, z2)).r);
   r = clamp (r * c.r, 0.0, 1.0);
 
-  g = (texture (data2, vec3 (g, y, zg1)).r - ampoffset) * amprange;
+  g = (texture (data2, vec3 (g, y, zg1)).r * dequant.z + dequant.w - ampoffset) * amprange;
   g = pow (g, gamma);
   g = bright + contrast * g;
   g = 2.0 * g * (1.0 - balance);
-  c.g = texture (fade2, vec2 (y, z2)).r;
+  c.g = fade (texture (stamp2, vec2 (y, z2)).r);
   g = clamp (g * c.g, 0.0, 1.0);
 
   if (c.r > c.g)
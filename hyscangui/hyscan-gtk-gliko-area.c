@@ -33,12 +33,15 @@
  */
 
 #include <epoxy/gl.h>
+#include <float.h>
 
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "hyscan-gtk-gliko-area.h"
+#include "hyscan-gtk-gliko-kernels.h"
+#include "hyscan-gtk-gliko-view-block.h"
 
 #define SHADER_RESOURCE_PATH "/org/hyscan/gl/hyscan-gtk-gliko-area-shader.c"
 
@@ -67,6 +70,11 @@ enum
   P_COLOR1_ALPHA,
   P_COLOR2_ALPHA,
   P_BACKGROUND_ALPHA,
+  P_TEXTURE_FORMAT,  // формат хранения амплитуд в текстурах
+  P_TEXTURE_GAIN1,   // масштаб амплитуд канала 1 в 8-битных текстурах
+  P_TEXTURE_GAIN2,   // масштаб амплитуд канала 2 в 8-битных текстурах
+  P_TEXTURE_OFFSET1, // смещение амплитуд канала 1 в 8-битных текстурах
+  P_TEXTURE_OFFSET2, // смещение амплитуд канала 2 в 8-битных текстурах
   N_PROPERTIES
 };
 
@@ -75,6 +83,14 @@ enum
 #define TEX_SIZE_BITS 8
 #define TEX_SIZE (1 << TEX_SIZE_BITS)
 
+// число итераций гашения, после которого отметки времени пересчитываются,
+// чтобы не терять точность float
+#define FADE_REBASE (1 << 22)
+
+// отметка времени азимута, в который ещё ничего не записывалось;
+// меньше любой отметки очистки и не меняется при сдвиге отметок
+#define STAMP_NEVER (-FLT_MAX)
+
 typedef float sample_t;
 
 struct _HyScanGtkGlikoAreaPrivate
@@ -93,7 +109,7 @@ struct _HyScanGtkGlikoAreaPrivate
   int bottom;
   int buf_len;
 
-  GLuint tex[2][TEX_MAX], tex_fade[2], tex_beam[2];
+  GLuint tex[2][TEX_MAX], tex_stamp[2], tex_beam[2];
   float center_x;
   float center_y;
   float scale;
@@ -114,14 +130,41 @@ struct _HyScanGtkGlikoAreaPrivate
   float color[2][4];
   float background[4];
   sample_t *buf[2][TEX_MAX];
-  sample_t *fade[2];
+  sample_t *stamp[2];          // номер итерации гашения при последней записи азимута
+  int fade_count;              // номер текущей итерации гашения
+  float clear_stamp;           // номер итерации, на которой изображение было очищено
   sample_t *beam[2];
 
+  // изменения, ещё не загруженные в текстуры; загружаются один раз за кадр
+  int *dirty_from[2]; // для каждого блока азимутов первая измененная строка блока
+  int *dirty_to[2];   // для каждого блока азимутов последняя измененная строка блока
+  int beam_dirty[2];  // признак изменения текстуры луча
+  int stamp_dirty[2]; // признак изменения текстуры отметок времени
+
+  // формат хранения амплитуд в текстурах; преобразование выполняется при загрузке
+  int tex_format;        // требуемый формат, HyScanGtkGlikoTextureFormat
+  int tex_format_loaded; // формат, с которым созданы текстуры
+  float tex_gain[2];     // масштаб амплитуд в 8-битных текстурах
+  float tex_offset[2];   // смещение амплитуд в 8-битных текстурах
+  void *staging;         // буфер преобразованных строк
+
   float white;
   float black;
   float gamma;
 
-  int data1_loc, data2_loc, beam1_loc, beam2_loc, fade1_loc, fade2_loc;
+  const HyScanGtkGlikoKernels *kernels; // функции прореживания и наложения строк
+
+  int data1_loc, data2_loc, beam1_loc, beam2_loc, stamp1_loc, stamp2_loc;
+
+  // положение uniform-переменных программы, определяется при создании программы
+  int distance_loc, bottom_loc, tna_loc, tnd_loc, freq1_loc, freq2_loc;
+  int now_loc, cleared_loc, fade_coef_loc;
+  int contrast_loc, bright_loc, balance_loc, ampoffset_loc, amprange_loc, gamma_loc;
+  int colorr_loc, colorg_loc, background_loc, dequant_loc;
+
+  unsigned int ubo;          // буфер блока параметров отображения
+  view_state_t view;
+  view_state_t view_loaded;
 };
 
 static void hyscan_gtk_gliko_area_interface_init (HyScanGtkGlikoLayerInterface *iface);
@@ -140,17 +183,21 @@ G_DEFINE_TYPE_WITH_CODE (HyScanGtkGlikoArea, hyscan_gtk_gliko_area, G_TYPE_OBJEC
 
 static GParamSpec *obj_properties[N_PROPERTIES] = { NULL };
 
+// текстурные координаты вычисляются по параметрам отображения из блока ViewState
 static const char *vertexShaderSource =
     "#version 330 core\n"
     "layout (location = 0) in vec3 aPos;\n"
-    "layout (location = 1) in vec2 aTexCoord;\n"
+    "\n"
+    VIEW_BLOCK_SOURCE
+    "uniform float distance;\n"
     "\n"
     "out vec2 TexCoord;\n"
     "\n"
     "void main()\n"
     "{\n"
     "  gl_Position = vec4(aPos, 1.0);\n"
-    "  TexCoord = vec2(aTexCoord.x, aTexCoord.y);\n"
+    "  TexCoord.x = 0.5 * (1.0 + aPos.x * distance * scale * size.x / size.y) - distance * center.x;\n"
+    "  TexCoord.y = 0.5 * (1.0 + aPos.y * distance * scale) - distance * center.y;\n"
     "}\n";
 
 static int
@@ -224,11 +271,11 @@ create_model (HyScanGtkGlikoAreaPrivate *p)
   // ------------------------------------------------------------------
   static const float vertices[] =
       {
-        // positions          // texture coords
-        0.5f, 0.5f, 0.0f, 1.0f, 1.0f,   // top right
-        0.5f, -0.5f, 0.0f, 1.0f, 0.0f,  // bottom right
-        -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, // bottom left
-        -0.5f, 0.5f, 0.0f, 0.0f, 1.0f   // top left
+        // positions
+        1.0f, 1.0f, 0.0f,   // top right
+        1.0f, -1.0f, 0.0f,  // bottom right
+        -1.0f, -1.0f, 0.0f, // bottom left
+        -1.0f, 1.0f, 0.0f   // top left
       };
   static const unsigned int indices[] =
       {
@@ -244,17 +291,14 @@ create_model (HyScanGtkGlikoAreaPrivate *p)
   glBindVertexArray (p->vao);
 
   glBindBuffer (GL_ARRAY_BUFFER, p->vbo);
-  glBufferData (GL_ARRAY_BUFFER, sizeof (vertices), vertices, GL_DYNAMIC_DRAW);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (vertices), vertices, GL_STATIC_DRAW);
 
   glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, p->ebo);
   glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (indices), indices, GL_STATIC_DRAW);
 
-  glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) 0);
+  glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof (float), (void *) 0);
   glEnableVertexAttribArray (0);
 
-  glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void *) (3 * sizeof (float)));
-  glEnableVertexAttribArray (1);
-
   // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
   glBindBuffer (GL_ARRAY_BUFFER, 0);
 
@@ -284,58 +328,6 @@ static void glerr()
       }                                                                           \
   }
 
-static void
-set_uniform1f (const unsigned int prog, const char *name, const float val)
-{
-  int loc = glGetUniformLocation (prog, name);
-  if (loc == -1)
-    {
-      glerr ();
-      return;
-    }
-  glUniform1f (loc, val);
-}
-
-static void
-set_uniform1i (const unsigned int prog, const char *name, const int val)
-{
-  int loc = glGetUniformLocation (prog, name);
-  if (loc == -1)
-    {
-      glerr ();
-      return;
-    }
-  glUniform1i (loc, val);
-}
-
-static void
-set_uniform4fv (const unsigned int prog, const char *name, const float *a)
-{
-  int loc = glGetUniformLocation (prog, name);
-  if (loc == -1)
-    {
-      glerr ();
-      return;
-    }
-  glUniform4fv (loc, 1, a);
-}
-
-static void
-resample2 (sample_t *dst, const sample_t *src, const int ndst)
-{
-  int i;
-  sample_t *d = dst;
-  const sample_t *s = src;
-
-  for (i = ndst; i != 0; i--)
-    {
-      d[0] = 0.5f * (s[0] + s[1]);
-      //d[0] = s[0] > s[1] ? s[0]: s[1];
-      d++;
-      s += 2;
-    }
-}
-
 #if 0
 static void pattern( HyScanGtkGlikoAreaPrivate *p )
 {
@@ -395,11 +387,171 @@ static void pattern( HyScanGtkGlikoAreaPrivate *p )
 }
 #endif
 
+// помечает все текстуры для полной загрузки
 static void
-init_textures (HyScanGtkGlikoAreaPrivate *p)
+mark_all_dirty (HyScanGtkGlikoAreaPrivate *p)
+{
+  int k, ia;
+
+  for (k = 0; k < 2; k++)
+    {
+      for (ia = 0; ia < p->tna; ia++)
+        {
+          p->dirty_from[k][ia] = 0;
+          p->dirty_to[k][ia] = TEX_SIZE - 1;
+        }
+      p->beam_dirty[k] = 1;
+      p->stamp_dirty[k] = 1;
+    }
+}
+
+// внутренний формат текстуры амплитуд, тип и размер отсчета при загрузке
+static void
+texture_format (const int format, GLint *internal_format, GLenum *type, int *size)
+{
+  switch (format)
+    {
+    case HYSCAN_GTK_GLIKO_TEXTURE_FLOAT16:
+      *internal_format = GL_R16F;
+      *type = GL_HALF_FLOAT;
+      *size = 2;
+      break;
+    case HYSCAN_GTK_GLIKO_TEXTURE_UNORM8:
+      *internal_format = GL_R8;
+      *type = GL_UNSIGNED_BYTE;
+      *size = 1;
+      break;
+    default:
+      *internal_format = GL_R32F;
+      *type = GL_FLOAT;
+      *size = sizeof (sample_t);
+      break;
+    }
+}
+
+// выделяет память текстур амплитуд в текущем формате хранения,
+// содержимое загружается из буферов при следующей отрисовке
+static void
+alloc_data_textures (HyScanGtkGlikoAreaPrivate *p)
+{
+  int i, k;
+  GLint internal_format;
+  GLenum type;
+  int size;
+
+  texture_format (p->tex_format, &internal_format, &type, &size);
+
+  for (k = 0; k < 2; k++)
+    {
+      for (i = 0; i < p->n_tex; i++)
+        {
+          glBindTexture (GL_TEXTURE_2D_ARRAY, p->tex[k][i]);
+          glTexImage3D (GL_TEXTURE_2D_ARRAY, 0, internal_format, TEX_SIZE, TEX_SIZE, p->tna * p->tnd[i], 0, GL_RED, type, NULL);
+        }
+    }
+  glerr ();
+
+  if (p->staging != NULL)
+    {
+      free (p->staging);
+      p->staging = NULL;
+    }
+  p->tex_format_loaded = p->tex_format;
+  mark_all_dirty (p);
+}
+
+// загружает в текстуры накопленные изменения: для каждого блока азимутов
+// одной операцией на слой загружается диапазон измененных строк,
+// текстуры луча и затухания загружаются целиком одной операцией
+static void
+flush_textures (HyScanGtkGlikoAreaPrivate *p)
 {
   int i, j, k;
   int ia, id;
+  int a0, rows;
+  GLint internal_format;
+  GLenum type;
+  int size;
+
+  texture_format (p->tex_format_loaded, &internal_format, &type, &size);
+
+  // буфер для преобразования всех строк одного блока азимутов
+  if (size != (int) sizeof (sample_t) && p->staging == NULL)
+    {
+      if ((p->staging = malloc ((size_t) TEX_SIZE * size << p->nd_bits)) == NULL)
+        return;
+    }
+
+  for (k = 0; k < 2; k++)
+    {
+      for (ia = 0; ia < p->tna; ia++)
+        {
+          if (p->dirty_from[k][ia] > p->dirty_to[k][ia])
+            continue;
+
+          a0 = ia * TEX_SIZE + p->dirty_from[k][ia];
+          rows = p->dirty_to[k][ia] - p->dirty_from[k][ia] + 1;
+
+          for (i = 0, j = (1 << p->nd_bits); i < p->n_tex; i++, j >>= 1)
+            {
+              const sample_t *src = p->buf[k][i] + a0 * j;
+              const char *pixels = (const char *) src;
+
+              // измененные строки преобразуются в формат текстуры целиком
+              switch (p->tex_format_loaded)
+                {
+                case HYSCAN_GTK_GLIKO_TEXTURE_FLOAT16:
+                  p->kernels->pack_half (p->staging, src, rows * j);
+                  pixels = p->staging;
+                  break;
+                case HYSCAN_GTK_GLIKO_TEXTURE_UNORM8:
+                  p->kernels->pack_unorm8 (p->staging, src, p->tex_gain[k], p->tex_offset[k], rows * j);
+                  pixels = p->staging;
+                  break;
+                default:
+                  break;
+                }
+
+              glBindTexture (GL_TEXTURE_2D_ARRAY, p->tex[k][i]);
+              glPixelStorei (GL_UNPACK_ROW_LENGTH, j);
+              for (id = 0; id < p->tnd[i]; id++)
+                {
+                  glTexSubImage3D (GL_TEXTURE_2D_ARRAY,
+                                   0,                                                 // mipmap number
+                                   0, p->dirty_from[k][ia], ia * p->tnd[i] + id,      // xoffset, yoffset, zoffset,
+                                   TEX_SIZE, rows, 1,                                 // width, height, depth
+                                   GL_RED,                                            // format
+                                   type,                                              // type
+                                   pixels + id * TEX_SIZE * size);
+                }
+            }
+
+          p->dirty_from[k][ia] = TEX_SIZE;
+          p->dirty_to[k][ia] = -1;
+        }
+
+      glPixelStorei (GL_UNPACK_ROW_LENGTH, TEX_SIZE);
+      if (p->beam_dirty[k])
+        {
+          glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_beam[k]);
+          glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, 0, TEX_SIZE, p->tna, GL_RED, GL_FLOAT, p->beam[k]);
+          p->beam_dirty[k] = 0;
+        }
+      if (p->stamp_dirty[k])
+        {
+          glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_stamp[k]);
+          glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, 0, TEX_SIZE, p->tna, GL_RED, GL_FLOAT, p->stamp[k]);
+          p->stamp_dirty[k] = 0;
+        }
+    }
+  glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+  glerr ();
+}
+
+static void
+init_textures (HyScanGtkGlikoAreaPrivate *p)
+{
+  int i, j, k;
 
   if (p->init_stage != 1)
     return;
@@ -407,11 +559,9 @@ init_textures (HyScanGtkGlikoAreaPrivate *p)
 
   glGenTextures (p->n_tex, p->tex[0]);
   glGenTextures (p->n_tex, p->tex[1]);
-  glGenTextures (2, p->tex_fade);
+  glGenTextures (2, p->tex_stamp);
   glGenTextures (2, p->tex_beam);
 
-  p->tna = (1 << (p->na_bits - TEX_SIZE_BITS));
-
   for (k = 0; k < 2; k++)
     {
       for (i = 0, j = (1 << p->nd_bits); i < p->n_tex; i++, j >>= 1)
@@ -419,56 +569,35 @@ init_textures (HyScanGtkGlikoAreaPrivate *p)
           p->tnd[i] = j / TEX_SIZE;
 
           glBindTexture (GL_TEXTURE_2D_ARRAY, p->tex[k][i]);
-          //glTexStorage3D (GL_TEXTURE_2D_ARRAY, 1, GL_R32F, TEX_SIZE, TEX_SIZE, p->tna * p->tnd[i]);
-          glPixelStorei (GL_UNPACK_ROW_LENGTH, j * sizeof (sample_t));
-          glTexImage3D (GL_TEXTURE_2D_ARRAY, 0, GL_R32F, TEX_SIZE, TEX_SIZE, p->tna * p->tnd[i], 0, GL_RED, GL_FLOAT, NULL);
           glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
           glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
           glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
           glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
           //glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP);
           //glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-          //glPixelStorei (GL_UNPACK_ROW_LENGTH, j * sizeof (sample_t));
-          for (ia = 0; ia < p->tna; ia++)
-            {
-              for (id = 0; id < p->tnd[i]; id++)
-                {
-                  glTexSubImage3D (GL_TEXTURE_2D_ARRAY,
-                                   0,                         // mipmap number
-                                   0, 0, ia * p->tnd[i] + id, // xoffset, yoffset, zoffset,
-                                   TEX_SIZE, TEX_SIZE, 1,     // width, height, depth
-                                   GL_RED,                    // format
-                                   GL_FLOAT,                  // type
-                                   p->buf[k][i] + ia * TEX_SIZE * j + id * TEX_SIZE);
-                }
-            }
         }
       glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_beam[k]);
       //glTexStorage2D (GL_TEXTURE_1D_ARRAY, 1, GL_R32F, TEX_SIZE, p->tna);
-      glPixelStorei (GL_UNPACK_ROW_LENGTH, (1 << p->nd_bits) * sizeof (sample_t));
       glTexImage2D (GL_TEXTURE_1D_ARRAY, 0, GL_R32F, TEX_SIZE, p->tna, 0, GL_RED, GL_FLOAT, NULL);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      for (ia = 0; ia < p->tna; ia++)
-        {
-          glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->beam[k] + ia * TEX_SIZE);
-        }
-      glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[k]);
-      glPixelStorei (GL_UNPACK_ROW_LENGTH, (1 << p->nd_bits) * sizeof (sample_t));
+      glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_stamp[k]);
       //glTexStorage2D (GL_TEXTURE_1D_ARRAY, 1, GL_R32F, TEX_SIZE, p->tna);
       glTexImage2D (GL_TEXTURE_1D_ARRAY, 0, GL_R32F, TEX_SIZE, p->tna, 0, GL_RED, GL_FLOAT, NULL);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
       glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
-      glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      for (ia = 0; ia < p->tna; ia++)
-        {
-          glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[k] + ia * TEX_SIZE);
-        }
+      // метки времени не интерполируются: STAMP_NEVER рядом с записанным азимутом
+      // дал бы чёрную полосу, а граница очистки - размытый край
+      glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri (GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
   glerr ();
+
+  // память текстур амплитуд выделяется в выбранном формате хранения,
+  // содержимое загружается из буферов при первой отрисовке
+  alloc_data_textures (p);
 }
 
 static void
@@ -487,12 +616,6 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
   int i;
   float x0 = 0.0f, x1 = p->w, y0 = 0.0f, y1 = p->h;
   float real_scale;
-  float sh = y1 - y0;
-  float sw = x1 - x0;
-  //float sx = x0;
-  //float sy = y0;
-  float tx0, ty0, tx1, ty1;
-  float d;
   float contrast;
   float real_distance;
   float real_bottom;
@@ -508,6 +631,11 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
       break;
     }
 
+  if (p->tex_format_loaded != p->tex_format)
+    alloc_data_textures (p);
+
+  flush_textures (p);
+
   //glClearColor( p->background[0], p->background[1], p->background[2], p->background[3] );
   //glClear(GL_COLOR_BUFFER_BIT);
 
@@ -526,8 +654,8 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
   glUniform1i (p->data2_loc, 1);
   glUniform1i (p->beam1_loc, 2);
   glUniform1i (p->beam2_loc, 3);
-  glUniform1i (p->fade1_loc, 4);
-  glUniform1i (p->fade2_loc, 5);
+  glUniform1i (p->stamp1_loc, 4);
+  glUniform1i (p->stamp2_loc, 5);
 
   real_scale = p->scale * p->nd * 2.0f / (y1 - y0);
   real_distance = p->nd;
@@ -552,18 +680,23 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
   glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_beam[1]);
 
   glActiveTexture (GL_TEXTURE0 + 4);
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[0]);
+  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_stamp[0]);
 
   glActiveTexture (GL_TEXTURE0 + 5);
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[1]);
+  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_stamp[1]);
+
+  glUniform1f (p->distance_loc, real_distance);
+  glUniform1f (p->bottom_loc, real_bottom);
 
-  set_uniform1f (p->program, "distance", real_distance);
-  set_uniform1f (p->program, "bottom", real_bottom);
+  glUniform1i (p->tna_loc, p->tna);
+  glUniform1i (p->tnd_loc, p->tnd[i]);
+  glUniform1f (p->freq1_loc, p->freq1);
+  glUniform1f (p->freq2_loc, p->freq2);
 
-  set_uniform1i (p->program, "tna", p->tna);
-  set_uniform1i (p->program, "tnd", p->tnd[i]);
-  set_uniform1f (p->program, "freq1", p->freq1);
-  set_uniform1f (p->program, "freq2", p->freq2);
+  // гашение вычисляется в шейдере по отметкам времени записи азимутов
+  glUniform1f (p->now_loc, (float) p->fade_count);
+  glUniform1f (p->cleared_loc, p->clear_stamp);
+  glUniform1f (p->fade_coef_loc, p->fade_coef);
 
   contrast = p->contrast;
   if (contrast > 1.0f)
@@ -582,43 +715,35 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
     {
       contrast = 1.0f + contrast;
     }
-  set_uniform1f (p->program, "contrast", contrast);
-  set_uniform1f (p->program, "bright", p->bright);
-  set_uniform1f (p->program, "balance", 0.5f * (1.0f + p->balance));
-  set_uniform1f (p->program, "ampoffset", p->black);
-  set_uniform1f (p->program, "amprange", 1.0f / (p->white - p->black));
-  set_uniform1f (p->program, "gamma", p->gamma);
-
-  set_uniform1f (p->program, "rotate", -p->rotate * 3.1415926536f / 180.f);
-
-  set_uniform4fv (p->program, "colorr", p->color[0]);
-  set_uniform4fv (p->program, "colorg", p->color[1]);
-  set_uniform4fv (p->program, "background", p->background);
-  d = (float) p->nd / (float) (1 << p->nd_bits);
-
-  tx0 = 0.5f * (1.0f - d * sw * p->scale / sh) - d * p->center_x;
-  tx1 = 0.5f * (1.0f + d * sw * p->scale / sh) - d * p->center_x;
-  ty0 = 0.5f * (1.0f - d * p->scale) - d * p->center_y;
-  ty1 = 0.5f * (1.0f + d * p->scale) - d * p->center_y;
+  glUniform1f (p->contrast_loc, contrast);
+  glUniform1f (p->bright_loc, p->bright);
+  glUniform1f (p->balance_loc, 0.5f * (1.0f + p->balance));
+  glUniform1f (p->ampoffset_loc, p->black);
+  glUniform1f (p->amprange_loc, 1.0f / (p->white - p->black));
+  glUniform1f (p->gamma_loc, p->gamma);
+
+  glUniform4fv (p->colorr_loc, 1, p->color[0]);
+  glUniform4fv (p->colorg_loc, 1, p->color[1]);
+  glUniform4fv (p->background_loc, 1, p->background);
+
+  // восстановление амплитуд из 8-битных значений: amp = value / gain + offset
+  if (p->tex_format_loaded == HYSCAN_GTK_GLIKO_TEXTURE_UNORM8)
+    glUniform4f (p->dequant_loc, 1.0f / p->tex_gain[0], p->tex_offset[0], 1.0f / p->tex_gain[1], p->tex_offset[1]);
+  else
+    glUniform4f (p->dequant_loc, 1.0f, 0.0f, 1.0f, 0.0f);
 
-  sw = 1.0;
-  sh = 1.0;
+  // параметры отображения загружаются в буфер только при изменении
+  p->view.center[0] = p->center_x;
+  p->view.center[1] = p->center_y;
+  p->view.size[0] = x1 - x0;
+  p->view.size[1] = y1 - y0;
+  p->view.scale = p->scale;
+  p->view.rotate = -p->rotate * 3.1415926536f / 180.f;
+  hyscan_gtk_gliko_view_block_bind (p->ubo, &p->view, &p->view_loaded);
 
-  float vertices[] =
-      {
-        // positions            // texture coords
-        sw, sh, 0.0f, tx1, ty1,   // top right
-        sw, -sh, 0.0f, tx1, ty0,  // bottom right
-        -sw, -sh, 0.0f, tx0, ty0, // bottom left
-        -sw, sh, 0.0f, tx0, ty1   // top left
-      };
-
-  glBindVertexArray (p->vao); // seeing as we only have a single VAO there's no need to bind it every time, but we'll do so to keep things a bit more organized
-  glBindBuffer (GL_ARRAY_BUFFER, p->vbo);
+  glBindVertexArray (p->vao);
   glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, p->ebo);
 
-  glBufferSubData (GL_ARRAY_BUFFER, 0, sizeof (vertices), vertices);
-
   glDrawElements (GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
   return;
 }
@@ -639,8 +764,28 @@ layer_realize (HyScanGtkGlikoLayer *layer)
   p->data2_loc = glGetUniformLocation (p->program, "data2");
   p->beam1_loc = glGetUniformLocation (p->program, "beam1");
   p->beam2_loc = glGetUniformLocation (p->program, "beam2");
-  p->fade1_loc = glGetUniformLocation (p->program, "fade1");
-  p->fade2_loc = glGetUniformLocation (p->program, "fade2");
+  p->stamp1_loc = glGetUniformLocation (p->program, "stamp1");
+  p->stamp2_loc = glGetUniformLocation (p->program, "stamp2");
+  p->distance_loc = glGetUniformLocation (p->program, "distance");
+  p->bottom_loc = glGetUniformLocation (p->program, "bottom");
+  p->tna_loc = glGetUniformLocation (p->program, "tna");
+  p->tnd_loc = glGetUniformLocation (p->program, "tnd");
+  p->freq1_loc = glGetUniformLocation (p->program, "freq1");
+  p->freq2_loc = glGetUniformLocation (p->program, "freq2");
+  p->now_loc = glGetUniformLocation (p->program, "now");
+  p->cleared_loc = glGetUniformLocation (p->program, "cleared");
+  p->fade_coef_loc = glGetUniformLocation (p->program, "fade_coef");
+  p->contrast_loc = glGetUniformLocation (p->program, "contrast");
+  p->bright_loc = glGetUniformLocation (p->program, "bright");
+  p->balance_loc = glGetUniformLocation (p->program, "balance");
+  p->ampoffset_loc = glGetUniformLocation (p->program, "ampoffset");
+  p->amprange_loc = glGetUniformLocation (p->program, "amprange");
+  p->gamma_loc = glGetUniformLocation (p->program, "gamma");
+  p->colorr_loc = glGetUniformLocation (p->program, "colorr");
+  p->colorg_loc = glGetUniformLocation (p->program, "colorg");
+  p->background_loc = glGetUniformLocation (p->program, "background");
+  p->dequant_loc = glGetUniformLocation (p->program, "dequant");
+  hyscan_gtk_gliko_view_block_init (p->program, &p->ubo, &p->view_loaded);
 
   create_model (p);
 
@@ -651,6 +796,23 @@ layer_realize (HyScanGtkGlikoLayer *layer)
   //model_init();
 }
 
+// коэффициент гашения азимута, записанного на итерации stamp;
+// совпадает с вычислением в шейдере
+static float
+fade_value (HyScanGtkGlikoAreaPrivate *p, const float stamp)
+{
+  float n;
+
+  if (stamp < p->clear_stamp)
+    return 0.0f;
+
+  n = p->fade_count - stamp;
+  if (n <= 0.0f)
+    return 1.0f;
+
+  return powf (p->fade_coef, n);
+}
+
 static void
 fill_buffer (sample_t *buffer, const sample_t value, const int length)
 {
@@ -693,6 +855,16 @@ hyscan_gtk_gliko_area_init_dimension (HyScanGtkGlikoArea *instance, const int na
           free (p->buf[0][0]);
           p->buf[0][0] = NULL;
         }
+      if (p->dirty_from[0] != NULL)
+        {
+          free (p->dirty_from[0]);
+          p->dirty_from[0] = NULL;
+        }
+      if (p->staging != NULL)
+        {
+          free (p->staging);
+          p->staging = NULL;
+        }
 
       p->nd_bits = nd_bits;
       p->na_bits = na_bits;
@@ -711,10 +883,18 @@ hyscan_gtk_gliko_area_init_dimension (HyScanGtkGlikoArea *instance, const int na
           p->buf[1][i] = p->buf[1][i - 1] + (1 << p->na_bits) * j;
         }
 
-      p->fade[0] = p->buf[0][0] + k - (1 << p->na_bits) - (1 << p->na_bits);
-      p->fade[1] = p->buf[1][0] + k - (1 << p->na_bits) - (1 << p->na_bits);
+      p->stamp[0] = p->buf[0][0] + k - (1 << p->na_bits) - (1 << p->na_bits);
+      p->stamp[1] = p->buf[1][0] + k - (1 << p->na_bits) - (1 << p->na_bits);
       p->beam[0] = p->buf[0][0] + k - (1 << p->na_bits);
       p->beam[1] = p->buf[1][0] + k - (1 << p->na_bits);
+
+      p->tna = (1 << (p->na_bits - TEX_SIZE_BITS));
+      if ((p->dirty_from[0] = malloc (4 * p->tna * sizeof (int))) == NULL)
+        return;
+
+      p->dirty_to[0] = p->dirty_from[0] + p->tna;
+      p->dirty_from[1] = p->dirty_to[0] + p->tna;
+      p->dirty_to[1] = p->dirty_from[1] + p->tna;
     }
 
   p->na = na;
@@ -725,22 +905,27 @@ hyscan_gtk_gliko_area_init_dimension (HyScanGtkGlikoArea *instance, const int na
 
   for (i = 0; i < (1 << p->na_bits); i++)
     {
-      p->fade[0][i] = 0.0f;
-      p->fade[1][i] = 0.0f;
+      p->stamp[0][i] = STAMP_NEVER;
+      p->stamp[1][i] = STAMP_NEVER;
       p->beam[0][i] = 0;
       p->beam[1][i] = 0;
     }
+  p->beam_valid[0] = 0;
+  p->beam_valid[1] = 0;
+  p->fade_count = 0;
+  p->clear_stamp = 0.0f;
+
+  mark_all_dirty (p);
 }
 
 void
 hyscan_gtk_gliko_area_set_data (HyScanGtkGlikoArea *instance, const int channel, const int azimuth, const gfloat *data)
 {
   HyScanGtkGlikoAreaPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO_AREA, HyScanGtkGlikoAreaPrivate);
-  sample_t *dst, *dst_row;
-  const sample_t *src;
-  sample_t k, c;
+  sample_t *dst_row;
+  sample_t k;
   int i, j;
-  int ia, id;
+  int ia;
   int a;
 
   if (p->init_stage != 2)
@@ -770,52 +955,32 @@ hyscan_gtk_gliko_area_set_data (HyScanGtkGlikoArea *instance, const int channel,
 
   j = (1 << p->nd_bits);
   dst_row = p->buf[channel][0] + a * j;
-  k = p->remain * p->fade[channel][a];
-  p->fade[channel][a] = 1.0f;
+  // к новым данным добавляются предыдущие данные этого азимута с учетом их гашения
+  k = p->remain * fade_value (p, p->stamp[channel][a]);
+  p->stamp[channel][a] = (sample_t) p->fade_count;
 
-  for (dst = dst_row, src = data, i = p->nd; i != 0; i--, dst++, src++)
-    {
-      c = (k * (*dst)) + (*src);
-      if (c > 1.0f)
-        c = 1.0f;
-      *dst = c;
-    }
-
-  glBindTexture (GL_TEXTURE_2D_ARRAY, p->tex[channel][0]);
-  glPixelStorei (GL_UNPACK_ROW_LENGTH, j * sizeof (sample_t));
-  for (id = 0; id < p->tnd[0]; id++)
-    {
-      glTexSubImage3D (GL_TEXTURE_2D_ARRAY,
-                       0,                                                // mipmap number
-                       0, a % TEX_SIZE, (a / TEX_SIZE) * p->tnd[0] + id, // xoffset, yoffset, zoffset,
-                       TEX_SIZE, 1, 1,                                   // width, height, depth
-                       GL_RED,                                           // format
-                       GL_FLOAT,                                         // type
-                       dst_row + id * TEX_SIZE);
-    }
-  //glTexSubImage2D( GL_TEXTURE_2D, 0, 0, a, j, 1, comp, GL_UNSIGNED_BYTE, dst_row );
+  p->kernels->blend (dst_row, data, k, p->nd);
 
   for (i = 1, j = (1 << p->nd_bits); i < p->n_tex; i++)
     {
       j >>= 1;
-      resample2 (p->buf[channel][i] + a * j, p->buf[channel][i - 1] + a * (j << 1), j);
-      glBindTexture (GL_TEXTURE_2D_ARRAY, p->tex[channel][i]);
-      glPixelStorei (GL_UNPACK_ROW_LENGTH, j * sizeof (sample_t));
-      for (id = 0; id < p->tnd[i]; id++)
-        {
-          glTexSubImage3D (GL_TEXTURE_2D_ARRAY,
-                           0,                                                // mipmap number
-                           0, a % TEX_SIZE, (a / TEX_SIZE) * p->tnd[i] + id, // xoffset, yoffset, zoffset,
-                           TEX_SIZE, 1, 1,                                   // width, height, depth
-                           GL_RED,                                           // format
-                           GL_FLOAT,                                         // type
-                           p->buf[channel][i] + a * j + id * TEX_SIZE);
-          //glTexSubImage2D( GL_TEXTURE_2D, 0, 0, a, j, 1, comp, GL_UNSIGNED_BYTE, p->buf[ i ] + a * j );
-        }
+      p->kernels->resample2 (p->buf[channel][i] + a * j, p->buf[channel][i - 1] + a * (j << 1), j);
     }
 
-  // формируем модуляцию яркости для лучей двух каналов
-  fill_buffer (p->beam[channel], 0.0f, p->na);
+  // строка будет загружена в текстуры при отрисовке кадра
+  ia = a / TEX_SIZE;
+  if (p->dirty_from[channel][ia] > a % TEX_SIZE)
+    p->dirty_from[channel][ia] = a % TEX_SIZE;
+  if (p->dirty_to[channel][ia] < a % TEX_SIZE)
+    p->dirty_to[channel][ia] = a % TEX_SIZE;
+
+  // формируем модуляцию яркости для лучей двух каналов:
+  // стираем предыдущее положение луча и рисуем новое
+  if (p->beam_valid[channel])
+    {
+      for (i = -3; i <= 3; i++)
+        p->beam[channel][(p->beam_pos[channel] + p->na + i) % p->na] = 0.0f;
+    }
 
   p->beam[channel][a] = 1.0f;
 
@@ -824,78 +989,49 @@ hyscan_gtk_gliko_area_set_data (HyScanGtkGlikoArea *instance, const int channel,
       p->beam[channel][(a + i) % p->na] =
           p->beam[channel][(a + p->na - i) % p->na] = 1.0f / (1.0f + i);
     }
-  glPixelStorei (GL_UNPACK_ROW_LENGTH, (1 << p->na_bits) * sizeof (sample_t));
-
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_beam[channel]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->beam[channel] + ia * TEX_SIZE);
-    }
-  //glTexSubImage2D( GL_TEXTURE_1D_ARRAY, 0, 0, 0, 1 << p->na_bits, 1, GL_RED, GL_UNSIGNED_BYTE, p->beam );
-  //glTexSubImage1D( GL_TEXTURE_1D, 0, 0, 1 << p->na_bits, GL_RED, GL_UNSIGNED_BYTE, p->beam );
+  p->beam_pos[channel] = a;
+  p->beam_valid[channel] = 1;
 
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[channel]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[channel] + ia * TEX_SIZE);
-    }
-  glerr ();
+  p->beam_dirty[channel] = 1;
+  p->stamp_dirty[channel] = 1;
 }
 
 void
 hyscan_gtk_gliko_area_fade (HyScanGtkGlikoArea *instance)
 {
   HyScanGtkGlikoAreaPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO_AREA, HyScanGtkGlikoAreaPrivate);
-  int i, ia;
+  int i;
 
   if (p->init_stage != 2)
     return;
 
+  // гашение применяется в шейдере, здесь только увеличивается номер итерации
+  if (++p->fade_count < FADE_REBASE)
+    return;
+
+  // изредка сдвигаем отметки времени к нулю; отметка очистки сдвигается
+  // вместе с ними, чтобы сохранился порядок записанных и очищенных азимутов
   for (i = 0; i < p->na; i++)
     {
-      p->fade[0][i] = (p->fade_coef * p->fade[0][i]);
-      p->fade[1][i] = (p->fade_coef * p->fade[1][i]);
-    }
-  glPixelStorei (GL_UNPACK_ROW_LENGTH, (1 << p->na_bits) * sizeof (sample_t));
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[0]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[0] + ia * TEX_SIZE);
+      p->stamp[0][i] -= FADE_REBASE;
+      p->stamp[1][i] -= FADE_REBASE;
     }
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[1]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[1] + ia * TEX_SIZE);
-    }
-  glerr ();
+  p->fade_count -= FADE_REBASE;
+  p->clear_stamp -= FADE_REBASE;
+  p->stamp_dirty[0] = 1;
+  p->stamp_dirty[1] = 1;
 }
 
 void
 hyscan_gtk_gliko_area_clear (HyScanGtkGlikoArea *instance)
 {
   HyScanGtkGlikoAreaPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO_AREA, HyScanGtkGlikoAreaPrivate);
-  int i, ia;
-
   if (p->init_stage != 2)
     return;
 
-  for (i = 0; i < p->na; i++)
-    {
-      p->fade[0][i] = 0.0f;
-      p->fade[1][i] = 0.0f;
-    }
-  glPixelStorei (GL_UNPACK_ROW_LENGTH, (1 << p->na_bits) * sizeof (sample_t));
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[0]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[0] + ia * TEX_SIZE);
-    }
-  glBindTexture (GL_TEXTURE_1D_ARRAY, p->tex_fade[1]);
-  for (ia = 0; ia < p->tna; ia++)
-    {
-      glTexSubImage2D (GL_TEXTURE_1D_ARRAY, 0, 0, ia, TEX_SIZE, 1, GL_RED, GL_FLOAT, p->fade[1] + ia * TEX_SIZE);
-    }
-  glerr ();
+  // азимуты, записанные раньше очистки, в шейдере считаются погасшими
+  p->fade_count++;
+  p->clear_stamp = (float) p->fade_count;
 }
 
 /* Initialization */
@@ -928,6 +1064,12 @@ hyscan_gtk_gliko_area_class_init (HyScanGtkGlikoAreaClass *klass)
   obj_properties[P_COLOR1_ALPHA] = g_param_spec_float ("gliko-color1-alpha", "ColorAlpha", "Alpha channel of color", 0.0, 1.0, 1.0, rw);
   obj_properties[P_COLOR2_ALPHA] = g_param_spec_float ("gliko-color2-alpha", "ColorAlpha", "Alpha channel of color", 0.0, 1.0, 1.0, rw);
   obj_properties[P_BACKGROUND_ALPHA] = g_param_spec_float ("gliko-background-alpha", "BackgroundAlpha", "Alpha channel of background", 0.0, 1.0, 1.0, rw);
+  obj_properties[P_TEXTURE_FORMAT] = g_param_spec_int ("gliko-texture-format", "TextureFormat", "Amplitude texture format (HyScanGtkGlikoTextureFormat)",
+                                                       HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32, HYSCAN_GTK_GLIKO_TEXTURE_UNORM8, HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32, rw);
+  obj_properties[P_TEXTURE_GAIN1] = g_param_spec_float ("gliko-texture-gain1", "TextureGain1", "Amplitude gain for 8-bit texture of channel 1", G_MINFLOAT, G_MAXFLOAT, 1.0, rw);
+  obj_properties[P_TEXTURE_GAIN2] = g_param_spec_float ("gliko-texture-gain2", "TextureGain2", "Amplitude gain for 8-bit texture of channel 2", G_MINFLOAT, G_MAXFLOAT, 1.0, rw);
+  obj_properties[P_TEXTURE_OFFSET1] = g_param_spec_float ("gliko-texture-offset1", "TextureOffset1", "Amplitude offset for 8-bit texture of channel 1", -G_MAXFLOAT, G_MAXFLOAT, 0.0, rw);
+  obj_properties[P_TEXTURE_OFFSET2] = g_param_spec_float ("gliko-texture-offset2", "TextureOffset2", "Amplitude offset for 8-bit texture of channel 2", -G_MAXFLOAT, G_MAXFLOAT, 0.0, rw);
 
   obj_properties[P_COLOR1] = g_param_spec_string ("gliko-color1-rgb", "Color1", "Color for channel 1 #RRGGBB", "#FFFFFF", rw);
   obj_properties[P_COLOR2] = g_param_spec_string ("gliko-color2-rgb", "Color2", "Color for channel 2 #RRGGBB", "#FFFFFF", rw);
@@ -978,6 +1120,17 @@ hyscan_gtk_gliko_area_init (HyScanGtkGlikoArea *area)
   p->freq2 = 1.0f;
 
   p->buf[0][0] = NULL;
+  p->dirty_from[0] = NULL;
+
+  p->tex_format = HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32;
+  p->tex_format_loaded = HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32;
+  p->tex_gain[0] = 1.0f;
+  p->tex_gain[1] = 1.0f;
+  p->tex_offset[0] = 0.0f;
+  p->tex_offset[1] = 0.0f;
+  p->staging = NULL;
+
+  p->kernels = hyscan_gtk_gliko_kernels_get ();
 }
 
 static void
@@ -995,6 +1148,16 @@ hyscan_gtk_gliko_area_object_finalize (GObject *object)
       free (p->buf[0][0]);
       p->buf[0][0] = NULL;
     }
+  if (p->dirty_from[0] != NULL)
+    {
+      free (p->dirty_from[0]);
+      p->dirty_from[0] = NULL;
+    }
+  if (p->staging != NULL)
+    {
+      free (p->staging);
+      p->staging = NULL;
+    }
 
   G_OBJECT_CLASS (hyscan_gtk_gliko_area_parent_class)
       ->finalize (object);
@@ -1039,6 +1202,14 @@ get_pfloat (HyScanGtkGlikoAreaPrivate *p, const int id)
       return &p->color[1][3];
     case P_BACKGROUND_ALPHA:
       return &p->background[3];
+    case P_TEXTURE_GAIN1:
+      return &p->tex_gain[0];
+    case P_TEXTURE_GAIN2:
+      return &p->tex_gain[1];
+    case P_TEXTURE_OFFSET1:
+      return &p->tex_offset[0];
+    case P_TEXTURE_OFFSET2:
+      return &p->tex_offset[1];
     default:
       break;
     }
@@ -1069,6 +1240,8 @@ get_pint (HyScanGtkGlikoAreaPrivate *p, const int id)
     {
     case P_BOTTOM:
       return &p->bottom;
+    case P_TEXTURE_FORMAT:
+      return &p->tex_format;
     default:
       break;
     }
@@ -1091,6 +1264,14 @@ hyscan_gtk_gliko_area_set_property (GObject *object, guint prop_id, const GValue
   else if ((pf = get_pfloat (p, prop_id)) != NULL)
     {
       *pf = g_value_get_float (value);
+
+      // 8-битные текстуры перезагружаются с новыми масштабом и смещением
+      if (prop_id >= P_TEXTURE_GAIN1 && prop_id <= P_TEXTURE_OFFSET2 &&
+          p->tex_format_loaded == HYSCAN_GTK_GLIKO_TEXTURE_UNORM8 &&
+          p->init_stage == 2)
+        {
+          mark_all_dirty (p);
+        }
     }
   else if ((pf = get_prgb (p, prop_id)) != NULL)
     {
@@ -46,6 +46,16 @@ G_BEGIN_DECLS
 #define HYSCAN_IS_GTK_GLIKO_AREA_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_GTK_GLIKO_AREA))
 #define HYSCAN_GTK_GLIKO_AREA_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_GTK_GLIKO_AREA, HyScanGtkGlikoAreaClass))
 
+/* Формат хранения амплитуд в текстурах (свойство "gliko-texture-format"). */
+typedef enum
+{
+  HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32 = 0, /* 32-битные числа с плавающей точкой. */
+  HYSCAN_GTK_GLIKO_TEXTURE_FLOAT16,     /* 16-битные числа с плавающей точкой. */
+  HYSCAN_GTK_GLIKO_TEXTURE_UNORM8       /* 8-битные нормированные значения, масштаб и смещение
+                                           задаются свойствами "gliko-texture-gain1/2"
+                                           и "gliko-texture-offset1/2". */
+} HyScanGtkGlikoTextureFormat;
+
 typedef struct _HyScanGtkGlikoArea HyScanGtkGlikoArea;
 typedef struct _HyScanGtkGlikoAreaPrivate HyScanGtkGlikoAreaPrivate;
 typedef struct _HyScanGtkGlikoAreaClass HyScanGtkGlikoAreaClass;
@@ -69,6 +69,11 @@ struct _HyScanGtkGlikoDrawingPrivate
   int width;
   int height;
   int stride;
+
+  cairo_surface_t *recording;     // запись рисования между begin и end
+  cairo_t *recording_context;     // контекст рисования, возвращаемый begin
+  cairo_rectangle_int_t ink;      // область, занятая изображением в pixeldata
+  cairo_region_t *upload;         // измененная область, ещё не загруженная в текстуру
 };
 
 #define glerr()                                                                   \
@@ -82,6 +87,7 @@ struct _HyScanGtkGlikoDrawingPrivate
   }
 
 static void layer_interface_init (HyScanGtkGlikoLayerInterface *iface);
+static void hyscan_gtk_gliko_drawing_object_finalize (GObject *object);
 
 G_DEFINE_TYPE_WITH_CODE (HyScanGtkGlikoDrawing, hyscan_gtk_gliko_drawing, G_TYPE_OBJECT, G_IMPLEMENT_INTERFACE (HYSCAN_TYPE_GTK_GLIKO_LAYER, layer_interface_init))
 
@@ -271,6 +277,14 @@ layer_resize (HyScanGtkGlikoLayer *layer, gint width, gint height)
   draw_example (p->context);
   cairo_surface_flush (p->surface);
 
+  // буфер целиком загружается в текстуру ниже и очищается при первом рисовании
+  p->ink.x = 0;
+  p->ink.y = 0;
+  p->ink.width = p->width;
+  p->ink.height = p->height;
+  cairo_region_destroy (p->upload);
+  p->upload = cairo_region_create ();
+
   if (p->tex_valid)
     {
       glDeleteTextures (1, &p->tex);
@@ -293,6 +307,7 @@ layer_resize (HyScanGtkGlikoLayer *layer, gint width, gint height)
   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
   p->tex_update = 0;
 }
 
@@ -304,19 +319,32 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
   if (p->program_valid == 0)
     return;
 
+  // загружаем в текстуру только измененные прямоугольники
   if (p->tex_update)
     {
+      int i, n;
+
       glBindTexture (GL_TEXTURE_2D, p->tex);
       glPixelStorei (GL_UNPACK_ROW_LENGTH, p->stride >> 2);
-      glTexSubImage2D (GL_TEXTURE_2D,
-                       0,
-                       0,
-                       0,
-                       p->width,
-                       p->height,
-                       GL_BGRA,
-                       GL_UNSIGNED_BYTE,
-                       p->pixeldata);
+      n = cairo_region_num_rectangles (p->upload);
+      for (i = 0; i < n; i++)
+        {
+          cairo_rectangle_int_t r;
+
+          cairo_region_get_rectangle (p->upload, i, &r);
+          glTexSubImage2D (GL_TEXTURE_2D,
+                           0,
+                           r.x,
+                           r.y,
+                           r.width,
+                           r.height,
+                           GL_BGRA,
+                           GL_UNSIGNED_BYTE,
+                           p->pixeldata + r.y * p->stride + 4 * r.x);
+        }
+      glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+      cairo_region_destroy (p->upload);
+      p->upload = cairo_region_create ();
       p->tex_update = 0;
     }
 
@@ -376,17 +404,65 @@ hyscan_gtk_gliko_drawing_init (HyScanGtkGlikoDrawing *drawing)
   p->stride = 0;
   p->surface = NULL;
   p->context = NULL;
+
+  p->recording = NULL;
+  p->recording_context = NULL;
+  p->upload = cairo_region_create ();
 }
 
 static void
 hyscan_gtk_gliko_drawing_class_init (HyScanGtkGlikoDrawingClass *klass)
 {
-  //GObjectClass *g_class = G_OBJECT_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   //static const int rw = (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+  object_class->finalize = hyscan_gtk_gliko_drawing_object_finalize;
+
   g_type_class_add_private (klass, sizeof (HyScanGtkGlikoDrawingPrivate));
 }
 
+static void
+hyscan_gtk_gliko_drawing_object_finalize (GObject *object)
+{
+  HyScanGtkGlikoDrawing *drawing = HYSCAN_GTK_GLIKO_DRAWING (object);
+  HyScanGtkGlikoDrawingPrivate *p = drawing->priv;
+
+  if (p->recording_context != NULL)
+    {
+      cairo_destroy (p->recording_context);
+      p->recording_context = NULL;
+    }
+  if (p->recording != NULL)
+    {
+      cairo_surface_destroy (p->recording);
+      p->recording = NULL;
+    }
+  if (p->upload != NULL)
+    {
+      cairo_region_destroy (p->upload);
+      p->upload = NULL;
+    }
+  // поверхность ссылается на pixeldata, поэтому освобождается раньше буфера
+  if (p->context != NULL)
+    {
+      cairo_destroy (p->context);
+      p->context = NULL;
+    }
+  if (p->surface != NULL)
+    {
+      cairo_surface_destroy (p->surface);
+      p->surface = NULL;
+    }
+  if (p->pixeldata != NULL)
+    {
+      free (p->pixeldata);
+      p->pixeldata = NULL;
+    }
+
+  G_OBJECT_CLASS (hyscan_gtk_gliko_drawing_parent_class)
+      ->finalize (object);
+}
+
 HYSCAN_API
 HyScanGtkGlikoDrawing *
 hyscan_gtk_gliko_drawing_new (void)
@@ -394,14 +470,30 @@ hyscan_gtk_gliko_drawing_new (void)
   return HYSCAN_GTK_GLIKO_DRAWING (g_object_new (hyscan_gtk_gliko_drawing_get_type (), NULL));
 }
 
+// Рисование записывается и переносится в буфер слоя в hyscan_gtk_gliko_drawing_end;
+// при этом очищается и загружается в текстуру только область предыдущего и нового
+// изображений, а если ничего не нарисовано и буфер уже пуст, текстура не загружается
 HYSCAN_API
 cairo_t *
 hyscan_gtk_gliko_drawing_begin (HyScanGtkGlikoDrawing *instance)
 {
   HyScanGtkGlikoDrawingPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO_DRAWING, HyScanGtkGlikoDrawingPrivate);
+  cairo_rectangle_t extents;
 
-  memset (p->pixeldata, 0, p->stride * p->height);
-  return p->context;
+  if (p->surface == NULL)
+    return NULL;
+
+  if (p->recording_context == NULL)
+    {
+      extents.x = 0;
+      extents.y = 0;
+      extents.width = p->width;
+      extents.height = p->height;
+      p->recording = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &extents);
+      p->recording_context = cairo_create (p->recording);
+    }
+
+  return p->recording_context;
 }
 
 HYSCAN_API
@@ -409,7 +501,58 @@ void
 hyscan_gtk_gliko_drawing_end (HyScanGtkGlikoDrawing *instance)
 {
   HyScanGtkGlikoDrawingPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO_DRAWING, HyScanGtkGlikoDrawingPrivate);
+  cairo_rectangle_int_t bounds = { 0, 0, p->width, p->height };
+  cairo_region_t *damage;
+  double x, y, width, height;
+  int i, n;
+
+  if (p->recording_context == NULL)
+    return;
 
+  // область нового изображения
+  cairo_recording_surface_ink_extents (p->recording, &x, &y, &width, &height);
+
+  // изменяется область старого и нового изображений
+  damage = cairo_region_create_rectangle (&p->ink);
+  p->ink.x = floor (x);
+  p->ink.y = floor (y);
+  p->ink.width = ceil (x + width) - p->ink.x;
+  p->ink.height = ceil (y + height) - p->ink.y;
+  gdk_rectangle_intersect (&p->ink, &bounds, &p->ink);
+  cairo_region_union_rectangle (damage, &p->ink);
+  cairo_region_intersect_rectangle (damage, &bounds);
+
+  // очищаем измененную область и переносим в неё новое изображение
+  n = cairo_region_num_rectangles (damage);
   cairo_surface_flush (p->surface);
-  p->tex_update = 1;
+  for (i = 0; i < n; i++)
+    {
+      cairo_rectangle_int_t r;
+      int row;
+
+      cairo_region_get_rectangle (damage, i, &r);
+      for (row = r.y; row < r.y + r.height; row++)
+        memset (p->pixeldata + row * p->stride + 4 * r.x, 0, 4 * r.width);
+    }
+  cairo_surface_mark_dirty (p->surface);
+
+  if (n > 0)
+    {
+      cairo_save (p->context);
+      gdk_cairo_region (p->context, damage);
+      cairo_clip (p->context);
+      cairo_set_source_surface (p->context, p->recording, 0, 0);
+      cairo_paint (p->context);
+      cairo_restore (p->context);
+      cairo_surface_flush (p->surface);
+
+      cairo_region_union (p->upload, damage);
+      p->tex_update = 1;
+    }
+
+  cairo_region_destroy (damage);
+  cairo_destroy (p->recording_context);
+  cairo_surface_destroy (p->recording);
+  p->recording_context = NULL;
+  p->recording = NULL;
 }
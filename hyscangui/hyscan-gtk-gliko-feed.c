@@ -0,0 +1,167 @@
+/* hyscan-gtk-gliko-feed.c
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/**
+ * SECTION: hyscan-gtk-gliko-feed
+ * @Short_description: выдача строк акустических данных в индикатор кругового обзора
+ * @Title: HyScanGtkGlikoFeed
+ *
+ * Этапы обработки данных #HyScanGtkGliko, не зависящие от проигрывателя:
+ * разбор показаний датчика угла поворота $HYRA, вычисление угла поворота для
+ * строки акустических данных и выдача строки в #HyScanGtkGlikoArea.
+ * Функции вынесены из виджета, чтобы те же этапы можно было измерять
+ * без проигрывателя и окна.
+ */
+
+#include "hyscan-gtk-gliko-feed.h"
+#include <math.h>
+#include <string.h>
+
+/* Приводит угол к диапазону 0..360 с шагом 360 / 65536 градусов. */
+static gdouble
+hyscan_gtk_gliko_feed_range360 (gdouble a)
+{
+  guint i;
+  gdouble d;
+
+  d = a * 65536.0 / 360.0;
+  i = (int) d;
+  d = (i & 0xFFFF);
+  return d * 360.0 / 65536.0;
+}
+
+/**
+ * hyscan_gtk_gliko_feed_parse_angle:
+ * @sentence: строка NMEA
+ * @angle: (out): угол поворота, градусы от 0 до 360
+ *
+ * Разбирает показание датчика угла поворота $HYRA.
+ *
+ * Returns: %TRUE, если строка является показанием датчика угла.
+ */
+gboolean
+hyscan_gtk_gliko_feed_parse_angle (const gchar *sentence,
+                                   gdouble     *angle)
+{
+  const char header[6] = { '$', 'H', 'Y', 'R', 'A', ',' };
+
+  if (sentence == NULL || memcmp (sentence, header, sizeof (header)) != 0)
+    return FALSE;
+
+  *angle = hyscan_gtk_gliko_feed_range360 (g_ascii_strtod (sentence + sizeof (header), NULL));
+
+  return TRUE;
+}
+
+/**
+ * hyscan_gtk_gliko_feed_interpolate:
+ * @time0: время первого показания датчика угла
+ * @angle0: первое показание, градусы
+ * @time1: время второго показания датчика угла, больше @time0
+ * @angle1: второе показание, градусы
+ * @time: время строки акустических данных
+ *
+ * Вычисляет угол поворота в момент @time, считая, что между показаниями угол
+ * изменялся линейно в направлении кратчайшего поворота.
+ *
+ * Returns: угол поворота, градусы от 0 до 360.
+ */
+gdouble
+hyscan_gtk_gliko_feed_interpolate (gint64  time0,
+                                   gdouble angle0,
+                                   gint64  time1,
+                                   gdouble angle1,
+                                   gint64  time)
+{
+  gdouble d, dm, dn, dp;
+
+  /* изменение угла, с учетом перехода через 0 */
+  dn = angle1 - angle0;
+  dm = dn - 360.0;
+  dp = dn + 360.0;
+  d = dn;
+  if (fabs (dm) < fabs (dn))
+    d = dm;
+  else if (fabs (dp) < fabs (dn))
+    d = dp;
+
+  return hyscan_gtk_gliko_feed_range360 (angle0 + d * (time - time0) / (time1 - time0));
+}
+
+/**
+ * hyscan_gtk_gliko_feed_put:
+ * @feed: состояние выдачи строк канала
+ * @angle: угол поворота, градусы от 0 до 360
+ * @amplitudes: амплитуды строки
+ * @length: число амплитуд
+ *
+ * Выдаёт строку в индикатор в азимутальный дискрет, соответствующий углу @angle.
+ * Строка обрезается или дополняется нулями до длины строки индикатора. Если
+ * после предыдущей строки пропущен один азимутальный дискрет, в него
+ * повторно выдаётся предыдущая строка.
+ */
+void
+hyscan_gtk_gliko_feed_put (HyScanGtkGlikoFeed *feed,
+                           gdouble             angle,
+                           const gfloat       *amplitudes,
+                           guint32             length)
+{
+  guint32 j;
+
+  /* номер углового дискрета */
+  j = (guint32) (angle * feed->num_azimuthes / 360.0);
+  j %= feed->num_azimuthes;
+
+  // если уже есть отрисованный азимут
+  if (feed->azimuth_displayed)
+    {
+      // если луч перепрыгнул через 1 азимутальный дискрет, дублируем предыдущий азимут
+      if (j == ((feed->azimuth + 2) % feed->num_azimuthes))
+        hyscan_gtk_gliko_area_set_data (feed->area, feed->channel, (feed->azimuth + 1) % feed->num_azimuthes, feed->buffer);
+      else if (j == ((feed->azimuth - 2) % feed->num_azimuthes))
+        hyscan_gtk_gliko_area_set_data (feed->area, feed->channel, (feed->azimuth - 1) % feed->num_azimuthes, feed->buffer);
+    }
+
+  if (length > feed->length)
+    length = feed->length;
+
+  /* запоминаем строку амплитуд в буфере, остаток обнуляем */
+  memcpy (feed->buffer, amplitudes, length * sizeof (gfloat));
+  memset (feed->buffer + length, 0, (feed->length - length) * sizeof (gfloat));
+
+  /* передаем строку в индикатор кругового обзора */
+  hyscan_gtk_gliko_area_set_data (feed->area, feed->channel, j, feed->buffer);
+  feed->azimuth = j;
+  feed->azimuth_displayed = TRUE;
+}
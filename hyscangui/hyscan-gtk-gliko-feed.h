@@ -0,0 +1,88 @@
+/* hyscan-gtk-gliko-feed.h
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_GTK_GLIKO_FEED_H__
+#define __HYSCAN_GTK_GLIKO_FEED_H__
+
+#include <hyscan-api.h>
+#include "hyscan-gtk-gliko-area.h"
+
+G_BEGIN_DECLS
+
+typedef struct _HyScanGtkGlikoFeed HyScanGtkGlikoFeed;
+
+/**
+ * HyScanGtkGlikoFeed:
+ * @area: индикатор кругового обзора
+ * @channel: номер канала индикатора
+ * @num_azimuthes: число азимутальных дискретов индикатора
+ * @length: число отсчётов в строке индикатора
+ * @buffer: буфер строки, не меньше @length отсчётов
+ * @azimuth: последний выданный в индикатор азимутальный дискрет
+ * @azimuth_displayed: признак того, что @azimuth выдан и пропуск следующего дискрета можно дорисовать
+ *
+ * Состояние выдачи строк одного канала в индикатор. Буфер строки выделяет
+ * и освобождает владелец структуры.
+ */
+struct _HyScanGtkGlikoFeed
+{
+  HyScanGtkGlikoArea          *area;
+  gint                         channel;
+  guint                        num_azimuthes;
+  guint32                      length;
+  gfloat                      *buffer;
+  guint32                      azimuth;
+  gboolean                     azimuth_displayed;
+};
+
+HYSCAN_API
+gboolean         hyscan_gtk_gliko_feed_parse_angle    (const gchar        *sentence,
+                                                       gdouble            *angle);
+
+HYSCAN_API
+gdouble          hyscan_gtk_gliko_feed_interpolate    (gint64              time0,
+                                                       gdouble             angle0,
+                                                       gint64              time1,
+                                                       gdouble             angle1,
+                                                       gint64              time);
+
+HYSCAN_API
+void             hyscan_gtk_gliko_feed_put            (HyScanGtkGlikoFeed *feed,
+                                                       gdouble             angle,
+                                                       const gfloat       *amplitudes,
+                                                       guint32             length);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_GTK_GLIKO_FEED_H__ */
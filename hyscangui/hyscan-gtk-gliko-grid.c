@@ -39,6 +39,7 @@
 #include <string.h>
 
 #include "hyscan-gtk-gliko-grid.h"
+#include "hyscan-gtk-gliko-view-block.h"
 
 /* Properties enum */
 enum
@@ -85,10 +86,17 @@ struct _HyScanGtkGlikoGridPrivate
   int program;      // shader program
   unsigned int vao; // vertex array object
   unsigned int vbo; // vertex buffer object
+  unsigned int ibo; // буфер параметров окружностей, по одному на экземпляр
+  unsigned int ubo; // буфер блока параметров отображения
   float vertices[360 * 3 + 24 * 3];
   float circles[MAX_CIRCLES];
+  float instances[MAX_CIRCLES * 2]; // радиус и прозрачность каждой окружности
   int num_circles; // количество окружностей в сетке
+  int circles_dirty; // признак изменения окружностей и линий после загрузки в буферы
   float color[4];
+  int color_loc;
+  view_state_t view;
+  view_state_t view_loaded;
 };
 
 #define glerr()                                                                   \
@@ -116,54 +124,29 @@ static void update_circles (HyScanGtkGlikoGridPrivate *p);
 static const char *vertexShaderSource =
     "#version 330 core\n"
     "layout (location = 0) in vec3 aPos;\n"
-    "uniform float cx;\n"
-    "uniform float cy;\n"
-    "uniform float scale;\n"
-    "uniform float width;\n"
-    "uniform float height;\n"
-    "uniform float radius;\n"
-    "uniform float sin_alpha;\n"
-    "uniform float cos_alpha;\n"
+    "layout (location = 1) in vec2 aCircle;\n"
+    VIEW_BLOCK_SOURCE
+    "uniform vec4 color;\n"
+    "out vec4 LineColor;\n"
     "void main()\n"
     "{\n"
+    "   float sin_alpha = sin(rotate);\n"
+    "   float cos_alpha = cos(rotate);\n"
     "   float x = cos_alpha * aPos.x - sin_alpha * aPos.y;\n"
     "   float y = sin_alpha * aPos.x + cos_alpha * aPos.y;\n"
-    "   gl_Position = vec4((2.0 * cx + x * radius) * scale * height / width, (2.0 * cy + y * radius) * scale, aPos.z, 1.0);\n"
+    "   gl_Position = vec4((2.0 * center.x + x * aCircle.x) * size.y / (scale * size.x), (2.0 * center.y + y * aCircle.x) / scale, aPos.z, 1.0);\n"
+    "   LineColor = vec4(color.rgb, color.a * aCircle.y);\n"
     "}\n";
 
 static const char *fragmentShaderSource =
     "#version 330 core\n"
+    "in vec4 LineColor;\n"
     "out vec4 FragColor;\n"
-    "uniform vec4 color;\n"
     "void main()\n"
     "{\n"
-    "   FragColor = color;\n"
+    "   FragColor = LineColor;\n"
     "}\n";
 
-static void
-set_uniform1f (const unsigned int prog, const char *name, const float val)
-{
-  int loc = glGetUniformLocation (prog, name);
-  if (loc == -1)
-    {
-      glerr ();
-      return;
-    }
-  glUniform1f (loc, val);
-}
-
-static void
-set_uniform4fv (const unsigned int prog, const char *name, const float *a)
-{
-  int loc = glGetUniformLocation (prog, name);
-  if (loc == -1)
-    {
-      glerr ();
-      return;
-    }
-  glUniform4fv (loc, 1, a);
-}
-
 static int
 create_shader_program ()
 {
@@ -230,11 +213,20 @@ create_model (HyScanGtkGlikoGridPrivate *p)
   glBufferData (GL_ARRAY_BUFFER, sizeof (p->vertices), p->vertices, GL_DYNAMIC_DRAW);
   // одна вершина хранится как вектор из 3х чисел с плавающей точкой
   glVertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof (float), (void *) 0);
+  glEnableVertexAttribArray (0);
+
+  // параметры окружности задаются один раз на экземпляр
+  glGenBuffers (1, &p->ibo);
+  glBindBuffer (GL_ARRAY_BUFFER, p->ibo);
+  glBufferData (GL_ARRAY_BUFFER, sizeof (p->instances), p->instances, GL_DYNAMIC_DRAW);
+  glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof (float), (void *) 0);
+  glVertexAttribDivisor (1, 1);
+  glEnableVertexAttribArray (1);
 
   // отменяем выбор объектов
-  glEnableVertexAttribArray (0);
   glBindBuffer (GL_ARRAY_BUFFER, 0);
   glBindVertexArray (0);
+  p->circles_dirty = 1;
 }
 
 static void
@@ -250,24 +242,10 @@ static void
 layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
 {
   HyScanGtkGlikoGridPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (layer, HYSCAN_TYPE_GTK_GLIKO_GRID, HyScanGtkGlikoGridPrivate);
-  int i, j;
-  float a;
-  float c1[4];
-  float c2[4];
 
   if (p->program == -1)
     return;
 
-  c1[0] = p->color[0];
-  c1[1] = p->color[1];
-  c1[2] = p->color[2];
-  c1[3] = p->color[3];
-
-  c2[0] = c1[0];
-  c2[1] = c1[1];
-  c2[2] = c1[2];
-  c2[3] = 0.5f * c1[3];
-
   update_circles (p);
 
   // не требуется для рисования линиями
@@ -281,40 +259,32 @@ layer_render (HyScanGtkGlikoLayer *layer, GdkGLContext *context)
   glUseProgram (p->program);
 
   // задаем параметры программы шейдера
-  set_uniform1f (p->program, "cx", p->cx);
-  set_uniform1f (p->program, "cy", p->cy);
-  set_uniform1f (p->program, "scale", 1.0f / p->scale);
-  set_uniform1f (p->program, "width", (float) p->w);
-  set_uniform1f (p->program, "height", (float) p->h);
-
+  p->view.center[0] = p->cx;
+  p->view.center[1] = p->cy;
+  p->view.size[0] = (float) p->w;
+  p->view.size[1] = (float) p->h;
+  p->view.scale = p->scale;
   // угол вращения относительно центра
-  a = -p->alpha * G_PI / 180.0;
-  set_uniform1f (p->program, "sin_alpha", sinf (a));
-  set_uniform1f (p->program, "cos_alpha", cosf (a));
+  p->view.rotate = -p->alpha * G_PI / 180.0;
+  hyscan_gtk_gliko_view_block_bind (p->ubo, &p->view, &p->view_loaded);
+  glUniform4fv (p->color_loc, 1, p->color);
 
-  // выбираем буфер с координатами вершин
-  glBindBuffer (GL_ARRAY_BUFFER, p->vbo);
   glBindVertexArray (p->vao);
 
-  glBufferSubData (GL_ARRAY_BUFFER, 360 * 3 * sizeof (float), 12 * 6 * sizeof (float), p->vertices + 360 * 3);
-
-  // рисуем набор окружностей
-  for (i = 0, j = 0; i < p->num_circles; i++)
+  // загружаем в буферы изменившиеся линии и окружности
+  if (p->circles_dirty)
     {
-      j++;
-      if (j == p->bold || i == (p->num_circles - 1))
-        {
-          j = 0;
-          set_uniform4fv (p->program, "color", c1);
-        }
-      else
-        {
-          set_uniform4fv (p->program, "color", c2);
-        }
-      set_uniform1f (p->program, "radius", p->circles[i]);
-      glDrawArrays (GL_LINE_LOOP, 0, 360);
+      glBindBuffer (GL_ARRAY_BUFFER, p->vbo);
+      glBufferSubData (GL_ARRAY_BUFFER, 0, sizeof (p->vertices), p->vertices);
+      glBindBuffer (GL_ARRAY_BUFFER, p->ibo);
+      glBufferSubData (GL_ARRAY_BUFFER, 0, 2 * p->num_circles * sizeof (float), p->instances);
+      p->circles_dirty = 0;
     }
-  // рисуем 30-градусные азимутальные линии
+
+  // рисуем набор окружностей одним вызовом
+  glDrawArraysInstanced (GL_LINE_LOOP, 0, 360, p->num_circles);
+  // рисуем 30-градусные азимутальные линии; они используют параметры
+  // нулевого экземпляра, то есть внешней окружности
   glDrawArrays (GL_LINES, 360, 24);
 }
 
@@ -325,6 +295,11 @@ layer_realize (HyScanGtkGlikoLayer *layer)
 
   // создаем программу шейдера
   p->program = create_shader_program ();
+  if (p->program != -1)
+    {
+      p->color_loc = glGetUniformLocation (p->program, "color");
+      hyscan_gtk_gliko_view_block_init (p->program, &p->ubo, &p->view_loaded);
+    }
 
   // создаем буфер для хранения вершин
   create_model (p);
@@ -342,7 +317,7 @@ static void
 update_circles (HyScanGtkGlikoGridPrivate *p)
 {
   float step, r0;
-  int i, k;
+  int i, j, k;
   const float x[3] = { 2.0f, 2.5f, 2.0f };
   const int num[3] = { 5, 5, 5 };
   const int n = 10;
@@ -370,6 +345,26 @@ update_circles (HyScanGtkGlikoGridPrivate *p)
   p->bold = k;
   r0 = p->step / p->radius;
 
+  // параметры экземпляров окружностей в обратном порядке: нулевой экземпляр -
+  // внешняя окружность, его параметры используются и для азимутальных линий;
+  // каждая bold-я и внешняя окружности рисуются ярче остальных
+  for (i = 0, j = 0; i < p->num_circles; i++)
+    {
+      float *instance = p->instances + 2 * (p->num_circles - 1 - i);
+
+      j++;
+      instance[0] = p->circles[i];
+      if (j == p->bold || i == (p->num_circles - 1))
+        {
+          j = 0;
+          instance[1] = 1.0f;
+        }
+      else
+        {
+          instance[1] = 0.5f;
+        }
+    }
+
   // координаты точек окружности
   for (i = 0; i < 360; i++)
     {
@@ -389,6 +384,8 @@ update_circles (HyScanGtkGlikoGridPrivate *p)
       line_vertices[i * 6 + 4] = cosf (a * 30.0f * i);
       line_vertices[i * 6 + 5] = 0.0f;
     }
+
+  p->circles_dirty = 1;
 }
 
 static void
@@ -0,0 +1,477 @@
+/* hyscan-gtk-gliko-kernels.c
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/**
+ * SECTION: hyscan-gtk-gliko-kernels
+ * @Short_description: функции обработки строк индикатора кругового обзора
+ * @Title: HyScanGtkGlikoKernels
+ *
+ * Функции прореживания строк при построении уровней детализации, наложения
+ * новых строк на гашеные старые и преобразования строк в компактные форматы
+ * текстур в #HyScanGtkGlikoArea. Для каждой функции есть скалярный вариант,
+ * с которым совпадают векторные варианты SSE2/AVX2 и NEON. Преобразование
+ * в 16-битные числа с плавающей точкой выполняется только скалярно: оно
+ * нужно лишь при загрузке изменённых строк в текстуры.
+ *
+ * Функция hyscan_gtk_gliko_kernels_get() возвращает самый быстрый набор функций
+ * для текущего процессора. SSE2 есть на всех процессорах x86-64, наличие AVX2
+ * проверяется при выполнении. NEON используется, если компилятор собирает код
+ * для процессора с NEON.
+ *
+ * Функция hyscan_gtk_gliko_kernels_list() возвращает все доступные наборы,
+ * а hyscan_gtk_gliko_kernels_get_scalar() - скалярный вариант для проверки.
+ */
+
+#include "hyscan-gtk-gliko-kernels.h"
+
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#define HYSCAN_GTK_GLIKO_SSE2
+#endif
+#if defined (HYSCAN_GTK_GLIKO_SSE2) && defined (__GNUC__)
+#include <immintrin.h>
+#define HYSCAN_GTK_GLIKO_CPU_DETECT
+#define HYSCAN_GTK_GLIKO_TARGET(isa) __attribute__ ((target (isa)))
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HYSCAN_GTK_GLIKO_NEON
+#endif
+
+#define HYSCAN_GTK_GLIKO_MAX_KERNELS 4
+
+static void
+hyscan_gtk_gliko_resample2_scalar (gfloat       *dst,
+                                   const gfloat *src,
+                                   gint          n_dst)
+{
+  gint i;
+
+  for (i = 0; i < n_dst; i++, src += 2)
+    dst[i] = 0.5f * (src[0] + src[1]);
+}
+
+static void
+hyscan_gtk_gliko_blend_scalar (gfloat       *dst,
+                               const gfloat *src,
+                               gfloat        k,
+                               gint          n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      gfloat c = k * dst[i] + src[i];
+
+      dst[i] = (c > 1.0f) ? 1.0f : c;
+    }
+}
+
+/* Преобразует число в half float с округлением к ближайшему чётному. Слишком
+ * большие числа становятся бесконечностью, слишком маленькие - денормализованными
+ * числами, которые получаются сложением со степенью двойки так, чтобы нужные
+ * разряды оказались в младших битах мантиссы. */
+static guint16
+hyscan_gtk_gliko_float_to_half (gfloat value)
+{
+  union { gfloat f; guint32 u; } v, magic;
+  guint32 sign;
+
+  v.f = value;
+  sign = (v.u >> 16) & 0x8000;
+  v.u &= 0x7fffffff;
+
+  /* Переполнение, бесконечность и NaN. */
+  if (v.u >= 0x47800000)
+    return sign | ((v.u > 0x7f800000) ? 0x7e00 : 0x7c00);
+
+  /* Денормализованные числа и ноль. */
+  if (v.u < 0x38800000)
+    {
+      magic.u = 0x3f000000;
+      v.f += magic.f;
+      return sign | (v.u - magic.u);
+    }
+
+  /* Нормализованные числа: смена смещения порядка и округление мантиссы. */
+  v.u += 0xc8000fff + ((v.u >> 13) & 1);
+
+  return sign | (v.u >> 13);
+}
+
+static void
+hyscan_gtk_gliko_pack_half_scalar (guint16      *dst,
+                                   const gfloat *src,
+                                   gint          n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = hyscan_gtk_gliko_float_to_half (src[i]);
+}
+
+static void
+hyscan_gtk_gliko_pack_unorm8_scalar (guint8       *dst,
+                                     const gfloat *src,
+                                     gfloat        gain,
+                                     gfloat        offset,
+                                     gint          n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    {
+      gfloat c = (src[i] - offset) * gain;
+
+      /* NaN становится нулём. */
+      c = (c > 0.0f) ? c : 0.0f;
+      c = (c < 1.0f) ? c : 1.0f;
+      dst[i] = (guint8) (255.0f * c + 0.5f);
+    }
+}
+
+#ifdef HYSCAN_GTK_GLIKO_SSE2
+/* Прореживает строку по 4 отсчёта за итерацию: чётные и нечётные отсчёты
+ * разделяются перестановкой и складываются. */
+static void
+hyscan_gtk_gliko_resample2_sse2 (gfloat       *dst,
+                                 const gfloat *src,
+                                 gint          n_dst)
+{
+  const __m128 half = _mm_set1_ps (0.5f);
+  gint i;
+
+  for (i = 0; i + 4 <= n_dst; i += 4)
+    {
+      __m128 a, b, even, odd;
+
+      a = _mm_loadu_ps (src + 2 * i);
+      b = _mm_loadu_ps (src + 2 * i + 4);
+      even = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+      odd = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+      _mm_storeu_ps (dst + i, _mm_mul_ps (half, _mm_add_ps (even, odd)));
+    }
+
+  hyscan_gtk_gliko_resample2_scalar (dst + i, src + 2 * i, n_dst - i);
+}
+
+/* Накладывает строку по 4 отсчёта за итерацию. Минимум берётся с единицей
+ * в первом аргументе, чтобы значения NaN сохранялись так же, как в скалярном
+ * варианте. */
+static void
+hyscan_gtk_gliko_blend_sse2 (gfloat       *dst,
+                             const gfloat *src,
+                             gfloat        k,
+                             gint          n)
+{
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 vk = _mm_set1_ps (k);
+  gint i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      __m128 c;
+
+      c = _mm_add_ps (_mm_mul_ps (vk, _mm_loadu_ps (dst + i)), _mm_loadu_ps (src + i));
+      _mm_storeu_ps (dst + i, _mm_min_ps (one, c));
+    }
+
+  hyscan_gtk_gliko_blend_scalar (dst + i, src + i, k, n - i);
+}
+
+/* Преобразует строку по 16 отсчётов за итерацию. Порядок аргументов max и min
+ * выбран так, чтобы NaN становился нулём, как в скалярном варианте. */
+static void
+hyscan_gtk_gliko_pack_unorm8_sse2 (guint8       *dst,
+                                   const gfloat *src,
+                                   gfloat        gain,
+                                   gfloat        offset,
+                                   gint          n)
+{
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 scale = _mm_set1_ps (255.0f);
+  const __m128 round = _mm_set1_ps (0.5f);
+  const __m128 vgain = _mm_set1_ps (gain);
+  const __m128 voffset = _mm_set1_ps (offset);
+  gint i, j;
+
+  for (i = 0; i + 16 <= n; i += 16)
+    {
+      __m128i q[4];
+
+      for (j = 0; j < 4; j++)
+        {
+          __m128 c;
+
+          c = _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (src + i + 4 * j), voffset), vgain);
+          c = _mm_min_ps (_mm_max_ps (c, zero), one);
+          q[j] = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (scale, c), round));
+        }
+
+      _mm_storeu_si128 ((__m128i *) (dst + i),
+                        _mm_packus_epi16 (_mm_packs_epi32 (q[0], q[1]), _mm_packs_epi32 (q[2], q[3])));
+    }
+
+  hyscan_gtk_gliko_pack_unorm8_scalar (dst + i, src + i, gain, offset, n - i);
+}
+#endif /* HYSCAN_GTK_GLIKO_SSE2 */
+
+#ifdef HYSCAN_GTK_GLIKO_CPU_DETECT
+/* Вариант hyscan_gtk_gliko_resample2_sse2() по 8 отсчётов за итерацию.
+ * Перестановка выполняется внутри 128-битных половин регистра, поэтому
+ * результат переупорядочивается 64-битными словами. */
+HYSCAN_GTK_GLIKO_TARGET ("avx2")
+static void
+hyscan_gtk_gliko_resample2_avx2 (gfloat       *dst,
+                                 const gfloat *src,
+                                 gint          n_dst)
+{
+  const __m256 half = _mm256_set1_ps (0.5f);
+  gint i;
+
+  for (i = 0; i + 8 <= n_dst; i += 8)
+    {
+      __m256 a, b, even, odd, d;
+
+      a = _mm256_loadu_ps (src + 2 * i);
+      b = _mm256_loadu_ps (src + 2 * i + 8);
+      even = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+      odd = _mm256_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+      d = _mm256_mul_ps (half, _mm256_add_ps (even, odd));
+      d = _mm256_castpd_ps (_mm256_permute4x64_pd (_mm256_castps_pd (d), _MM_SHUFFLE (3, 1, 2, 0)));
+      _mm256_storeu_ps (dst + i, d);
+    }
+
+  hyscan_gtk_gliko_resample2_scalar (dst + i, src + 2 * i, n_dst - i);
+}
+
+/* Вариант hyscan_gtk_gliko_blend_sse2() по 8 отсчётов за итерацию. */
+HYSCAN_GTK_GLIKO_TARGET ("avx2")
+static void
+hyscan_gtk_gliko_blend_avx2 (gfloat       *dst,
+                             const gfloat *src,
+                             gfloat        k,
+                             gint          n)
+{
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 vk = _mm256_set1_ps (k);
+  gint i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      __m256 c;
+
+      c = _mm256_add_ps (_mm256_mul_ps (vk, _mm256_loadu_ps (dst + i)), _mm256_loadu_ps (src + i));
+      _mm256_storeu_ps (dst + i, _mm256_min_ps (one, c));
+    }
+
+  hyscan_gtk_gliko_blend_scalar (dst + i, src + i, k, n - i);
+}
+#endif /* HYSCAN_GTK_GLIKO_CPU_DETECT */
+
+#ifdef HYSCAN_GTK_GLIKO_NEON
+/* Прореживает строку по 4 отсчёта за итерацию, чётные и нечётные отсчёты
+ * разделяются при загрузке. */
+static void
+hyscan_gtk_gliko_resample2_neon (gfloat       *dst,
+                                 const gfloat *src,
+                                 gint          n_dst)
+{
+  gint i;
+
+  for (i = 0; i + 4 <= n_dst; i += 4)
+    {
+      float32x4x2_t s = vld2q_f32 (src + 2 * i);
+
+      vst1q_f32 (dst + i, vmulq_n_f32 (vaddq_f32 (s.val[0], s.val[1]), 0.5f));
+    }
+
+  hyscan_gtk_gliko_resample2_scalar (dst + i, src + 2 * i, n_dst - i);
+}
+
+/* Накладывает строку по 4 отсчёта за итерацию. */
+static void
+hyscan_gtk_gliko_blend_neon (gfloat       *dst,
+                             const gfloat *src,
+                             gfloat        k,
+                             gint          n)
+{
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  gint i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    {
+      float32x4_t c;
+
+      c = vaddq_f32 (vmulq_n_f32 (vld1q_f32 (dst + i), k), vld1q_f32 (src + i));
+      vst1q_f32 (dst + i, vminq_f32 (one, c));
+    }
+
+  hyscan_gtk_gliko_blend_scalar (dst + i, src + i, k, n - i);
+}
+
+/* Преобразует строку по 8 отсчётов за итерацию. NaN сохраняется до
+ * преобразования в целое, которое даёт для него ноль. */
+static void
+hyscan_gtk_gliko_pack_unorm8_neon (guint8       *dst,
+                                   const gfloat *src,
+                                   gfloat        gain,
+                                   gfloat        offset,
+                                   gint          n)
+{
+  const float32x4_t zero = vdupq_n_f32 (0.0f);
+  const float32x4_t one = vdupq_n_f32 (1.0f);
+  const float32x4_t round = vdupq_n_f32 (0.5f);
+  const float32x4_t voffset = vdupq_n_f32 (offset);
+  gint i, j;
+
+  for (i = 0; i + 8 <= n; i += 8)
+    {
+      uint32x4_t q[2];
+
+      for (j = 0; j < 2; j++)
+        {
+          float32x4_t c;
+
+          c = vmulq_n_f32 (vsubq_f32 (vld1q_f32 (src + i + 4 * j), voffset), gain);
+          c = vminq_f32 (vmaxq_f32 (c, zero), one);
+          q[j] = vcvtq_u32_f32 (vaddq_f32 (vmulq_n_f32 (c, 255.0f), round));
+        }
+
+      vst1_u8 (dst + i, vmovn_u16 (vcombine_u16 (vmovn_u32 (q[0]), vmovn_u32 (q[1]))));
+    }
+
+  hyscan_gtk_gliko_pack_unorm8_scalar (dst + i, src + i, gain, offset, n - i);
+}
+#endif /* HYSCAN_GTK_GLIKO_NEON */
+
+static const HyScanGtkGlikoKernels hyscan_gtk_gliko_kernels_scalar = {
+  "scalar", hyscan_gtk_gliko_resample2_scalar, hyscan_gtk_gliko_blend_scalar,
+  hyscan_gtk_gliko_pack_half_scalar, hyscan_gtk_gliko_pack_unorm8_scalar
+};
+
+#ifdef HYSCAN_GTK_GLIKO_SSE2
+static const HyScanGtkGlikoKernels hyscan_gtk_gliko_kernels_sse2 = {
+  "sse2", hyscan_gtk_gliko_resample2_sse2, hyscan_gtk_gliko_blend_sse2,
+  hyscan_gtk_gliko_pack_half_scalar, hyscan_gtk_gliko_pack_unorm8_sse2
+};
+#endif
+
+#ifdef HYSCAN_GTK_GLIKO_CPU_DETECT
+static const HyScanGtkGlikoKernels hyscan_gtk_gliko_kernels_avx2 = {
+  "avx2", hyscan_gtk_gliko_resample2_avx2, hyscan_gtk_gliko_blend_avx2,
+  hyscan_gtk_gliko_pack_half_scalar, hyscan_gtk_gliko_pack_unorm8_sse2
+};
+#endif
+
+#ifdef HYSCAN_GTK_GLIKO_NEON
+static const HyScanGtkGlikoKernels hyscan_gtk_gliko_kernels_neon = {
+  "neon", hyscan_gtk_gliko_resample2_neon, hyscan_gtk_gliko_blend_neon,
+  hyscan_gtk_gliko_pack_half_scalar, hyscan_gtk_gliko_pack_unorm8_neon
+};
+#endif
+
+/**
+ * hyscan_gtk_gliko_kernels_list:
+ * @n_kernels: (out): число наборов функций
+ *
+ * Функция возвращает все наборы функций, которые можно использовать на текущем
+ * процессоре, в порядке возрастания скорости. Первым идёт скалярный вариант.
+ *
+ * Returns: (transfer none): массив наборов функций
+ */
+const HyScanGtkGlikoKernels **
+hyscan_gtk_gliko_kernels_list (guint *n_kernels)
+{
+  static const HyScanGtkGlikoKernels *kernels[HYSCAN_GTK_GLIKO_MAX_KERNELS];
+  static guint n = 0;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      kernels[n++] = &hyscan_gtk_gliko_kernels_scalar;
+
+#ifdef HYSCAN_GTK_GLIKO_SSE2
+      kernels[n++] = &hyscan_gtk_gliko_kernels_sse2;
+#endif
+
+#ifdef HYSCAN_GTK_GLIKO_CPU_DETECT
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        kernels[n++] = &hyscan_gtk_gliko_kernels_avx2;
+#endif
+
+#ifdef HYSCAN_GTK_GLIKO_NEON
+      kernels[n++] = &hyscan_gtk_gliko_kernels_neon;
+#endif
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  *n_kernels = n;
+
+  return kernels;
+}
+
+/**
+ * hyscan_gtk_gliko_kernels_get:
+ *
+ * Функция возвращает самый быстрый набор функций для текущего процессора.
+ *
+ * Returns: (transfer none): набор функций
+ */
+const HyScanGtkGlikoKernels *
+hyscan_gtk_gliko_kernels_get (void)
+{
+  const HyScanGtkGlikoKernels **kernels;
+  guint n_kernels;
+
+  kernels = hyscan_gtk_gliko_kernels_list (&n_kernels);
+
+  return kernels[n_kernels - 1];
+}
+
+/**
+ * hyscan_gtk_gliko_kernels_get_scalar:
+ *
+ * Функция возвращает скалярный набор функций, с которым сравниваются векторные.
+ *
+ * Returns: (transfer none): набор функций
+ */
+const HyScanGtkGlikoKernels *
+hyscan_gtk_gliko_kernels_get_scalar (void)
+{
+  return &hyscan_gtk_gliko_kernels_scalar;
+}
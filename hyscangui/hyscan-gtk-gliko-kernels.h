@@ -0,0 +1,100 @@
+/* hyscan-gtk-gliko-kernels.h
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_GTK_GLIKO_KERNELS_H__
+#define __HYSCAN_GTK_GLIKO_KERNELS_H__
+
+#include <glib.h>
+#include <hyscan-api.h>
+
+G_BEGIN_DECLS
+
+/* Прореживание строки в 2 раза: dst[i] = (src[2i] + src[2i+1]) / 2, i < n_dst. */
+typedef void (*HyScanGtkGlikoResampleFunc) (gfloat       *dst,
+                                            const gfloat *src,
+                                            gint          n_dst);
+
+/* Наложение новой строки на гашеную старую: dst[i] = min (k * dst[i] + src[i], 1), i < n. */
+typedef void (*HyScanGtkGlikoBlendFunc)    (gfloat       *dst,
+                                            const gfloat *src,
+                                            gfloat        k,
+                                            gint          n);
+
+/* Преобразование строки в 16-битные числа с плавающей точкой (half float),
+ * округление к ближайшему чётному. */
+typedef void (*HyScanGtkGlikoPackHalfFunc)   (guint16      *dst,
+                                              const gfloat *src,
+                                              gint          n);
+
+/* Преобразование строки в 8-битные нормированные значения:
+ * dst[i] = round (255 * clamp ((src[i] - offset) * gain, 0, 1)), i < n. */
+typedef void (*HyScanGtkGlikoPackUnorm8Func) (guint8       *dst,
+                                              const gfloat *src,
+                                              gfloat        gain,
+                                              gfloat        offset,
+                                              gint          n);
+
+typedef struct _HyScanGtkGlikoKernels HyScanGtkGlikoKernels;
+
+/**
+ * HyScanGtkGlikoKernels:
+ * @name: название набора инструкций
+ * @resample2: функция прореживания строки
+ * @blend: функция наложения строки
+ * @pack_half: функция преобразования строки в 16-битные числа с плавающей точкой
+ * @pack_unorm8: функция преобразования строки в 8-битные нормированные значения
+ *
+ * Набор функций обработки строк индикатора кругового обзора.
+ */
+struct _HyScanGtkGlikoKernels
+{
+  const gchar                 *name;
+  HyScanGtkGlikoResampleFunc   resample2;
+  HyScanGtkGlikoBlendFunc      blend;
+  HyScanGtkGlikoPackHalfFunc   pack_half;
+  HyScanGtkGlikoPackUnorm8Func pack_unorm8;
+};
+
+HYSCAN_API
+const HyScanGtkGlikoKernels  *hyscan_gtk_gliko_kernels_get        (void);
+
+HYSCAN_API
+const HyScanGtkGlikoKernels  *hyscan_gtk_gliko_kernels_get_scalar (void);
+
+HYSCAN_API
+const HyScanGtkGlikoKernels **hyscan_gtk_gliko_kernels_list       (guint *n_kernels);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_GTK_GLIKO_KERNELS_H__ */
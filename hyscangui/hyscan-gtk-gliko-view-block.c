@@ -0,0 +1,67 @@
+/* hyscan-gtk-gliko-view-block.c
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#include <string.h>
+
+#include "hyscan-gtk-gliko-view-block.h"
+
+// связывает блок программы с точкой привязки и создает буфер для него
+void
+hyscan_gtk_gliko_view_block_init (const GLuint program, GLuint *ubo, view_state_t *loaded)
+{
+  GLuint index;
+
+  index = glGetUniformBlockIndex (program, "ViewState");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding (program, index, VIEW_BLOCK_BINDING);
+
+  memset (loaded, 0, sizeof (*loaded));
+  glGenBuffers (1, ubo);
+  glBindBuffer (GL_UNIFORM_BUFFER, *ubo);
+  glBufferData (GL_UNIFORM_BUFFER, sizeof (*loaded), loaded, GL_DYNAMIC_DRAW);
+  glBindBuffer (GL_UNIFORM_BUFFER, 0);
+}
+
+// подключает буфер к точке привязки и загружает в него параметры,
+// если они отличаются от загруженных ранее
+void
+hyscan_gtk_gliko_view_block_bind (const GLuint ubo, const view_state_t *state, view_state_t *loaded)
+{
+  glBindBufferBase (GL_UNIFORM_BUFFER, VIEW_BLOCK_BINDING, ubo);
+  if (memcmp (state, loaded, sizeof (*state)) != 0)
+    {
+      glBufferSubData (GL_UNIFORM_BUFFER, 0, sizeof (*state), state);
+      *loaded = *state;
+    }
+}
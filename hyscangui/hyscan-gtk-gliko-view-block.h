@@ -0,0 +1,70 @@
+/* hyscan-gtk-gliko-view-block.h
+ *
+ * Copyright 2020-2021 Screen LLC, Vladimir Sharov <sharovv@mail.ru>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_GTK_GLIKO_VIEW_BLOCK_H__
+#define __HYSCAN_GTK_GLIKO_VIEW_BLOCK_H__
+
+#include <epoxy/gl.h>
+
+// Общий для слоев индикатора кругового обзора блок uniform-переменных ViewState
+// с параметрами отображения: центр, размер области, масштаб и поворот.
+// Расположение полей соответствует правилам std140.
+
+// точка привязки блока
+#define VIEW_BLOCK_BINDING 0
+
+// объявление блока в шейдере
+#define VIEW_BLOCK_SOURCE                  \
+  "layout (std140) uniform ViewState\n"    \
+  "{\n"                                    \
+  "  vec2 center;\n"                       \
+  "  vec2 size;\n"                         \
+  "  float scale;\n"                       \
+  "  float rotate;\n"                      \
+  "};\n"
+
+typedef struct _view_state_t
+{
+  float center[2]; // координаты центра
+  float size[2];   // ширина и высота области отображения, пиксели
+  float scale;     // масштаб
+  float rotate;    // угол поворота, радианы
+  float reserved[2];
+} view_state_t;
+
+void hyscan_gtk_gliko_view_block_init (const GLuint program, GLuint *ubo, view_state_t *loaded);
+
+void hyscan_gtk_gliko_view_block_bind (const GLuint ubo, const view_state_t *state, view_state_t *loaded);
+
+#endif /* __HYSCAN_GTK_GLIKO_VIEW_BLOCK_H__ */
@@ -50,6 +50,7 @@
 #include "hyscan-gtk-gliko.h"
 
 #include "hyscan-gtk-gliko-area.h"
+#include "hyscan-gtk-gliko-feed.h"
 #include "hyscan-gtk-gliko-grid.h"
 
 #include "hyscan-gtk-gliko-que.h"
@@ -89,16 +90,13 @@ typedef struct _channel_t
   gint64 alpha_time;
   gdouble alpha_value;
   gdouble data_rate;
-  gfloat *buffer;
+  HyScanGtkGlikoFeed feed; // выдача строк в индикатор, буфер строки размером allocated
   guint32 iko_length;
   guint32 allocated;
   int process_init;
-  int gliko_channel;
   int ready_alpha_init;
   int ready_data_init;
-  int azimuth_displayed;
   int iko_length_initialized;
-  guint32 azimuth;
   gchar *source_name;
   gfloat freq;
 } channel_t;
@@ -130,6 +128,8 @@ struct _HyScanGtkGlikoPrivate
   float black;
   float gamma;
 
+  HyScanGtkGlikoTextureFormat texture_format;
+
   channel_t channel[2];
   guint32 iko_length;
   int iko_length_initialized;
@@ -220,6 +220,8 @@ hyscan_gtk_gliko_init (HyScanGtkGliko *instance)
   p->black = 0.0f;
   p->gamma = 1.0f;
 
+  p->texture_format = HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32;
+
   p->iko_length = 1024;
   p->iko_length_initialized = 0;
 
@@ -233,18 +235,18 @@ hyscan_gtk_gliko_init (HyScanGtkGliko *instance)
   p->alpha_que_buffer = NULL;
 
   p->channel[0].allocated = 0;
-  p->channel[0].buffer = NULL;
+  p->channel[0].feed.buffer = NULL;
   p->channel[0].data_que_buffer = NULL;
 
   p->channel[1].allocated = 0;
-  p->channel[1].buffer = NULL;
+  p->channel[1].feed.buffer = NULL;
   p->channel[1].data_que_buffer = NULL;
 
   p->channel[0].source_name = NULL;
   p->channel[1].source_name = NULL;
 
-  p->channel[0].gliko_channel = 0;
-  p->channel[1].gliko_channel = 1;
+  p->channel[0].feed.channel = 0;
+  p->channel[1].feed.channel = 1;
 
   p->channel[0].acoustic_data = NULL;
   p->channel[1].acoustic_data = NULL;
@@ -341,6 +343,8 @@ finalize (GObject *gobject)
   g_clear_object (&p->nmea_data);
   g_clear_object (&p->channel[0].acoustic_data);
   g_clear_object (&p->channel[1].acoustic_data);
+  g_free (p->channel[0].feed.buffer);
+  g_free (p->channel[1].feed.buffer);
 
   if (p->project_name != NULL)
     {
@@ -433,8 +437,8 @@ channel_reset_playback (HyScanGtkGlikoPrivate *p,
   c->process_init = 0;
 
   // последний выданный на индикатор азимутальный дискрет
-  c->azimuth_displayed = 0;
-  c->azimuth = 0;
+  c->feed.azimuth_displayed = FALSE;
+  c->feed.azimuth = 0;
 
   c->ready_alpha_init = 0;
   c->ready_data_init = 0;
@@ -483,7 +487,7 @@ channel_open (HyScanGtkGlikoPrivate *p,
   c->allocated = 0;
 
   // указатель на буфер
-  c->buffer = NULL;
+  g_clear_pointer (&c->feed.buffer, g_free);
 
   /* Объект обработки акустических данных. */
   g_clear_object (&c->acoustic_data);
@@ -573,18 +577,6 @@ channel_process (HyScanGtkGlikoPrivate *p,
     }
 }
 
-static gdouble
-range360 (const gdouble a)
-{
-  guint i;
-  gdouble d;
-
-  d = a * 65536.0 / 360.0;
-  i = (int) d;
-  d = (i & 0xFFFF);
-  return d * 360.0 / 65536.0;
-}
-
 // обработчик сигнала process
 void
 player_process_callback (HyScanDataPlayer *player,
@@ -651,25 +643,16 @@ player_process_callback (HyScanDataPlayer *player,
   for (; p->nmea_index != inleft; p->nmea_index += indelta)
     {
       const gchar *nmea;
-      const char header[6] = { '$', 'H', 'Y', 'R', 'A', ',' };
 
       /* Считываем строку nmea */
       nmea = hyscan_nmea_data_get (p->nmea_data, p->nmea_index, &alpha.time);
 
-      if (nmea == NULL)
+      /* обрабатываем только датчик угла поворота, текущий угол поворота в градусах */
+      if (!hyscan_gtk_gliko_feed_parse_angle (nmea, &alpha.value))
         {
           continue;
         }
 
-      /* обрабатываем только датчик угла поворота */
-      if (memcmp (nmea, header, sizeof (header)) != 0)
-        {
-          continue;
-        }
-
-      /* текущий угол поворота, градусы */
-      alpha.value = range360 (g_ascii_strtod (nmea + sizeof (header), NULL));
-
       //printf( "process %s %"PRIu64" %.2lf\n", hyscan_data_player_get_track_name( player ), alpha.time, alpha.value );
       //fflush( stdout );
 
@@ -688,24 +671,25 @@ channel_ready (HyScanGtkGlikoPrivate *p,
   int ra, rd;
   alpha_que_t alpha;
   data_que_t data;
-  gdouble a, d, dm, dn, dp;
+  gdouble a;
   const gfloat *amplitudes;
-  guint32 i, j, length;
+  guint32 length;
   gint64 t;
 
   // резервируем буфер для строки отсчетов
   if (c->allocated == 0)
     {
-      if (c->buffer != NULL)
-        {
-          g_free (c->buffer);
-          c->buffer = NULL;
-        }
+      g_clear_pointer (&c->feed.buffer, g_free);
       for (c->allocated = (1 << 10); c->allocated < p->iko_length; c->allocated <<= 1)
         ;
-      c->buffer = g_malloc0 (c->allocated * sizeof (gfloat));
+      c->feed.buffer = g_malloc0 (c->allocated * sizeof (gfloat));
     }
 
+  // параметры индикатора могут измениться между вызовами
+  c->feed.area = p->iko;
+  c->feed.num_azimuthes = p->num_azimuthes;
+  c->feed.length = p->iko_length;
+
   // просматриваем очередь данных датчика угла
   do
     {
@@ -751,20 +735,6 @@ channel_ready (HyScanGtkGlikoPrivate *p,
           c->ready_alpha_init = 0;
           continue;
         }
-      /* изменение угла, с учетом перехода через 0 */
-      dn = alpha.value - c->alpha_value;
-      dm = dn - 360.0;
-      dp = dn + 360.0;
-      d = dn;
-      if (fabs (dm) < fabs (dn))
-        {
-          d = dm;
-        }
-      else if (fabs (dp) < fabs (dn))
-        {
-          d = dp;
-        }
-
       // у нас есть два замера угла,
       // обрабатываем очередь данных,
       // предполагая, что угол изменялся линейно
@@ -795,69 +765,24 @@ channel_ready (HyScanGtkGlikoPrivate *p,
               // переходим к следующему углу
               break;
             }
-          // значение угла
-          a = c->alpha_value + d * (data.time - c->alpha_time) / (alpha.time - c->alpha_time);
+          // значение угла в допустимом диапазоне 0..360
+          a = hyscan_gtk_gliko_feed_interpolate (c->alpha_time, c->alpha_value, alpha.time, alpha.value, data.time);
 
           // следующая строка изображения
           c->data_que_count++;
 
-          /* допустимый диапазон 0..360 */
-          a = range360 (a);
-
-          //printf( "ready %d %"PRIu64" %.2lf\n", channel_index, data.time, a );
-          //fflush( stdout );
-
-          /* номер углового дискрета */
-          j = (guint32) (a * p->num_azimuthes / 360.0);
-          j %= p->num_azimuthes;
-
-          // если уже есть отрисованный азимут
-          if (c->azimuth_displayed)
-            {
-              // если луч перепрыгнул через 1 азимутальный дискрет
-              if (j == ((c->azimuth + 2) % p->num_azimuthes))
-                {
-                  // дублируем предыдущий азимут
-                  hyscan_gtk_gliko_area_set_data (HYSCAN_GTK_GLIKO_AREA (p->iko), c->gliko_channel, (c->azimuth + 1) % p->num_azimuthes, c->buffer);
-                }
-              else if (j == ((c->azimuth - 2) % p->num_azimuthes))
-                {
-                  hyscan_gtk_gliko_area_set_data (HYSCAN_GTK_GLIKO_AREA (p->iko), c->gliko_channel, (c->azimuth - 1) % p->num_azimuthes, c->buffer);
-                }
-              // можно дорисовать только один пропущенный азимутальный дискрет
-              c->azimuth_displayed = 0;
-            }
-
           // считываем строку акустического изображения
           amplitudes = hyscan_acoustic_data_get_amplitude (c->acoustic_data, NULL, data.index, &length, &t);
 
           if (amplitudes == NULL)
             {
               g_warning ("can't read acoustic line %d", data.index);
+              c->feed.azimuth_displayed = FALSE;
               break;
             }
 
-          if (length > p->iko_length)
-            {
-              length = p->iko_length;
-            }
-
-          /* запоминаем строку амплитуд в буфере */
-          memcpy (c->buffer, amplitudes, length * sizeof (gfloat));
-
-          /* если есть остаток, обнуляем его */
-          if (length < p->iko_length)
-            {
-              for (i = length; i < p->iko_length; i++)
-                {
-                  c->buffer[i] = 0.0f;
-                }
-            }
-
           /* передаем строку в индикатор кругового обзора */
-          hyscan_gtk_gliko_area_set_data (HYSCAN_GTK_GLIKO_AREA (p->iko), c->gliko_channel, j, c->buffer);
-          c->azimuth = j;
-          c->azimuth_displayed = 1;
+          hyscan_gtk_gliko_feed_put (&c->feed, a, amplitudes, length);
         }
       while (rd > 0);
 
@@ -1208,6 +1133,48 @@ hyscan_gtk_gliko_get_gamma_value (HyScanGtkGliko *instance)
   return p->gamma;
 }
 
+HYSCAN_API
+void
+hyscan_gtk_gliko_set_texture_format (HyScanGtkGliko *instance,
+                                     const HyScanGtkGlikoTextureFormat format)
+{
+  HyScanGtkGlikoPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO, HyScanGtkGlikoPrivate);
+
+  p->texture_format = format;
+  g_object_set (p->iko, "gliko-texture-format", (gint) p->texture_format, NULL);
+}
+
+HYSCAN_API
+HyScanGtkGlikoTextureFormat
+hyscan_gtk_gliko_get_texture_format (HyScanGtkGliko *instance)
+{
+  HyScanGtkGlikoPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO, HyScanGtkGlikoPrivate);
+  return p->texture_format;
+}
+
+// масштаб и смещение амплитуд канала в 8-битных текстурах
+HYSCAN_API
+void
+hyscan_gtk_gliko_set_texture_range (HyScanGtkGliko *instance,
+                                    const gint channel_index,
+                                    const gdouble gain,
+                                    const gdouble offset)
+{
+  HyScanGtkGlikoPrivate *p = G_TYPE_INSTANCE_GET_PRIVATE (instance, HYSCAN_TYPE_GTK_GLIKO, HyScanGtkGlikoPrivate);
+
+  switch (channel_index)
+    {
+    case 0:
+      g_object_set (p->iko, "gliko-texture-gain1", (gfloat) gain, "gliko-texture-offset1", (gfloat) offset, NULL);
+      break;
+    case 1:
+      g_object_set (p->iko, "gliko-texture-gain2", (gfloat) gain, "gliko-texture-offset2", (gfloat) offset, NULL);
+      break;
+    default:
+      break;
+    }
+}
+
 HYSCAN_API
 HyScanSourceType
 hyscan_gtk_gliko_get_source (HyScanGtkGliko *instance,
@@ -39,6 +39,7 @@
 #include <hyscan-api.h>
 #include <hyscan-data-player.h>
 #include <hyscan-gtk-gliko-overlay.h>
+#include <hyscan-gtk-gliko-area.h>
 
 G_BEGIN_DECLS
 
@@ -168,6 +169,18 @@ void hyscan_gtk_gliko_set_gamma_value (HyScanGtkGliko *instance,
 HYSCAN_API
 gdouble hyscan_gtk_gliko_get_gamma_value (HyScanGtkGliko *instance);
 
+HYSCAN_API
+void hyscan_gtk_gliko_set_texture_format (HyScanGtkGliko *instance,
+                                          const HyScanGtkGlikoTextureFormat format);
+HYSCAN_API
+HyScanGtkGlikoTextureFormat hyscan_gtk_gliko_get_texture_format (HyScanGtkGliko *instance);
+
+HYSCAN_API
+void hyscan_gtk_gliko_set_texture_range (HyScanGtkGliko *instance,
+                                         const gint channel_index,
+                                         const gdouble gain,
+                                         const gdouble offset);
+
 HYSCAN_API
 HyScanSourceType hyscan_gtk_gliko_get_source (HyScanGtkGliko *instance,
                                               const gint channel);
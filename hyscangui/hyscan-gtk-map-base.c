@@ -46,6 +46,23 @@
  * - #HyScanMapTileSourceFile - тайлы, предварительно загруженные на компьютер,
  * - #HyScanMapTileSourceBlend - комбинация нескольких источников.
  *
+ * Тайлы видимой области и запаса вокруг неё хранятся в кольцевом буфере:
+ * тайл (x, y) рисуется в ячейке (x mod n_cols, y mod n_rows) одной поверхности,
+ * а поверхность переносится на виджет с повторением. Поэтому при сдвиге карты
+ * рисуются только тайлы, появившиеся в области, а при изменении масштаба без
+ * смены зума - только недостающие тайлы.
+ *
+ * Пока тайл загружается, вместо него рисуется заглушка из уже загруженных тайлов
+ * соседних зумов: увеличенный фрагмент ближайшего тайла-предка или уменьшенные
+ * дочерние тайлы. Заглушки берутся только из кэшей в памяти и не требуют загрузки.
+ * Тайлы загружаются в порядке удаления от центра видимой области, а тайлы
+ * запаса вокруг неё - после видимых.
+ *
+ * Загруженные изображения тайлов помещаются в общий для всех слоёв кэш поверхностей
+ * #HyScanMapTileCache, поэтому тайл, загруженный одним слоем, без повторного
+ * декодирования используется другими слоями с тем же источником. Кроме того,
+ * пиксельные данные тайлов сохраняются в кэш #HyScanCache, указанный при создании слоя.
+ *
  * Для того, чтобы подложка размещалась ниже всех остальных слоёв, прочим слоям
  * следует подключаться к сигналу #GtkCifroArea::visible-draw в последнюю очередь
  * (через g_signal_connect_after()).
@@ -54,6 +71,7 @@
 
 #include "hyscan-gtk-map-base.h"
 #include "hyscan-gtk-map.h"
+#include "hyscan-map-tile-cache.h"
 #include <hyscan-task-queue.h>
 #include <math.h>
 #include <string.h>
@@ -63,6 +81,9 @@
 // #define HYSCAN_GTK_MAP_BASE_DEBUG
 
 #define CACHE_HEADER_MAGIC     0x484d6170    /* Идентификатор заголовка кэша. */
+#define CACHE_KEY_PREFIX       "HyScanGtkMapBase.t."
+#define CACHE_KEY_LENGTH       (sizeof (CACHE_KEY_PREFIX) + HYSCAN_MAP_TILE_KEY_STRLEN)
+#define PLACEHOLDER_DEPTH      4             /* Число уровней, на которых ищется тайл-предок для заглушки. */
 
 #define TOTAL_TILES(zoom)      (((zoom) == 0 ? 1 : 2u << ((zoom) - 1)) - 1)
 #define CLAMP_TILE(val, zoom)  CLAMP((gint)(val), 0, (gint)TOTAL_TILES ((zoom)))
@@ -81,6 +102,17 @@ typedef struct
   gsize                        size;                /* Размер пиксельных данных. */
 } HyScanGtkMapBaseCacheHeader;
 
+/* Ячейка кольцевого буфера тайлов. */
+typedef struct
+{
+  guint                        x;                   /* Координата тайла по оси x. */
+  guint                        y;                   /* Координата тайла по оси y. */
+  guint                        zoom;                /* Зум тайла. */
+  guint                        source_hash;         /* Хэш источника тайла. */
+  gboolean                     valid;               /* Признак того, что в ячейке нарисован тайл. */
+  gboolean                     filled;              /* Признак того, что тайл заполнен, а не заглушка. */
+} HyScanGtkMapBaseSlot;
+
 struct _HyScanGtkMapBasePrivate
 {
   HyScanGtkMap                *map;                 /* Виджет карты, на котором показываются тайлы. */
@@ -89,6 +121,7 @@ struct _HyScanGtkMapBasePrivate
   HyScanMapTileGrid           *tile_grid;           /* Тайловая сетка. */
 
   /* Кэш. */
+  HyScanMapTileCache          *tile_cache;          /* Общий кэш поверхностей тайлов. */
   HyScanCache                 *cache;               /* Кэш тайлов. */
   HyScanBuffer                *cache_buffer;        /* Буфер заголовка кэша данных для чтения. */
   HyScanBuffer                *tile_buffer;         /* Буфер данных поверхности тайла для чтения. */
@@ -96,10 +129,11 @@ struct _HyScanGtkMapBasePrivate
   GList                       *filled_buffer;       /* Список заполненных тайлов, которые можно нарисовать. */
   GMutex                       filled_lock;         /* Блокировка доступа к filled_buffer. */
 
-  /* Поверхность cairo с тайлами видимой области. */
+  /* Кольцевой буфер с тайлами видимой области. */
   cairo_surface_t             *surface;             /* Поверхность cairo с тайлами. */
-  gboolean                     surface_filled;      /* Признак того, что все тайлы заполнены. */
-  guint                        surface_hash;        /* Хэш источника тайлов на момент создания поверхности. */
+  HyScanGtkMapBaseSlot        *slots;               /* Ячейки поверхности. */
+  guint                        n_cols;              /* Число ячеек по горизонтали. */
+  guint                        n_rows;              /* Число ячеек по вертикали. */
   guint                        from_x;              /* Координата по оси x левого тайла. */
   guint                        to_x;                /* Координата по оси x правого тайла. */
   guint                        from_y;              /* Координата по оси y верхнего тайла. */
@@ -134,13 +168,30 @@ static gint                 hyscan_gtk_map_base_tile_compare             (HyScan
 static gboolean             hyscan_gtk_map_base_filled_buffer_flush      (HyScanGtkMapBase         *layer);
 static gboolean             hyscan_gtk_map_base_buffer_is_visible        (HyScanGtkMapBase         *layer);
 static void                 hyscan_gtk_map_base_get_cache_key            (HyScanMapTile            *tile,
-                                                                          gchar                    *key,
-                                                                          gsize                     key_length);
+                                                                          guint                     source_hash,
+                                                                          gchar                    *key);
+static cairo_surface_t *    hyscan_gtk_map_base_tile_lookup              (HyScanGtkMapBasePrivate  *priv,
+                                                                          HyScanMapTile            *tile);
+static void                 hyscan_gtk_map_base_draw_placeholder         (HyScanGtkMapBasePrivate  *priv,
+                                                                          cairo_t                  *cairo,
+                                                                          HyScanMapTile            *tile,
+                                                                          gdouble                   x_point,
+                                                                          gdouble                   y_point);
 static gboolean             hyscan_gtk_map_base_draw_tile                (HyScanGtkMapBasePrivate  *priv,
                                                                           cairo_t                  *cairo,
-                                                                          HyScanMapTile            *tile);
-static cairo_surface_t *    hyscan_gtk_map_base_surface_make             (HyScanGtkMapBasePrivate  *priv,
-                                                                          gboolean                 *filled);
+                                                                          HyScanMapTile            *tile,
+                                                                          gdouble                   x_point,
+                                                                          gdouble                   y_point,
+                                                                          gboolean                  placeholder);
+static gboolean             hyscan_gtk_map_base_refresh_slot             (HyScanGtkMapBasePrivate  *priv,
+                                                                          cairo_t                 **cairo,
+                                                                          guint                     x,
+                                                                          guint                     y,
+                                                                          guint                     source_hash);
+static void                 hyscan_gtk_map_base_surface_resize           (HyScanGtkMapBasePrivate  *priv,
+                                                                          guint                     n_cols,
+                                                                          guint                     n_rows);
+static void                 hyscan_gtk_map_base_surface_clear            (HyScanGtkMapBasePrivate  *priv);
 static guint                hyscan_gtk_map_base_get_optimal_zoom         (HyScanGtkMapBasePrivate  *priv);
 static gdouble              hyscan_gtk_map_base_get_scaling              (HyScanGtkMapBasePrivate  *priv,
                                                                           guint                     zoom);
@@ -152,6 +203,7 @@ static void                 hyscan_gtk_map_base_get_view                 (HyScan
                                                                           gint                     *to_tile_y);
 static gboolean             hyscan_gtk_map_base_cache_get                (HyScanGtkMapBasePrivate  *priv,
                                                                           HyScanBuffer             *buffer,
+                                                                          guint                     source_hash,
                                                                           HyScanMapTile            *tile);
 
 G_DEFINE_TYPE_WITH_CODE (HyScanGtkMapBase, hyscan_gtk_map_base, G_TYPE_INITIALLY_UNOWNED,
@@ -221,6 +273,7 @@ hyscan_gtk_map_base_object_constructed (GObject *object)
 
   priv->visible = TRUE;
 
+  priv->tile_cache = hyscan_map_tile_cache_get_default ();
   priv->cache_buffer = hyscan_buffer_new ();
   priv->tile_buffer = hyscan_buffer_new ();
 
@@ -234,10 +287,11 @@ hyscan_gtk_map_base_object_finalize (GObject *object)
   HyScanGtkMapBasePrivate *priv = gtk_map_base->priv;
 
   /* Освобождаем память. */
-  g_clear_pointer (&priv->surface, cairo_surface_destroy);
+  hyscan_gtk_map_base_surface_clear (priv);
   g_clear_object (&priv->map);
   g_clear_object (&priv->source);
-  g_object_unref (priv->cache);
+  g_object_unref (priv->tile_cache);
+  g_clear_object (&priv->cache);
   g_object_unref (priv->cache_buffer);
   g_object_unref (priv->tile_buffer);
   cairo_surface_destroy (priv->dummy_tile);
@@ -408,6 +462,7 @@ hyscan_gtk_map_base_create_dummy_tile (HyScanGtkMapBasePrivate *priv)
 /* Помещает в кэш информацию о тайле. */
 static void
 hyscan_gtk_map_base_cache_set (HyScanGtkMapBasePrivate *priv,
+                               guint                    source_hash,
                                HyScanMapTile           *tile)
 {
   HyScanBuffer *header_buffer;
@@ -416,7 +471,7 @@ hyscan_gtk_map_base_cache_set (HyScanGtkMapBasePrivate *priv,
   HyScanBuffer *data_buffer;
   const guint8 *data;
 
-  gchar cache_key[255];
+  gchar cache_key[CACHE_KEY_LENGTH];
 
   cairo_surface_t *surface;
 
@@ -440,7 +495,7 @@ hyscan_gtk_map_base_cache_set (HyScanGtkMapBasePrivate *priv,
   hyscan_buffer_wrap (data_buffer, HYSCAN_DATA_BLOB, (gpointer) data, header.size);
 
   /* Помещаем все данные в кэш. */
-  hyscan_gtk_map_base_get_cache_key (tile, cache_key, sizeof (cache_key));
+  hyscan_gtk_map_base_get_cache_key (tile, source_hash, cache_key);
   hyscan_cache_set2 (priv->cache, cache_key, NULL, header_buffer, data_buffer);
 
   cairo_surface_destroy (surface);
@@ -519,17 +574,31 @@ hyscan_gtk_map_base_load (HyScanMapTile    *tile,
 {
   HyScanGtkMapBasePrivate *priv = layer->priv;
   HyScanMapTileSource *source;
+  gboolean filled = FALSE;
+  guint source_hash;
 
   source = g_object_get_data (G_OBJECT (tile), DATA_KEY_SOURCE);
   if (source == NULL)
     return;
 
+  source_hash = hyscan_map_tile_source_hash (source);
+
+  /* Тайл мог быть уже загружен другим слоем с тем же источником. */
+  if (hyscan_map_tile_cache_get (priv->tile_cache, source_hash, tile))
+    {
+      filled = TRUE;
+    }
+  else if (hyscan_map_tile_source_fill (source, tile, cancellable))
+    {
+      filled = TRUE;
+      hyscan_map_tile_cache_set (priv->tile_cache, source_hash, tile);
+      hyscan_gtk_map_base_cache_set (priv, source_hash, tile);
+    }
+
   /* Если удалось заполнить новый тайл, то запрашиваем обновление области
    * виджета с новым тайлом. */
-  if (hyscan_map_tile_source_fill (source, tile, cancellable))
+  if (filled)
     {
-      hyscan_gtk_map_base_cache_set (priv, tile);
-
       /* Добавляем тайл в буфер заполненных тайлов. */
       g_mutex_lock (&priv->filled_lock);
       priv->filled_buffer = g_list_append (priv->filled_buffer, g_object_ref (tile));
@@ -540,39 +609,36 @@ hyscan_gtk_map_base_load (HyScanMapTile    *tile,
     }
 }
 
-/* Устанавливает ключ кэширования для тайла @tile. */
+/* Устанавливает ключ кэширования для тайла @tile. Ключ фиксированной длины
+ * CACHE_KEY_LENGTH формируется из двоичного ключа тайла без форматирования строк. */
 static void
 hyscan_gtk_map_base_get_cache_key (HyScanMapTile *tile,
-                                   gchar         *key,
-                                   gsize          key_length)
+                                   guint          source_hash,
+                                   gchar         *key)
 {
-  HyScanMapTileSource *source;
+  HyScanMapTileKey tile_key;
 
-  source = g_object_get_data (G_OBJECT (tile), DATA_KEY_SOURCE);
-  g_snprintf (key, key_length,
-              "HyScanGtkMapBase.t.%u.%u.%u.%u.%u",
-              hyscan_map_tile_get_zoom (tile),
-              hyscan_map_tile_get_x (tile),
-              hyscan_map_tile_get_y (tile),
-              hyscan_map_tile_get_size (tile),
-              hyscan_map_tile_source_hash (source));
+  hyscan_map_tile_key_init (&tile_key, source_hash, tile);
+  memcpy (key, CACHE_KEY_PREFIX, sizeof (CACHE_KEY_PREFIX) - 1);
+  hyscan_map_tile_key_to_string (&tile_key, key + sizeof (CACHE_KEY_PREFIX) - 1);
 }
 
 /* Функция проверяет кэш на наличие данных и считывает их в буфер tile_buffer. */
 static gboolean
 hyscan_gtk_map_base_cache_get (HyScanGtkMapBasePrivate *priv,
                                HyScanBuffer            *tile_buffer,
+                               guint                    source_hash,
                                HyScanMapTile           *tile)
 {
   HyScanGtkMapBaseCacheHeader header;
 
-  gchar cache_key[255];
+  gchar cache_key[CACHE_KEY_LENGTH];
 
   if (priv->cache == NULL)
     return FALSE;
 
   /* Формируем ключ кэшированных данных. */
-  hyscan_gtk_map_base_get_cache_key (tile, cache_key, sizeof (cache_key));
+  hyscan_gtk_map_base_get_cache_key (tile, source_hash, cache_key);
 
   /* Ищем данные в кэше. */
   hyscan_buffer_wrap (priv->cache_buffer, HYSCAN_DATA_BLOB, &header, sizeof (header));
@@ -631,62 +697,176 @@ hyscan_gtk_map_base_get_optimal_zoom (HyScanGtkMapBasePrivate *priv)
   return hyscan_map_tile_grid_adjust_zoom (priv->tile_grid, 1 / scale);
 }
 
-/* Риусет тайл (x, y) в контексте cairo. */
-static gboolean
-hyscan_gtk_map_base_draw_tile (HyScanGtkMapBasePrivate *priv,
-                               cairo_t                 *cairo,
-                               HyScanMapTile           *tile)
+/* Ищет изображение тайла в кэшах в памяти. Возвращает поверхность, которую
+ * следует освободить, или %NULL, если тайл ещё не загружен. */
+static cairo_surface_t *
+hyscan_gtk_map_base_tile_lookup (HyScanGtkMapBasePrivate *priv,
+                                 HyScanMapTile           *tile)
 {
   cairo_surface_t *surface;
-
+  guchar *cached_data;
+  guint32 size;
   guint tile_size;
-  gboolean hit;
+  guint source_hash;
 
-  guint x0, y0, x, y;
-  gdouble x_point, y_point;
+  /* Если в общем кэше найдена поверхность, то используем её без копирования. */
+  source_hash = hyscan_map_tile_source_hash (priv->source);
+  if (hyscan_map_tile_cache_get (priv->tile_cache, source_hash, tile))
+    {
+      surface = hyscan_map_tile_get_surface (tile);
+      hyscan_map_tile_set_surface (tile, NULL);
+
+      return surface;
+    }
+
+  /* Иначе ищем пиксельные данные в кэше HyScanCache. */
+  if (!hyscan_gtk_map_base_cache_get (priv, priv->tile_buffer, source_hash, tile))
+    return NULL;
+
+  cached_data = hyscan_buffer_get (priv->tile_buffer, NULL, &size);
+
+  /* Копируем данные в собственную поверхность и помещаем её в общий кэш,
+   * чтобы следующие отрисовки тайла обходились без копирования. */
+  tile_size = hyscan_map_tile_get_size (tile);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tile_size, tile_size);
+  if (size != (guint32) cairo_image_surface_get_stride (surface) * tile_size)
+    {
+      cairo_surface_destroy (surface);
+      return NULL;
+    }
+
+  cairo_surface_flush (surface);
+  memcpy (cairo_image_surface_get_data (surface), cached_data, size);
+  cairo_surface_mark_dirty (surface);
+
+  hyscan_map_tile_set_surface (tile, surface);
+  hyscan_map_tile_cache_set (priv->tile_cache, source_hash, tile);
+  hyscan_map_tile_set_surface (tile, NULL);
+
+  return surface;
+}
+
+/* Рисует заглушку для незагруженного тайла: увеличенный фрагмент ближайшего
+ * загруженного тайла-предка, а если его нет - уменьшенные дочерние тайлы
+ * поверх тайла в клеточку. */
+static void
+hyscan_gtk_map_base_draw_placeholder (HyScanGtkMapBasePrivate *priv,
+                                      cairo_t                 *cairo,
+                                      HyScanMapTile           *tile,
+                                      gdouble                  x_point,
+                                      gdouble                  y_point)
+{
+  cairo_surface_t *surface;
+  guint x, y, zoom, tile_size;
+  guint depth, i;
 
-  x0 = priv->from_x;
-  y0 = priv->from_y;
   x = hyscan_map_tile_get_x (tile);
   y = hyscan_map_tile_get_y (tile);
+  zoom = hyscan_map_tile_get_zoom (tile);
   tile_size = hyscan_map_tile_get_size (tile);
 
-  /* Если в кэше найдена поверхность, то устанавливаем её. */
-  hit = hyscan_gtk_map_base_cache_get (priv, priv->tile_buffer, tile);
-  if (hit)
+  /* Ближайший предок: тайл зума (zoom - depth) содержит квадрат 2^depth x 2^depth тайлов. */
+  for (depth = 1; depth <= PLACEHOLDER_DEPTH && depth <= zoom; depth++)
     {
-      guchar *cached_data;
-      guint32 size;
+      HyScanMapTile *parent;
+      guint scale;
+      gdouble cell_size;
 
-      cached_data = hyscan_buffer_get (priv->tile_buffer, NULL, &size);
-      hyscan_map_tile_set_surface_data (tile, cached_data, size);
-      surface = hyscan_map_tile_get_surface (tile);
+      parent = hyscan_map_tile_new (priv->tile_grid, x >> depth, y >> depth, zoom - depth);
+      g_object_set_data_full (G_OBJECT (parent), DATA_KEY_SOURCE, g_object_ref (priv->source), g_object_unref);
+      surface = hyscan_gtk_map_base_tile_lookup (priv, parent);
+      g_object_unref (parent);
+
+      if (surface == NULL)
+        continue;
+
+      scale = 1u << depth;
+      cell_size = (gdouble) tile_size / scale;
+
+      cairo_save (cairo);
+      cairo_translate (cairo, x_point, y_point);
+      cairo_scale (cairo, scale, scale);
+      cairo_set_source_surface (cairo, surface, -cell_size * (x % scale), -cell_size * (y % scale));
+      cairo_pattern_set_extend (cairo_get_source (cairo), CAIRO_EXTEND_PAD);
+      cairo_rectangle (cairo, 0, 0, cell_size, cell_size);
+      cairo_fill (cairo);
+      cairo_restore (cairo);
+
+      cairo_surface_destroy (surface);
+
+      return;
     }
-  else
+
+  /* Тайл в клеточку, поверх которого рисуются найденные дочерние тайлы. */
+  cairo_set_source_surface (cairo, priv->dummy_tile, x_point, y_point);
+  cairo_rectangle (cairo, x_point, y_point, tile_size, tile_size);
+  cairo_fill (cairo);
+
+  for (i = 0; i < 4; i++)
     {
-      surface = cairo_surface_reference (priv->dummy_tile);
-    }
+      HyScanMapTile *child;
+
+      child = hyscan_map_tile_new (priv->tile_grid, 2 * x + i % 2, 2 * y + i / 2, zoom + 1);
+      g_object_set_data_full (G_OBJECT (child), DATA_KEY_SOURCE, g_object_ref (priv->source), g_object_unref);
+      surface = hyscan_gtk_map_base_tile_lookup (priv, child);
+      g_object_unref (child);
 
-  x_point = (x - x0) * tile_size;
-  y_point = (y - y0) * tile_size;
+      if (surface == NULL)
+        continue;
 
-  cairo_set_source_surface (cairo, surface, x_point, y_point);
-  cairo_paint (cairo);
+      cairo_save (cairo);
+      cairo_translate (cairo, x_point + 0.5 * tile_size * (i % 2), y_point + 0.5 * tile_size * (i / 2));
+      cairo_scale (cairo, 0.5, 0.5);
+      cairo_set_source_surface (cairo, surface, 0, 0);
+      cairo_rectangle (cairo, 0, 0, tile_size, tile_size);
+      cairo_fill (cairo);
+      cairo_restore (cairo);
 
-  cairo_surface_destroy (surface);
+      cairo_surface_destroy (surface);
+    }
+}
 
-  /* Убираем поверхность из тайла, т.к. поверхность использует память внутри priv->tile_buffer,
-   * которая может быть повторно использована. */
-  hyscan_map_tile_set_surface (tile, NULL);
+/* Рисует тайл в ячейке с левым верхним углом (x_point, y_point), заменяя её содержимое.
+ * Если тайл не загружен и placeholder = %TRUE, то рисует заглушку. Возвращает %TRUE,
+ * если тайл был найден. */
+static gboolean
+hyscan_gtk_map_base_draw_tile (HyScanGtkMapBasePrivate *priv,
+                               cairo_t                 *cairo,
+                               HyScanMapTile           *tile,
+                               gdouble                  x_point,
+                               gdouble                  y_point,
+                               gboolean                 placeholder)
+{
+  cairo_surface_t *surface;
+  guint tile_size;
+  gboolean hit;
+
+  tile_size = hyscan_map_tile_get_size (tile);
+  surface = hyscan_gtk_map_base_tile_lookup (priv, tile);
+  hit = (surface != NULL);
+
+  cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+  if (hit)
+    {
+      cairo_set_source_surface (cairo, surface, x_point, y_point);
+      cairo_rectangle (cairo, x_point, y_point, tile_size, tile_size);
+      cairo_fill (cairo);
+      cairo_surface_destroy (surface);
+    }
+  else if (placeholder)
+    {
+      hyscan_gtk_map_base_draw_placeholder (priv, cairo, tile, x_point, y_point);
+    }
 
 #ifdef HYSCAN_GTK_MAP_BASE_DEBUG
   /* Номер тайла для отладки. */
   {
     gchar label[255];
 
-    cairo_move_to (cairo, (x - x0 + 0.5) * tile_size, (y - y0 + 0.5) * tile_size);
+    cairo_set_operator (cairo, CAIRO_OPERATOR_OVER);
+    cairo_move_to (cairo, x_point + 0.5 * tile_size, y_point + 0.5 * tile_size);
     cairo_set_source_rgba (cairo, 0, 0, 0, 0.5);
-    g_snprintf (label, sizeof (label), "%d, %d", x, y);
+    g_snprintf (label, sizeof (label), "%d, %d", hyscan_map_tile_get_x (tile), hyscan_map_tile_get_y (tile));
     cairo_show_text (cairo, label);
     cairo_rectangle (cairo, x_point, y_point, tile_size, tile_size);
     cairo_set_line_width (cairo, 1.0);
@@ -697,55 +877,120 @@ hyscan_gtk_map_base_draw_tile (HyScanGtkMapBasePrivate *priv,
   return hit;
 }
 
-/* Создаёт новую поверхность cairo с тайлами
- * и устанавливает filled = TRUE, если все тайлы заполнены. */
-static cairo_surface_t *
-hyscan_gtk_map_base_surface_make (HyScanGtkMapBasePrivate *priv,
-                                  gboolean                *filled)
+/* Удаляет кольцевой буфер тайлов. */
+static void
+hyscan_gtk_map_base_surface_clear (HyScanGtkMapBasePrivate *priv)
+{
+  g_clear_pointer (&priv->surface, cairo_surface_destroy);
+  g_clear_pointer (&priv->slots, g_free);
+  priv->n_cols = 0;
+  priv->n_rows = 0;
+}
+
+/* Создаёт кольцевой буфер размером n_cols x n_rows тайлов и переносит в него
+ * тайлы текущей области из старого буфера. */
+static void
+hyscan_gtk_map_base_surface_resize (HyScanGtkMapBasePrivate *priv,
+                                    guint                    n_cols,
+                                    guint                    n_rows)
 {
-  HyScanMapTileIter iter;
-  guint x, y;
   cairo_surface_t *surface;
+  HyScanGtkMapBaseSlot *slots;
   cairo_t *cairo;
+  guint tile_size = priv->tile_size;
+  guint i;
 
-  gboolean filled_ret = TRUE;
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, n_cols * tile_size, n_rows * tile_size);
+  slots = g_new0 (HyScanGtkMapBaseSlot, n_cols * n_rows);
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-                                        (priv->to_x - priv->from_x + 1) * priv->tile_size,
-                                        (priv->to_y - priv->from_y + 1) * priv->tile_size);
+  /* Ширина области не превышает n_cols, поэтому тайлы области попадают в разные ячейки. */
   cairo = cairo_create (surface);
-
-  /* Отрисовываем все тайлы, которые находятся в видимой области */
-  hyscan_map_tile_iter_init (&iter, priv->from_x, priv->to_x, priv->from_y, priv->to_y);
-  while (hyscan_map_tile_iter_next (&iter, &x, &y))
+  cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+  for (i = 0; priv->surface != NULL && i < priv->n_cols * priv->n_rows; i++)
     {
-      HyScanMapTile *tile;
-      gboolean tile_filled;
-      
-      tile = hyscan_map_tile_new (priv->tile_grid, x, y, priv->zoom);
-      g_object_set_data_full (G_OBJECT (tile), DATA_KEY_SOURCE, g_object_ref (priv->source), g_object_unref);
+      HyScanGtkMapBaseSlot *slot = &priv->slots[i];
+      guint col, row;
+
+      if (!slot->valid || slot->zoom != priv->zoom ||
+          slot->x < priv->from_x || slot->x > priv->to_x ||
+          slot->y < priv->from_y || slot->y > priv->to_y)
+        {
+          continue;
+        }
+
+      col = slot->x % n_cols;
+      row = slot->y % n_rows;
+      slots[row * n_cols + col] = *slot;
+
+      cairo_set_source_surface (cairo, priv->surface,
+                                ((gdouble) col - i % priv->n_cols) * tile_size,
+                                ((gdouble) row - i / priv->n_cols) * tile_size);
+      cairo_rectangle (cairo, col * tile_size, row * tile_size, tile_size, tile_size);
+      cairo_fill (cairo);
+    }
+  cairo_destroy (cairo);
 
-      /* Тайл не найден, добавляем его в очередь на загрузку. */
-      tile_filled = hyscan_gtk_map_base_draw_tile (priv, cairo, tile);
-      if (!tile_filled)
-        hyscan_task_queue_push (priv->task_queue, G_OBJECT (tile));
+  hyscan_gtk_map_base_surface_clear (priv);
+  priv->surface = surface;
+  priv->slots = slots;
+  priv->n_cols = n_cols;
+  priv->n_rows = n_rows;
+}
 
-      filled_ret = filled_ret && tile_filled;
+/* Рисует тайл (x, y) текущего зума в его ячейке кольцевого буфера, если он там ещё
+ * не нарисован, и ставит незагруженный тайл в очередь. Контекст рисования *cairo
+ * создаётся при первой необходимости. */
+static gboolean
+hyscan_gtk_map_base_refresh_slot (HyScanGtkMapBasePrivate  *priv,
+                                  cairo_t                 **cairo,
+                                  guint                     x,
+                                  guint                     y,
+                                  guint                     source_hash)
+{
+  HyScanGtkMapBaseSlot *slot;
+  HyScanMapTile *tile;
+  gboolean same_tile;
+  guint col, row;
 
-      g_object_unref (tile);
-    }
+  col = x % priv->n_cols;
+  row = y % priv->n_rows;
+  slot = &priv->slots[row * priv->n_cols + col];
 
-  /* Запускаем обработку сформированной очереди. */
-  hyscan_task_queue_push_end (priv->task_queue);
+  same_tile = slot->valid && slot->x == x && slot->y == y &&
+              slot->zoom == priv->zoom && slot->source_hash == source_hash;
 
-  cairo_destroy (cairo);
+  /* Тайл уже нарисован в своей ячейке. */
+  if (same_tile && slot->filled)
+    return FALSE;
 
-  *filled = filled_ret;
-  return surface;
+  if (*cairo == NULL)
+    *cairo = cairo_create (priv->surface);
+
+  tile = hyscan_map_tile_new (priv->tile_grid, x, y, priv->zoom);
+  g_object_set_data_full (G_OBJECT (tile), DATA_KEY_SOURCE, g_object_ref (priv->source), g_object_unref);
+
+  /* Заглушка рисуется один раз, до появления самого тайла ячейка не перерисовывается. */
+  slot->x = x;
+  slot->y = y;
+  slot->zoom = priv->zoom;
+  slot->source_hash = source_hash;
+  slot->valid = TRUE;
+  slot->filled = hyscan_gtk_map_base_draw_tile (priv, *cairo, tile,
+                                                col * priv->tile_size, row * priv->tile_size,
+                                                !same_tile);
+
+  /* Тайл не найден, добавляем его в очередь на загрузку. */
+  if (!slot->filled)
+    hyscan_task_queue_push (priv->task_queue, G_OBJECT (tile));
+
+  g_object_unref (tile);
+
+  return TRUE;
 }
 
-/* Обновляет поверхность cairo, чтобы она содержала запрошенную область с тайлами.
- * Возвращает %TRUE, если поверхность была перерисована. */
+/* Обновляет кольцевой буфер, чтобы он содержал запрошенную область с тайлами.
+ * Рисуются только тайлы, которых ещё нет в буфере или которые ещё не заполнены.
+ * Возвращает %TRUE, если в буфере был нарисован хотя бы один тайл. */
 static gboolean
 hyscan_gtk_map_base_refresh_surface (HyScanGtkMapBasePrivate *priv,
                                      guint                    x0,
@@ -754,36 +999,56 @@ hyscan_gtk_map_base_refresh_surface (HyScanGtkMapBasePrivate *priv,
                                      guint                    yn,
                                      guint                    zoom)
 {
-  gboolean source_retained;
+  HyScanMapTileIter iter;
+  cairo_t *cairo = NULL;
+  guint source_hash;
+  guint n_cols, n_rows;
+  guint x, y;
 
   g_return_val_if_fail (x0 <= xn && y0 <= yn, FALSE);
 
   priv->scale = hyscan_gtk_map_base_get_scaling (priv, zoom);
+  source_hash = hyscan_map_tile_source_hash (priv->source);
 
-  /* Источник тайлов с момента создания поверхности подложки не изменился. */
-  source_retained = hyscan_map_tile_source_hash (priv->source) == priv->surface_hash;
-
-  /* Если нужный регион уже отрисован, то ничего не делаем. */
-  if (priv->surface_filled &&
-      source_retained &&
-      priv->from_x <= x0 && priv->to_x >= xn &&
-      priv->from_y <= y0 && priv->to_y >= yn &&
-      priv->zoom == zoom)
-    {
-      return FALSE;
-    }
-
-  /* Устанавливаем новые размеры поверхности с запасом preload_margin. */
+  /* Область тайлов с запасом preload_margin. */
   priv->from_x = CLAMP_TILE (x0 - priv->preload_margin, zoom);
   priv->to_x = CLAMP_TILE (xn + priv->preload_margin, zoom);
   priv->from_y = CLAMP_TILE (y0 - priv->preload_margin, zoom);
   priv->to_y = CLAMP_TILE (yn + priv->preload_margin, zoom);
   priv->zoom = zoom;
 
-  /* Рисуем все нужные тайлы в их исходном размере. */
-  g_clear_pointer (&priv->surface, cairo_surface_destroy);
-  priv->surface = hyscan_gtk_map_base_surface_make (priv, &priv->surface_filled);
-  priv->surface_hash = hyscan_map_tile_source_hash (priv->source);
+  /* Буфер должен вмещать всю область, но не быть намного больше неё. */
+  n_cols = priv->to_x - priv->from_x + 1;
+  n_rows = priv->to_y - priv->from_y + 1;
+  if (priv->surface == NULL ||
+      n_cols > priv->n_cols || n_rows > priv->n_rows ||
+      2 * n_cols < priv->n_cols || 2 * n_rows < priv->n_rows)
+    {
+      hyscan_gtk_map_base_surface_resize (priv, n_cols, n_rows);
+    }
+
+  /* Сначала обрабатываем видимые тайлы, затем тайлы запаса вокруг видимой области.
+   * В обоих случаях обход идёт от центра к краям, поэтому центральные тайлы
+   * раньше попадают в очередь загрузки. */
+  hyscan_map_tile_iter_init (&iter, x0, xn, y0, yn);
+  while (hyscan_map_tile_iter_next (&iter, &x, &y))
+    hyscan_gtk_map_base_refresh_slot (priv, &cairo, x, y, source_hash);
+
+  hyscan_map_tile_iter_init (&iter, priv->from_x, priv->to_x, priv->from_y, priv->to_y);
+  while (hyscan_map_tile_iter_next (&iter, &x, &y))
+    {
+      if (x0 <= x && x <= xn && y0 <= y && y <= yn)
+        continue;
+
+      hyscan_gtk_map_base_refresh_slot (priv, &cairo, x, y, source_hash);
+    }
+
+  if (cairo == NULL)
+    return FALSE;
+
+  /* Запускаем обработку сформированной очереди. */
+  hyscan_task_queue_push_end (priv->task_queue);
+  cairo_destroy (cairo);
 
   return TRUE;
 }
@@ -862,17 +1127,26 @@ hyscan_gtk_map_base_draw (HyScanGtkMapBase *layer,
     /* Переводим в коордианты для рисования. */
     gtk_cifro_area_visible_value_to_point (GTK_CIFRO_AREA (priv->map), &xs, &ys, x_val, y_val);
 
-    /* Определяем матрицу преобразований буфера. */
-    cairo_matrix_init_scale (&matrix, 1.0 / priv->scale, 1.0 / priv->scale);
+    /* Определяем матрицу преобразований буфера. Левый верхний тайл области
+     * находится в ячейке (from_x mod n_cols, from_y mod n_rows). */
+    cairo_matrix_init_translate (&matrix,
+                                 (priv->from_x % priv->n_cols) * priv->tile_size,
+                                 (priv->from_y % priv->n_rows) * priv->tile_size);
+    cairo_matrix_scale (&matrix, 1.0 / priv->scale, 1.0 / priv->scale);
     cairo_matrix_translate (&matrix, -xs, -ys);
 
-    /* Переносим буфер на поверхность CifroArea. Используем быстрый фильтр CAIRO_FILTER_BILINEAR. */
+    /* Переносим буфер на поверхность CifroArea. Используем быстрый фильтр CAIRO_FILTER_BILINEAR.
+     * Повторение буфера восстанавливает порядок тайлов, а прямоугольник ограничивает его областью. */
     pattern = cairo_pattern_create_for_surface (priv->surface);
     cairo_pattern_set_matrix (pattern, &matrix);
     cairo_pattern_set_filter (pattern, CAIRO_FILTER_BILINEAR);
+    cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
 
     cairo_set_source (cairo, pattern);
-    cairo_paint (cairo);
+    cairo_rectangle (cairo, xs, ys,
+                     (priv->to_x - priv->from_x + 1) * priv->tile_size * priv->scale,
+                     (priv->to_y - priv->from_y + 1) * priv->tile_size * priv->scale);
+    cairo_fill (cairo);
     cairo_pattern_destroy (pattern);
   }
 
@@ -937,6 +1211,9 @@ hyscan_gtk_map_base_set_source (HyScanGtkMapBase    *base,
   g_clear_object (&priv->tile_grid);
   g_clear_pointer (&priv->dummy_tile, cairo_surface_destroy);
 
+  /* Размер тайлов нового источника может отличаться. */
+  hyscan_gtk_map_base_surface_clear (priv);
+
   priv->source = g_object_ref (source);
   priv->tile_grid = hyscan_map_tile_source_get_grid (priv->source);
   priv->tile_size = hyscan_map_tile_grid_get_tile_size (priv->tile_grid);
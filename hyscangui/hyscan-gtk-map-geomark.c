@@ -54,9 +54,11 @@
 #include "hyscan-gtk-map-geomark.h"
 #include "hyscan-gtk-map.h"
 #include "hyscan-gtk-layer-param.h"
+#include "hyscan-map-rtree.h"
 #include <hyscan-cartesian.h>
 
 #define HOVER_RADIUS            7                             /* Радиус хэндла. */
+#define DRAW_MARGIN             200                           /* Отступ от видимой области, в котором ещё рисуются метки, пикс. */
 #define DEFAULT_LINE_WIDTH      1.0                           /* Толщина линии контура метки. */
 #define DEFAULT_COLOR           "#B25D43"                     /* Цвет контура метки. */
 #define DEFAULT_HOVER_COLOR     "#9443B2"                     /* Цвет контура метки при наведении мыши. */
@@ -93,6 +95,32 @@ typedef struct
   gboolean               pending;   /* Признак того, что метка обрабатывается. */
 } HyScanGtkMapGeomarkLocation;
 
+/* Параметры поиска хэндла под курсором мыши. */
+typedef struct
+{
+  HyScanGeoCartesian2D   cursor;       /* Координаты курсора. */
+  gdouble                max_dist;     /* Максимальное расстояние до хэндла. */
+  gdouble                handle_dist;  /* Расстояние до найденного хэндла. */
+  guint                  handle_mode;  /* Режим найденного хэндла. */
+  HyScanGeoCartesian2D   handle_point; /* Координаты найденного хэндла. */
+  const gchar           *handle_id;    /* Идентификатор метки найденного хэндла. */
+} HyScanGtkMapGeomarkHandleSearch;
+
+/* Параметры поиска метки под курсором мыши. */
+typedef struct
+{
+  HyScanGeoCartesian2D               cursor;       /* Координаты курсора. */
+  const HyScanGtkMapGeomarkLocation *hover;        /* Найденная метка. */
+  gdouble                            min_distance; /* Расстояние от курсора до центра найденной метки. */
+} HyScanGtkMapGeomarkHoverSearch;
+
+/* Параметры рисования меток, найденных в пространственном индексе. */
+typedef struct
+{
+  HyScanGtkMapGeomark   *gm_layer;     /* Слой. */
+  cairo_t               *cairo;        /* Контекст рисования. */
+} HyScanGtkMapGeomarkDrawFound;
+
 struct _HyScanGtkMapGeomarkPrivate
 {
   HyScanGtkMap                            *map;                /* Карта. */
@@ -102,6 +130,7 @@ struct _HyScanGtkMapGeomarkPrivate
 
   GRWLock                                  mark_lock;          /* Блокировка доступа к меткам. */
   GHashTable                              *marks;              /* Список меток на слое. */
+  HyScanMapRTree                          *rtree;              /* Пространственный индекс меток. */
   gint                                     count;              /* Счётчик количества меток. */
 
   guint                                    mode;               /* Режим работы слоя (тип взаимодействия). */
@@ -200,6 +229,7 @@ hyscan_gtk_map_geomark_object_constructed (GObject *object)
   g_rw_lock_init (&priv->mark_lock);
   priv->marks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                        (GDestroyNotify) hyscan_gtk_map_geomark_location_free);
+  priv->rtree = hyscan_map_rtree_new ();
 
   /* Параметры оформления. */
   priv->param = hyscan_gtk_layer_param_new ();
@@ -229,6 +259,7 @@ hyscan_gtk_map_geomark_object_finalize (GObject *object)
   g_free (priv->hover_id);
   g_free (priv->hover_candidate_id);
   g_free (priv->active_mark_id);
+  g_clear_object (&priv->rtree);
   g_clear_pointer (&priv->marks, g_hash_table_destroy);
   g_clear_object (&priv->pango_layout);
   g_clear_object (&priv->param);
@@ -262,6 +293,28 @@ hyscan_gtk_map_geomark_location_copy (HyScanGtkMapGeomarkLocation *location)
   return copy;
 }
 
+/* Находит координаты вершин прямоугольника метки по её центру и размерам. */
+static void
+hyscan_gtk_map_geomark_location_corners (HyScanGtkMapGeomarkLocation *location)
+{
+  gdouble width2, height2;
+
+  width2 = location->width / 2.0;
+  height2 = location->height / 2.0;
+
+  location->corner[0].x = location->c2d.x - width2;
+  location->corner[0].y = location->c2d.y - height2;
+
+  location->corner[1].x = location->c2d.x + width2;
+  location->corner[1].y = location->c2d.y - height2;
+
+  location->corner[2].x = location->c2d.x + width2;
+  location->corner[2].y = location->c2d.y + height2;
+
+  location->corner[3].x = location->c2d.x - width2;
+  location->corner[3].y = location->c2d.y + height2;
+}
+
 /* Проецирует метку на карту.
  * Функция должна вызываться за g_rw_lock_writer_lock (&priv->mark_lock). */
 static void
@@ -271,7 +324,6 @@ hyscan_gtk_map_geomark_project_location (HyScanGtkMapGeomark         *layer,
   HyScanGtkMapGeomarkPrivate *priv = layer->priv;
   HyScanMarkGeo *mark = location->mark;
   gdouble scale;
-  gdouble width2, height2;
 
   if (priv->map == NULL)
     return;
@@ -283,21 +335,40 @@ hyscan_gtk_map_geomark_project_location (HyScanGtkMapGeomark         *layer,
 
   /* Находим координаты центра и вершин прямоугольника. */
   hyscan_gtk_map_geo_to_value (priv->map, mark->center, &location->c2d);
+  hyscan_gtk_map_geomark_location_corners (location);
+}
 
-  width2 = location->width / 2.0;
-  height2 = location->height / 2.0;
+/* Обновляет положение метки в пространственном индексе.
+ * Функция должна вызываться за g_rw_lock_writer_lock (&priv->mark_lock). */
+static void
+hyscan_gtk_map_geomark_index_location (HyScanGtkMapGeomark         *layer,
+                                       HyScanGtkMapGeomarkLocation *location)
+{
+  HyScanGtkMapGeomarkPrivate *priv = layer->priv;
 
-  location->corner[0].x = location->c2d.x - width2;
-  location->corner[0].y = location->c2d.y - height2;
+  if (priv->map == NULL)
+    return;
 
-  location->corner[1].x = location->c2d.x + width2;
-  location->corner[1].y = location->c2d.y - height2;
+  hyscan_map_rtree_insert (priv->rtree, location, &location->corner[0], &location->corner[2]);
+}
 
-  location->corner[2].x = location->c2d.x + width2;
-  location->corner[2].y = location->c2d.y + height2;
+/* Пересчитывает координаты всех меток и заново строит пространственный индекс.
+ * Функция должна вызываться за g_rw_lock_writer_lock (&priv->mark_lock). */
+static void
+hyscan_gtk_map_geomark_reindex (HyScanGtkMapGeomark *layer)
+{
+  HyScanGtkMapGeomarkPrivate *priv = layer->priv;
+  GHashTableIter iter;
+  HyScanGtkMapGeomarkLocation *location;
 
-  location->corner[3].x = location->c2d.x - width2;
-  location->corner[3].y = location->c2d.y + height2;
+  hyscan_map_rtree_clear (priv->rtree);
+
+  g_hash_table_iter_init (&iter, priv->marks);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
+    {
+      hyscan_gtk_map_geomark_project_location (layer, location);
+      hyscan_gtk_map_geomark_index_location (layer, location);
+    }
 }
 
 /* Добавляет метку в список меток слоя.
@@ -310,13 +381,41 @@ hyscan_gtk_map_geomark_insert_mark (gpointer key,
   HyScanGtkMapGeomark *gm_layer = HYSCAN_GTK_MAP_GEOMARK (user_data);
   HyScanGtkMapGeomarkPrivate *priv = gm_layer->priv;
   HyScanGtkMapGeomarkLocation *location;
+  HyScanGeoCartesian2D from, to;
 
-  location = g_slice_new0 (HyScanGtkMapGeomarkLocation);
+  location = g_hash_table_lookup (priv->marks, key);
+
+  /* Новая метка или метка, которую сохраняет пользователь. */
+  if (location == NULL || location->pending)
+    {
+      if (location != NULL)
+        hyscan_map_rtree_remove (priv->rtree, location);
+
+      location = g_slice_new0 (HyScanGtkMapGeomarkLocation);
+      location->mark = value;
+      location->mark_id = g_strdup (key);
+
+      hyscan_gtk_map_geomark_project_location (gm_layer, location);
+      hyscan_gtk_map_geomark_index_location (gm_layer, location);
+      g_hash_table_insert (priv->marks, key, location);
+
+      return TRUE;
+    }
+
+  /* Существующая метка: заменяем данные, а индекс обновляем, только если метка сдвинулась. */
+  from = location->corner[0];
+  to = location->corner[2];
+
+  hyscan_mark_geo_free (location->mark);
   location->mark = value;
-  location->mark_id = g_strdup (key);
+  g_free (key);
 
   hyscan_gtk_map_geomark_project_location (gm_layer, location);
-  g_hash_table_insert (priv->marks, key, location);
+  if (from.x != location->corner[0].x || from.y != location->corner[0].y ||
+      to.x != location->corner[2].x || to.y != location->corner[2].y)
+    {
+      hyscan_gtk_map_geomark_index_location (gm_layer, location);
+    }
 
   return TRUE;
 }
@@ -331,7 +430,24 @@ hyscan_gtk_map_geomark_model_changed (HyScanGtkMapGeomark *gm_layer)
 
   g_rw_lock_writer_lock (&priv->mark_lock);
 
-  g_hash_table_remove_all (priv->marks);
+  /* Удаляем метки, которых больше нет в модели. */
+  {
+    GHashTableIter iter;
+    gchar *mark_id;
+    HyScanGtkMapGeomarkLocation *location;
+
+    g_hash_table_iter_init (&iter, priv->marks);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &mark_id, (gpointer *) &location))
+      {
+        if (g_hash_table_contains (marks, mark_id))
+          continue;
+
+        hyscan_map_rtree_remove (priv->rtree, location);
+        g_hash_table_iter_remove (&iter);
+      }
+  }
+
+  /* Добавляем новые и обновляем изменённые метки. */
   g_hash_table_foreach_steal (marks, hyscan_gtk_map_geomark_insert_mark, gm_layer);
   priv->count = g_hash_table_size (priv->marks);
 
@@ -436,6 +552,43 @@ hyscan_gtk_map_geomark_draw_location (HyScanGtkMapGeomark         *gm_layer,
   cairo_restore (cairo);
 }
 
+/* Проверяет хэндлы метки, найденной в пространственном индексе. */
+static void
+hyscan_gtk_map_geomark_handle_check (gpointer item,
+                                     gpointer user_data)
+{
+  HyScanGtkMapGeomarkHandleSearch *search = user_data;
+  HyScanGtkMapGeomarkLocation *location = item;
+  gsize i;
+  gdouble dist;
+
+  if (location->pending)
+    return;
+
+  dist = hyscan_cartesian_distance (&location->c2d, &search->cursor);
+  if (dist < search->max_dist && dist < search->handle_dist)
+    {
+      search->handle_dist = dist;
+      search->handle_mode = MODE_DRAG;
+      search->handle_id = location->mark_id;
+      search->handle_point = location->c2d;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (location->corner); ++i)
+    {
+      HyScanGeoCartesian2D *corner = &location->corner[i];
+
+      dist = hyscan_cartesian_distance (corner, &search->cursor);
+      if (dist < search->max_dist && dist < search->handle_dist)
+        {
+          search->handle_dist = dist;
+          search->handle_mode = MODE_RESIZE;
+          search->handle_id = location->mark_id;
+          search->handle_point = *corner;
+        }
+    }
+}
+
 /* Определяет наличие хэндла в точке с логическими координатами (x, y) и возвращает идентификатор соответствующей метки.
  * Функция должна вызываться за g_rw_lock_reader_lock(&priv->mark_lock). */
 static gchar *
@@ -446,64 +599,35 @@ hyscan_gtk_map_geomark_handle_at (HyScanGtkMapGeomark  *gm_layer,
                                   HyScanGeoCartesian2D *point)
 {
   HyScanGtkMapGeomarkPrivate *priv = gm_layer->priv;
-  HyScanGeoCartesian2D cursor;
-  GHashTableIter iter;
-  HyScanGtkMapGeomarkLocation *location;
-  gchar *mark_id;
-
+  HyScanGtkMapGeomarkHandleSearch search;
+  HyScanGeoCartesian2D from, to;
   gdouble scale;
-  gdouble max_dist;
-
-  gdouble handle_dist = G_MAXDOUBLE;
-  guint handle_mode = MODE_NONE;
-  HyScanGeoCartesian2D handle_point = {0, 0};
-  const gchar *handle_id = NULL;
 
-  cursor.x = x;
-  cursor.y = y;
+  search.cursor.x = x;
+  search.cursor.y = y;
   gtk_cifro_area_get_scale (GTK_CIFRO_AREA (priv->map), &scale, NULL);
-  max_dist = HOVER_RADIUS * scale;
-
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &mark_id, (gpointer *) &location))
-    {
-      gsize i;
-      gdouble dist;
+  search.max_dist = HOVER_RADIUS * scale;
 
-      if (location->pending)
-        continue;
+  search.handle_dist = G_MAXDOUBLE;
+  search.handle_mode = MODE_NONE;
+  search.handle_point.x = 0;
+  search.handle_point.y = 0;
+  search.handle_id = NULL;
 
-      dist = hyscan_cartesian_distance (&location->c2d, &cursor);
-      if (dist < max_dist && dist < handle_dist)
-        {
-          handle_dist = dist;
-          handle_mode = MODE_DRAG;
-          handle_id = mark_id;
-          handle_point = location->c2d;
-        }
-
-      for (i = 0; i < G_N_ELEMENTS (location->corner); ++i)
-        {
-          HyScanGeoCartesian2D *corner = &location->corner[i];
-
-          dist = hyscan_cartesian_distance (corner, &cursor);
-          if (dist < max_dist && dist < handle_dist)
-            {
-              handle_dist = dist;
-              handle_mode = MODE_RESIZE;
-              handle_id = mark_id;
-              handle_point = *corner;
-            }
-        }
-    }
+  /* Хэндлы лежат на границе метки, поэтому достаточно проверить метки рядом с курсором. */
+  from.x = x - search.max_dist;
+  from.y = y - search.max_dist;
+  to.x = x + search.max_dist;
+  to.y = y + search.max_dist;
+  hyscan_map_rtree_search (priv->rtree, &from, &to, hyscan_gtk_map_geomark_handle_check, &search);
 
   if (mode != NULL)
-    *mode = handle_mode;
+    *mode = search.handle_mode;
 
   if (point != NULL)
-    *point = handle_point;
+    *point = search.handle_point;
 
-  return g_strdup (handle_id);
+  return g_strdup (search.handle_id);
 }
 
 /* Рисует хэндл, над которым находится курсор мыши. */
@@ -528,6 +652,22 @@ hyscan_gtk_map_geomark_draw_handle (HyScanGtkMapGeomark *gm_layer,
   cairo_fill (cairo);
 }
 
+/* Рисует метку, найденную в пространственном индексе. */
+static void
+hyscan_gtk_map_geomark_draw_found (gpointer item,
+                                   gpointer user_data)
+{
+  HyScanGtkMapGeomarkDrawFound *found = user_data;
+  HyScanGtkMapGeomarkLocation *location = item;
+  HyScanGtkMapGeomarkPrivate *priv = found->gm_layer->priv;
+
+  /* Пропускаем активную метку. */
+  if (priv->drag_mark_id != NULL && g_str_equal (location->mark_id, priv->drag_mark_id))
+    return;
+
+  hyscan_gtk_map_geomark_draw_location (found->gm_layer, found->cairo, location, FALSE);
+}
+
 /* Рисует слой по сигналу "visible-draw". */
 static void
 hyscan_gtk_map_geomark_draw (GtkCifroArea        *carea,
@@ -535,24 +675,26 @@ hyscan_gtk_map_geomark_draw (GtkCifroArea        *carea,
                              HyScanGtkMapGeomark *gm_layer)
 {
   HyScanGtkMapGeomarkPrivate *priv = gm_layer->priv;
-  GHashTableIter iter;
-  HyScanGtkMapGeomarkLocation *location;
-  gchar *mark_id;
+  HyScanGtkMapGeomarkDrawFound found;
+  HyScanGeoCartesian2D from, to;
+  gdouble scale;
 
   if (!hyscan_gtk_layer_get_visible (HYSCAN_GTK_LAYER (gm_layer)))
     return;
 
-  g_rw_lock_reader_lock (&priv->mark_lock);
+  /* Рисуем только метки, попадающие в видимую область. Отступ учитывает подписи под метками. */
+  gtk_cifro_area_get_view (carea, &from.x, &to.x, &from.y, &to.y);
+  gtk_cifro_area_get_scale (carea, &scale, NULL);
+  from.x -= DRAW_MARGIN * scale;
+  from.y -= DRAW_MARGIN * scale;
+  to.x += DRAW_MARGIN * scale;
+  to.y += DRAW_MARGIN * scale;
 
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &mark_id, (gpointer *) &location))
-    {
-      /* Пропускаем активную метку. */
-      if (priv->drag_mark_id != NULL && g_str_equal (mark_id, priv->drag_mark_id))
-        continue;
+  g_rw_lock_reader_lock (&priv->mark_lock);
 
-      hyscan_gtk_map_geomark_draw_location (gm_layer, cairo, location, FALSE);
-    }
+  found.gm_layer = gm_layer;
+  found.cairo = cairo;
+  hyscan_map_rtree_search (priv->rtree, &from, &to, hyscan_gtk_map_geomark_draw_found, &found);
 
   /* Рисуем активную метку. */
   if (priv->drag_mark != NULL)
@@ -658,15 +800,9 @@ hyscan_gtk_map_geomark_proj_notify (HyScanGtkMap *map,
 {
   HyScanGtkMapGeomark *gm_layer = HYSCAN_GTK_MAP_GEOMARK (user_data);
   HyScanGtkMapGeomarkPrivate *priv = gm_layer->priv;
-  GHashTableIter iter;
-  HyScanGtkMapGeomarkLocation *location;
 
   g_rw_lock_writer_lock (&priv->mark_lock);
-
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
-    hyscan_gtk_map_geomark_project_location (gm_layer, location);
-
+  hyscan_gtk_map_geomark_reindex (gm_layer);
   g_rw_lock_writer_unlock (&priv->mark_lock);
 }
 
@@ -773,7 +909,17 @@ hyscan_gtk_map_geomark_handle_release (HyScanGtkLayer *layer,
   /* Помещаем метку в общий список. */
   priv->drag_mark->pending = TRUE;
   if (priv->drag_mark_id != NULL)
-    g_hash_table_insert (priv->marks, priv->drag_mark_id, priv->drag_mark);
+    {
+      HyScanGtkMapGeomarkLocation *prev_location;
+
+      prev_location = g_hash_table_lookup (priv->marks, priv->drag_mark_id);
+      if (prev_location != NULL)
+        hyscan_map_rtree_remove (priv->rtree, prev_location);
+
+      hyscan_gtk_map_geomark_location_corners (priv->drag_mark);
+      hyscan_gtk_map_geomark_index_location (gm_layer, priv->drag_mark);
+      g_hash_table_insert (priv->marks, priv->drag_mark_id, priv->drag_mark);
+    }
   else
     hyscan_gtk_map_geomark_location_free (priv->drag_mark);
 
@@ -905,7 +1051,15 @@ hyscan_gtk_map_geomark_key_press (HyScanGtkMapGeomark *gm_layer,
 
       mark_id = g_strdup (priv->drag_mark_id);
       if (mark_id != NULL)
-        g_hash_table_remove (priv->marks, priv->drag_mark_id);
+        {
+          HyScanGtkMapGeomarkLocation *location;
+
+          location = g_hash_table_lookup (priv->marks, mark_id);
+          if (location != NULL)
+            hyscan_map_rtree_remove (priv->rtree, location);
+
+          g_hash_table_remove (priv->marks, mark_id);
+        }
       hyscan_gtk_map_geomark_drag_clear (gm_layer, TRUE);
 
       g_rw_lock_writer_unlock (&priv->mark_lock);
@@ -968,6 +1122,11 @@ hyscan_gtk_map_geomark_added (HyScanGtkLayer          *gtk_layer,
   g_signal_connect (priv->map, "notify::projection", G_CALLBACK (hyscan_gtk_map_geomark_proj_notify), gm_layer);
   g_signal_connect_swapped (priv->map, "key-press-event", G_CALLBACK (hyscan_gtk_map_geomark_key_press), gm_layer);
   g_signal_connect_swapped (priv->map, "configure-event", G_CALLBACK (hyscan_gtk_map_geomark_configure), gm_layer);
+
+  /* Метки, полученные до добавления слоя на карту, проецируем сейчас. */
+  g_rw_lock_writer_lock (&priv->mark_lock);
+  hyscan_gtk_map_geomark_reindex (gm_layer);
+  g_rw_lock_writer_unlock (&priv->mark_lock);
 }
 
 /* Обработка удаления слоя с карты. */
@@ -981,6 +1140,10 @@ hyscan_gtk_map_geomark_removed (HyScanGtkLayer *gtk_layer)
 
   g_signal_handlers_disconnect_by_data (priv->map, gm_layer);
   g_clear_object (&priv->map);
+
+  g_rw_lock_writer_lock (&priv->mark_lock);
+  hyscan_map_rtree_clear (priv->rtree);
+  g_rw_lock_writer_unlock (&priv->mark_lock);
 }
 
 /* Захватывает пользовательский ввод в контейнере.
@@ -1043,6 +1206,26 @@ hyscan_gtk_map_geomark_hint_shown (HyScanGtkLayer *layer,
     }
 }
 
+/* Проверяет, находится ли курсор над меткой, найденной в пространственном индексе. */
+static void
+hyscan_gtk_map_geomark_hover_check (gpointer item,
+                                    gpointer user_data)
+{
+  HyScanGtkMapGeomarkHoverSearch *search = user_data;
+  const HyScanGtkMapGeomarkLocation *mark = item;
+  gdouble mark_distance;
+
+  if (!hyscan_cartesian_is_point_inside (&search->cursor, &mark->corner[0], &mark->corner[2]))
+    return;
+
+  mark_distance = hyscan_cartesian_distance (&search->cursor, &mark->c2d);
+  if (mark_distance > search->min_distance)
+    return;
+
+  search->min_distance = mark_distance;
+  search->hover = mark;
+}
+
 /* Находит метку, которая находится в точке (x, y)
  * Функция должна вызываться за g_rw_lock_reader_lock (&priv->mark_lock); */
 static const HyScanGtkMapGeomarkLocation *
@@ -1052,32 +1235,16 @@ hyscan_gtk_map_geomark_find_hover (HyScanGtkMapGeomark *gm_layer,
                                     gdouble            *distance)
 {
   HyScanGtkMapGeomarkPrivate *priv = gm_layer->priv;
-  GHashTableIter iter;
-  HyScanGeoCartesian2D value;
-  HyScanGtkMapGeomarkLocation *mark;
-  gdouble min_distance = G_MAXDOUBLE;
-  const HyScanGtkMapGeomarkLocation *hover = NULL;
+  HyScanGtkMapGeomarkHoverSearch search;
 
-  gtk_cifro_area_point_to_value (GTK_CIFRO_AREA (priv->map), x, y, &value.x, &value.y);
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mark))
-    {
-      gdouble mark_distance;
-
-      if (!hyscan_cartesian_is_point_inside (&value, &mark->corner[0], &mark->corner[2]))
-        continue;
-
-      mark_distance = hyscan_cartesian_distance (&value, &mark->c2d);
-      if (mark_distance > min_distance)
-        continue;
-
-      min_distance = mark_distance;
-      hover = mark;
-    }
+  gtk_cifro_area_point_to_value (GTK_CIFRO_AREA (priv->map), x, y, &search.cursor.x, &search.cursor.y);
+  search.hover = NULL;
+  search.min_distance = G_MAXDOUBLE;
+  hyscan_map_rtree_search (priv->rtree, &search.cursor, &search.cursor, hyscan_gtk_map_geomark_hover_check, &search);
 
-  *distance = min_distance;
+  *distance = search.min_distance;
 
-  return hover;
+  return search.hover;
 }
 
 static gchar *
@@ -65,6 +65,7 @@
 #include <math.h>
 
 #define TILE_SIZE              256           /* Размер тайла. */
+#define AREA_MODS_MAX          1000          /* Число накопленных изменений областей, при котором они применяются к кэшу. */
 
 /* Раскомментируйте строку ниже для вывода отладочной информации на тайлах. */
 // #define DEBUG_TILES
@@ -75,29 +76,64 @@ enum
   PROP_CACHE_SIZE
 };
 
+/* Ключ кэша тайлов. */
 typedef struct
 {
+  guint                         x;                 /* Координата x тайла. */
+  guint                         y;                 /* Координата y тайла. */
+  guint                         zoom;              /* Номер масштаба тайла. */
+  guint                         param_mod;         /* Номер изменения параметров в момент отрисовки тайла. */
+} HyScanGtkMapTiledKey;
+
+typedef struct
+{
+  HyScanGtkMapTiledKey          key;               /* Ключ тайла в хэш-таблице. */
+  GList                         link;              /* Элемент LRU-очереди, data указывает на эту структуру. */
+  GList                         zoom_link;         /* Элемент очереди тайлов масштаба, data указывает на эту структуру. */
   HyScanMapTile                *tile;              /* Заполненный тайл. */
   guint                         fill_mod;          /* Номер изменения данных в момент отрисовки тайла. */
   guint                         actual_mod;        /* Актуальный номер изменения данных для тайла. */
-  guint                         param_mod;         /* Номер изменения параметров в момент отрисовки тайла. */
   HyScanGeoCartesian2D          area_from;         /* Граница области, которую покрывает тайл. */
   HyScanGeoCartesian2D          area_to;           /* Граница области, которую покрывает тайл. */
 } HyScanGtkMapTiledCache;
 
+/* Пространственный индекс тайлов одного масштаба.
+ * Параметры сетки определяются по первому помещённому в кэш тайлу, что позволяет
+ * по координатам области найти номера всех тайлов, которые её покрывают. */
+typedef struct
+{
+  GQueue                        tiles;             /* Тайлы этого масштаба, находящиеся в кэше. */
+  gdouble                       origin_x;          /* Координата x левой границы тайлов с номером x = 0. */
+  gdouble                       origin_y;          /* Координата y верхней границы тайлов с номером y = 0. */
+  gdouble                       step;              /* Размер тайла в логических координатах. */
+} HyScanGtkMapTiledZoom;
+
+/* Изменённая область, ожидающая применения к кэшу. */
+typedef struct
+{
+  HyScanGeoCartesian2D          point0;            /* Координаты начала отрезка. */
+  HyScanGeoCartesian2D          point1;            /* Координаты конца отрезка. */
+  guint                         mod_count;         /* Номер изменения данных. */
+} HyScanGtkMapTiledAreaMod;
+
 struct _HyScanGtkMapTiledPrivate
 {
   HyScanGtkMap                 *map;               /* Виджет карты, на котором размещен слой. */
   HyScanMapTileGrid            *tile_grid;         /* Тайловая сетка. */
   HyScanTaskQueue              *task_queue;        /* Очередь по загрузке тайлов. */
 
-  GRWLock                       rw_lock;           /* Блокировка доступа к cached_tiles. */
-  GQueue                       *cached_tiles;      /* Список кэшированных тайлов. */
+  GRWLock                       rw_lock;           /* Блокировка доступа к cached_tiles и cached_index. */
+  GQueue                        cached_tiles;      /* LRU-очередь кэшированных тайлов, недавние в начале. */
+  GHashTable                   *cached_index;      /* Таблица HyScanGtkMapTiledKey -> HyScanGtkMapTiledCache. */
+  GPtrArray                    *cached_zooms;      /* Индексы тайлов по масштабам HyScanGtkMapTiledZoom. */
   guint                         cache_size;        /* Максимально разрешённое число тайлов в кэше. */
 
   guint                         mod_count;         /* Номер изменения данных. */
   guint                         param_mod_count;   /* Номер изменения в параметрах отображения слоя. */
 
+  GMutex                        area_lock;         /* Блокировка доступа к area_mods. */
+  GArray                       *area_mods;         /* Изменённые области HyScanGtkMapTiledAreaMod, ещё не применённые к кэшу. */
+
   gboolean                      redraw;            /* Признак необходимости перерисовки. */
   guint                         redraw_tag;        /* Тэг функции, которая запрашивает перерисовку. */
 };
@@ -108,6 +144,9 @@ static void    hyscan_gtk_map_tiled_set_property             (GObject
                                                               const GValue            *value,
                                                               GParamSpec              *pspec);
 static void    hyscan_gtk_map_tiled_cache_free               (HyScanGtkMapTiledCache  *cache);
+static guint   hyscan_gtk_map_tiled_key_hash                 (gconstpointer            key);
+static gboolean hyscan_gtk_map_tiled_key_equal              (gconstpointer            a,
+                                                              gconstpointer            b);
 static void    hyscan_gtk_map_tiled_object_constructed       (GObject                 *object);
 static void    hyscan_gtk_map_tiled_object_finalize          (GObject                 *object);
 
@@ -127,7 +166,7 @@ hyscan_gtk_map_tiled_class_init (HyScanGtkMapTiledClass *klass)
 
   g_object_class_install_property (object_class, PROP_CACHE_SIZE,
     g_param_spec_uint ("cache-size", "Tile cache size", "Maximum allowed number of tiles in cache",
-                       30, 1000, 250,
+                       30, 50000, 250,
                        G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
 }
 
@@ -166,8 +205,14 @@ hyscan_gtk_map_tiled_object_constructed (GObject *object)
 
   G_OBJECT_CLASS (hyscan_gtk_map_tiled_parent_class)->constructed (object);
 
-  priv->cached_tiles = g_queue_new ();
+  g_queue_init (&priv->cached_tiles);
+  priv->cached_index = g_hash_table_new_full (hyscan_gtk_map_tiled_key_hash, hyscan_gtk_map_tiled_key_equal,
+                                              NULL, (GDestroyNotify) hyscan_gtk_map_tiled_cache_free);
+  priv->cached_zooms = g_ptr_array_new_with_free_func (g_free);
   g_rw_lock_init (&priv->rw_lock);
+
+  priv->area_mods = g_array_new (FALSE, FALSE, sizeof (HyScanGtkMapTiledAreaMod));
+  g_mutex_init (&priv->area_lock);
 }
 
 static void
@@ -177,12 +222,55 @@ hyscan_gtk_map_tiled_object_finalize (GObject *object)
   HyScanGtkMapTiledPrivate *priv = gtk_map_tiled->priv;
 
   g_rw_lock_clear (&priv->rw_lock);
-  g_queue_free_full (priv->cached_tiles, (GDestroyNotify) hyscan_gtk_map_tiled_cache_free);
+  g_hash_table_unref (priv->cached_index);
+  g_ptr_array_unref (priv->cached_zooms);
+
+  g_mutex_clear (&priv->area_lock);
+  g_array_unref (priv->area_mods);
 
   G_OBJECT_CLASS (hyscan_gtk_map_tiled_parent_class)->finalize (object);
 }
 
-/* Получает из кэша изображение поверхности тайла и записывает их в @tile. */
+/* Функция хэширования ключа кэша. */
+static guint
+hyscan_gtk_map_tiled_key_hash (gconstpointer key)
+{
+  const HyScanGtkMapTiledKey *k = key;
+  guint hash;
+
+  hash = k->x;
+  hash = hash * 31 + k->y;
+  hash = hash * 31 + k->zoom;
+  hash = hash * 31 + k->param_mod;
+
+  return hash;
+}
+
+/* Функция сравнения ключей кэша. */
+static gboolean
+hyscan_gtk_map_tiled_key_equal (gconstpointer a,
+                                gconstpointer b)
+{
+  const HyScanGtkMapTiledKey *ka = a;
+  const HyScanGtkMapTiledKey *kb = b;
+
+  return ka->x == kb->x && ka->y == kb->y && ka->zoom == kb->zoom && ka->param_mod == kb->param_mod;
+}
+
+/* Заполняет ключ кэша для тайла @tile. */
+static inline void
+hyscan_gtk_map_tiled_key_init (HyScanGtkMapTiledKey *key,
+                               HyScanMapTile        *tile,
+                               guint                 param_mod)
+{
+  key->x = hyscan_map_tile_get_x (tile);
+  key->y = hyscan_map_tile_get_y (tile);
+  key->zoom = hyscan_map_tile_get_zoom (tile);
+  key->param_mod = param_mod;
+}
+
+/* Получает из кэша изображение поверхности тайла и записывает их в @tile.
+ * Найденный тайл перемещается в начало LRU-очереди. */
 static gboolean
 hyscan_gtk_map_tiled_cache_get (HyScanGtkMapTiled *tiled_layer,
                                 HyScanMapTile     *tile,
@@ -190,37 +278,34 @@ hyscan_gtk_map_tiled_cache_get (HyScanGtkMapTiled *tiled_layer,
                                 gboolean          *refill)
 {
   HyScanGtkMapTiledPrivate *priv = tiled_layer->priv;
+  HyScanGtkMapTiledCache *cache;
+  HyScanGtkMapTiledKey key;
 
   gboolean found = FALSE;
   gboolean refill_ = TRUE;
 
-  GList *tile_l;
+  hyscan_gtk_map_tiled_key_init (&key, tile, param_mod);
 
-  g_rw_lock_reader_lock (&priv->rw_lock);
+  /* Перемещение в очереди изменяет её, поэтому нужна блокировка на запись. */
+  g_rw_lock_writer_lock (&priv->rw_lock);
 
-  /* Ищем в кэше тайл. */
-  for (tile_l = priv->cached_tiles->head; tile_l != NULL; tile_l = tile_l->next)
+  cache = g_hash_table_lookup (priv->cached_index, &key);
+  if (cache != NULL)
     {
-      HyScanGtkMapTiledCache *cache = tile_l->data;
-      HyScanMapTile *cached_tile = cache->tile;
       cairo_surface_t *surface;
 
-      if (cache->param_mod != param_mod)
-        continue;
-
-      if (hyscan_map_tile_compare (cached_tile, tile) != 0)
-        continue;
-
       found = TRUE;
       refill_ = cache->actual_mod > cache->fill_mod;
 
-      surface = hyscan_map_tile_get_surface (cached_tile);
+      surface = hyscan_map_tile_get_surface (cache->tile);
       hyscan_map_tile_set_surface (tile, surface);
-
       cairo_surface_destroy (surface);
+
+      g_queue_unlink (&priv->cached_tiles, &cache->link);
+      g_queue_push_head_link (&priv->cached_tiles, &cache->link);
     }
 
-  g_rw_lock_reader_unlock (&priv->rw_lock);
+  g_rw_lock_writer_unlock (&priv->rw_lock);
 
   *refill = refill_;
 
@@ -328,6 +413,141 @@ hyscan_gtk_map_tiled_fill_tile (HyScanGtkMapTiled *tiled_layer,
 #endif
 }
 
+/* Возвращает индекс масштаба тайла @cache, при необходимости создавая его.
+ * Функция должна вызываться под блокировкой на запись. */
+static HyScanGtkMapTiledZoom *
+hyscan_gtk_map_tiled_zoom_get (HyScanGtkMapTiledPrivate *priv,
+                               HyScanGtkMapTiledCache   *cache)
+{
+  HyScanGtkMapTiledZoom *zoom;
+  guint z = cache->key.zoom;
+
+  if (z >= priv->cached_zooms->len)
+    g_ptr_array_set_size (priv->cached_zooms, z + 1);
+
+  zoom = g_ptr_array_index (priv->cached_zooms, z);
+  if (zoom != NULL)
+    return zoom;
+
+  /* Восстанавливаем параметры сетки по границам тайла. */
+  zoom = g_new0 (HyScanGtkMapTiledZoom, 1);
+  g_queue_init (&zoom->tiles);
+  zoom->step = cache->area_to.x - cache->area_from.x;
+  zoom->origin_x = cache->area_from.x - cache->key.x * zoom->step;
+  zoom->origin_y = cache->area_from.y + cache->key.y * zoom->step;
+  g_ptr_array_index (priv->cached_zooms, z) = zoom;
+
+  return zoom;
+}
+
+/* Помечает изменёнными тайлы масштаба @zoom, которые пересекает отрезок @area_mod.
+ * Функция должна вызываться под блокировкой на запись. */
+static void
+hyscan_gtk_map_tiled_zoom_set_mod (HyScanGtkMapTiledPrivate *priv,
+                                   HyScanGtkMapTiledZoom    *zoom,
+                                   guint                     z,
+                                   HyScanGtkMapTiledAreaMod *area_mod)
+{
+  HyScanGtkMapTiledKey key;
+  gdouble min_x, max_x, min_y, max_y;
+  gint from_x, to_x, from_y, to_y;
+  gint x, y;
+
+  min_x = MIN (area_mod->point0.x, area_mod->point1.x);
+  max_x = MAX (area_mod->point0.x, area_mod->point1.x);
+  min_y = MIN (area_mod->point0.y, area_mod->point1.y);
+  max_y = MAX (area_mod->point0.y, area_mod->point1.y);
+
+  /* Номера тайлов, касающихся ограничивающего прямоугольника отрезка, включая соседей по границе. */
+  from_x = (gint) ceil ((min_x - zoom->origin_x) / zoom->step) - 1;
+  to_x   = (gint) floor ((max_x - zoom->origin_x) / zoom->step);
+  from_y = (gint) ceil ((zoom->origin_y - max_y) / zoom->step) - 1;
+  to_y   = (gint) floor ((zoom->origin_y - min_y) / zoom->step);
+  from_x = MAX (from_x, 0);
+  from_y = MAX (from_y, 0);
+
+  if (from_x > to_x || from_y > to_y)
+    return;
+
+  /* Если тайлов в прямоугольнике больше, чем в кэше, проще перебрать кэш. */
+  if ((guint64) (to_x - from_x + 1) * (to_y - from_y + 1) > zoom->tiles.length)
+    {
+      GList *link;
+
+      for (link = zoom->tiles.head; link != NULL; link = link->next)
+        {
+          HyScanGtkMapTiledCache *cache = link->data;
+
+          if ((gint) cache->key.x < from_x || (gint) cache->key.x > to_x ||
+              (gint) cache->key.y < from_y || (gint) cache->key.y > to_y)
+            {
+              continue;
+            }
+
+          if (hyscan_cartesian_is_inside (&area_mod->point0, &area_mod->point1, &cache->area_from, &cache->area_to))
+            cache->actual_mod = MAX (cache->actual_mod, area_mod->mod_count);
+        }
+
+      return;
+    }
+
+  key.zoom = z;
+  key.param_mod = g_atomic_int_get (&priv->param_mod_count);
+  for (x = from_x; x <= to_x; ++x)
+    {
+      for (y = from_y; y <= to_y; ++y)
+        {
+          HyScanGtkMapTiledCache *cache;
+
+          key.x = x;
+          key.y = y;
+          cache = g_hash_table_lookup (priv->cached_index, &key);
+          if (cache == NULL)
+            continue;
+
+          if (hyscan_cartesian_is_inside (&area_mod->point0, &area_mod->point1, &cache->area_from, &cache->area_to))
+            cache->actual_mod = MAX (cache->actual_mod, area_mod->mod_count);
+        }
+    }
+}
+
+/* Применяет к кэшу все накопленные изменения областей за одну блокировку. */
+static void
+hyscan_gtk_map_tiled_area_mod_apply (HyScanGtkMapTiled *tiled_layer)
+{
+  HyScanGtkMapTiledPrivate *priv = tiled_layer->priv;
+  GArray *area_mods;
+  guint i, z;
+
+  /* Забираем накопленные изменения, не задерживая hyscan_gtk_map_tiled_set_area_mod(). */
+  g_mutex_lock (&priv->area_lock);
+  if (priv->area_mods->len == 0)
+    {
+      g_mutex_unlock (&priv->area_lock);
+      return;
+    }
+  area_mods = priv->area_mods;
+  priv->area_mods = g_array_new (FALSE, FALSE, sizeof (HyScanGtkMapTiledAreaMod));
+  g_mutex_unlock (&priv->area_lock);
+
+  g_rw_lock_writer_lock (&priv->rw_lock);
+
+  for (z = 0; z < priv->cached_zooms->len; ++z)
+    {
+      HyScanGtkMapTiledZoom *zoom = g_ptr_array_index (priv->cached_zooms, z);
+
+      if (zoom == NULL || zoom->tiles.length == 0)
+        continue;
+
+      for (i = 0; i < area_mods->len; ++i)
+        hyscan_gtk_map_tiled_zoom_set_mod (priv, zoom, z, &g_array_index (area_mods, HyScanGtkMapTiledAreaMod, i));
+    }
+
+  g_rw_lock_writer_unlock (&priv->rw_lock);
+
+  g_array_unref (area_mods);
+}
+
 static void
 hyscan_gtk_map_tiled_cache_free (HyScanGtkMapTiledCache *cache)
 {
@@ -335,20 +555,23 @@ hyscan_gtk_map_tiled_cache_free (HyScanGtkMapTiledCache *cache)
   g_slice_free (HyScanGtkMapTiledCache, cache);
 }
 
+/* Удаляет из кэша самые давно использованные тайлы сверх разрешённого числа.
+ * Функция должна вызываться под блокировкой на запись. */
 static void
 hyscan_gtk_map_tiled_cache_trim (HyScanGtkMapTiled *tiled_layer)
 {
   HyScanGtkMapTiledPrivate *priv = tiled_layer->priv;
 
-  g_rw_lock_writer_lock (&priv->rw_lock);
-  while (priv->cached_tiles->length > priv->cache_size)
+  while (priv->cached_tiles.length > priv->cache_size)
     {
       HyScanGtkMapTiledCache *cache;
+      HyScanGtkMapTiledZoom *zoom;
 
-      cache = g_queue_pop_tail (priv->cached_tiles);
-      hyscan_gtk_map_tiled_cache_free (cache);
+      cache = g_queue_pop_tail_link (&priv->cached_tiles)->data;
+      zoom = g_ptr_array_index (priv->cached_zooms, cache->key.zoom);
+      g_queue_unlink (&zoom->tiles, &cache->zoom_link);
+      g_hash_table_remove (priv->cached_index, &cache->key);
     }
-  g_rw_lock_writer_unlock (&priv->rw_lock);
 }
 
 static void
@@ -357,8 +580,9 @@ hyscan_gtk_map_tiled_cache_clean (HyScanGtkMapTiled *tiled_layer)
   HyScanGtkMapTiledPrivate *priv = tiled_layer->priv;
 
   g_rw_lock_writer_lock (&priv->rw_lock);
-  g_queue_free_full (priv->cached_tiles, (GDestroyNotify) hyscan_gtk_map_tiled_cache_free);
-  priv->cached_tiles = g_queue_new ();
+  g_queue_init (&priv->cached_tiles);
+  g_hash_table_remove_all (priv->cached_index);
+  g_ptr_array_set_size (priv->cached_zooms, 0);
   g_rw_lock_writer_unlock (&priv->rw_lock);
 }
 
@@ -370,50 +594,55 @@ hyscan_gtk_map_tiled_cache_set (HyScanGtkMapTiled *tiled_layer,
                                 guint              param_mod_count)
 {
   HyScanGtkMapTiledPrivate *priv = tiled_layer->priv;
-  GList *tile_l;
-  HyScanGtkMapTiledCache *cache = NULL;
-  gboolean found = FALSE;
+  HyScanGtkMapTiledCache *cache;
+  HyScanGtkMapTiledKey key;
+
+  hyscan_gtk_map_tiled_key_init (&key, tile, param_mod_count);
 
   g_rw_lock_writer_lock (&priv->rw_lock);
 
-  /* Ищем в кэше тайл. */
-  for (tile_l = priv->cached_tiles->head; tile_l != NULL; tile_l = tile_l->next)
+  /* Параметры слоя изменились, пока тайл заполнялся, - такой тайл никогда не будет запрошен. */
+  if (param_mod_count != (guint) g_atomic_int_get (&priv->param_mod_count))
     {
-      cache = tile_l->data;
-
-      if (hyscan_map_tile_compare (cache->tile, tile) != 0)
-        continue;
-
-      /* Если тайл нашёлся, выдёргиваем его из стека. */
-      g_queue_unlink (priv->cached_tiles, tile_l);
-      found = TRUE;
-      break;
+      g_rw_lock_writer_unlock (&priv->rw_lock);
+      return;
     }
 
-  if (G_UNLIKELY (!found))
+  /* Ищем в кэше тайл. */
+  cache = g_hash_table_lookup (priv->cached_index, &key);
+
+  if (G_UNLIKELY (cache == NULL))
     {
+      HyScanGtkMapTiledZoom *zoom;
+
       cache = g_slice_new0 (HyScanGtkMapTiledCache);
+      cache->key = key;
+      cache->link.data = cache;
+      cache->zoom_link.data = cache;
       hyscan_map_tile_get_bounds (tile, &cache->area_from, &cache->area_to);
 
-      tile_l = g_list_alloc ();
-      tile_l->data = cache;
+      g_hash_table_insert (priv->cached_index, &cache->key, cache);
+
+      zoom = hyscan_gtk_map_tiled_zoom_get (priv, cache);
+      g_queue_push_head_link (&zoom->tiles, &cache->zoom_link);
     }
   else
     {
+      /* Если тайл нашёлся, выдёргиваем его из очереди. */
+      g_queue_unlink (&priv->cached_tiles, &cache->link);
       g_object_unref (cache->tile);
     }
 
   /* Пишем в кэш актуальную информацию. */
   cache->fill_mod = mod_count;
-  cache->param_mod = param_mod_count;
   cache->tile = g_object_ref (tile);
 
-  /* Помещаем заполненный тайл на верх стека. */
-  g_queue_push_head_link (priv->cached_tiles, tile_l);
-
-  g_rw_lock_writer_unlock (&priv->rw_lock);
+  /* Помещаем заполненный тайл в начало очереди. */
+  g_queue_push_head_link (&priv->cached_tiles, &cache->link);
 
   hyscan_gtk_map_tiled_cache_trim (tiled_layer);
+
+  g_rw_lock_writer_unlock (&priv->rw_lock);
 }
 
 
@@ -543,6 +772,9 @@ hyscan_gtk_map_tiled_draw (HyScanGtkMapTiled *tiled_layer,
   /* Текущий номер изменения параметров - выбираем тайлы только с таким же номером. */
   param_mod = g_atomic_int_get (&priv->param_mod_count);
 
+  /* Помечаем тайлы, затронутые изменениями данных с момента прошлой отрисовки. */
+  hyscan_gtk_map_tiled_area_mod_apply (tiled_layer);
+
   hyscan_map_tile_iter_init (&iter, from_tile_x, to_tile_x, from_tile_y, to_tile_y);
   while (hyscan_map_tile_iter_next (&iter, &x, &y))
     {
@@ -598,6 +830,9 @@ hyscan_gtk_map_tiled_draw (HyScanGtkMapTiled *tiled_layer,
  * например, из-за поступления новых данных. Тайлы всех масштабов, содержащие
  * изображение этой области, будут считаться более  невалидными и при следующем
  * выводе потребуют перерисовки.
+ *
+ * Изменения накапливаются и применяются к кэшу тайлов все сразу перед следующей
+ * отрисовкой слоя, поэтому функция не блокирует поток отрисовки.
  */
 void
 hyscan_gtk_map_tiled_set_area_mod (HyScanGtkMapTiled    *tiled_layer,
@@ -605,31 +840,25 @@ hyscan_gtk_map_tiled_set_area_mod (HyScanGtkMapTiled    *tiled_layer,
                                    HyScanGeoCartesian2D *point1)
 {
   HyScanGtkMapTiledPrivate *priv;
-
-  GList *cache_l;
-  guint mod_count;
+  HyScanGtkMapTiledAreaMod area_mod;
+  gboolean apply;
 
   g_return_if_fail (HYSCAN_IS_GTK_MAP_TILED (tiled_layer));
   priv = tiled_layer->priv;
 
-  /* Увеличиваем счетчик изменений данных. */
-  g_atomic_int_inc (&priv->mod_count);
-  mod_count = g_atomic_int_get (&priv->mod_count);
-
-  g_rw_lock_writer_lock (&priv->rw_lock);
-
-  for (cache_l = priv->cached_tiles->head; cache_l != NULL; cache_l = cache_l->next)
-    {
-      HyScanGtkMapTiledCache *cache = cache_l->data;
-
-      /* Если отрезок проходит через тайл, то помечаем этот тайл как изменённый. */
-      if (!hyscan_cartesian_is_inside (point0, point1, &cache->area_from, &cache->area_to))
-        continue;
+  area_mod.point0 = *point0;
+  area_mod.point1 = *point1;
 
-      cache->actual_mod = mod_count;
-    }
-
-  g_rw_lock_writer_unlock (&priv->rw_lock);
+  /* Увеличиваем счетчик изменений данных. */
+  g_mutex_lock (&priv->area_lock);
+  area_mod.mod_count = g_atomic_int_add (&priv->mod_count, 1) + 1;
+  g_array_append_val (priv->area_mods, area_mod);
+  apply = priv->area_mods->len >= AREA_MODS_MAX;
+  g_mutex_unlock (&priv->area_lock);
+
+  /* Слой долго не рисовался, применяем изменения сейчас, чтобы не накапливать их. */
+  if (apply)
+    hyscan_gtk_map_tiled_area_mod_apply (tiled_layer);
 }
 
 /**
@@ -46,6 +46,7 @@
 #include <hyscan-cartesian.h>
 #include <math.h>
 #include "hyscan-gtk-map-track-draw-bar.h"
+#include "hyscan-gtk-map-track-index.h"
 #include "hyscan-gtk-layer-param.h"
 
 #define DEFAULT_COLOR_SHADOW          "rgba(150, 150, 150, 0.5)"    /* Цвет затенения. */
@@ -76,6 +77,7 @@ struct _HyScanGtkMapTrackDrawBarPrivate
   HyScanGtkMapTrackDrawBarStyle       style;                        /* Стиль оформления. */
   GMutex                              lock;                         /* Мьютекс для доступа к полю style. */
   HyScanGtkLayerParam                *param;                        /* HyScanParam для стилей оформления. */
+  HyScanGtkMapTrackIndex             *index;                        /* Участки точек галсов. */
 };
 
 static void    hyscan_gtk_map_track_draw_bar_interface_init           (HyScanGtkMapTrackDrawInterface *iface);
@@ -89,19 +91,19 @@ static void    hyscan_gtk_map_track_draw_bar_emit                     (HyScanGtk
 static void    hyscan_gtk_map_track_draw_bar_path                     (HyScanGeoCartesian2D           *from,
                                                                        HyScanGeoCartesian2D           *to,
                                                                        gdouble                         scale,
-                                                                       GList                          *points,
+                                                                       const HyScanGtkMapTrackChunks  *chunks,
                                                                        cairo_t                        *cairo,
                                                                        HyScanGtkMapTrackDrawBarStyle  *style);
 static void    hyscan_gtk_map_track_draw_bar_side                     (HyScanGeoCartesian2D           *from,
                                                                        HyScanGeoCartesian2D           *to,
                                                                        gdouble                         scale,
-                                                                       GList                          *points,
+                                                                       const HyScanGtkMapTrackChunks  *chunks,
                                                                        cairo_t                        *cairo,
                                                                        HyScanGtkMapTrackDrawBarStyle  *style);
 static void    hyscan_gtk_map_track_draw_bar_start                    (HyScanGeoCartesian2D           *from,
                                                                        HyScanGeoCartesian2D           *to,
                                                                        gdouble                         scale,
-                                                                       GList                          *points,
+                                                                       const HyScanGtkMapTrackChunks  *chunks,
                                                                        cairo_t                        *cairo,
                                                                        HyScanGtkMapTrackDrawBarStyle  *style);
 
@@ -174,6 +176,11 @@ hyscan_gtk_map_track_draw_bar_object_constructed (GObject *object)
   hyscan_gtk_layer_param_add_rgba (priv->param, "/port-color", &style->color_left);
   hyscan_gtk_layer_param_add_rgba (priv->param, "/starboard-color", &style->color_right);
   g_signal_connect_swapped (priv->param, "set", G_CALLBACK (hyscan_gtk_map_track_draw_bar_emit), draw_bar);
+
+  /* Участки галсов перестраиваются при любом изменении данных модели. */
+  priv->index = hyscan_gtk_map_track_index_new ();
+  g_signal_connect_swapped (priv->model, "changed", G_CALLBACK (hyscan_gtk_map_track_index_update), priv->index);
+  g_signal_connect_swapped (priv->model, "param-set", G_CALLBACK (hyscan_gtk_map_track_index_invalidate), priv->index);
 }
 
 static void
@@ -182,6 +189,8 @@ hyscan_gtk_map_track_draw_bar_object_finalize (GObject *object)
   HyScanGtkMapTrackDrawBar *gtk_map_track_draw_bar = HYSCAN_GTK_MAP_TRACK_DRAW_BAR (object);
   HyScanGtkMapTrackDrawBarPrivate *priv = gtk_map_track_draw_bar->priv;
 
+  g_signal_handlers_disconnect_by_data (priv->model, priv->index);
+  g_object_unref (priv->index);
   g_object_unref (priv->param);
   g_object_unref (priv->model);
   g_mutex_clear (&priv->lock);
@@ -195,96 +204,135 @@ hyscan_gtk_map_track_draw_bar_emit (HyScanGtkMapTrackDrawBar *draw_bar)
   g_signal_emit_by_name (draw_bar, "param-changed");
 }
 
-/* Рисует часть галса по точкам points. */
+/* Рисует часть галса по точкам chunks, пропуская участки за пределами тайла. */
 static void
 hyscan_gtk_map_track_draw_bar_path (HyScanGeoCartesian2D          *from,
                                     HyScanGeoCartesian2D          *to,
                                     gdouble                        scale,
-                                    GList                         *points,
+                                    const HyScanGtkMapTrackChunks *chunks,
                                     cairo_t                       *cairo,
                                     HyScanGtkMapTrackDrawBarStyle *style)
 {
-  GList *point_l;
   HyScanMapTrackPoint *point;
   HyScanGeoCartesian2D coord;
+  gboolean prev_visible = FALSE;
+  gdouble margin;
+  guint i, k;
+
+  margin = scale * style->line_width;
 
   /* Рисуем линию движения. */
   gdk_cairo_set_source_rgba (cairo, &style->color_track);
   cairo_set_line_width (cairo, style->line_width);
   cairo_new_path (cairo);
-  for (point_l = points; point_l != NULL; point_l = point_l->next)
+  for (k = 0; k < chunks->n_chunks; k++)
     {
-      point = point_l->data;
-
-      /* Координаты точки на поверхности cairo. */
-      hyscan_gtk_map_track_draw_scale (&point->ship_c2d, from, to, scale, &coord);
-
-      cairo_line_to (cairo, coord.x, coord.y);
+      const HyScanGtkMapTrackChunk *chunk = &chunks->chunks[k];
+      guint last;
+
+      if (!hyscan_gtk_map_track_chunk_is_visible (chunk, from, to, margin))
+        {
+          prev_visible = FALSE;
+          continue;
+        }
+
+      /* Первая точка участка уже нарисована как последняя точка предыдущего участка. */
+      i = chunk->first;
+      if (!prev_visible)
+        {
+          point = &chunks->points[i];
+          hyscan_gtk_map_track_draw_scale (&point->ship_c2d, from, to, scale, &coord);
+          cairo_move_to (cairo, coord.x, coord.y);
+        }
+
+      /* Участок заканчивается первой точкой следующего участка. */
+      last = MIN (chunk->first + chunk->n_points, chunks->n_points - 1);
+      for (i = i + 1; i <= last; i++)
+        {
+          point = &chunks->points[i];
+
+          /* Координаты точки на поверхности cairo. */
+          hyscan_gtk_map_track_draw_scale (&point->ship_c2d, from, to, scale, &coord);
+
+          cairo_line_to (cairo, coord.x, coord.y);
+        }
+
+      prev_visible = TRUE;
     }
   cairo_stroke (cairo);
 }
 
-/* Рисует точки одного из бортов по точкам points. */
+/* Рисует точки одного из бортов по точкам chunks, пропуская участки за пределами тайла. */
 static void
 hyscan_gtk_map_track_draw_bar_side (HyScanGeoCartesian2D          *from,
                                     HyScanGeoCartesian2D          *to,
                                     gdouble                        scale,
-                                    GList                         *points,
+                                    const HyScanGtkMapTrackChunks *chunks,
                                     cairo_t                       *cairo,
                                     HyScanGtkMapTrackDrawBarStyle *style)
 {
-  GList *point_l;
   HyScanMapTrackPoint *point, *next_point;
   GdkRGBA *fill_color;
+  guint i, k;
 
   gdouble threshold;
+  gdouble margin;
 
   /* Делим весь отрезок на зоны длины threshold. В каждой зоне одна полоса. */
   threshold = scale * (style->bar_margin + style->bar_width);
+  margin = scale * style->bar_width;
 
   /* Рисуем полосы от бортов. */
   cairo_set_line_width (cairo, style->bar_width);
   cairo_new_path (cairo);
-  for (point_l = points; point_l != NULL; point_l = point_l->next)
+  for (k = 0; k < chunks->n_chunks; k++)
     {
-      HyScanGeoCartesian2D ship, start, end;
-
-      point = point_l->data;
-      next_point = point_l->next ? point_l->next->data : NULL;
+      const HyScanGtkMapTrackChunk *chunk = &chunks->chunks[k];
 
-      /* Пропускаем полосы на криволинейных участках. */
-      // if (!point->straight)
-      //   continue;
-
-      if (point->b_dist <= 0)
-        continue;
-
-      /* Рисуем полосу, только если следующая полоса лежит в другой зоне. */
-      if (next_point == NULL || round (next_point->dist_along / threshold) == round (point->dist_along / threshold))
+      if (!hyscan_gtk_map_track_chunk_is_visible (chunk, from, to, margin))
         continue;
 
-      hyscan_gtk_map_track_draw_scale (&point->ship_c2d, from, to, scale, &ship);
-      hyscan_gtk_map_track_draw_scale (&point->start_c2d, from, to, scale, &start);
-      hyscan_gtk_map_track_draw_scale (&point->fr_c2d, from, to, scale, &end);
-
-      if (point->source == HYSCAN_GTK_MAP_TRACK_DRAW_SOURCE_LEFT)
-        fill_color = &style->color_left;
-      else
-        fill_color = &style->color_right;
-
-      /* Линия дальности. */
-      cairo_move_to (cairo, start.x, start.y);
-      cairo_line_to (cairo, end.x, end.y);
-      gdk_cairo_set_source_rgba (cairo, fill_color);
-      cairo_set_line_width (cairo, style->bar_width);
-      cairo_stroke (cairo);
-
-      /* Линия, соединяющая центр судна с антенной. */
-      cairo_move_to (cairo, start.x, start.y);
-      cairo_line_to (cairo, ship.x, ship.y);
-      gdk_cairo_set_source_rgba (cairo, &style->color_shadow);
-      cairo_set_line_width (cairo, style->bar_width);
-      cairo_stroke (cairo);
+      for (i = chunk->first; i < chunk->first + chunk->n_points; i++)
+        {
+          HyScanGeoCartesian2D ship, start, end;
+
+          point = &chunks->points[i];
+          next_point = (i + 1 < chunks->n_points) ? &chunks->points[i + 1] : NULL;
+
+          /* Пропускаем полосы на криволинейных участках. */
+          // if (!point->straight)
+          //   continue;
+
+          if (point->b_dist <= 0)
+            continue;
+
+          /* Рисуем полосу, только если следующая полоса лежит в другой зоне. */
+          if (next_point == NULL || round (next_point->dist_along / threshold) == round (point->dist_along / threshold))
+            continue;
+
+          hyscan_gtk_map_track_draw_scale (&point->ship_c2d, from, to, scale, &ship);
+          hyscan_gtk_map_track_draw_scale (&point->start_c2d, from, to, scale, &start);
+          hyscan_gtk_map_track_draw_scale (&point->fr_c2d, from, to, scale, &end);
+
+          if (point->source == HYSCAN_GTK_MAP_TRACK_DRAW_SOURCE_LEFT)
+            fill_color = &style->color_left;
+          else
+            fill_color = &style->color_right;
+
+          /* Линия дальности. */
+          cairo_move_to (cairo, start.x, start.y);
+          cairo_line_to (cairo, end.x, end.y);
+          gdk_cairo_set_source_rgba (cairo, fill_color);
+          cairo_set_line_width (cairo, style->bar_width);
+          cairo_stroke (cairo);
+
+          /* Линия, соединяющая центр судна с антенной. */
+          cairo_move_to (cairo, start.x, start.y);
+          cairo_line_to (cairo, ship.x, ship.y);
+          gdk_cairo_set_source_rgba (cairo, &style->color_shadow);
+          cairo_set_line_width (cairo, style->bar_width);
+          cairo_stroke (cairo);
+        }
     }
 }
 
@@ -293,17 +341,17 @@ static void
 hyscan_gtk_map_track_draw_bar_start (HyScanGeoCartesian2D          *from,
                                      HyScanGeoCartesian2D          *to,
                                      gdouble                        scale,
-                                     GList                         *points,
+                                     const HyScanGtkMapTrackChunks *chunks,
                                      cairo_t                       *cairo,
                                      HyScanGtkMapTrackDrawBarStyle *style)
 {
   HyScanMapTrackPoint *point;
   HyScanGeoCartesian2D coord;
 
-  if (points == NULL)
+  if (chunks->n_points == 0)
     return;
 
-  point = points->data;
+  point = &chunks->points[0];
 
   if (!hyscan_cartesian_is_point_inside (&point->ship_c2d, from, to))
     return;
@@ -330,6 +378,7 @@ hyscan_gtk_map_track_draw_bar_draw_region (HyScanGtkMapTrackDraw      *track_dra
   HyScanGtkMapTrackDrawBarStyle style;
   HyScanMapTrackData data;
   HyScanMapTrackModelInfo *track_info;
+  const HyScanGtkMapTrackIndexData *chunks;
 
   /* Блокируем доступ к данным галса. */
   track_info = hyscan_map_track_model_lock (priv->model, track_name);
@@ -348,13 +397,16 @@ hyscan_gtk_map_track_draw_bar_draw_region (HyScanGtkMapTrackDraw      *track_dra
   style = priv->style;
   g_mutex_unlock (&priv->lock);
 
+  /* Точки галса, разбитые на участки, с детализацией по масштабу. */
+  chunks = hyscan_gtk_map_track_index_get (priv->index, track_name, &data, scale);
+
   /* Рисуем. */
   cairo_save (cairo);
   cairo_set_antialias (cairo, CAIRO_ANTIALIAS_FAST);
-  hyscan_gtk_map_track_draw_bar_side (from, to, scale, data.port, cairo, &style);
-  hyscan_gtk_map_track_draw_bar_side (from, to, scale, data.starboard, cairo, &style);
-  hyscan_gtk_map_track_draw_bar_path (from, to, scale, data.nav, cairo, &style);
-  hyscan_gtk_map_track_draw_bar_start (from, to, scale, data.nav, cairo, &style);
+  hyscan_gtk_map_track_draw_bar_side (from, to, scale, &chunks->port, cairo, &style);
+  hyscan_gtk_map_track_draw_bar_side (from, to, scale, &chunks->starboard, cairo, &style);
+  hyscan_gtk_map_track_draw_bar_path (from, to, scale, &chunks->nav, cairo, &style);
+  hyscan_gtk_map_track_draw_bar_start (from, to, scale, &chunks->nav, cairo, &style);
   cairo_restore (cairo);
 
 exit:
@@ -44,10 +44,13 @@
  */
 
 #include "hyscan-gtk-map-track-draw-beam.h"
+#include "hyscan-gtk-map-track-index.h"
 #include "hyscan-gtk-layer-param.h"
+#include "hyscan-cairo.h"
 #include <hyscan-cartesian.h>
 #include <gdk/gdk.h>
 #include <hyscan-track-proj-quality.h>
+#include <math.h>
 
 enum
 {
@@ -57,12 +60,23 @@ enum
 
 struct _HyScanGtkMapTrackDrawBeamPrivate
 {
-  HyScanMapTrackModel *model;        /* Модель данных. */
-  GdkRGBA              color;        /* Цвет покрытия. */
-  GMutex               lock;         /* Мьютекс для блокировки доступа к color. */
-  HyScanGtkLayerParam *param;        /* Параметры отрисовщика. */
+  HyScanMapTrackModel    *model;        /* Модель данных. */
+  GdkRGBA                 color;        /* Цвет покрытия. */
+  GMutex                  lock;         /* Мьютекс для блокировки доступа к color. */
+  HyScanGtkLayerParam    *param;        /* Параметры отрисовщика. */
+  HyScanGtkMapTrackIndex *index;        /* Участки точек галсов. */
 };
 
+/* Данные изображения для закрашивания лучей без cairo. */
+typedef struct
+{
+  guchar                 *data;         /* Данные изображения или NULL, если рисование идёт через cairo. */
+  gint                    stride;       /* Размер строки изображения в байтах. */
+  gint                    width;        /* Ширина изображения. */
+  gint                    height;       /* Высота изображения. */
+  guint32                 pixel;        /* Цвет покрытия в формате CAIRO_FORMAT_ARGB32. */
+} HyScanGtkMapTrackDrawBeamRaster;
+
 static void    hyscan_gtk_map_track_draw_beam_interface_init           (HyScanGtkMapTrackDrawInterface *iface);
 static void    hyscan_gtk_map_track_draw_beam_set_property             (GObject                        *object,
                                                                         guint                           prop_id,
@@ -71,12 +85,19 @@ static void    hyscan_gtk_map_track_draw_beam_set_property             (GObject
 static void    hyscan_gtk_map_track_draw_beam_object_constructed       (GObject                        *object);
 static void    hyscan_gtk_map_track_draw_beam_object_finalize          (GObject                        *object);
 static void    hyscan_gtk_map_track_draw_beam_emit                     (HyScanGtkMapTrackDrawBeam      *draw_beam);
+static void    hyscan_gtk_map_track_draw_beam_fill                     (HyScanGtkMapTrackDrawBeamRaster *raster,
+                                                                        cairo_t                        *cairo,
+                                                                        const gdouble                  *points,
+                                                                        guint                           n_points);
+static gboolean hyscan_gtk_map_track_draw_beam_raster_init             (HyScanGtkMapTrackDrawBeamRaster *raster,
+                                                                        cairo_t                        *cairo,
+                                                                        const GdkRGBA                  *color);
 static void    hyscan_gtk_map_track_draw_beam_side                     (HyScanGtkMapTrackDrawBeam      *beam,
                                                                         HyScanTrackProjQuality         *quality_data,
                                                                         HyScanGeoCartesian2D           *from,
                                                                         HyScanGeoCartesian2D           *to,
                                                                         gdouble                         scale,
-                                                                        GList                          *points,
+                                                                        const HyScanGtkMapTrackChunks  *chunks,
                                                                         cairo_t                        *cairo,
                                                                         GCancellable                   *cancellable);
 
@@ -138,6 +159,11 @@ hyscan_gtk_map_track_draw_beam_object_constructed (GObject *object)
   hyscan_gtk_layer_param_set_stock_schema (priv->param, "map-track-beam");
   hyscan_gtk_layer_param_add_rgba (priv->param, "/beam-color", &priv->color);
   g_signal_connect_swapped (priv->param, "set", G_CALLBACK (hyscan_gtk_map_track_draw_beam_emit), draw_beam);
+
+  /* Участки галсов перестраиваются при любом изменении данных модели. */
+  priv->index = hyscan_gtk_map_track_index_new ();
+  g_signal_connect_swapped (priv->model, "changed", G_CALLBACK (hyscan_gtk_map_track_index_update), priv->index);
+  g_signal_connect_swapped (priv->model, "param-set", G_CALLBACK (hyscan_gtk_map_track_index_invalidate), priv->index);
 }
 
 static void
@@ -146,6 +172,8 @@ hyscan_gtk_map_track_draw_beam_object_finalize (GObject *object)
   HyScanGtkMapTrackDrawBeam *gtk_map_track_draw_beam = HYSCAN_GTK_MAP_TRACK_DRAW_BEAM (object);
   HyScanGtkMapTrackDrawBeamPrivate *priv = gtk_map_track_draw_beam->priv;
 
+  g_signal_handlers_disconnect_by_data (priv->model, priv->index);
+  g_object_unref (priv->index);
   g_object_unref (priv->param);
   g_object_unref (priv->model);
   g_mutex_clear (&priv->lock);
@@ -159,111 +187,207 @@ hyscan_gtk_map_track_draw_beam_emit (HyScanGtkMapTrackDrawBeam *draw_beam)
   g_signal_emit_by_name (draw_beam, "param-changed");
 }
 
-/* Рисует часть галса по точкам points. */
+/* Закрашивает многоугольник напрямую в данных изображения или, если это невозможно, через cairo. */
 static void
-hyscan_gtk_map_track_draw_beam_side (HyScanGtkMapTrackDrawBeam *beam,
-                                     HyScanTrackProjQuality    *quality_data,
-                                     HyScanGeoCartesian2D      *from,
-                                     HyScanGeoCartesian2D      *to,
-                                     gdouble                    scale,
-                                     GList                     *points,
-                                     cairo_t                   *cairo,
-                                     GCancellable              *cancellable)
+hyscan_gtk_map_track_draw_beam_fill (HyScanGtkMapTrackDrawBeamRaster *raster,
+                                     cairo_t                         *cairo,
+                                     const gdouble                   *points,
+                                     guint                            n_points)
+{
+  guint i;
+
+  if (raster->data != NULL)
+    {
+      hyscan_cairo_fill_convex (raster->data, raster->stride, raster->width, raster->height,
+                                points, n_points, raster->pixel);
+      return;
+    }
+
+  cairo_move_to (cairo, points[0], points[1]);
+  for (i = 1; i < n_points; i++)
+    cairo_line_to (cairo, points[2 * i], points[2 * i + 1]);
+  cairo_close_path (cairo);
+  cairo_fill (cairo);
+}
+
+/* Проверяет, можно ли рисовать напрямую в данных изображения, и подготавливает их. */
+static gboolean
+hyscan_gtk_map_track_draw_beam_raster_init (HyScanGtkMapTrackDrawBeamRaster *raster,
+                                            cairo_t                         *cairo,
+                                            const GdkRGBA                   *color)
+{
+  cairo_surface_t *surface;
+  cairo_matrix_t matrix;
+  gdouble offset_x, offset_y;
+  gdouble clip_x1, clip_y1, clip_x2, clip_y2;
+  gdouble alpha;
+
+  raster->data = NULL;
+
+  surface = cairo_get_target (cairo);
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+      cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32)
+    {
+      return FALSE;
+    }
+
+  /* Координаты пикселей должны совпадать с координатами пользователя, а область рисования не ограничена. */
+  raster->width = cairo_image_surface_get_width (surface);
+  raster->height = cairo_image_surface_get_height (surface);
+  cairo_get_matrix (cairo, &matrix);
+  cairo_surface_get_device_offset (surface, &offset_x, &offset_y);
+  cairo_clip_extents (cairo, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+  if (matrix.xx != 1.0 || matrix.yx != 0.0 || matrix.xy != 0.0 || matrix.yy != 1.0 ||
+      matrix.x0 != 0.0 || matrix.y0 != 0.0 || offset_x != 0.0 || offset_y != 0.0 ||
+      clip_x1 > 0.0 || clip_y1 > 0.0 || clip_x2 < raster->width || clip_y2 < raster->height)
+    {
+      return FALSE;
+    }
+
+  cairo_surface_flush (surface);
+  raster->data = cairo_image_surface_get_data (surface);
+  raster->stride = cairo_image_surface_get_stride (surface);
+  if (raster->data == NULL)
+    return FALSE;
+
+  /* Цвет с предварительно умноженной прозрачностью, как в CAIRO_FORMAT_ARGB32. */
+  alpha = CLAMP (color->alpha, 0.0, 1.0);
+  raster->pixel = (guint32) (255.0 * alpha + 0.5) << 24 |
+                  (guint32) (255.0 * alpha * CLAMP (color->red, 0.0, 1.0) + 0.5) << 16 |
+                  (guint32) (255.0 * alpha * CLAMP (color->green, 0.0, 1.0) + 0.5) << 8 |
+                  (guint32) (255.0 * alpha * CLAMP (color->blue, 0.0, 1.0) + 0.5);
+
+  return TRUE;
+}
+
+/* Рисует часть галса по точкам chunks, пропуская участки за пределами тайла. */
+static void
+hyscan_gtk_map_track_draw_beam_side (HyScanGtkMapTrackDrawBeam     *beam,
+                                     HyScanTrackProjQuality        *quality_data,
+                                     HyScanGeoCartesian2D          *from,
+                                     HyScanGeoCartesian2D          *to,
+                                     gdouble                        scale,
+                                     const HyScanGtkMapTrackChunks *chunks,
+                                     cairo_t                       *cairo,
+                                     GCancellable                  *cancellable)
 {
   HyScanGtkMapTrackDrawBeamPrivate *priv = beam->priv;
-  GList *point_l;
+  HyScanGtkMapTrackDrawBeamRaster raster;
   HyScanMapTrackPoint *point;
   HyScanGeoCartesian2D start, nf, ff1, ff2;
+  guint j, k;
 
-  if (points == NULL)
+  if (chunks->n_points == 0)
     return;
 
-  cairo_save (cairo);
-
-  /* Делаем не наложение цвета, а замену (это сохранит полупрозрачность цвета при наложении изображений). */
-  cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
-  gdk_cairo_set_source_rgba (cairo, &priv->color);
-
-  /* Чтобы соседние полосы точно совпадали, убираем сглаживание. */
-  cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
-
-  for (point_l = points; point_l != NULL; point_l = point_l->next)
+  /* Тайлы рисуются на изображении в памяти: закрашиваем лучи напрямую в его данных. */
+  if (!hyscan_gtk_map_track_draw_beam_raster_init (&raster, cairo, &priv->color))
     {
-      const gdouble *quality;
-      gsize i, quality_len;
+      cairo_save (cairo);
 
-      gdouble nr_part, dx1, dy1, dx2, dy2, dx_nf, dy_nf;
+      /* Делаем не наложение цвета, а замену (это сохранит полупрозрачность цвета при наложении изображений). */
+      cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+      gdk_cairo_set_source_rgba (cairo, &priv->color);
 
-      point = point_l->data;
+      /* Чтобы соседние полосы точно совпадали, убираем сглаживание. */
+      cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
+    }
 
-      quality = hyscan_track_proj_quality_squash (quality_data, point->index, &quality_len);
-      if (point->b_dist <= 0 || quality == NULL || quality_len == 0)
-        continue;
+  for (k = 0; k < chunks->n_chunks; k++)
+    {
+      const HyScanGtkMapTrackChunk *chunk = &chunks->chunks[k];
 
       if (g_cancellable_is_cancelled (cancellable))
         break;
 
-      /* Координаты точки на поверхности cairo. */
-      hyscan_gtk_map_track_draw_scale (&point->start_c2d, from, to, scale, &start);
-      hyscan_gtk_map_track_draw_scale (&point->fr1_c2d, from, to, scale, &ff1);
-      hyscan_gtk_map_track_draw_scale (&point->fr2_c2d, from, to, scale, &ff2);
-      hyscan_gtk_map_track_draw_scale (&point->nr_c2d, from, to, scale, &nf);
-
-      nr_part = point->nr_length_m / point->b_length_m;
-      dx1 = ff1.x - start.x;
-      dy1 = ff1.y - start.y;
-      dx2 = ff2.x - start.x;
-      dy2 = ff2.y - start.y;
-      dx_nf = (nf.x - start.x) / nr_part;
-      dy_nf = (nf.y - start.y) / nr_part;
-      for (i = 0; i < quality_len; i += 2)
+      /* Апертура уже учтена в границах участка, добавляем один пиксель на растеризацию. */
+      if (!hyscan_gtk_map_track_chunk_is_visible (chunk, from, to, scale))
+        continue;
+
+      for (j = chunk->first; j < chunk->first + chunk->n_points; j++)
         {
-          /* Начало и конец отрезка луча. */
-          gdouble s0 = quality[i], s1 = quality[i+1];
+          const gdouble *quality;
+          gsize i, quality_len;
 
-          /* Ближняя зона. */
-          if (s0 < nr_part)
-            {
-              HyScanGeoCartesian2D pt_nr[2];
-              gdouble nr0 = s0, nr1 = MIN (nr_part, s1);
-
-              pt_nr[0].x = start.x + nr0 * dx_nf;
-              pt_nr[0].y = start.y + nr0 * dy_nf;
-              pt_nr[1].x = start.x + nr1 * dx_nf;
-              pt_nr[1].y = start.y + nr1 * dy_nf;
-
-              cairo_move_to (cairo, pt_nr[0].x, pt_nr[0].y);
-              cairo_line_to (cairo, pt_nr[1].x, pt_nr[1].y);
-              cairo_set_line_width (cairo, point->aperture / scale);
-              cairo_stroke (cairo);
-            }
+          gdouble nr_part, dx1, dy1, dx2, dy2, dx_nf, dy_nf;
+          gdouble nr_length, nr_x, nr_y;
+
+          point = &chunks->points[j];
+
+          quality = hyscan_track_proj_quality_squash (quality_data, point->index, &quality_len);
+          if (point->b_dist <= 0 || quality == NULL || quality_len == 0)
+            continue;
 
-          /* Дальняя зона. */
-          if (s1 > nr_part)
+          if (g_cancellable_is_cancelled (cancellable))
+            break;
+
+          /* Координаты точки на поверхности cairo. */
+          hyscan_gtk_map_track_draw_scale (&point->start_c2d, from, to, scale, &start);
+          hyscan_gtk_map_track_draw_scale (&point->fr1_c2d, from, to, scale, &ff1);
+          hyscan_gtk_map_track_draw_scale (&point->fr2_c2d, from, to, scale, &ff2);
+          hyscan_gtk_map_track_draw_scale (&point->nr_c2d, from, to, scale, &nf);
+
+          nr_part = point->nr_length_m / point->b_length_m;
+          dx1 = ff1.x - start.x;
+          dy1 = ff1.y - start.y;
+          dx2 = ff2.x - start.x;
+          dy2 = ff2.y - start.y;
+          dx_nf = (nf.x - start.x) / nr_part;
+          dy_nf = (nf.y - start.y) / nr_part;
+
+          /* Ближняя зона - полоса шириной в апертуру антенны, (nr_x, nr_y) - половина её ширины поперёк луча. */
+          nr_length = hypot (dx_nf, dy_nf);
+          nr_x = (nr_length > 0.0) ? -dy_nf / nr_length * point->aperture / scale / 2.0 : 0.0;
+          nr_y = (nr_length > 0.0) ? dx_nf / nr_length * point->aperture / scale / 2.0 : 0.0;
+
+          for (i = 0; i < quality_len; i += 2)
             {
-              HyScanGeoCartesian2D pt_fr[4];
-              gdouble fr0 = MAX (s0, nr_part), fr1 = s1;
-
-              pt_fr[0].x = start.x + fr0 * dx1;
-              pt_fr[0].y = start.y + fr0 * dy1;
-              pt_fr[1].x = start.x + fr1 * dx1;
-              pt_fr[1].y = start.y + fr1 * dy1;
-              pt_fr[2].x = start.x + fr1 * dx2;
-              pt_fr[2].y = start.y + fr1 * dy2;
-              pt_fr[3].x = start.x + fr0 * dx2;
-              pt_fr[3].y = start.y + fr0 * dy2;
-
-              cairo_move_to (cairo, pt_fr[0].x, pt_fr[0].y);
-              cairo_line_to (cairo, pt_fr[1].x, pt_fr[1].y);
-              cairo_line_to (cairo, pt_fr[2].x, pt_fr[2].y);
-              cairo_line_to (cairo, pt_fr[3].x, pt_fr[3].y);
-              cairo_close_path (cairo);
-              cairo_fill (cairo);
+              /* Начало и конец отрезка луча. */
+              gdouble s0 = quality[i], s1 = quality[i+1];
+
+              /* Ближняя зона. */
+              if (s0 < nr_part && nr_length > 0.0)
+                {
+                  gdouble pt_nr[8];
+                  gdouble nr0 = s0, nr1 = MIN (nr_part, s1);
+
+                  pt_nr[0] = start.x + nr0 * dx_nf + nr_x;
+                  pt_nr[1] = start.y + nr0 * dy_nf + nr_y;
+                  pt_nr[2] = start.x + nr1 * dx_nf + nr_x;
+                  pt_nr[3] = start.y + nr1 * dy_nf + nr_y;
+                  pt_nr[4] = start.x + nr1 * dx_nf - nr_x;
+                  pt_nr[5] = start.y + nr1 * dy_nf - nr_y;
+                  pt_nr[6] = start.x + nr0 * dx_nf - nr_x;
+                  pt_nr[7] = start.y + nr0 * dy_nf - nr_y;
+
+                  hyscan_gtk_map_track_draw_beam_fill (&raster, cairo, pt_nr, 4);
+                }
+
+              /* Дальняя зона. */
+              if (s1 > nr_part)
+                {
+                  gdouble pt_fr[8];
+                  gdouble fr0 = MAX (s0, nr_part), fr1 = s1;
+
+                  pt_fr[0] = start.x + fr0 * dx1;
+                  pt_fr[1] = start.y + fr0 * dy1;
+                  pt_fr[2] = start.x + fr1 * dx1;
+                  pt_fr[3] = start.y + fr1 * dy1;
+                  pt_fr[4] = start.x + fr1 * dx2;
+                  pt_fr[5] = start.y + fr1 * dy2;
+                  pt_fr[6] = start.x + fr0 * dx2;
+                  pt_fr[7] = start.y + fr0 * dy2;
+
+                  hyscan_gtk_map_track_draw_beam_fill (&raster, cairo, pt_fr, 4);
+                }
             }
         }
     }
 
-  cairo_restore (cairo);
+  if (raster.data != NULL)
+    cairo_surface_mark_dirty (cairo_get_target (cairo));
+  else
+    cairo_restore (cairo);
 }
 
 static void
@@ -279,6 +403,7 @@ hyscan_gtk_map_track_draw_beam_draw_region (HyScanGtkMapTrackDraw     *track_dra
   HyScanGtkMapTrackDrawBeamPrivate *priv = beam->priv;
   HyScanMapTrackData data;
   HyScanMapTrackModelInfo *track_info;
+  const HyScanGtkMapTrackIndexData *chunks;
 
   /* Блокируем доступ к данным галса. */
   track_info = hyscan_map_track_model_lock (priv->model, track_name);
@@ -292,14 +417,17 @@ hyscan_gtk_map_track_draw_beam_draw_region (HyScanGtkMapTrackDraw     *track_dra
       goto exit;
     }
 
+  /* Точки галса, разбитые на участки, с детализацией по масштабу. */
+  chunks = hyscan_gtk_map_track_index_get (priv->index, track_name, &data, scale);
+
   /* Рисуем. */
   hyscan_gtk_map_track_draw_beam_side (beam,
                                        hyscan_map_track_get_quality_port (track_info->track),
-                                       from, to, scale, data.port, cairo, cancellable);
+                                       from, to, scale, &chunks->port, cairo, cancellable);
 
   hyscan_gtk_map_track_draw_beam_side (beam,
                                        hyscan_map_track_get_quality_starboard (track_info->track),
-                                       from, to, scale, data.starboard, cairo, cancellable);
+                                       from, to, scale, &chunks->starboard, cairo, cancellable);
 
 exit:
   hyscan_map_track_model_unlock (track_info);
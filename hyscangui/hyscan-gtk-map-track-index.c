@@ -0,0 +1,626 @@
+/* hyscan-gtk-map-track-index.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/**
+ * SECTION: hyscan-gtk-map-track-index
+ * @Short_description: разбиение точек галса на участки
+ * @Title: HyScanGtkMapTrackIndex
+ * @See_also: #HyScanGtkMapTrackDraw, #HyScanMapTrack
+ *
+ * Класс хранит копии точек галсов в непрерывных массивах, разбитых на участки
+ * по %CHUNK_SIZE точек. Для каждого участка известен прямоугольник, внутри
+ * которого находятся все его точки, поэтому при рисовании тайла можно
+ * пропустить участки, которые не пересекают тайл, не обращаясь к их точкам.
+ *
+ * Для мелких масштабов класс строит упрощённые уровни детализации галса.
+ * На уровне k соседние точки отстоят друг от друга не меньше, чем на
+ * %LOD_BASE * 2^k единиц карты: у линии движения учитывается расстояние между
+ * положениями судна, у бортов - расстояние вдоль галса. Уровень выбирается так,
+ * чтобы это расстояние не превышало %LOD_TOLERANCE пикселя, поэтому время
+ * рисования тайла в мелком масштабе зависит от размера тайла, а не от длины
+ * галса. Уровни строятся при первом обращении к ним.
+ *
+ * Данные галса берутся из #HyScanMapTrackData и перестраиваются, когда
+ * изменяется набор точек галса или вызывается функция
+ * hyscan_gtk_map_track_index_invalidate() или hyscan_gtk_map_track_index_update().
+ * Функция hyscan_gtk_map_track_index_update() также удаляет из индекса галсы,
+ * которых больше нет в списке галсов модели, поэтому память индекса не растёт
+ * с каждым просмотренным галсом. Если изменилась только часть точек
+ * в конце галса, например, при записи нового галса, то перестраиваются только
+ * участки и уровни детализации, содержащие эти точки. Индекс хранит копии
+ * точек, а не указатели на них, поэтому устаревший индекс никогда не ссылается
+ * на освобождённые данные галса.
+ *
+ * - hyscan_gtk_map_track_index_get() - получение участков галса;
+ * - hyscan_gtk_map_track_chunk_is_visible() - проверка видимости участка;
+ * - hyscan_gtk_map_track_index_invalidate() - сброс всех индексов;
+ * - hyscan_gtk_map_track_index_update() - сброс всех индексов и удаление галсов,
+ *   которых нет в модели.
+ *
+ * Функция hyscan_gtk_map_track_index_get() может вызываться из разных потоков
+ * для разных галсов. Обращение к одному галсу должно происходить за блокировкой
+ * hyscan_map_track_model_lock().
+ */
+
+#include "hyscan-gtk-map-track-index.h"
+#include <hyscan-cartesian.h>
+#include <string.h>
+#include <math.h>
+
+#define CHUNK_SIZE       64        /* Число точек в одном участке. */
+#define N_LEVELS         16        /* Число уровней детализации. */
+#define LOD_BASE         1.0       /* Расстояние между точками первого уровня детализации, единицы карты. */
+#define LOD_TOLERANCE    0.5       /* Максимальное расстояние между точками уровня детализации, пиксели. */
+
+/* Списки точек галса. */
+enum
+{
+  LIST_NAV,
+  LIST_PORT,
+  LIST_STARBOARD,
+  N_LISTS
+};
+
+/* Уровень детализации галса. */
+typedef struct
+{
+  HyScanGtkMapTrackIndexData     data;              /* Участки галса. */
+  guint                         *sources[N_LISTS];  /* Номера точек в полном списке. */
+  guint                          n_kept[N_LISTS];   /* Число точек без добавленной последней точки галса. */
+  gboolean                       built;             /* Признак того, что уровень построен. */
+} HyScanGtkMapTrackIndexLevel;
+
+/* Участки одного галса. */
+typedef struct
+{
+  HyScanGtkMapTrackIndexData     data;              /* Участки галса. */
+  HyScanGtkMapTrackIndexLevel    levels[N_LEVELS];  /* Уровни детализации. */
+  gboolean                       built;             /* Признак того, что участки построены. */
+  gint                           generation;        /* Поколение индекса, в котором построены участки. */
+
+  /* Состояние данных галса, по которым построены участки. Указатели только сравниваются. */
+  gconstpointer                  nav;               /* Список точек навигации. */
+  gconstpointer                  port;              /* Список точек левого борта. */
+  gconstpointer                  starboard;         /* Список точек правого борта. */
+  HyScanGeoCartesian2D           from;              /* Границы галса. */
+  HyScanGeoCartesian2D           to;                /* Границы галса. */
+} HyScanGtkMapTrackIndexTrack;
+
+struct _HyScanGtkMapTrackIndexPrivate
+{
+  GMutex                         lock;              /* Блокировка доступа к таблице галсов. */
+  GHashTable                    *tracks;            /* Таблица галсов #HyScanGtkMapTrackIndexTrack. */
+  gint                           generation;        /* Поколение индекса. */
+};
+
+static void    hyscan_gtk_map_track_index_object_constructed       (GObject                     *object);
+static void    hyscan_gtk_map_track_index_object_finalize          (GObject                     *object);
+static void    hyscan_gtk_map_track_index_track_free               (HyScanGtkMapTrackIndexTrack *track);
+
+G_DEFINE_TYPE_WITH_PRIVATE (HyScanGtkMapTrackIndex, hyscan_gtk_map_track_index, G_TYPE_OBJECT)
+
+static void
+hyscan_gtk_map_track_index_class_init (HyScanGtkMapTrackIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = hyscan_gtk_map_track_index_object_constructed;
+  object_class->finalize = hyscan_gtk_map_track_index_object_finalize;
+}
+
+static void
+hyscan_gtk_map_track_index_init (HyScanGtkMapTrackIndex *gtk_map_track_index)
+{
+  gtk_map_track_index->priv = hyscan_gtk_map_track_index_get_instance_private (gtk_map_track_index);
+}
+
+static void
+hyscan_gtk_map_track_index_object_constructed (GObject *object)
+{
+  HyScanGtkMapTrackIndex *index = HYSCAN_GTK_MAP_TRACK_INDEX (object);
+  HyScanGtkMapTrackIndexPrivate *priv = index->priv;
+
+  G_OBJECT_CLASS (hyscan_gtk_map_track_index_parent_class)->constructed (object);
+
+  g_mutex_init (&priv->lock);
+  priv->tracks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify) hyscan_gtk_map_track_index_track_free);
+}
+
+static void
+hyscan_gtk_map_track_index_object_finalize (GObject *object)
+{
+  HyScanGtkMapTrackIndex *index = HYSCAN_GTK_MAP_TRACK_INDEX (object);
+  HyScanGtkMapTrackIndexPrivate *priv = index->priv;
+
+  g_hash_table_unref (priv->tracks);
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (hyscan_gtk_map_track_index_parent_class)->finalize (object);
+}
+
+/* Возвращает участки списка list. */
+static inline HyScanGtkMapTrackChunks *
+hyscan_gtk_map_track_index_list (HyScanGtkMapTrackIndexData *data,
+                                 guint                       list)
+{
+  if (list == LIST_NAV)
+    return &data->nav;
+  else if (list == LIST_PORT)
+    return &data->port;
+  else
+    return &data->starboard;
+}
+
+/* Освобождает участки галса. */
+static void
+hyscan_gtk_map_track_index_data_free (HyScanGtkMapTrackIndexData *data)
+{
+  guint i;
+
+  for (i = 0; i < N_LISTS; i++)
+    {
+      HyScanGtkMapTrackChunks *chunks = hyscan_gtk_map_track_index_list (data, i);
+
+      g_free (chunks->points);
+      g_free (chunks->chunks);
+    }
+}
+
+/* Освобождает галс. */
+static void
+hyscan_gtk_map_track_index_track_free (HyScanGtkMapTrackIndexTrack *track)
+{
+  guint i, j;
+
+  hyscan_gtk_map_track_index_data_free (&track->data);
+  for (i = 0; i < N_LEVELS; i++)
+    {
+      hyscan_gtk_map_track_index_data_free (&track->levels[i].data);
+      for (j = 0; j < N_LISTS; j++)
+        g_free (track->levels[i].sources[j]);
+    }
+
+  g_slice_free (HyScanGtkMapTrackIndexTrack, track);
+}
+
+/* Расширяет прямоугольник chunk так, чтобы он включал окрестность точки point радиусом margin. */
+static inline void
+hyscan_gtk_map_track_index_extend (HyScanGtkMapTrackChunk     *chunk,
+                                   const HyScanGeoCartesian2D *point,
+                                   gdouble                     margin)
+{
+  chunk->from.x = MIN (chunk->from.x, point->x - margin);
+  chunk->from.y = MIN (chunk->from.y, point->y - margin);
+  chunk->to.x = MAX (chunk->to.x, point->x + margin);
+  chunk->to.y = MAX (chunk->to.y, point->y + margin);
+}
+
+/* Копирует точки из списка list. Возвращает число точек в начале массива, которые не изменились. */
+static guint
+hyscan_gtk_map_track_index_copy (HyScanGtkMapTrackChunks *chunks,
+                                 GList                   *list)
+{
+  GList *link;
+  guint n_points, n_same;
+  guint i;
+
+  n_points = g_list_length (list);
+  chunks->points = g_renew (HyScanMapTrackPoint, chunks->points, n_points);
+
+  n_same = 0;
+  for (link = list, i = 0; link != NULL; link = link->next, i++)
+    {
+      if (i == n_same && i < chunks->n_points &&
+          memcmp (&chunks->points[i], link->data, sizeof (HyScanMapTrackPoint)) == 0)
+        {
+          n_same++;
+          continue;
+        }
+
+      memcpy (&chunks->points[i], link->data, sizeof (HyScanMapTrackPoint));
+    }
+
+  chunks->n_points = n_points;
+
+  return n_same;
+}
+
+/* Разбивает точки на участки, начиная с участка, который содержит точку start.
+ * Для точек навигации учитывается только положение судна, для точек бортов -
+ * вся область луча. */
+static void
+hyscan_gtk_map_track_index_split (HyScanGtkMapTrackChunks *chunks,
+                                  guint                    start,
+                                  gboolean                 side)
+{
+  guint n_points, n_chunks;
+  guint i, k;
+
+  n_points = chunks->n_points;
+  n_chunks = (n_points + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  chunks->chunks = g_renew (HyScanGtkMapTrackChunk, chunks->chunks, n_chunks);
+  chunks->n_chunks = n_chunks;
+
+  /* Точка start входит также в прямоугольник предыдущего участка. */
+  for (k = (start > 0) ? (start - 1) / CHUNK_SIZE : 0; k < n_chunks; k++)
+    {
+      HyScanGtkMapTrackChunk *chunk = &chunks->chunks[k];
+      guint last;
+
+      chunk->first = k * CHUNK_SIZE;
+      chunk->n_points = MIN (CHUNK_SIZE, n_points - chunk->first);
+      chunk->from.x = chunk->from.y = G_MAXDOUBLE;
+      chunk->to.x = chunk->to.y = -G_MAXDOUBLE;
+
+      /* Включаем первую точку следующего участка, чтобы учесть соединяющий отрезок. */
+      last = MIN (chunk->first + chunk->n_points, n_points - 1);
+      for (i = chunk->first; i <= last; i++)
+        {
+          HyScanMapTrackPoint *point = &chunks->points[i];
+          gdouble margin;
+
+          if (!side)
+            {
+              hyscan_gtk_map_track_index_extend (chunk, &point->ship_c2d, 0.0);
+              continue;
+            }
+
+          /* Точки без данных бортов не рисуются. */
+          if (point->b_dist <= 0)
+            continue;
+
+          /* Ближняя зона рисуется линией толщиной в апертуру антенны. */
+          margin = point->aperture / 2.0;
+          hyscan_gtk_map_track_index_extend (chunk, &point->ship_c2d, margin);
+          hyscan_gtk_map_track_index_extend (chunk, &point->start_c2d, margin);
+          hyscan_gtk_map_track_index_extend (chunk, &point->nr_c2d, margin);
+          hyscan_gtk_map_track_index_extend (chunk, &point->fr_c2d, margin);
+          hyscan_gtk_map_track_index_extend (chunk, &point->fr1_c2d, margin);
+          hyscan_gtk_map_track_index_extend (chunk, &point->fr2_c2d, margin);
+        }
+    }
+}
+
+/* Обновляет список list уровня детализации level по полному списку full, у которого
+ * не изменились первые n_same точек. Соседние точки уровня отстоят друг от друга
+ * не меньше, чем на tolerance. */
+static void
+hyscan_gtk_map_track_index_simplify (HyScanGtkMapTrackIndexLevel   *level,
+                                     guint                          list,
+                                     const HyScanGtkMapTrackChunks *full,
+                                     guint                          n_same,
+                                     gdouble                        tolerance)
+{
+  HyScanGtkMapTrackChunks *chunks;
+  HyScanMapTrackPoint *last = NULL;
+  guint *sources;
+  gboolean side;
+  guint n, start, i;
+
+  chunks = hyscan_gtk_map_track_index_list (&level->data, list);
+  side = (list != LIST_NAV);
+
+  /* Оставляем точки, выбранные среди неизменившихся точек полного списка. */
+  n = level->n_kept[list];
+  while (n > 0 && level->sources[list][n - 1] >= n_same)
+    n--;
+
+  start = n;
+  chunks->points = g_renew (HyScanMapTrackPoint, chunks->points, full->n_points + 1);
+  sources = level->sources[list] = g_renew (guint, level->sources[list], full->n_points + 1);
+
+  /* Последнюю оставленную точку восстанавливаем, она могла быть расширена. */
+  i = 0;
+  if (n > 0)
+    {
+      i = sources[n - 1];
+      chunks->points[n - 1] = full->points[i];
+      last = &chunks->points[n - 1];
+      i++;
+    }
+
+  for (; i < full->n_points; i++)
+    {
+      const HyScanMapTrackPoint *point = &full->points[i];
+
+      if (side)
+        {
+          gdouble gap;
+
+          /* Точки без данных бортов не рисуются. */
+          if (point->b_dist <= 0)
+            continue;
+
+          if (last != NULL)
+            {
+              gap = fabs (point->dist_along - last->dist_along);
+              if (gap < tolerance)
+                continue;
+
+              /* Расширяем луч на пропущенные точки, но не закрываем настоящие разрывы в данных. */
+              if (gap < 2.0 * tolerance)
+                last->aperture = MAX (last->aperture, gap);
+            }
+        }
+      else if (last != NULL && hyscan_cartesian_distance (&point->ship_c2d, &last->ship_c2d) < tolerance)
+        {
+          continue;
+        }
+
+      chunks->points[n] = *point;
+      sources[n] = i;
+      last = &chunks->points[n];
+      n++;
+    }
+
+  level->n_kept[list] = n;
+
+  /* Линия движения всегда заканчивается в последней точке галса. */
+  if (!side && n > 0 && sources[n - 1] != full->n_points - 1)
+    {
+      chunks->points[n] = full->points[full->n_points - 1];
+      sources[n] = full->n_points - 1;
+      n++;
+    }
+
+  chunks->n_points = n;
+  chunks->points = g_renew (HyScanMapTrackPoint, chunks->points, n);
+  level->sources[list] = g_renew (guint, sources, n);
+
+  /* Точка start - 1 могла быть расширена. */
+  hyscan_gtk_map_track_index_split (chunks, (start > 0) ? start - 1 : 0, side);
+}
+
+/* Обновляет уровень детализации number. */
+static void
+hyscan_gtk_map_track_index_level_update (HyScanGtkMapTrackIndexTrack *track,
+                                         guint                        number,
+                                         const guint                 *n_same)
+{
+  HyScanGtkMapTrackIndexLevel *level = &track->levels[number];
+  guint i;
+
+  for (i = 0; i < N_LISTS; i++)
+    {
+      hyscan_gtk_map_track_index_simplify (level, i,
+                                           hyscan_gtk_map_track_index_list (&track->data, i),
+                                           n_same[i], ldexp (LOD_BASE, number));
+    }
+
+  level->built = TRUE;
+}
+
+/**
+ * hyscan_gtk_map_track_index_new:
+ *
+ * Создаёт индекс участков галсов.
+ *
+ * Returns: (transfer full): новый объект #HyScanGtkMapTrackIndex, для удаления g_object_unref().
+ */
+HyScanGtkMapTrackIndex *
+hyscan_gtk_map_track_index_new (void)
+{
+  return g_object_new (HYSCAN_TYPE_GTK_MAP_TRACK_INDEX, NULL);
+}
+
+/**
+ * hyscan_gtk_map_track_index_invalidate:
+ * @index: указатель на #HyScanGtkMapTrackIndex
+ *
+ * Помечает участки всех галсов устаревшими. Участки будут перестроены при
+ * следующем вызове hyscan_gtk_map_track_index_get(). Функцию следует вызывать
+ * при любом изменении данных галсов, например, по сигналу
+ * #HyScanMapTrackModel::changed.
+ */
+void
+hyscan_gtk_map_track_index_invalidate (HyScanGtkMapTrackIndex *index)
+{
+  g_return_if_fail (HYSCAN_IS_GTK_MAP_TRACK_INDEX (index));
+
+  g_atomic_int_inc (&index->priv->generation);
+}
+
+/**
+ * hyscan_gtk_map_track_index_update:
+ * @index: указатель на #HyScanGtkMapTrackIndex
+ * @model: модель галсов #HyScanMapTrackModel
+ *
+ * Помечает участки всех галсов устаревшими, как hyscan_gtk_map_track_index_invalidate(),
+ * и удаляет участки галсов, которых нет в списке галсов модели @model. Функцию
+ * следует вызывать по сигналу #HyScanMapTrackModel::changed.
+ */
+void
+hyscan_gtk_map_track_index_update (HyScanGtkMapTrackIndex *index,
+                                   HyScanMapTrackModel    *model)
+{
+  HyScanGtkMapTrackIndexPrivate *priv;
+  GHashTableIter iter;
+  GPtrArray *stale;
+  gchar **tracks;
+  const gchar *track_name;
+  guint i;
+
+  g_return_if_fail (HYSCAN_IS_GTK_MAP_TRACK_INDEX (index));
+  priv = index->priv;
+
+  g_atomic_int_inc (&priv->generation);
+
+  tracks = hyscan_map_track_model_get_tracks (model);
+  if (tracks == NULL)
+    return;
+
+  /* Ищем галсы, которых больше нет в модели. */
+  stale = g_ptr_array_new_with_free_func (g_free);
+  g_mutex_lock (&priv->lock);
+  g_hash_table_iter_init (&iter, priv->tracks);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &track_name, NULL))
+    {
+      if (!g_strv_contains ((const gchar * const *) tracks, track_name))
+        g_ptr_array_add (stale, g_strdup (track_name));
+    }
+  g_mutex_unlock (&priv->lock);
+
+  /* Участки галса могут использоваться при рисовании за блокировкой галса,
+   * поэтому удаляем их за той же блокировкой. */
+  for (i = 0; i < stale->len; i++)
+    {
+      HyScanMapTrackModelInfo *info;
+
+      track_name = g_ptr_array_index (stale, i);
+      info = hyscan_map_track_model_lock (model, track_name);
+
+      g_mutex_lock (&priv->lock);
+      g_hash_table_remove (priv->tracks, track_name);
+      g_mutex_unlock (&priv->lock);
+
+      if (info != NULL)
+        hyscan_map_track_model_unlock (info);
+    }
+
+  g_ptr_array_unref (stale);
+  g_strfreev (tracks);
+}
+
+/**
+ * hyscan_gtk_map_track_index_get:
+ * @index: указатель на #HyScanGtkMapTrackIndex
+ * @track_name: имя галса
+ * @data: данные галса
+ * @scale: масштаб рисования, единицы карты на пиксель; 0 - без упрощения
+ *
+ * Возвращает участки галса, при необходимости перестраивая их по данным @data.
+ * В мелком масштабе @scale возвращаются участки упрощённого галса, в котором
+ * расстояние между соседними точками не превышает половины пикселя.
+ *
+ * Функция должна вызываться за блокировкой hyscan_map_track_model_lock()
+ * галса @track_name.
+ *
+ * Returns: (transfer none): участки галса, действительные до снятия блокировки.
+ */
+const HyScanGtkMapTrackIndexData *
+hyscan_gtk_map_track_index_get (HyScanGtkMapTrackIndex   *index,
+                                const gchar              *track_name,
+                                const HyScanMapTrackData *data,
+                                gdouble                   scale)
+{
+  HyScanGtkMapTrackIndexPrivate *priv;
+  HyScanGtkMapTrackIndexTrack *track;
+  gint generation;
+  gint number;
+  guint i;
+
+  g_return_val_if_fail (HYSCAN_IS_GTK_MAP_TRACK_INDEX (index), NULL);
+  priv = index->priv;
+
+  g_mutex_lock (&priv->lock);
+  track = g_hash_table_lookup (priv->tracks, track_name);
+  if (track == NULL)
+    {
+      track = g_slice_new0 (HyScanGtkMapTrackIndexTrack);
+      g_hash_table_insert (priv->tracks, g_strdup (track_name), track);
+    }
+  g_mutex_unlock (&priv->lock);
+
+  generation = g_atomic_int_get (&priv->generation);
+  if (!track->built ||
+      track->generation != generation ||
+      track->nav != data->nav || track->port != data->port || track->starboard != data->starboard ||
+      track->from.x != data->from.x || track->from.y != data->from.y ||
+      track->to.x != data->to.x || track->to.y != data->to.y)
+    {
+      guint n_same[N_LISTS];
+
+      /* Перестраиваем только изменившуюся часть галса. */
+      n_same[LIST_NAV] = hyscan_gtk_map_track_index_copy (&track->data.nav, data->nav);
+      n_same[LIST_PORT] = hyscan_gtk_map_track_index_copy (&track->data.port, data->port);
+      n_same[LIST_STARBOARD] = hyscan_gtk_map_track_index_copy (&track->data.starboard, data->starboard);
+
+      hyscan_gtk_map_track_index_split (&track->data.nav, n_same[LIST_NAV], FALSE);
+      hyscan_gtk_map_track_index_split (&track->data.port, n_same[LIST_PORT], TRUE);
+      hyscan_gtk_map_track_index_split (&track->data.starboard, n_same[LIST_STARBOARD], TRUE);
+
+      for (i = 0; i < N_LEVELS; i++)
+        {
+          if (track->levels[i].built)
+            hyscan_gtk_map_track_index_level_update (track, i, n_same);
+        }
+
+      track->built = TRUE;
+      track->generation = generation;
+      track->nav = data->nav;
+      track->port = data->port;
+      track->starboard = data->starboard;
+      track->from = data->from;
+      track->to = data->to;
+    }
+
+  /* Выбираем самый грубый уровень, на котором точки отстоят не больше, чем на LOD_TOLERANCE пикселя. */
+  if (scale * LOD_TOLERANCE < LOD_BASE)
+    return &track->data;
+
+  number = (gint) floor (log2 (scale * LOD_TOLERANCE / LOD_BASE));
+  number = MIN (number, N_LEVELS - 1);
+  if (!track->levels[number].built)
+    {
+      const guint n_same[N_LISTS] = { 0 };
+
+      hyscan_gtk_map_track_index_level_update (track, number, n_same);
+    }
+
+  return &track->levels[number].data;
+}
+
+/**
+ * hyscan_gtk_map_track_chunk_is_visible:
+ * @chunk: участок галса
+ * @from: вершина области рисования
+ * @to: противоположная вершина области рисования
+ * @margin: отступ вокруг участка, например, на толщину линий
+ *
+ * Проверяет, пересекает ли участок галса область рисования.
+ *
+ * Returns: %TRUE, если участок нужно рисовать.
+ */
+gboolean
+hyscan_gtk_map_track_chunk_is_visible (const HyScanGtkMapTrackChunk *chunk,
+                                       const HyScanGeoCartesian2D   *from,
+                                       const HyScanGeoCartesian2D   *to,
+                                       gdouble                       margin)
+{
+  return chunk->from.x - margin <= MAX (from->x, to->x) &&
+         chunk->to.x + margin >= MIN (from->x, to->x) &&
+         chunk->from.y - margin <= MAX (from->y, to->y) &&
+         chunk->to.y + margin >= MIN (from->y, to->y);
+}
@@ -0,0 +1,143 @@
+/* hyscan-gtk-map-track-index.h
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_GTK_MAP_TRACK_INDEX_H__
+#define __HYSCAN_GTK_MAP_TRACK_INDEX_H__
+
+#include <hyscan-map-track-model.h>
+
+G_BEGIN_DECLS
+
+#define HYSCAN_TYPE_GTK_MAP_TRACK_INDEX             (hyscan_gtk_map_track_index_get_type ())
+#define HYSCAN_GTK_MAP_TRACK_INDEX(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), HYSCAN_TYPE_GTK_MAP_TRACK_INDEX, HyScanGtkMapTrackIndex))
+#define HYSCAN_IS_GTK_MAP_TRACK_INDEX(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HYSCAN_TYPE_GTK_MAP_TRACK_INDEX))
+#define HYSCAN_GTK_MAP_TRACK_INDEX_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), HYSCAN_TYPE_GTK_MAP_TRACK_INDEX, HyScanGtkMapTrackIndexClass))
+#define HYSCAN_IS_GTK_MAP_TRACK_INDEX_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_GTK_MAP_TRACK_INDEX))
+#define HYSCAN_GTK_MAP_TRACK_INDEX_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_GTK_MAP_TRACK_INDEX, HyScanGtkMapTrackIndexClass))
+
+typedef struct _HyScanGtkMapTrackIndex HyScanGtkMapTrackIndex;
+typedef struct _HyScanGtkMapTrackIndexPrivate HyScanGtkMapTrackIndexPrivate;
+typedef struct _HyScanGtkMapTrackIndexClass HyScanGtkMapTrackIndexClass;
+
+/**
+ * HyScanGtkMapTrackChunk:
+ * @from: левая нижняя вершина прямоугольника, внутри которого находится участок
+ * @to: правая верхняя вершина прямоугольника, внутри которого находится участок
+ * @first: индекс первой точки участка в массиве точек
+ * @n_points: число точек участка
+ *
+ * Участок галса из нескольких подряд идущих точек. Прямоугольник участка
+ * включает также первую точку следующего участка, чтобы в него попадал
+ * соединяющий их отрезок. Если на участке нечего рисовать, то from.x > to.x.
+ */
+typedef struct
+{
+  HyScanGeoCartesian2D         from;
+  HyScanGeoCartesian2D         to;
+  guint                        first;
+  guint                        n_points;
+} HyScanGtkMapTrackChunk;
+
+/**
+ * HyScanGtkMapTrackChunks:
+ * @points: точки галса, расположенные подряд в памяти
+ * @n_points: число точек
+ * @chunks: участки галса
+ * @n_chunks: число участков
+ *
+ * Точки одного из списков галса, разбитые на участки.
+ */
+typedef struct
+{
+  HyScanMapTrackPoint         *points;
+  guint                        n_points;
+  HyScanGtkMapTrackChunk      *chunks;
+  guint                        n_chunks;
+} HyScanGtkMapTrackChunks;
+
+/**
+ * HyScanGtkMapTrackIndexData:
+ * @nav: точки навигации
+ * @port: точки левого борта
+ * @starboard: точки правого борта
+ *
+ * Точки галса, разбитые на участки.
+ */
+typedef struct
+{
+  HyScanGtkMapTrackChunks      nav;
+  HyScanGtkMapTrackChunks      port;
+  HyScanGtkMapTrackChunks      starboard;
+} HyScanGtkMapTrackIndexData;
+
+struct _HyScanGtkMapTrackIndex
+{
+  GObject parent_instance;
+
+  HyScanGtkMapTrackIndexPrivate *priv;
+};
+
+struct _HyScanGtkMapTrackIndexClass
+{
+  GObjectClass parent_class;
+};
+
+HYSCAN_API
+GType                               hyscan_gtk_map_track_index_get_type      (void);
+
+HYSCAN_API
+HyScanGtkMapTrackIndex *            hyscan_gtk_map_track_index_new           (void);
+
+HYSCAN_API
+void                                hyscan_gtk_map_track_index_invalidate    (HyScanGtkMapTrackIndex       *index);
+
+HYSCAN_API
+void                                hyscan_gtk_map_track_index_update        (HyScanGtkMapTrackIndex       *index,
+                                                                              HyScanMapTrackModel          *model);
+
+HYSCAN_API
+const HyScanGtkMapTrackIndexData *  hyscan_gtk_map_track_index_get           (HyScanGtkMapTrackIndex       *index,
+                                                                              const gchar                  *track_name,
+                                                                              const HyScanMapTrackData     *data,
+                                                                              gdouble                       scale);
+
+HYSCAN_API
+gboolean                            hyscan_gtk_map_track_chunk_is_visible    (const HyScanGtkMapTrackChunk *chunk,
+                                                                              const HyScanGeoCartesian2D   *from,
+                                                                              const HyScanGeoCartesian2D   *to,
+                                                                              gdouble                       margin);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_GTK_MAP_TRACK_INDEX_H__ */
@@ -43,7 +43,13 @@
  * указанного проекта.
  *
  * - hyscan_gtk_map_wfmark_new() - создание нового слоя;
- * - hyscan_gtk_map_wfmark_mark_view() - переход к указанной метке.
+ * - hyscan_gtk_map_wfmark_mark_view() - переход к указанной метке;
+ * - hyscan_gtk_map_wfmark_set_colormap() - установка цветовой схемы изображений меток;
+ * - hyscan_gtk_map_wfmark_set_levels() - установка уровней изображений меток.
+ *
+ * Раскрашенные акустические изображения меток хранятся в кэше слоя ограниченного
+ * объёма и используются повторно, пока не изменятся метка, масштаб карты или
+ * параметры раскраски.
  *
  * Стиль слоя может быть настроен с помощью ini-файла:
  * - "mark-color" - цвет контура метки
@@ -54,6 +60,7 @@
 #include "hyscan-gtk-map-wfmark.h"
 #include "hyscan-gtk-map.h"
 #include "hyscan-gtk-layer-param.h"
+#include "hyscan-map-rtree.h"
 #include <hyscan-cartesian.h>
 #include <math.h>
 #include <string.h>
@@ -74,6 +81,10 @@
   #define VISIBLE_AREA_PADDING 0
 #endif
 
+#define THUMBNAILS_MAX_SIZE  (64 << 20)   /* Максимальный объём кэша изображений меток, байт. */
+#define DRAW_MARGIN          100          /* Отступ от видимой области, в котором ещё рисуются метки, пикс. */
+#define HOVER_MARGIN         5.0          /* Расстояние до метки нулевой ширины, при котором она выделяется, пикс. */
+
 enum
 {
   PROP_O,
@@ -91,6 +102,7 @@ enum
 
 typedef struct
 {
+  const gchar                 *mark_id;         /* Идентификатор метки (принадлежит priv->marks). */
   HyScanMarkLocation          *mloc;            /* Указатель на оригинальную метку (принадлежит priv->marks). */
 
   /* Поля ниже определяются переводом географических координат метки в СК карты с учетом текущей проекции. */
@@ -120,6 +132,35 @@ typedef struct
   gfloat                               ppi;                /* PPI дисплея. */
 } HyScanGtkMapWfmarkDrawMark;
 
+/* Параметры рисования меток, найденных в пространственном индексе. */
+typedef struct
+{
+  HyScanGtkMapWfmark                  *wfm_layer;          /* Слой. */
+  cairo_t                             *cairo;              /* Контекст рисования. */
+  HyScanGtkMapWfmarkDrawMark          *draw_mark;          /* Параметры рисования метки. */
+  gboolean                             queue_added;        /* Признак отправки тайла на генерацию. */
+} HyScanGtkMapWfmarkDrawFound;
+
+/* Параметры поиска метки под курсором мыши. */
+typedef struct
+{
+  HyScanGeoCartesian2D                 cursor;             /* Координаты курсора. */
+  gdouble                              scale;              /* Масштаб GtkCifroArea. */
+  const HyScanGtkMapWfmarkLocation    *hover;              /* Найденная метка. */
+  gdouble                              min_distance;       /* Расстояние от курсора до центра найденной метки. */
+} HyScanGtkMapWfmarkHoverSearch;
+
+/* Раскрашенное акустическое изображение метки. */
+typedef struct
+{
+  gchar                               *mark_id;            /* Идентификатор метки. */
+  gint64                               mtime;              /* Время изменения метки. */
+  HyScanTile                          *tile;               /* Параметры тайла изображения. */
+  cairo_surface_t                     *surface;            /* Изображение. */
+  gsize                                size;               /* Объём изображения, байт. */
+  GList                               *link;               /* Элемент в очереди priv->thumbnails_lru. */
+} HyScanGtkMapWfmarkThumbnail;
+
 struct _HyScanGtkMapWfmarkPrivate
 {
   HyScanGtkMap                          *map;             /* Карта. */
@@ -134,8 +175,14 @@ struct _HyScanGtkMapWfmarkPrivate
   HyScanFactoryAmplitude                *factory_amp;     /* Фабрика объектов акустических данных. */
   HyScanFactoryDepth                    *factory_dpt;     /* Фабрика объектов глубины. */
   HyScanTileQueue                       *tile_queue;      /* Очередь для работы с аккустическими изображениями. */
+  HyScanTileColor                       *tile_color;      /* Раскраска аккустических изображений. */
+
+  GHashTable                            *thumbnails;      /* Изображения меток #HyScanGtkMapWfmarkThumbnail. */
+  GQueue                                 thumbnails_lru;  /* Изображения в порядке использования, новые в начале. */
+  gsize                                  thumbnails_size; /* Объём изображений в кэше, байт. */
 
   GHashTable                            *marks;           /* Хэш-таблица меток #HyScanGtkMapWfmarkLocation. */
+  HyScanMapRTree                        *rtree;           /* Пространственный индекс загруженных меток. */
 
   const HyScanGtkMapWfmarkLocation      *hover_location;  /* Метка, над которой находится курсор мыши. */
   const HyScanGtkMapWfmarkLocation      *hover_candidate; /* Метка, над которой находится курсор мыши. */
@@ -166,6 +213,7 @@ static void     hyscan_gtk_map_wfmark_object_finalize          (GObject
 static void     hyscan_gtk_map_wfmark_model_changed            (HyScanGtkMapWfmark         *wfm_layer);
 static void     hyscan_gtk_map_wfmark_location_free            (HyScanGtkMapWfmarkLocation *location);
 static gboolean hyscan_gtk_map_wfmark_redraw                   (gpointer                    data);
+static void     hyscan_gtk_map_wfmark_thumbnail_free           (HyScanGtkMapWfmarkThumbnail *thumbnail);
 static void     hyscan_gtk_map_wfmark_tile_loaded              (HyScanGtkMapWfmark         *wfm_layer,
                                                                 HyScanTile                 *tile,
                                                                 gfloat                     *img,
@@ -257,6 +305,9 @@ hyscan_gtk_map_wfmark_object_constructed (GObject *object)
 
   priv->marks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                        (GDestroyNotify) hyscan_gtk_map_wfmark_location_free);
+  priv->thumbnails = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) hyscan_gtk_map_wfmark_thumbnail_free);
+  priv->rtree = hyscan_map_rtree_new ();
 
   g_signal_connect_swapped (priv->model, "changed",
                             G_CALLBACK (hyscan_gtk_map_wfmark_model_changed), wfm_layer);
@@ -285,6 +336,11 @@ hyscan_gtk_map_wfmark_object_constructed (GObject *object)
                                             priv->cache,
                                             priv->factory_amp,
                                             priv->factory_dpt);
+
+  /* Раскраска изображений меток. 1.0 / 2.2 = 0.454545... */
+  priv->tile_color = hyscan_tile_color_new (priv->cache);
+  hyscan_tile_color_set_levels_for_all (priv->tile_color, 0.0, 0.454545, 1.0);
+
   /* Отображаем акустические изображения меток.*/
   priv->show_mode = SHOW_ACOUSTIC_IMAGE;
 
@@ -302,7 +358,10 @@ hyscan_gtk_map_wfmark_object_finalize (GObject *object)
   /*  Отключаемся от сигнала готовности тайла. */
   g_signal_handlers_disconnect_by_data (priv->tile_queue, gtk_map_wfmark);
 
+  g_object_unref (priv->rtree);
   g_hash_table_unref (priv->marks);
+  g_hash_table_unref (priv->thumbnails);
+  g_queue_clear (&priv->thumbnails_lru);
   g_object_unref (priv->param);
   g_object_unref (priv->pango_layout);
   g_object_unref (priv->model);
@@ -310,6 +369,7 @@ hyscan_gtk_map_wfmark_object_finalize (GObject *object)
   g_object_unref (priv->cache);
 
   g_object_unref (priv->tile_queue);
+  g_object_unref (priv->tile_color);
   g_object_unref (priv->factory_dpt);
   g_object_unref (priv->factory_amp);
 
@@ -391,6 +451,40 @@ hyscan_gtk_map_wfmark_location_free (HyScanGtkMapWfmarkLocation *location)
   g_slice_free (HyScanGtkMapWfmarkLocation, location);
 }
 
+/* Обновляет положение метки в пространственном индексе. В индекс попадают
+ * только загруженные метки, спроецированные на карту. */
+static void
+hyscan_gtk_map_wfmark_index_location (HyScanGtkMapWfmark         *wfm_layer,
+                                      HyScanGtkMapWfmarkLocation *location)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+
+  if (priv->map != NULL && location->mloc->loaded)
+    hyscan_map_rtree_insert (priv->rtree, location, &location->extent_from, &location->extent_to);
+  else
+    hyscan_map_rtree_remove (priv->rtree, location);
+}
+
+/* Пересчитывает координаты всех меток и заново строит пространственный индекс. */
+static void
+hyscan_gtk_map_wfmark_reindex (HyScanGtkMapWfmark *wfm_layer)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+  GHashTableIter iter;
+  HyScanGtkMapWfmarkLocation *location;
+
+  hyscan_map_rtree_clear (priv->rtree);
+  if (priv->map == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, priv->marks);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
+    {
+      hyscan_gtk_map_wfmark_project_location (wfm_layer, location);
+      hyscan_gtk_map_wfmark_index_location (wfm_layer, location);
+    }
+}
+
 static gboolean
 hyscan_gtk_map_wfmark_insert_mark (gpointer key,
                                    gpointer value,
@@ -399,12 +493,47 @@ hyscan_gtk_map_wfmark_insert_mark (gpointer key,
   HyScanGtkMapWfmark *wfm_layer = HYSCAN_GTK_MAP_WFMARK (user_data);
   HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
   HyScanGtkMapWfmarkLocation *location;
+  HyScanGeoCartesian2D extent_from, extent_to;
+  gboolean loaded;
+
+  location = g_hash_table_lookup (priv->marks, key);
+
+  /* Новая метка. */
+  if (location == NULL)
+    {
+      location = hyscan_gtk_map_wfmark_location_new ();
+      location->mark_id = key;
+      location->mloc = value;
+
+      g_hash_table_insert (priv->marks, key, location);
+      if (priv->map == NULL)
+        return TRUE;
+
+      hyscan_gtk_map_wfmark_project_location (wfm_layer, location);
+      hyscan_gtk_map_wfmark_index_location (wfm_layer, location);
 
-  location = hyscan_gtk_map_wfmark_location_new ();
+      return TRUE;
+    }
+
+  /* Существующая метка: заменяем данные, а индекс обновляем, только если метка сдвинулась. */
+  loaded = location->mloc->loaded;
+  extent_from = location->extent_from;
+  extent_to = location->extent_to;
+
+  hyscan_mark_location_free (location->mloc);
   location->mloc = value;
+  g_free (key);
+
+  if (priv->map == NULL)
+    return TRUE;
 
   hyscan_gtk_map_wfmark_project_location (wfm_layer, location);
-  g_hash_table_insert (priv->marks, key, location);
+  if (loaded != location->mloc->loaded ||
+      extent_from.x != location->extent_from.x || extent_from.y != location->extent_from.y ||
+      extent_to.x != location->extent_to.x || extent_to.y != location->extent_to.y)
+    {
+      hyscan_gtk_map_wfmark_index_location (wfm_layer, location);
+    }
 
   return TRUE;
 }
@@ -421,15 +550,221 @@ hyscan_gtk_map_wfmark_model_changed (HyScanGtkMapWfmark *wfm_layer)
   marks = hyscan_mark_loc_model_get (priv->model);
 
   priv->hover_location = NULL;
-  g_hash_table_remove_all (priv->marks);
+  priv->hover_candidate = NULL;
+
+  /* Удаляем метки, которых больше нет в модели. */
+  {
+    GHashTableIter iter;
+    gchar *mark_id;
+    HyScanGtkMapWfmarkLocation *location;
+
+    g_hash_table_iter_init (&iter, priv->marks);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &mark_id, (gpointer *) &location))
+      {
+        if (g_hash_table_contains (marks, mark_id))
+          continue;
+
+        hyscan_map_rtree_remove (priv->rtree, location);
+        g_hash_table_iter_remove (&iter);
+      }
+  }
+
+  /* Добавляем новые и обновляем изменённые метки. */
   g_hash_table_foreach_steal (marks, hyscan_gtk_map_wfmark_insert_mark, wfm_layer);
 
+  /* Удаляем изображения удалённых и изменённых меток. */
+  {
+    GHashTableIter iter;
+    HyScanGtkMapWfmarkThumbnail *thumbnail;
+    HyScanGtkMapWfmarkLocation *location;
+
+    g_hash_table_iter_init (&iter, priv->thumbnails);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &thumbnail))
+      {
+        location = g_hash_table_lookup (priv->marks, thumbnail->mark_id);
+        if (location != NULL && location->mloc->mark->mtime == thumbnail->mtime)
+          continue;
+
+        g_queue_delete_link (&priv->thumbnails_lru, thumbnail->link);
+        priv->thumbnails_size -= thumbnail->size;
+        g_hash_table_iter_remove (&iter);
+      }
+  }
+
   if (priv->map != NULL)
     gtk_widget_queue_draw (GTK_WIDGET (priv->map));
 
   g_hash_table_unref (marks);
 }
 
+/* Освобождает изображение метки. */
+static void
+hyscan_gtk_map_wfmark_thumbnail_free (HyScanGtkMapWfmarkThumbnail *thumbnail)
+{
+  g_free (thumbnail->mark_id);
+  g_object_unref (thumbnail->tile);
+  cairo_surface_destroy (thumbnail->surface);
+  g_slice_free (HyScanGtkMapWfmarkThumbnail, thumbnail);
+}
+
+/* Удаляет изображение метки из кэша. */
+static void
+hyscan_gtk_map_wfmark_thumbnail_remove (HyScanGtkMapWfmark          *wfm_layer,
+                                        HyScanGtkMapWfmarkThumbnail *thumbnail)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+
+  g_queue_delete_link (&priv->thumbnails_lru, thumbnail->link);
+  priv->thumbnails_size -= thumbnail->size;
+  g_hash_table_remove (priv->thumbnails, thumbnail->mark_id);
+}
+
+/* Проверяет, что изображение построено для тайла с такими же параметрами. */
+static gboolean
+hyscan_gtk_map_wfmark_thumbnail_match (HyScanGtkMapWfmarkThumbnail *thumbnail,
+                                       gint64                       mtime,
+                                       HyScanTile                  *tile)
+{
+  HyScanTile *cached = thumbnail->tile;
+
+  return thumbnail->mtime == mtime &&
+         cached->info.source == tile->info.source &&
+         cached->info.flags == tile->info.flags &&
+         cached->info.ppi == tile->info.ppi &&
+         cached->info.across_start == tile->info.across_start &&
+         cached->info.across_end == tile->info.across_end &&
+         cached->info.along_start == tile->info.along_start &&
+         cached->info.along_end == tile->info.along_end;
+}
+
+/* Ищет раскрашенное изображение метки mark_id для тайла tile. Возвращает новую
+ * ссылку на изображение или NULL, если изображения нет или оно устарело. */
+static cairo_surface_t *
+hyscan_gtk_map_wfmark_thumbnail_lookup (HyScanGtkMapWfmark *wfm_layer,
+                                        const gchar        *mark_id,
+                                        gint64              mtime,
+                                        HyScanTile         *tile)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+  HyScanGtkMapWfmarkThumbnail *thumbnail;
+
+  thumbnail = g_hash_table_lookup (priv->thumbnails, mark_id);
+  if (thumbnail == NULL || !hyscan_gtk_map_wfmark_thumbnail_match (thumbnail, mtime, tile))
+    return NULL;
+
+  /* Переносим изображение в начало очереди. */
+  g_queue_unlink (&priv->thumbnails_lru, thumbnail->link);
+  g_queue_push_head_link (&priv->thumbnails_lru, thumbnail->link);
+
+  return cairo_surface_reference (thumbnail->surface);
+}
+
+/* Помещает раскрашенное изображение метки в кэш, вытесняя давно не использованные изображения. */
+static void
+hyscan_gtk_map_wfmark_thumbnail_insert (HyScanGtkMapWfmark *wfm_layer,
+                                        const gchar        *mark_id,
+                                        gint64              mtime,
+                                        HyScanTile         *tile,
+                                        cairo_surface_t    *surface)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+  HyScanGtkMapWfmarkThumbnail *thumbnail;
+
+  thumbnail = g_hash_table_lookup (priv->thumbnails, mark_id);
+  if (thumbnail != NULL)
+    hyscan_gtk_map_wfmark_thumbnail_remove (wfm_layer, thumbnail);
+
+  thumbnail = g_slice_new (HyScanGtkMapWfmarkThumbnail);
+  thumbnail->mark_id = g_strdup (mark_id);
+  thumbnail->mtime = mtime;
+  thumbnail->tile = g_object_ref (tile);
+  thumbnail->surface = cairo_surface_reference (surface);
+  thumbnail->size = (gsize) cairo_image_surface_get_stride (surface) * cairo_image_surface_get_height (surface);
+
+  g_queue_push_head (&priv->thumbnails_lru, thumbnail);
+  thumbnail->link = priv->thumbnails_lru.head;
+  priv->thumbnails_size += thumbnail->size;
+  g_hash_table_insert (priv->thumbnails, thumbnail->mark_id, thumbnail);
+
+  /* Последнее добавленное изображение остаётся в кэше, даже если оно больше допустимого объёма. */
+  while (priv->thumbnails_size > THUMBNAILS_MAX_SIZE && priv->thumbnails_lru.length > 1)
+    hyscan_gtk_map_wfmark_thumbnail_remove (wfm_layer, g_queue_peek_tail (&priv->thumbnails_lru));
+}
+
+/* Удаляет все изображения меток из кэша. */
+static void
+hyscan_gtk_map_wfmark_thumbnail_clear (HyScanGtkMapWfmark *wfm_layer)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+
+  g_queue_clear (&priv->thumbnails_lru);
+  g_hash_table_remove_all (priv->thumbnails);
+  priv->thumbnails_size = 0;
+}
+
+/* Раскрашивает акустическое изображение метки из очереди генерации тайлов. Если тайла
+ * ещё нет, отправляет его на генерацию и поднимает флаг queue_added. Возвращает новую
+ * ссылку на изображение или NULL. */
+static cairo_surface_t *
+hyscan_gtk_map_wfmark_thumbnail_render (HyScanGtkMapWfmark               *wfm_layer,
+                                        const gchar                      *mark_id,
+                                        const HyScanGtkMapWfmarkLocation *location,
+                                        HyScanTile                       *tile,
+                                        gboolean                         *queue_added)
+{
+  HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+  HyScanTileCacheable tile_cacheable;
+  HyScanTileSurface tile_surface;
+  cairo_surface_t *surface;
+  gfloat *image = NULL;
+  guint32 size = 0;
+
+  tile_cacheable.w =      /* Будет заполнено генератором. */
+  tile_cacheable.h = 0;   /* Будет заполнено генератором. */
+  tile_cacheable.finalized = FALSE;   /* Будет заполнено генератором. */
+
+  if (!hyscan_tile_queue_check (priv->tile_queue, tile, &tile_cacheable, NULL))
+    {
+      HyScanCancellable *cancellable;
+      cancellable = hyscan_cancellable_new ();
+      /* Добавляем тайл в очередь на генерацию. */
+      hyscan_tile_queue_add (priv->tile_queue, tile, cancellable);
+      g_object_unref (cancellable);
+      *queue_added = TRUE;
+
+      return NULL;
+    }
+
+  if (!hyscan_tile_queue_get (priv->tile_queue, tile, &tile_cacheable, &image, &size))
+    return NULL;
+
+  /* Тайл найден в кэше, раскрашиваем его сразу в изображение cairo. */
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tile_cacheable.w, tile_cacheable.h);
+  cairo_surface_flush (surface);
+
+  tile_surface.width  = tile_cacheable.w;
+  tile_surface.height = tile_cacheable.h;
+  tile_surface.stride = cairo_image_surface_get_stride (surface);
+  tile_surface.data   = cairo_image_surface_get_data (surface);
+
+  hyscan_tile_color_add (priv->tile_color, tile, image, size, &tile_surface);
+
+  if (!hyscan_tile_color_check (priv->tile_color, tile, &tile_cacheable))
+    {
+      cairo_surface_destroy (surface);
+      return NULL;
+    }
+
+  hyscan_tile_color_get (priv->tile_color, tile, &tile_cacheable, &tile_surface);
+  cairo_surface_mark_dirty (surface);
+
+  /* Запоминаем изображение, только если данные метки больше не изменятся. */
+  if (mark_id != NULL && tile_cacheable.finalized)
+    hyscan_gtk_map_wfmark_thumbnail_insert (wfm_layer, mark_id, location->mloc->mark->mtime, tile, surface);
+
+  return surface;
+}
+
 /* Функция рисует отдельную метку с параметрами mark. Если в результате тайл
  * с изображением метки был отправлен на генерацию, то будет поднят флаг queue_added. */
 static void
@@ -447,15 +782,12 @@ hyscan_gtk_map_wfmark_draw_mark (HyScanGtkMapWfmark         *wfm_layer,
   HyScanGeoCartesian2D area_rect_from = mark->area_rect_from, area_rect_to = mark->area_rect_to;
 
   HyScanTile *tile = NULL;
-  HyScanTileCacheable tile_cacheable;
   cairo_surface_t *surface = NULL;
   gdouble current_sin, current_cos,
           width, height,
           new_width, new_height,
           tmp;
   GdkRGBA *color = NULL;
-  gfloat *image = NULL;
-  guint32 size = 0;
 
   HyScanGeoCartesian2D position, new_position, offset,
                        m0, m2, b0, b2,
@@ -463,7 +795,6 @@ hyscan_gtk_map_wfmark_draw_mark (HyScanGtkMapWfmark         *wfm_layer,
                        m1, m3, b1, b3,
 #endif
                        border_from, border_to;
-  HyScanTileSurface tile_surface;
 
   current_sin = sin (location->angle);
   current_cos = cos (location->angle);
@@ -696,50 +1027,12 @@ hyscan_gtk_map_wfmark_draw_mark (HyScanGtkMapWfmark         *wfm_layer,
           tile->info.rotate   = FALSE;
           tile->info.flags    = location->mloc->has_course ? HYSCAN_TILE_PROFILER : HYSCAN_TILE_GROUND;
 
-          tile_cacheable.w =      /* Будет заполнено генератором. */
-          tile_cacheable.h = 0;   /* Будет заполнено генератором. */
-          tile_cacheable.finalized = FALSE;   /* Будет заполнено генератором. */
+          /* Раскрашенное изображение метки берём из кэша слоя или из очереди генерации тайлов. */
+          if (mark_id != NULL)
+            surface = hyscan_gtk_map_wfmark_thumbnail_lookup (wfm_layer, mark_id, location->mloc->mark->mtime, tile);
 
-          if (hyscan_tile_queue_check (priv->tile_queue, tile, &tile_cacheable, NULL))
-            {
-              if (hyscan_tile_queue_get (priv->tile_queue, tile, &tile_cacheable, &image, &size))
-                {
-                  /* Тайл найден в кэше. */
-
-                  HyScanTileColor *tile_color;
-
-                  tile_color = hyscan_tile_color_new (priv->cache);
-                  /* 1.0 / 2.2 = 0.454545... */
-                  hyscan_tile_color_set_levels (tile_color, tile->info.source, 0.0, 0.454545, 1.0);
-
-                  tile_surface.width  = tile_cacheable.w;
-                  tile_surface.height = tile_cacheable.h;
-                  tile_surface.stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, tile_surface.width);
-                  tile_surface.data   = g_malloc0 (tile_surface.height * tile_surface.stride);
-
-                  hyscan_tile_color_add (tile_color, tile, image, size, &tile_surface);
-
-                  if (hyscan_tile_color_check (tile_color, tile, &tile_cacheable))
-                    {
-                      hyscan_tile_color_get (tile_color, tile, &tile_cacheable, &tile_surface);
-                      surface = cairo_image_surface_create_for_data ( (guchar*)tile_surface.data,
-                                            CAIRO_FORMAT_ARGB32, tile_surface.width,
-                                            tile_surface.height, tile_surface.stride);
-                    }
-
-                  hyscan_tile_color_close (tile_color);
-                  g_object_unref (tile_color);
-               }
-            }
-          else
-            {
-              HyScanCancellable *cancellable;
-              cancellable = hyscan_cancellable_new ();
-              /* Добавляем тайл в очередь на генерацию. */
-              hyscan_tile_queue_add (priv->tile_queue, tile, cancellable);
-              g_object_unref (cancellable);
-              *queue_added = TRUE;
-            }
+          if (surface == NULL)
+            surface = hyscan_gtk_map_wfmark_thumbnail_render (wfm_layer, mark_id, location, tile, queue_added);
         }
       g_object_unref (tile);
     }
@@ -794,7 +1087,6 @@ hyscan_gtk_map_wfmark_draw_mark (HyScanGtkMapWfmark         *wfm_layer,
       cairo_set_source_surface (cairo, surface, -width, -height);
       cairo_paint (cairo);
       cairo_surface_destroy (surface);
-      g_free (tile_surface.data);
 
       cairo_set_line_width (cairo, selected ? 2.0 * priv->line_width : priv->line_width);
 
@@ -976,6 +1268,23 @@ hyscan_gtk_map_wfmark_draw_mark (HyScanGtkMapWfmark         *wfm_layer,
   cairo_restore (cairo);
 }
 
+/* Рисует метку, найденную в пространственном индексе. */
+static void
+hyscan_gtk_map_wfmark_draw_found (gpointer item,
+                                  gpointer user_data)
+{
+  HyScanGtkMapWfmarkDrawFound *found = user_data;
+  HyScanGtkMapWfmarkLocation *location = item;
+
+  /* Метку под курсором рисуем последней, поверх остальных. */
+  if (found->wfm_layer->priv->hover_location == location)
+    return;
+
+  found->draw_mark->location = location;
+  hyscan_gtk_map_wfmark_draw_mark (found->wfm_layer, found->cairo, location->mark_id,
+                                   found->draw_mark, &found->queue_added);
+}
+
 /* Рисует слой по сигналу "visible-draw". */
 static void
 hyscan_gtk_map_wfmark_draw (HyScanGtkMap       *map,
@@ -983,14 +1292,11 @@ hyscan_gtk_map_wfmark_draw (HyScanGtkMap       *map,
                             HyScanGtkMapWfmark *wfm_layer)
 {
   HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
-  GHashTableIter iter;
-  HyScanGtkMapWfmarkLocation *location;
-  gchar *mark_id;
   static guint id = 0;
-  gboolean queue_added = FALSE;
   guint area_width, area_height;
   HyScanGtkMapWfmarkDrawMark draw_mark;
-  const gchar *hover_id = NULL;
+  HyScanGtkMapWfmarkDrawFound found;
+  HyScanGeoCartesian2D view_from, view_to;
 
   if (!hyscan_gtk_layer_get_visible (HYSCAN_GTK_LAYER (wfm_layer)))
     return;
@@ -1009,20 +1315,18 @@ hyscan_gtk_map_wfmark_draw (HyScanGtkMap       *map,
 
   draw_mark.ppi = 1e-3 * HYSCAN_GTK_MAP_MM_PER_INCH * draw_mark.scale_px;
 
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &mark_id, (gpointer *) &location))
-    {
-      gboolean hovered = (priv->hover_location == location) ? TRUE : FALSE;
-
-      if (hovered)
-        hover_id = mark_id;
+  /* Рисуем только метки, попадающие в видимую область. */
+  gtk_cifro_area_get_view (GTK_CIFRO_AREA (priv->map), &view_from.x, &view_to.x, &view_from.y, &view_to.y);
+  view_from.x -= DRAW_MARGIN * draw_mark.scale;
+  view_from.y -= DRAW_MARGIN * draw_mark.scale;
+  view_to.x += DRAW_MARGIN * draw_mark.scale;
+  view_to.y += DRAW_MARGIN * draw_mark.scale;
 
-      if (!location->mloc->loaded || hovered)
-        continue;
-
-      draw_mark.location = location;
-      hyscan_gtk_map_wfmark_draw_mark (wfm_layer, cairo, mark_id, &draw_mark, &queue_added);
-    }
+  found.wfm_layer = wfm_layer;
+  found.cairo = cairo;
+  found.draw_mark = &draw_mark;
+  found.queue_added = FALSE;
+  hyscan_map_rtree_search (priv->rtree, &view_from, &view_to, hyscan_gtk_map_wfmark_draw_found, &found);
 
 #ifdef DEBUG_GRAPHIC_MARK
     {
@@ -1040,13 +1344,52 @@ hyscan_gtk_map_wfmark_draw (HyScanGtkMap       *map,
   if (priv->hover_location != NULL)
     {
       draw_mark.location = priv->hover_location;
-      hyscan_gtk_map_wfmark_draw_mark (wfm_layer, cairo, hover_id, &draw_mark, &queue_added);
+      hyscan_gtk_map_wfmark_draw_mark (wfm_layer, cairo, priv->hover_location->mark_id,
+                                       &draw_mark, &found.queue_added);
     }
 
-  if (queue_added)
+  if (found.queue_added)
     hyscan_tile_queue_add_finished (priv->tile_queue, id++);
 }
 
+/* Проверяет, находится ли курсор над меткой, найденной в пространственном индексе. */
+static void
+hyscan_gtk_map_wfmark_hover_check (gpointer item,
+                                   gpointer user_data)
+{
+  HyScanGtkMapWfmarkHoverSearch *search = user_data;
+  const HyScanGtkMapWfmarkLocation *location = item;
+  HyScanGeoCartesian2D rotated;
+  gboolean is_inside;           /* Признак того, что курсор внутри метки. */
+  gdouble mark_distance;
+
+  hyscan_cartesian_rotate (&search->cursor, &location->center_c2d, location->angle, &rotated);
+  if (location->rect_from.x != location->rect_to.x)
+    /* В случае, если метка имеет ненулевую ширину, проверяем,
+     * что курсор мыши попал во внутреннюю область метки .*/
+    {
+      is_inside = hyscan_cartesian_is_point_inside (&rotated, &location->rect_from, &location->rect_to);
+    }
+  else
+    /* В случае, если метка с нулевой шириной, проверяем,
+     * что курсор мыши на расстоянии 5px от линии метки. */
+    {
+      is_inside = location->rect_from.y < rotated.y && rotated.y < location->rect_to.y &&
+                  ABS (location->rect_from.x - rotated.x) < HOVER_MARGIN * search->scale;
+    }
+
+  if (!is_inside)
+    return;
+
+  /* Среди всех меток под курсором выбираем ту, чей центр ближе к курсору. */
+  mark_distance = hyscan_cartesian_distance (&location->center_c2d, &search->cursor);
+  if (mark_distance < search->min_distance)
+    {
+      search->min_distance = mark_distance;
+      search->hover = location;
+    }
+}
+
 /* Находит метку под курсором мыши. */
 static const HyScanGtkMapWfmarkLocation *
 hyscan_gtk_map_wfmark_find_hover (HyScanGtkMapWfmark   *wfm_layer,
@@ -1054,57 +1397,24 @@ hyscan_gtk_map_wfmark_find_hover (HyScanGtkMapWfmark   *wfm_layer,
                                   gdouble              *distance)
 {
   HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
+  HyScanGtkMapWfmarkHoverSearch search;
+  HyScanGeoCartesian2D from, to;
 
-  HyScanGtkMapWfmarkLocation *hover = NULL;
-  gdouble min_distance = G_MAXDOUBLE;
-
-  GHashTableIter iter;
-  HyScanGtkMapWfmarkLocation *location;
-
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
-    {
-      HyScanGeoCartesian2D rotated;
-      gboolean is_inside;           /* Признак того, что курсор внутри метки. */
-
-      if (!location->mloc->loaded)
-        continue;
-
-      hyscan_cartesian_rotate (cursor, &location->center_c2d, location->angle, &rotated);
-      if (location->rect_from.x != location->rect_to.x)
-        /* В случае, если метка имеет ненулевую ширину, проверяем,
-         * что курсор мыши попал во внутреннюю область метки .*/
-        {
-          is_inside = hyscan_cartesian_is_point_inside (&rotated, &location->rect_from, &location->rect_to);
-        }
-      else
-        /* В случае, если метка с нулевой шириной, проверяем,
-         * что курсор мыши на расстоянии 5px от линии метки. */
-        {
-          gdouble scale;
+  search.cursor = *cursor;
+  search.hover = NULL;
+  search.min_distance = G_MAXDOUBLE;
+  gtk_cifro_area_get_scale (GTK_CIFRO_AREA (priv->map), &search.scale, NULL);
 
-          gtk_cifro_area_get_scale (GTK_CIFRO_AREA (priv->map), &scale, NULL);
-          is_inside = location->rect_from.y < rotated.y && rotated.y < location->rect_to.y &&
-                      ABS (location->rect_from.x - rotated.x) < 5.0 * scale;
-        }
+  /* Кандидаты - метки, чей extent находится рядом с курсором. Отступ нужен для меток нулевой ширины. */
+  from.x = cursor->x - HOVER_MARGIN * search.scale;
+  from.y = cursor->y - HOVER_MARGIN * search.scale;
+  to.x = cursor->x + HOVER_MARGIN * search.scale;
+  to.y = cursor->y + HOVER_MARGIN * search.scale;
+  hyscan_map_rtree_search (priv->rtree, &from, &to, hyscan_gtk_map_wfmark_hover_check, &search);
 
-      if (is_inside)
-        {
-          gdouble mark_distance;
+  *distance = search.min_distance;
 
-          /* Среди всех меток под курсором выбираем ту, чей центр ближе к курсору. */
-          mark_distance = hyscan_cartesian_distance (&location->center_c2d, cursor);
-          if (mark_distance < min_distance)
-            {
-              min_distance = mark_distance;
-              hover = location;
-            }
-        }
-    }
-
-  *distance = min_distance;
-
-  return hover;
+  return search.hover;
 }
 
 /* Обработчик сигнала HyScanGtkMap::notify::projection.
@@ -1116,13 +1426,9 @@ hyscan_gtk_map_wfmark_proj_notify (HyScanGtkMap *map,
 {
   HyScanGtkMapWfmark *wfm_layer = HYSCAN_GTK_MAP_WFMARK (user_data);
   HyScanGtkMapWfmarkPrivate *priv = wfm_layer->priv;
-  GHashTableIter iter;
-  HyScanGtkMapWfmarkLocation *location;
 
   /* Обновляем координаты меток согласно новой проекции. */
-  g_hash_table_iter_init (&iter, priv->marks);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
-    hyscan_gtk_map_wfmark_project_location (wfm_layer, location);
+  hyscan_gtk_map_wfmark_reindex (wfm_layer);
 
   gtk_widget_queue_draw (GTK_WIDGET (priv->map));
 }
@@ -1154,6 +1460,9 @@ hyscan_gtk_map_wfmark_added (HyScanGtkLayer          *gtk_layer,
   g_signal_connect_after (priv->map, "visible-draw", G_CALLBACK (hyscan_gtk_map_wfmark_draw), wfm_layer);
   g_signal_connect (priv->map, "notify::projection", G_CALLBACK (hyscan_gtk_map_wfmark_proj_notify), wfm_layer);
   g_signal_connect_swapped (priv->map, "configure-event", G_CALLBACK (hyscan_gtk_map_wfmark_configure), wfm_layer);
+
+  /* Метки, полученные до добавления слоя на карту, проецируем сейчас. */
+  hyscan_gtk_map_wfmark_reindex (wfm_layer);
 }
 
 static void
@@ -1166,6 +1475,7 @@ hyscan_gtk_map_wfmark_removed (HyScanGtkLayer *gtk_layer)
 
   g_signal_handlers_disconnect_by_data (priv->map, wfm_layer);
   g_clear_object (&priv->map);
+  hyscan_map_rtree_clear (priv->rtree);
 }
 
 static void
@@ -1449,6 +1759,7 @@ hyscan_gtk_map_wfmark_set_project (HyScanGtkMapWfmark *wfm_layer,
 
   g_free (priv->project);
   priv->project = g_strdup (project_name);
+  hyscan_gtk_map_wfmark_thumbnail_clear (wfm_layer);
   hyscan_factory_amplitude_set_project (priv->factory_amp,
                                         priv->db,
                                         priv->project);
@@ -1479,3 +1790,67 @@ hyscan_gtk_map_wfmark_set_show_mode (HyScanGtkMapWfmark *wfm_layer,
   priv->show_mode = mode;
   gtk_widget_queue_draw (GTK_WIDGET (priv->map));
 }
+
+/**
+ * hyscan_gtk_map_wfmark_set_colormap:
+ * @wfm_layer: указатель на объект
+ * @colormap: (in) (array length=length): цветовая схема
+ * @length: количество элементов в цветовой схеме
+ * @background: цвет фона
+ *
+ * Функция устанавливает цветовую схему акустических изображений меток.
+ *
+ * Returns: TRUE, если параметры успешно скопированы.
+ */
+gboolean
+hyscan_gtk_map_wfmark_set_colormap (HyScanGtkMapWfmark *wfm_layer,
+                                    guint32            *colormap,
+                                    guint               length,
+                                    guint32             background)
+{
+  HyScanGtkMapWfmarkPrivate *priv;
+  gboolean status;
+
+  g_return_val_if_fail (HYSCAN_IS_GTK_MAP_WFMARK (wfm_layer), FALSE);
+  priv = wfm_layer->priv;
+
+  status = hyscan_tile_color_set_colormap_for_all (priv->tile_color, colormap, length, background);
+  hyscan_gtk_map_wfmark_thumbnail_clear (wfm_layer);
+
+  if (priv->map != NULL)
+    gtk_widget_queue_draw (GTK_WIDGET (priv->map));
+
+  return status;
+}
+
+/**
+ * hyscan_gtk_map_wfmark_set_levels:
+ * @wfm_layer: указатель на объект
+ * @black: уровень черной точки
+ * @gamma: гамма
+ * @white: уровень белой точки
+ *
+ * Функция устанавливает уровни акустических изображений меток.
+ *
+ * Returns: TRUE, если параметры успешно скопированы.
+ */
+gboolean
+hyscan_gtk_map_wfmark_set_levels (HyScanGtkMapWfmark *wfm_layer,
+                                  gdouble             black,
+                                  gdouble             gamma,
+                                  gdouble             white)
+{
+  HyScanGtkMapWfmarkPrivate *priv;
+  gboolean status;
+
+  g_return_val_if_fail (HYSCAN_IS_GTK_MAP_WFMARK (wfm_layer), FALSE);
+  priv = wfm_layer->priv;
+
+  status = hyscan_tile_color_set_levels_for_all (priv->tile_color, black, gamma, white);
+  hyscan_gtk_map_wfmark_thumbnail_clear (wfm_layer);
+
+  if (priv->map != NULL)
+    gtk_widget_queue_draw (GTK_WIDGET (priv->map));
+
+  return status;
+}
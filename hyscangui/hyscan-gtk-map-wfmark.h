@@ -91,6 +91,18 @@ HYSCAN_API
 void             hyscan_gtk_map_wfmark_set_show_mode  (HyScanGtkMapWfmark    *wfm_layer,
                                                        gint                   mode);
 
+HYSCAN_API
+gboolean         hyscan_gtk_map_wfmark_set_colormap   (HyScanGtkMapWfmark    *wfm_layer,
+                                                       guint32               *colormap,
+                                                       guint                  length,
+                                                       guint32                background);
+
+HYSCAN_API
+gboolean         hyscan_gtk_map_wfmark_set_levels     (HyScanGtkMapWfmark    *wfm_layer,
+                                                       gdouble                black,
+                                                       gdouble                gamma,
+                                                       gdouble                white);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_GTK_MAP_WFMARK_H__ */
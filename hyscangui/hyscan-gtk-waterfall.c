@@ -79,6 +79,13 @@
  * время. При этом дистанция на изображении будет отличаться от реальной
  * на величину, соответствующую скорости судна умноженной на период
  * перегенерации.
+ *
+ * Окончательно сформированные тайлы, которые больше не будут изменяться,
+ * виджет хранит в виде готовых поверхностей до тех пор, пока они остаются
+ * в видимой области. При сдвиге изображения, например, при автосдвижке, такие
+ * тайлы просто перерисовываются, без повторного поиска в кэше и раскрашивания.
+ * Поверхности сбрасываются при смене масштаба, галса, источников, параметров
+ * генерации и раскрашивания тайлов.
  */
 
 #include "hyscan-gtk-waterfall.h"
@@ -113,11 +120,23 @@ static const gdouble zooms_gost[] = {25000., 20000., 15000., 10000.,
                                          5.,     4.,     2.,    1.};
 static const int ZOOM_LEVELS = G_N_ELEMENTS (zooms_gost);
 
+/* Окончательно сформированный тайл видимой области. */
+typedef struct
+{
+  gint64                 key;                /* Координаты тайла. */
+  cairo_surface_t       *surface;            /* Изображение тайла. */
+  guint64                view_id;            /* Последний view, в котором тайл был виден. */
+} HyScanGtkWaterfallSurface;
+
 struct _HyScanGtkWaterfallPrivate
 {
   gfloat                 ppi;                /* PPI. */
   cairo_surface_t       *surface;            /* Поверхность тайла. */
 
+  GHashTable            *surfaces;           /* Окончательно сформированные тайлы видимой области. */
+  gint32                 surfaces_tile_size; /* Размер тайлов в таблице surfaces. */
+  gint                   surfaces_reset;     /* Признак необходимости сбросить таблицу surfaces. */
+
   HyScanTileQueue       *queue;
   HyScanTileColor       *color;
 
@@ -190,7 +209,10 @@ static HyScanTile * hyscan_gtk_waterfall_prepare_tile        (HyScanGtkWaterfall
                                                               gfloat                         scale);
 static gboolean hyscan_gtk_waterfall_get_tile                (HyScanGtkWaterfall            *self,
                                                               HyScanTile                    *tile,
-                                                              cairo_surface_t              **tile_surface);
+                                                              cairo_surface_t              **tile_surface,
+                                                              gboolean                      *finalized);
+static void     hyscan_gtk_waterfall_surface_free            (HyScanGtkWaterfallSurface     *surface);
+static void     hyscan_gtk_waterfall_surfaces_reset          (HyScanGtkWaterfall            *self);
 static void     hyscan_gtk_waterfall_hash_changed            (HyScanGtkWaterfall            *self,
                                                               gulong                         hash);
 static void     hyscan_gtk_waterfall_image_generated         (HyScanGtkWaterfall            *self,
@@ -323,6 +345,9 @@ hyscan_gtk_waterfall_object_constructed (GObject *object)
   af = hyscan_gtk_waterfall_state_get_amp_factory (HYSCAN_GTK_WATERFALL_STATE (self));
   df = hyscan_gtk_waterfall_state_get_dpt_factory (HYSCAN_GTK_WATERFALL_STATE (self));
 
+  priv->surfaces = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL,
+                                          (GDestroyNotify) hyscan_gtk_waterfall_surface_free);
+
   priv->queue = hyscan_tile_queue_new (n_threads, cache, af, df);
   priv->color = hyscan_tile_color_new (cache);
   priv->lrect = hyscan_track_rect_new (cache, af, df);
@@ -383,6 +408,7 @@ hyscan_gtk_waterfall_object_finalize (GObject *object)
 
   cairo_surface_destroy (priv->surface);
   cairo_surface_destroy (priv->dummy);
+  g_hash_table_unref (priv->surfaces);
 
   g_free (priv->zooms);
   g_free (priv->track);
@@ -519,7 +545,8 @@ hyscan_gtk_waterfall_prepare_tile (HyScanGtkWaterfallPrivate *priv,
 static gboolean
 hyscan_gtk_waterfall_get_tile (HyScanGtkWaterfall *self,
                                HyScanTile         *tile,
-                               cairo_surface_t   **surface)
+                               cairo_surface_t   **surface,
+                               gboolean           *finalized)
 {
   HyScanGtkWaterfallPrivate *priv = self->priv;;
 
@@ -533,6 +560,7 @@ hyscan_gtk_waterfall_get_tile (HyScanGtkWaterfall *self,
   HyScanCancellable *cancellable = NULL;
 
   queue_found = color_found = regenerate = FALSE;
+  *finalized = FALSE;
 
   /* Собираем информацию об имеющихся тайлах и их тождественности. */
   queue_found = hyscan_tile_queue_check (priv->queue, tile, &queue_cache, &regenerate);
@@ -578,8 +606,9 @@ hyscan_gtk_waterfall_get_tile (HyScanGtkWaterfall *self,
   switch (show_strategy)
     {
     case SHOW:
-      /* Просто отображаем тайл. */
+      /* Просто отображаем тайл. Окончательно сформированный тайл больше не изменится. */
       tile->cacheable = color_cache;
+      *finalized = color_cache.finalized && !regenerate;
       return hyscan_tile_color_get (priv->color, tile, &color_cache, &tile_surface);
 
     case RECOLOR:
@@ -597,6 +626,34 @@ hyscan_gtk_waterfall_get_tile (HyScanGtkWaterfall *self,
   return TRUE;
 }
 
+/* Функция освобождает окончательно сформированный тайл. */
+static void
+hyscan_gtk_waterfall_surface_free (HyScanGtkWaterfallSurface *surface)
+{
+  cairo_surface_destroy (surface->surface);
+  g_slice_free (HyScanGtkWaterfallSurface, surface);
+}
+
+/* Функция потокобезопасно помечает окончательно сформированные тайлы
+ * как устаревшие. Они будут удалены при следующей отрисовке. */
+static void
+hyscan_gtk_waterfall_surfaces_reset (HyScanGtkWaterfall *self)
+{
+  g_atomic_int_set (&self->priv->surfaces_reset, TRUE);
+}
+
+/* Функция удаляет тайлы, не попавшие в текущий view. */
+static gboolean
+hyscan_gtk_waterfall_surface_expired (gpointer key,
+                                      gpointer value,
+                                      gpointer user_data)
+{
+  HyScanGtkWaterfallSurface *surface = value;
+  guint64 *view_id = user_data;
+
+  return surface->view_id != *view_id;
+}
+
 /* Функция отлавливает сигнал "tile-queue-hash". */
 static void
 hyscan_gtk_waterfall_hash_changed (HyScanGtkWaterfall *self,
@@ -606,6 +663,7 @@ hyscan_gtk_waterfall_hash_changed (HyScanGtkWaterfall *self,
    * использовать GSIZE_TO_POINTER.
    */
   g_atomic_pointer_set (&self->priv->tq_hash, GSIZE_TO_POINTER (hash));
+  hyscan_gtk_waterfall_surfaces_reset (self);
 }
 
 /* Функция асинхронно разукрашивает тайл. */
@@ -708,6 +766,14 @@ hyscan_gtk_waterfall_visible_draw (GtkWidget *widget,
   /* Начался новый view. */
   priv->view_id++;
 
+  /* Сформированные тайлы другого масштаба или с устаревшими параметрами не нужны. */
+  if (g_atomic_int_compare_and_exchange (&priv->surfaces_reset, TRUE, FALSE) ||
+      priv->surfaces_tile_size != tile_size)
+    {
+      g_hash_table_remove_all (priv->surfaces);
+      priv->surfaces_tile_size = tile_size;
+    }
+
   /* Определяем возможность ПЕРЕгенерации тайлов. */
   priv->regen_time = g_get_monotonic_time ();
   priv->regen_allowed =  priv->regen_time - priv->regen_time_prev > priv->regen_period;
@@ -724,7 +790,23 @@ hyscan_gtk_waterfall_visible_draw (GtkWidget *widget,
     {
       for (i = num_of_tiles_y - 1; i >= 0; i--)
         {
+          HyScanGtkWaterfallSurface *known;
           HyScanTile * tile;
+          gboolean finalized;
+          gint64 key;
+
+          /* Окончательно сформированный тайл просто перерисовываем. */
+          key = (gint64) (((guint64) (guint32) (start_tile_x0 + j * tile_size) << 32) |
+                          (guint32) (start_tile_y0 + i * tile_size));
+          known = g_hash_table_lookup (priv->surfaces, &key);
+          if (known != NULL)
+            {
+              x_coord = x_coord0 + j * cairo_image_surface_get_width (known->surface);
+              y_coord = y_coord0 - i * cairo_image_surface_get_height (known->surface);
+              hyscan_gtk_waterfall_draw_surface (known->surface, cairo, x_coord, y_coord);
+              known->view_id = priv->view_id;
+              continue;
+            }
 
           tile = hyscan_gtk_waterfall_prepare_tile (priv,
                                                     start_tile_x0 + j * tile_size,
@@ -734,12 +816,24 @@ hyscan_gtk_waterfall_visible_draw (GtkWidget *widget,
                                                     scale);
 
           /* Ищем тайл. */
-          if (priv->open && hyscan_gtk_waterfall_get_tile (self, tile, &(priv->surface)))
+          if (priv->open && hyscan_gtk_waterfall_get_tile (self, tile, &(priv->surface), &finalized))
             {
               x_coord = x_coord0 + j * tile->cacheable.w;
               y_coord = y_coord0 - i * tile->cacheable.h;
 
               source_surface = priv->surface;
+              cairo_surface_mark_dirty (source_surface);
+
+              /* Забираем поверхность окончательно сформированного тайла себе. */
+              if (finalized)
+                {
+                  known = g_slice_new (HyScanGtkWaterfallSurface);
+                  known->key = key;
+                  known->surface = priv->surface;
+                  priv->surface = NULL;
+                  known->view_id = priv->view_id;
+                  g_hash_table_insert (priv->surfaces, &known->key, known);
+                }
             }
           /* Если не нашли, отрисовываем заглушку. */
           else
@@ -762,6 +856,9 @@ hyscan_gtk_waterfall_visible_draw (GtkWidget *widget,
 
   priv->view_finalised = view_finalised;
 
+  /* Тайлы, вышедшие из видимой области, больше не храним. */
+  g_hash_table_foreach_remove (priv->surfaces, hyscan_gtk_waterfall_surface_expired, &priv->view_id);
+
   if (priv->task_sent)
     {
       priv->regen_time_prev = priv->regen_time;
@@ -850,7 +947,6 @@ hyscan_gtk_waterfall_draw_surface (cairo_surface_t *src,
                                    gdouble          x,
                                    gdouble          y)
 {
-  cairo_surface_mark_dirty (src);
   cairo_save (dst);
   cairo_translate (dst, x, y);
   cairo_set_source_surface (dst, src, 0, 0);
@@ -878,6 +974,8 @@ hyscan_gtk_waterfall_create_dummy (HyScanGtkWaterfall *self)
   for (i = 0; i < TILE_SIZE_PX; i++)
     for (j = 0; j < TILE_SIZE_PX; j++)
       *((guint32*)(data + i * stride + j * sizeof (guint32))) = priv->dummy_color;
+
+  cairo_surface_mark_dirty (priv->dummy);
 }
 
 /* Функция обработки сигнала изменения параметров дисплея. */
@@ -1200,6 +1298,7 @@ hyscan_gtk_waterfall_sources_changed (HyScanGtkWaterfallState *model,
   hyscan_track_rect_set_source (priv->lrect, track, priv->left_source);
   hyscan_track_rect_set_source (priv->rrect, track, priv->right_source);
 
+  hyscan_gtk_waterfall_surfaces_reset (self);
   g_free (track);
 }
 
@@ -1209,6 +1308,7 @@ hyscan_gtk_waterfall_tile_flags_changed (HyScanGtkWaterfallState *model,
                                          HyScanGtkWaterfall   *self)
 {
   self->priv->tile_flags = hyscan_gtk_waterfall_state_get_tile_flags (model);
+  hyscan_gtk_waterfall_surfaces_reset (self);
 }
 
 /* Функция обрабатывает смену профиля. */
@@ -1235,6 +1335,7 @@ hyscan_gtk_waterfall_track_changed (HyScanGtkWaterfallState *model,
     }
 
   priv->open = FALSE;
+  hyscan_gtk_waterfall_surfaces_reset (self);
 
   g_clear_pointer (&priv->track, g_free);
   hyscan_gtk_waterfall_state_get_track (model, &db, &project, &priv->track);
@@ -1372,6 +1473,7 @@ hyscan_gtk_waterfall_set_upsample (HyScanGtkWaterfall *self,
   g_return_if_fail (HYSCAN_IS_GTK_WATERFALL (self));
 
   self->priv->tile_upsample = upsample;
+  hyscan_gtk_waterfall_surfaces_reset (self);
 }
 
 /**
@@ -1395,6 +1497,7 @@ hyscan_gtk_waterfall_set_colormap (HyScanGtkWaterfall *self,
 {
   g_return_val_if_fail (HYSCAN_IS_GTK_WATERFALL (self), FALSE);
 
+  hyscan_gtk_waterfall_surfaces_reset (self);
   gtk_widget_queue_draw (GTK_WIDGET (self));
 
   return hyscan_tile_color_set_colormap (self->priv->color, source, colormap, length, background);
@@ -1419,6 +1522,7 @@ hyscan_gtk_waterfall_set_colormap_for_all (HyScanGtkWaterfall *self,
 {
   g_return_val_if_fail (HYSCAN_IS_GTK_WATERFALL (self), FALSE);
 
+  hyscan_gtk_waterfall_surfaces_reset (self);
   gtk_widget_queue_draw (GTK_WIDGET (self));
 
   return hyscan_tile_color_set_colormap_for_all (self->priv->color, colormap, length, background);
@@ -1445,6 +1549,7 @@ hyscan_gtk_waterfall_set_levels (HyScanGtkWaterfall *self,
 {
   g_return_val_if_fail (HYSCAN_IS_GTK_WATERFALL (self), FALSE);
 
+  hyscan_gtk_waterfall_surfaces_reset (self);
   gtk_widget_queue_draw (GTK_WIDGET (self));
 
   return hyscan_tile_color_set_levels (self->priv->color, source, black, gamma, white);
@@ -1469,6 +1574,7 @@ hyscan_gtk_waterfall_set_levels_for_all (HyScanGtkWaterfall *self,
 {
   g_return_val_if_fail (HYSCAN_IS_GTK_WATERFALL (self), FALSE);
 
+  hyscan_gtk_waterfall_surfaces_reset (self);
   gtk_widget_queue_draw (GTK_WIDGET (self));
 
   return hyscan_tile_color_set_levels_for_all (self->priv->color, black, gamma, white);
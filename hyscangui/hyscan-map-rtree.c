@@ -0,0 +1,700 @@
+/* hyscan-map-rtree.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/**
+ * SECTION: hyscan-map-rtree
+ * @Short_description: Пространственный индекс объектов на карте
+ * @Title: HyScanMapRTree
+ * @See_also: #HyScanGtkMapWfmark, #HyScanGtkMapGeomark
+ *
+ * Класс реализует R-дерево - индекс прямоугольных областей на плоскости.
+ * Индекс позволяет быстро найти все объекты, чьи границы пересекают заданную
+ * область, например, видимую часть карты или окрестность указателя мыши.
+ *
+ * Элементами индекса являются произвольные указатели, каждый из которых
+ * может присутствовать в индексе только один раз:
+ *
+ * - hyscan_map_rtree_insert() - добавляет или обновляет элемент;
+ * - hyscan_map_rtree_remove() - удаляет элемент;
+ * - hyscan_map_rtree_search() - находит элементы, пересекающие область;
+ * - hyscan_map_rtree_clear() - удаляет все элементы.
+ *
+ * Индекс изменяется инкрементально: добавление и удаление элемента требуют
+ * O(log n) операций. Переполненные узлы делятся квадратичным алгоритмом
+ * Гуттмана, опустевшие узлы расформировываются с повторной вставкой их
+ * элементов.
+ *
+ * Класс не является потокобезопасным.
+ */
+
+#include "hyscan-map-rtree.h"
+#include <string.h>
+
+#define MAX_ENTRIES    16      /* Максимальное число записей в узле. */
+#define MIN_ENTRIES    4       /* Минимальное число записей в узле, кроме корня. */
+#define STACK_SIZE     (16 * MAX_ENTRIES) /* Размер стека обхода дерева, достаточный для 4^16 элементов. */
+
+typedef struct _HyScanMapRTreeNode HyScanMapRTreeNode;
+
+/* Прямоугольник со сторонами вдоль осей координат. */
+typedef struct
+{
+  gdouble                      x0;                  /* Минимальная координата по оси X. */
+  gdouble                      y0;                  /* Минимальная координата по оси Y. */
+  gdouble                      x1;                  /* Максимальная координата по оси X. */
+  gdouble                      y1;                  /* Максимальная координата по оси Y. */
+} HyScanMapRTreeRect;
+
+/* Запись узла. */
+typedef struct
+{
+  HyScanMapRTreeRect           rect;                /* Границы дочернего узла или элемента. */
+  gpointer                     child;               /* Дочерний узел или элемент, если узел - лист. */
+} HyScanMapRTreeEntry;
+
+/* Узел дерева. Одна запись сверх максимума нужна для переполнения перед делением узла. */
+struct _HyScanMapRTreeNode
+{
+  HyScanMapRTreeNode          *parent;              /* Родительский узел. */
+  guint                        level;               /* Высота узла над листьями, у листьев 0. */
+  guint                        n_entries;           /* Число записей. */
+  HyScanMapRTreeEntry          entries[MAX_ENTRIES + 1]; /* Записи. */
+};
+
+struct _HyScanMapRTreePrivate
+{
+  HyScanMapRTreeNode          *root;                /* Корень дерева. */
+  GHashTable                  *leaves;              /* Таблица листьев, в которых находятся элементы. */
+};
+
+static void                 hyscan_map_rtree_object_constructed       (GObject                   *object);
+static void                 hyscan_map_rtree_object_finalize          (GObject                   *object);
+static HyScanMapRTreeNode * hyscan_map_rtree_node_new                 (guint                      level);
+static void                 hyscan_map_rtree_node_free                (HyScanMapRTreeNode        *node);
+static void                 hyscan_map_rtree_insert_entry             (HyScanMapRTreePrivate     *priv,
+                                                                       const HyScanMapRTreeEntry *entry,
+                                                                       guint                      level);
+
+G_DEFINE_TYPE_WITH_PRIVATE (HyScanMapRTree, hyscan_map_rtree, G_TYPE_OBJECT)
+
+static void
+hyscan_map_rtree_class_init (HyScanMapRTreeClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = hyscan_map_rtree_object_constructed;
+  object_class->finalize = hyscan_map_rtree_object_finalize;
+}
+
+static void
+hyscan_map_rtree_init (HyScanMapRTree *map_rtree)
+{
+  map_rtree->priv = hyscan_map_rtree_get_instance_private (map_rtree);
+}
+
+static void
+hyscan_map_rtree_object_constructed (GObject *object)
+{
+  HyScanMapRTree *rtree = HYSCAN_MAP_RTREE (object);
+  HyScanMapRTreePrivate *priv = rtree->priv;
+
+  G_OBJECT_CLASS (hyscan_map_rtree_parent_class)->constructed (object);
+
+  priv->root = hyscan_map_rtree_node_new (0);
+  priv->leaves = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+hyscan_map_rtree_object_finalize (GObject *object)
+{
+  HyScanMapRTree *rtree = HYSCAN_MAP_RTREE (object);
+  HyScanMapRTreePrivate *priv = rtree->priv;
+
+  hyscan_map_rtree_node_free (priv->root);
+  g_hash_table_unref (priv->leaves);
+
+  G_OBJECT_CLASS (hyscan_map_rtree_parent_class)->finalize (object);
+}
+
+/* Площадь прямоугольника. */
+static inline gdouble
+hyscan_map_rtree_rect_area (const HyScanMapRTreeRect *rect)
+{
+  return (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
+}
+
+/* Объединяет прямоугольники a и b. */
+static inline void
+hyscan_map_rtree_rect_union (const HyScanMapRTreeRect *a,
+                             const HyScanMapRTreeRect *b,
+                             HyScanMapRTreeRect       *result)
+{
+  result->x0 = MIN (a->x0, b->x0);
+  result->y0 = MIN (a->y0, b->y0);
+  result->x1 = MAX (a->x1, b->x1);
+  result->y1 = MAX (a->y1, b->y1);
+}
+
+/* Прирост площади прямоугольника rect при добавлении в него прямоугольника add. */
+static inline gdouble
+hyscan_map_rtree_rect_enlargement (const HyScanMapRTreeRect *rect,
+                                   const HyScanMapRTreeRect *add)
+{
+  HyScanMapRTreeRect joined;
+
+  hyscan_map_rtree_rect_union (rect, add, &joined);
+
+  return hyscan_map_rtree_rect_area (&joined) - hyscan_map_rtree_rect_area (rect);
+}
+
+/* Проверяет пересечение прямоугольников. */
+static inline gboolean
+hyscan_map_rtree_rect_intersects (const HyScanMapRTreeRect *a,
+                                  const HyScanMapRTreeRect *b)
+{
+  return a->x0 <= b->x1 && b->x0 <= a->x1 && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+/* Создаёт прямоугольник по двум противоположным вершинам. */
+static inline void
+hyscan_map_rtree_rect_init (HyScanMapRTreeRect         *rect,
+                            const HyScanGeoCartesian2D *from,
+                            const HyScanGeoCartesian2D *to)
+{
+  rect->x0 = MIN (from->x, to->x);
+  rect->y0 = MIN (from->y, to->y);
+  rect->x1 = MAX (from->x, to->x);
+  rect->y1 = MAX (from->y, to->y);
+}
+
+static HyScanMapRTreeNode *
+hyscan_map_rtree_node_new (guint level)
+{
+  HyScanMapRTreeNode *node;
+
+  node = g_slice_new (HyScanMapRTreeNode);
+  node->parent = NULL;
+  node->level = level;
+  node->n_entries = 0;
+
+  return node;
+}
+
+/* Освобождает узел вместе с дочерними узлами. */
+static void
+hyscan_map_rtree_node_free (HyScanMapRTreeNode *node)
+{
+  guint i;
+
+  if (node->level > 0)
+    {
+      for (i = 0; i < node->n_entries; i++)
+        hyscan_map_rtree_node_free (node->entries[i].child);
+    }
+
+  g_slice_free (HyScanMapRTreeNode, node);
+}
+
+/* Определяет границы всех записей узла. */
+static void
+hyscan_map_rtree_node_cover (const HyScanMapRTreeNode *node,
+                             HyScanMapRTreeRect       *rect)
+{
+  guint i;
+
+  *rect = node->entries[0].rect;
+  for (i = 1; i < node->n_entries; i++)
+    hyscan_map_rtree_rect_union (rect, &node->entries[i].rect, rect);
+}
+
+/* Находит запись родительского узла, указывающую на узел node. */
+static guint
+hyscan_map_rtree_node_index (const HyScanMapRTreeNode *node)
+{
+  const HyScanMapRTreeNode *parent = node->parent;
+  guint i;
+
+  for (i = 0; i < parent->n_entries; i++)
+    {
+      if (parent->entries[i].child == node)
+        return i;
+    }
+
+  g_assert_not_reached ();
+}
+
+/* Добавляет запись в узел и запоминает новое положение дочернего узла или элемента. */
+static void
+hyscan_map_rtree_node_attach (HyScanMapRTreePrivate     *priv,
+                              HyScanMapRTreeNode        *node,
+                              const HyScanMapRTreeEntry *entry)
+{
+  node->entries[node->n_entries++] = *entry;
+
+  if (node->level > 0)
+    ((HyScanMapRTreeNode *) entry->child)->parent = node;
+  else
+    g_hash_table_insert (priv->leaves, entry->child, node);
+}
+
+/* Делит переполненный узел квадратичным алгоритмом Гуттмана. Часть записей
+ * остаётся в узле node, остальные переносятся в новый узел, который возвращается. */
+static HyScanMapRTreeNode *
+hyscan_map_rtree_node_split (HyScanMapRTreePrivate *priv,
+                             HyScanMapRTreeNode    *node)
+{
+  HyScanMapRTreeEntry entries[MAX_ENTRIES + 1];
+  gboolean assigned[MAX_ENTRIES + 1] = { FALSE };
+  HyScanMapRTreeRect cover1, cover2;
+  HyScanMapRTreeNode *sibling;
+  guint n_entries, remaining;
+  guint seed1 = 0, seed2 = 1;
+  gdouble max_waste = -G_MAXDOUBLE;
+  guint i, j;
+
+  n_entries = node->n_entries;
+  memcpy (entries, node->entries, n_entries * sizeof (HyScanMapRTreeEntry));
+
+  /* Выбираем пару записей, которые хуже всего объединять в один узел. */
+  for (i = 0; i < n_entries; i++)
+    {
+      for (j = i + 1; j < n_entries; j++)
+        {
+          HyScanMapRTreeRect joined;
+          gdouble waste;
+
+          hyscan_map_rtree_rect_union (&entries[i].rect, &entries[j].rect, &joined);
+          waste = hyscan_map_rtree_rect_area (&joined) -
+                  hyscan_map_rtree_rect_area (&entries[i].rect) -
+                  hyscan_map_rtree_rect_area (&entries[j].rect);
+
+          if (waste > max_waste)
+            {
+              max_waste = waste;
+              seed1 = i;
+              seed2 = j;
+            }
+        }
+    }
+
+  sibling = hyscan_map_rtree_node_new (node->level);
+  node->n_entries = 0;
+
+  hyscan_map_rtree_node_attach (priv, node, &entries[seed1]);
+  hyscan_map_rtree_node_attach (priv, sibling, &entries[seed2]);
+  cover1 = entries[seed1].rect;
+  cover2 = entries[seed2].rect;
+  assigned[seed1] = assigned[seed2] = TRUE;
+  remaining = n_entries - 2;
+
+  while (remaining > 0)
+    {
+      HyScanMapRTreeNode *target;
+      HyScanMapRTreeRect *cover;
+      gdouble max_diff = -1.0;
+      gdouble best_d1 = 0.0, best_d2 = 0.0;
+      guint next = 0;
+
+      /* Если одному из узлов не хватает записей до минимума, отдаём ему все оставшиеся. */
+      if (node->n_entries + remaining <= MIN_ENTRIES || sibling->n_entries + remaining <= MIN_ENTRIES)
+        {
+          target = node->n_entries + remaining <= MIN_ENTRIES ? node : sibling;
+          for (i = 0; i < n_entries; i++)
+            {
+              if (!assigned[i])
+                hyscan_map_rtree_node_attach (priv, target, &entries[i]);
+            }
+
+          break;
+        }
+
+      /* Выбираем запись, для которой сильнее всего важен выбор узла. */
+      for (i = 0; i < n_entries; i++)
+        {
+          gdouble d1, d2;
+
+          if (assigned[i])
+            continue;
+
+          d1 = hyscan_map_rtree_rect_enlargement (&cover1, &entries[i].rect);
+          d2 = hyscan_map_rtree_rect_enlargement (&cover2, &entries[i].rect);
+          if (ABS (d1 - d2) > max_diff)
+            {
+              max_diff = ABS (d1 - d2);
+              best_d1 = d1;
+              best_d2 = d2;
+              next = i;
+            }
+        }
+
+      /* Добавляем её в узел, площадь которого увеличится меньше. */
+      if (best_d1 < best_d2)
+        target = node;
+      else if (best_d2 < best_d1)
+        target = sibling;
+      else if (hyscan_map_rtree_rect_area (&cover1) != hyscan_map_rtree_rect_area (&cover2))
+        target = hyscan_map_rtree_rect_area (&cover1) < hyscan_map_rtree_rect_area (&cover2) ? node : sibling;
+      else
+        target = node->n_entries <= sibling->n_entries ? node : sibling;
+
+      cover = (target == node) ? &cover1 : &cover2;
+      hyscan_map_rtree_rect_union (cover, &entries[next].rect, cover);
+      hyscan_map_rtree_node_attach (priv, target, &entries[next]);
+      assigned[next] = TRUE;
+      remaining--;
+    }
+
+  return sibling;
+}
+
+/* Выбирает узел уровня level для записи с границами rect. */
+static HyScanMapRTreeNode *
+hyscan_map_rtree_choose_node (HyScanMapRTreePrivate    *priv,
+                              const HyScanMapRTreeRect *rect,
+                              guint                     level)
+{
+  HyScanMapRTreeNode *node = priv->root;
+
+  while (node->level > level)
+    {
+      gdouble min_enlargement = G_MAXDOUBLE;
+      gdouble min_area = G_MAXDOUBLE;
+      guint best = 0;
+      guint i;
+
+      /* Выбираем запись, площадь которой увеличится меньше всего, а из равных - наименьшую. */
+      for (i = 0; i < node->n_entries; i++)
+        {
+          gdouble enlargement, area;
+
+          area = hyscan_map_rtree_rect_area (&node->entries[i].rect);
+          enlargement = hyscan_map_rtree_rect_enlargement (&node->entries[i].rect, rect);
+          if (enlargement < min_enlargement || (enlargement == min_enlargement && area < min_area))
+            {
+              min_enlargement = enlargement;
+              min_area = area;
+              best = i;
+            }
+        }
+
+      node = node->entries[best].child;
+    }
+
+  return node;
+}
+
+/* Обновляет границы узлов от node до корня и добавляет в дерево узлы, появившиеся при делении. */
+static void
+hyscan_map_rtree_adjust (HyScanMapRTreePrivate *priv,
+                         HyScanMapRTreeNode    *node,
+                         HyScanMapRTreeNode    *split)
+{
+  HyScanMapRTreeEntry entry;
+
+  while (node != priv->root)
+    {
+      HyScanMapRTreeNode *parent = node->parent;
+
+      hyscan_map_rtree_node_cover (node, &parent->entries[hyscan_map_rtree_node_index (node)].rect);
+
+      if (split != NULL)
+        {
+          hyscan_map_rtree_node_cover (split, &entry.rect);
+          entry.child = split;
+          hyscan_map_rtree_node_attach (priv, parent, &entry);
+
+          split = parent->n_entries > MAX_ENTRIES ? hyscan_map_rtree_node_split (priv, parent) : NULL;
+        }
+
+      node = parent;
+    }
+
+  /* Делился корень - дерево растёт на один уровень. */
+  if (split != NULL)
+    {
+      HyScanMapRTreeNode *root;
+
+      root = hyscan_map_rtree_node_new (node->level + 1);
+
+      hyscan_map_rtree_node_cover (node, &entry.rect);
+      entry.child = node;
+      hyscan_map_rtree_node_attach (priv, root, &entry);
+
+      hyscan_map_rtree_node_cover (split, &entry.rect);
+      entry.child = split;
+      hyscan_map_rtree_node_attach (priv, root, &entry);
+
+      priv->root = root;
+    }
+}
+
+/* Добавляет запись в узел уровня level. */
+static void
+hyscan_map_rtree_insert_entry (HyScanMapRTreePrivate     *priv,
+                               const HyScanMapRTreeEntry *entry,
+                               guint                      level)
+{
+  HyScanMapRTreeNode *node;
+  HyScanMapRTreeNode *split = NULL;
+
+  node = hyscan_map_rtree_choose_node (priv, &entry->rect, level);
+  hyscan_map_rtree_node_attach (priv, node, entry);
+
+  if (node->n_entries > MAX_ENTRIES)
+    split = hyscan_map_rtree_node_split (priv, node);
+
+  hyscan_map_rtree_adjust (priv, node, split);
+}
+
+/* Расформировывает узлы, в которых после удаления записи осталось меньше
+ * MIN_ENTRIES записей, и повторно вставляет их записи в дерево. */
+static void
+hyscan_map_rtree_condense (HyScanMapRTreePrivate *priv,
+                           HyScanMapRTreeNode    *node)
+{
+  GSList *orphans = NULL;
+  GSList *link;
+
+  while (node != priv->root)
+    {
+      HyScanMapRTreeNode *parent = node->parent;
+      guint index = hyscan_map_rtree_node_index (node);
+
+      if (node->n_entries < MIN_ENTRIES)
+        {
+          parent->entries[index] = parent->entries[--parent->n_entries];
+          orphans = g_slist_prepend (orphans, node);
+        }
+      else
+        {
+          hyscan_map_rtree_node_cover (node, &parent->entries[index].rect);
+        }
+
+      node = parent;
+    }
+
+  /* Записи вставляются на тот же уровень, на котором находились. */
+  for (link = orphans; link != NULL; link = link->next)
+    {
+      HyScanMapRTreeNode *orphan = link->data;
+      guint i;
+
+      for (i = 0; i < orphan->n_entries; i++)
+        hyscan_map_rtree_insert_entry (priv, &orphan->entries[i], orphan->level);
+
+      g_slice_free (HyScanMapRTreeNode, orphan);
+    }
+  g_slist_free (orphans);
+
+  /* Корень с единственным дочерним узлом заменяем этим узлом. */
+  while (priv->root->level > 0 && priv->root->n_entries == 1)
+    {
+      HyScanMapRTreeNode *root = priv->root;
+
+      priv->root = root->entries[0].child;
+      priv->root->parent = NULL;
+      g_slice_free (HyScanMapRTreeNode, root);
+    }
+}
+
+/**
+ * hyscan_map_rtree_new:
+ *
+ * Создаёт пустой пространственный индекс.
+ *
+ * Returns: (transfer full): новый объект #HyScanMapRTree, для удаления g_object_unref().
+ */
+HyScanMapRTree *
+hyscan_map_rtree_new (void)
+{
+  return g_object_new (HYSCAN_TYPE_MAP_RTREE, NULL);
+}
+
+/**
+ * hyscan_map_rtree_insert:
+ * @rtree: указатель на #HyScanMapRTree
+ * @item: элемент
+ * @from: одна из вершин прямоугольника, в котором находится элемент
+ * @to: противоположная вершина прямоугольника
+ *
+ * Добавляет элемент @item с границами от @from до @to. Если элемент уже есть
+ * в индексе, то его границы обновляются.
+ */
+void
+hyscan_map_rtree_insert (HyScanMapRTree             *rtree,
+                         gpointer                    item,
+                         const HyScanGeoCartesian2D *from,
+                         const HyScanGeoCartesian2D *to)
+{
+  HyScanMapRTreeEntry entry;
+
+  g_return_if_fail (HYSCAN_IS_MAP_RTREE (rtree));
+
+  hyscan_map_rtree_remove (rtree, item);
+
+  hyscan_map_rtree_rect_init (&entry.rect, from, to);
+  entry.child = item;
+  hyscan_map_rtree_insert_entry (rtree->priv, &entry, 0);
+}
+
+/**
+ * hyscan_map_rtree_remove:
+ * @rtree: указатель на #HyScanMapRTree
+ * @item: элемент
+ *
+ * Удаляет элемент @item из индекса.
+ *
+ * Returns: %TRUE, если элемент был в индексе.
+ */
+gboolean
+hyscan_map_rtree_remove (HyScanMapRTree *rtree,
+                         gpointer        item)
+{
+  HyScanMapRTreePrivate *priv;
+  HyScanMapRTreeNode *leaf;
+  guint i;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_RTREE (rtree), FALSE);
+  priv = rtree->priv;
+
+  leaf = g_hash_table_lookup (priv->leaves, item);
+  if (leaf == NULL)
+    return FALSE;
+
+  g_hash_table_remove (priv->leaves, item);
+  for (i = 0; i < leaf->n_entries; i++)
+    {
+      if (leaf->entries[i].child != item)
+        continue;
+
+      leaf->entries[i] = leaf->entries[--leaf->n_entries];
+      break;
+    }
+
+  hyscan_map_rtree_condense (priv, leaf);
+
+  return TRUE;
+}
+
+/**
+ * hyscan_map_rtree_clear:
+ * @rtree: указатель на #HyScanMapRTree
+ *
+ * Удаляет все элементы из индекса.
+ */
+void
+hyscan_map_rtree_clear (HyScanMapRTree *rtree)
+{
+  HyScanMapRTreePrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_MAP_RTREE (rtree));
+  priv = rtree->priv;
+
+  hyscan_map_rtree_node_free (priv->root);
+  priv->root = hyscan_map_rtree_node_new (0);
+  g_hash_table_remove_all (priv->leaves);
+}
+
+/**
+ * hyscan_map_rtree_get_size:
+ * @rtree: указатель на #HyScanMapRTree
+ *
+ * Returns: число элементов в индексе.
+ */
+guint
+hyscan_map_rtree_get_size (HyScanMapRTree *rtree)
+{
+  g_return_val_if_fail (HYSCAN_IS_MAP_RTREE (rtree), 0);
+
+  return g_hash_table_size (rtree->priv->leaves);
+}
+
+/**
+ * hyscan_map_rtree_search:
+ * @rtree: указатель на #HyScanMapRTree
+ * @from: одна из вершин области поиска
+ * @to: противоположная вершина области поиска
+ * @func: (scope call): функция, вызываемая для каждого найденного элемента
+ * @user_data: пользовательские данные для @func
+ *
+ * Находит все элементы, границы которых пересекают область от @from до @to,
+ * и вызывает для каждого из них функцию @func. Порядок элементов не определён.
+ * Изменять индекс из функции @func нельзя.
+ *
+ * Returns: число найденных элементов.
+ */
+guint
+hyscan_map_rtree_search (HyScanMapRTree             *rtree,
+                         const HyScanGeoCartesian2D *from,
+                         const HyScanGeoCartesian2D *to,
+                         HyScanMapRTreeFunc          func,
+                         gpointer                    user_data)
+{
+  HyScanMapRTreeNode *stack[STACK_SIZE];
+  HyScanMapRTreeRect rect;
+  guint n_stack = 0;
+  guint n_found = 0;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_RTREE (rtree), 0);
+
+  hyscan_map_rtree_rect_init (&rect, from, to);
+
+  /* В стеке одновременно не больше MAX_ENTRIES узлов каждого уровня. */
+  stack[n_stack++] = rtree->priv->root;
+  while (n_stack > 0)
+    {
+      HyScanMapRTreeNode *node = stack[--n_stack];
+      guint i;
+
+      for (i = 0; i < node->n_entries; i++)
+        {
+          HyScanMapRTreeEntry *entry = &node->entries[i];
+
+          if (!hyscan_map_rtree_rect_intersects (&entry->rect, &rect))
+            continue;
+
+          if (node->level > 0)
+            {
+              stack[n_stack++] = entry->child;
+              continue;
+            }
+
+          n_found++;
+          if (func != NULL)
+            func (entry->child, user_data);
+        }
+    }
+
+  return n_found;
+}
@@ -0,0 +1,108 @@
+/* hyscan-map-rtree.h
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+#ifndef __HYSCAN_MAP_RTREE_H__
+#define __HYSCAN_MAP_RTREE_H__
+
+#include <glib-object.h>
+#include <hyscan-api.h>
+#include <hyscan-geo.h>
+
+G_BEGIN_DECLS
+
+#define HYSCAN_TYPE_MAP_RTREE             (hyscan_map_rtree_get_type ())
+#define HYSCAN_MAP_RTREE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), HYSCAN_TYPE_MAP_RTREE, HyScanMapRTree))
+#define HYSCAN_IS_MAP_RTREE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HYSCAN_TYPE_MAP_RTREE))
+#define HYSCAN_MAP_RTREE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), HYSCAN_TYPE_MAP_RTREE, HyScanMapRTreeClass))
+#define HYSCAN_IS_MAP_RTREE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_MAP_RTREE))
+#define HYSCAN_MAP_RTREE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_MAP_RTREE, HyScanMapRTreeClass))
+
+typedef struct _HyScanMapRTree HyScanMapRTree;
+typedef struct _HyScanMapRTreePrivate HyScanMapRTreePrivate;
+typedef struct _HyScanMapRTreeClass HyScanMapRTreeClass;
+
+struct _HyScanMapRTree
+{
+  GObject parent_instance;
+
+  HyScanMapRTreePrivate *priv;
+};
+
+struct _HyScanMapRTreeClass
+{
+  GObjectClass parent_class;
+};
+
+/**
+ * HyScanMapRTreeFunc:
+ * @item: найденный элемент
+ * @user_data: пользовательские данные
+ *
+ * Функция обратного вызова для элементов, найденных hyscan_map_rtree_search().
+ */
+typedef void (*HyScanMapRTreeFunc) (gpointer item,
+                                    gpointer user_data);
+
+HYSCAN_API
+GType                  hyscan_map_rtree_get_type         (void);
+
+HYSCAN_API
+HyScanMapRTree *       hyscan_map_rtree_new              (void);
+
+HYSCAN_API
+void                   hyscan_map_rtree_insert           (HyScanMapRTree             *rtree,
+                                                          gpointer                    item,
+                                                          const HyScanGeoCartesian2D *from,
+                                                          const HyScanGeoCartesian2D *to);
+
+HYSCAN_API
+gboolean               hyscan_map_rtree_remove           (HyScanMapRTree             *rtree,
+                                                          gpointer                    item);
+
+HYSCAN_API
+void                   hyscan_map_rtree_clear            (HyScanMapRTree             *rtree);
+
+HYSCAN_API
+guint                  hyscan_map_rtree_get_size         (HyScanMapRTree             *rtree);
+
+HYSCAN_API
+guint                  hyscan_map_rtree_search           (HyScanMapRTree             *rtree,
+                                                          const HyScanGeoCartesian2D *from,
+                                                          const HyScanGeoCartesian2D *to,
+                                                          HyScanMapRTreeFunc          func,
+                                                          gpointer                    user_data);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_MAP_RTREE_H__ */
@@ -0,0 +1,415 @@
+/* hyscan-map-tile-cache.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+/**
+ * SECTION: hyscan-map-tile-cache
+ * @Short_description: Кэш изображений тайлов в памяти
+ * @Title: HyScanMapTileCache
+ * @See_also: #HyScanMapTile, #HyScanGtkMapBase
+ *
+ * Класс хранит в памяти готовые к отрисовке поверхности cairo тайлов в формате
+ * ARGB32 с предварительно умноженной альфой. Поиск изображения в кэше не
+ * требует ни чтения файла, ни декодирования PNG, ни копирования пиксельных
+ * данных: найденная поверхность устанавливается в тайл по ссылке.
+ *
+ * Тайлы идентифицируются хэшем источника тайлов hyscan_map_tile_source_hash()
+ * и координатами тайла. Объём кэша ограничивается суммарным размером пиксельных
+ * данных в байтах; при превышении ограничения вытесняются давно
+ * неиспользованные тайлы.
+ *
+ * Общий для всего процесса кэш возвращает функция hyscan_map_tile_cache_get_default().
+ * Его используют все слои #HyScanGtkMapBase, поэтому тайл, загруженный одним
+ * виджетом карты, сразу доступен другим виджетам с тем же источником.
+ *
+ * Поверхности в кэше не должны изменяться после помещения в него. Все функции
+ * класса потокобезопасны.
+ *
+ * Для контроля эффективности кэша предназначена функция hyscan_map_tile_cache_get_stats().
+ */
+
+#include "hyscan-map-tile-cache.h"
+
+#define DEFAULT_MAX_SIZE       (128 * 1024 * 1024)   /* Объём кэша по умолчанию, байт. */
+
+enum
+{
+  PROP_O,
+  PROP_MAX_SIZE,
+};
+
+/* Запись кэша. */
+typedef struct
+{
+  HyScanMapTileKey             key;                 /* Ключ тайла. */
+  GList                        link;                /* Звено LRU-очереди. */
+  cairo_surface_t             *surface;             /* Поверхность тайла. */
+  gsize                        bytes;               /* Размер пиксельных данных поверхности. */
+} HyScanMapTileCacheEntry;
+
+struct _HyScanMapTileCachePrivate
+{
+  GMutex                       lock;                /* Блокировка доступа к кэшу. */
+  GHashTable                  *index;               /* Таблица записей кэша по ключу. */
+  GQueue                       lru;                 /* LRU-очередь записей, в начале последние использованные. */
+  gsize                        size;                /* Текущий объём пиксельных данных. */
+  gsize                        max_size;            /* Максимальный объём пиксельных данных. */
+
+  guint64                      hits;                /* Число попаданий. */
+  guint64                      misses;              /* Число промахов. */
+  guint64                      evictions;           /* Число вытесненных тайлов. */
+};
+
+static void       hyscan_map_tile_cache_set_property             (GObject                   *object,
+                                                                  guint                      prop_id,
+                                                                  const GValue              *value,
+                                                                  GParamSpec                *pspec);
+static void       hyscan_map_tile_cache_object_constructed       (GObject                   *object);
+static void       hyscan_map_tile_cache_object_finalize          (GObject                   *object);
+static void       hyscan_map_tile_cache_entry_free               (gpointer                   data);
+static void       hyscan_map_tile_cache_trim                     (HyScanMapTileCachePrivate *priv);
+
+G_DEFINE_TYPE_WITH_PRIVATE (HyScanMapTileCache, hyscan_map_tile_cache, G_TYPE_OBJECT)
+
+static void
+hyscan_map_tile_cache_class_init (HyScanMapTileCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = hyscan_map_tile_cache_set_property;
+
+  object_class->constructed = hyscan_map_tile_cache_object_constructed;
+  object_class->finalize = hyscan_map_tile_cache_object_finalize;
+
+  g_object_class_install_property (object_class, PROP_MAX_SIZE,
+    g_param_spec_uint64 ("max-size", "Max size", "Maximum size of cached pixel data in bytes",
+                         0, G_MAXUINT64, DEFAULT_MAX_SIZE,
+                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+}
+
+static void
+hyscan_map_tile_cache_init (HyScanMapTileCache *map_tile_cache)
+{
+  map_tile_cache->priv = hyscan_map_tile_cache_get_instance_private (map_tile_cache);
+}
+
+static void
+hyscan_map_tile_cache_set_property (GObject      *object,
+                                    guint         prop_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+  HyScanMapTileCache *map_tile_cache = HYSCAN_MAP_TILE_CACHE (object);
+  HyScanMapTileCachePrivate *priv = map_tile_cache->priv;
+
+  switch (prop_id)
+    {
+    case PROP_MAX_SIZE:
+      priv->max_size = g_value_get_uint64 (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+hyscan_map_tile_cache_object_constructed (GObject *object)
+{
+  HyScanMapTileCache *map_tile_cache = HYSCAN_MAP_TILE_CACHE (object);
+  HyScanMapTileCachePrivate *priv = map_tile_cache->priv;
+
+  G_OBJECT_CLASS (hyscan_map_tile_cache_parent_class)->constructed (object);
+
+  g_mutex_init (&priv->lock);
+  g_queue_init (&priv->lru);
+  priv->index = g_hash_table_new_full (hyscan_map_tile_key_hash, hyscan_map_tile_key_equal,
+                                       NULL, hyscan_map_tile_cache_entry_free);
+}
+
+static void
+hyscan_map_tile_cache_object_finalize (GObject *object)
+{
+  HyScanMapTileCache *map_tile_cache = HYSCAN_MAP_TILE_CACHE (object);
+  HyScanMapTileCachePrivate *priv = map_tile_cache->priv;
+
+  g_hash_table_destroy (priv->index);
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (hyscan_map_tile_cache_parent_class)->finalize (object);
+}
+
+static void
+hyscan_map_tile_cache_entry_free (gpointer data)
+{
+  HyScanMapTileCacheEntry *entry = data;
+
+  cairo_surface_destroy (entry->surface);
+  g_slice_free (HyScanMapTileCacheEntry, entry);
+}
+
+/* Вытесняет давно неиспользованные тайлы, пока объём кэша превышает допустимый.
+ * Вызывается под блокировкой. */
+static void
+hyscan_map_tile_cache_trim (HyScanMapTileCachePrivate *priv)
+{
+  while (priv->size > priv->max_size && priv->lru.tail != NULL)
+    {
+      HyScanMapTileCacheEntry *entry;
+
+      entry = priv->lru.tail->data;
+      g_queue_unlink (&priv->lru, &entry->link);
+      priv->size -= entry->bytes;
+      priv->evictions++;
+
+      g_hash_table_remove (priv->index, &entry->key);
+    }
+}
+
+/**
+ * hyscan_map_tile_cache_new:
+ * @max_size: максимальный объём пиксельных данных в кэше, байт
+ *
+ * Создаёт новый кэш изображений тайлов.
+ *
+ * Returns: (transfer full): новый объект #HyScanMapTileCache, для удаления g_object_unref().
+ */
+HyScanMapTileCache *
+hyscan_map_tile_cache_new (gsize max_size)
+{
+  return g_object_new (HYSCAN_TYPE_MAP_TILE_CACHE,
+                       "max-size", (guint64) max_size,
+                       NULL);
+}
+
+/**
+ * hyscan_map_tile_cache_get_default:
+ *
+ * Возвращает общий для всего процесса кэш изображений тайлов. Кэш создаётся
+ * при первом вызове функции и имеет объём 128 МБ.
+ *
+ * Returns: (transfer full): объект #HyScanMapTileCache, для удаления g_object_unref().
+ */
+HyScanMapTileCache *
+hyscan_map_tile_cache_get_default (void)
+{
+  static HyScanMapTileCache *default_cache = NULL;
+
+  if (g_once_init_enter (&default_cache))
+    g_once_init_leave (&default_cache, hyscan_map_tile_cache_new (DEFAULT_MAX_SIZE));
+
+  return g_object_ref (default_cache);
+}
+
+/**
+ * hyscan_map_tile_cache_set_max_size:
+ * @cache: указатель на #HyScanMapTileCache
+ * @max_size: максимальный объём пиксельных данных в кэше, байт
+ *
+ * Устанавливает максимальный объём кэша. Если текущий объём превышает новое
+ * значение, то лишние тайлы вытесняются сразу.
+ */
+void
+hyscan_map_tile_cache_set_max_size (HyScanMapTileCache *cache,
+                                    gsize               max_size)
+{
+  HyScanMapTileCachePrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_CACHE (cache));
+  priv = cache->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->max_size = max_size;
+  hyscan_map_tile_cache_trim (priv);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * hyscan_map_tile_cache_get:
+ * @cache: указатель на #HyScanMapTileCache
+ * @source_hash: хэш источника тайлов
+ * @tile: тайл
+ *
+ * Ищет в кэше изображение тайла @tile из источника с хэшем @source_hash и,
+ * если оно найдено, устанавливает его поверхность в тайл. Поверхность
+ * разделяется с кэшем и не должна изменяться.
+ *
+ * Returns: %TRUE, если изображение найдено.
+ */
+gboolean
+hyscan_map_tile_cache_get (HyScanMapTileCache *cache,
+                           guint               source_hash,
+                           HyScanMapTile      *tile)
+{
+  HyScanMapTileCachePrivate *priv;
+  HyScanMapTileCacheEntry *entry;
+  HyScanMapTileKey key;
+  cairo_surface_t *surface = NULL;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_CACHE (cache), FALSE);
+  priv = cache->priv;
+
+  hyscan_map_tile_key_init (&key, source_hash, tile);
+
+  g_mutex_lock (&priv->lock);
+
+  entry = g_hash_table_lookup (priv->index, &key);
+  if (entry != NULL)
+    {
+      surface = cairo_surface_reference (entry->surface);
+      g_queue_unlink (&priv->lru, &entry->link);
+      g_queue_push_head_link (&priv->lru, &entry->link);
+      priv->hits++;
+    }
+  else
+    {
+      priv->misses++;
+    }
+
+  g_mutex_unlock (&priv->lock);
+
+  if (surface == NULL)
+    return FALSE;
+
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
+  return TRUE;
+}
+
+/**
+ * hyscan_map_tile_cache_set:
+ * @cache: указатель на #HyScanMapTileCache
+ * @source_hash: хэш источника тайлов
+ * @tile: тайл с изображением
+ *
+ * Помещает в кэш поверхность тайла @tile. Кэш сохраняет ссылку на поверхность,
+ * поэтому она не должна изменяться в дальнейшем и не должна ссылаться на
+ * чужую память (см. hyscan_map_tile_set_surface_data()). Если у тайла нет
+ * поверхности, то функция ничего не делает.
+ */
+void
+hyscan_map_tile_cache_set (HyScanMapTileCache *cache,
+                           guint               source_hash,
+                           HyScanMapTile      *tile)
+{
+  HyScanMapTileCachePrivate *priv;
+  HyScanMapTileCacheEntry *entry, *old_entry;
+  cairo_surface_t *surface;
+  gsize bytes;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_CACHE (cache));
+  priv = cache->priv;
+
+  surface = hyscan_map_tile_get_surface (tile);
+  if (surface == NULL)
+    return;
+
+  bytes = (gsize) cairo_image_surface_get_stride (surface) * cairo_image_surface_get_height (surface);
+
+  entry = g_slice_new (HyScanMapTileCacheEntry);
+  hyscan_map_tile_key_init (&entry->key, source_hash, tile);
+  entry->link.data = entry;
+  entry->link.prev = entry->link.next = NULL;
+  entry->surface = surface;
+  entry->bytes = bytes;
+
+  g_mutex_lock (&priv->lock);
+
+  /* Заменяем предыдущее изображение тайла, если оно было. */
+  old_entry = g_hash_table_lookup (priv->index, &entry->key);
+  if (old_entry != NULL)
+    {
+      g_queue_unlink (&priv->lru, &old_entry->link);
+      priv->size -= old_entry->bytes;
+      g_hash_table_remove (priv->index, &old_entry->key);
+    }
+
+  g_hash_table_insert (priv->index, &entry->key, entry);
+  g_queue_push_head_link (&priv->lru, &entry->link);
+  priv->size += bytes;
+
+  hyscan_map_tile_cache_trim (priv);
+
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * hyscan_map_tile_cache_get_stats:
+ * @cache: указатель на #HyScanMapTileCache
+ * @stats: (out): статистика кэша
+ *
+ * Получает статистику работы кэша: число попаданий, промахов, вытесненных
+ * тайлов, а также текущий и максимальный объём кэша.
+ */
+void
+hyscan_map_tile_cache_get_stats (HyScanMapTileCache      *cache,
+                                 HyScanMapTileCacheStats *stats)
+{
+  HyScanMapTileCachePrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_CACHE (cache));
+  priv = cache->priv;
+
+  g_mutex_lock (&priv->lock);
+  stats->hits = priv->hits;
+  stats->misses = priv->misses;
+  stats->evictions = priv->evictions;
+  stats->n_tiles = g_hash_table_size (priv->index);
+  stats->size = priv->size;
+  stats->max_size = priv->max_size;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * hyscan_map_tile_cache_clear:
+ * @cache: указатель на #HyScanMapTileCache
+ *
+ * Удаляет из кэша все изображения. Счётчики статистики не сбрасываются.
+ */
+void
+hyscan_map_tile_cache_clear (HyScanMapTileCache *cache)
+{
+  HyScanMapTileCachePrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_CACHE (cache));
+  priv = cache->priv;
+
+  g_mutex_lock (&priv->lock);
+  g_queue_init (&priv->lru);
+  g_hash_table_remove_all (priv->index);
+  priv->size = 0;
+  g_mutex_unlock (&priv->lock);
+}
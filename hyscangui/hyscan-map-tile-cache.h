@@ -0,0 +1,120 @@
+/* hyscan-map-tile-cache.h
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+#ifndef __HYSCAN_MAP_TILE_CACHE_H__
+#define __HYSCAN_MAP_TILE_CACHE_H__
+
+#include <hyscan-map-tile.h>
+
+G_BEGIN_DECLS
+
+#define HYSCAN_TYPE_MAP_TILE_CACHE             (hyscan_map_tile_cache_get_type ())
+#define HYSCAN_MAP_TILE_CACHE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), HYSCAN_TYPE_MAP_TILE_CACHE, HyScanMapTileCache))
+#define HYSCAN_IS_MAP_TILE_CACHE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HYSCAN_TYPE_MAP_TILE_CACHE))
+#define HYSCAN_MAP_TILE_CACHE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), HYSCAN_TYPE_MAP_TILE_CACHE, HyScanMapTileCacheClass))
+#define HYSCAN_IS_MAP_TILE_CACHE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_MAP_TILE_CACHE))
+#define HYSCAN_MAP_TILE_CACHE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_MAP_TILE_CACHE, HyScanMapTileCacheClass))
+
+typedef struct _HyScanMapTileCache HyScanMapTileCache;
+typedef struct _HyScanMapTileCachePrivate HyScanMapTileCachePrivate;
+typedef struct _HyScanMapTileCacheClass HyScanMapTileCacheClass;
+typedef struct _HyScanMapTileCacheStats HyScanMapTileCacheStats;
+
+struct _HyScanMapTileCache
+{
+  GObject parent_instance;
+
+  HyScanMapTileCachePrivate *priv;
+};
+
+struct _HyScanMapTileCacheClass
+{
+  GObjectClass parent_class;
+};
+
+/**
+ * HyScanMapTileCacheStats:
+ * @hits: число запросов, для которых тайл был найден в кэше
+ * @misses: число запросов, для которых тайл не был найден
+ * @evictions: число тайлов, вытесненных из кэша
+ * @n_tiles: текущее число тайлов в кэше
+ * @size: текущий объём изображений в кэше, байт
+ * @max_size: максимальный объём изображений в кэше, байт
+ *
+ * Статистика работы кэша тайлов.
+ */
+struct _HyScanMapTileCacheStats
+{
+  guint64                 hits;
+  guint64                 misses;
+  guint64                 evictions;
+  guint                   n_tiles;
+  gsize                   size;
+  gsize                   max_size;
+};
+
+HYSCAN_API
+GType                     hyscan_map_tile_cache_get_type          (void);
+
+HYSCAN_API
+HyScanMapTileCache *      hyscan_map_tile_cache_new               (gsize                     max_size);
+
+HYSCAN_API
+HyScanMapTileCache *      hyscan_map_tile_cache_get_default       (void);
+
+HYSCAN_API
+void                      hyscan_map_tile_cache_set_max_size      (HyScanMapTileCache       *cache,
+                                                                   gsize                     max_size);
+
+HYSCAN_API
+gboolean                  hyscan_map_tile_cache_get               (HyScanMapTileCache       *cache,
+                                                                   guint                     source_hash,
+                                                                   HyScanMapTile            *tile);
+
+HYSCAN_API
+void                      hyscan_map_tile_cache_set               (HyScanMapTileCache       *cache,
+                                                                   guint                     source_hash,
+                                                                   HyScanMapTile            *tile);
+
+HYSCAN_API
+void                      hyscan_map_tile_cache_get_stats         (HyScanMapTileCache       *cache,
+                                                                   HyScanMapTileCacheStats  *stats);
+
+HYSCAN_API
+void                      hyscan_map_tile_cache_clear             (HyScanMapTileCache       *cache);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_MAP_TILE_CACHE_H__ */
@@ -43,10 +43,21 @@
  * Хотя класс может выполнять загрузку тайлов из любого источника #HyScanMapTileSource,
  * его основное практическое применение - это сохранение тайлов из сети на жесткий
  * диск, чтобы пользователь мог работать с картами офф-лайн. В этом случае в
- * качестве источника тайлов следует использовать #HyScanMapTileSourceFile.
+ * качестве источника тайлов следует использовать #HyScanMapTileSourceFile или
+ * #HyScanMapTileSourcePack.
+ *
+ * Тайлы загружаются параллельно функцией hyscan_map_tile_source_fill_async().
+ * Запросы к #HyScanMapTileSourceWeb не занимают потоков на время ожидания ответа
+ * сервера, а источники без асинхронной реализации заполняют тайлы в потоках #GTask.
+ * Максимальное число одновременно загружаемых тайлов задаётся функцией
+ * hyscan_map_tile_loader_set_max_jobs().
+ * Если источником является #HyScanMapTileSourceFile или #HyScanMapTileSourcePack,
+ * то тайлы, которые уже есть в кэше, пропускаются. Поэтому прерванную загрузку можно продолжить,
+ * повторно запустив её для той же области.
  *
  * Методы класса:
  * - hyscan_map_tile_loader_new() - создает новый объект класса,
+ * - hyscan_map_tile_loader_set_max_jobs() - устанавливает число параллельных загрузок,
  * - hyscan_map_tile_loader_start() - запускает загрузку тайлов,
  * - hyscan_map_tile_loader_stop() - останавливает загрузку тайлов.
  *
@@ -56,26 +67,70 @@
  */
 
 #include "hyscan-map-tile-loader.h"
+#include "hyscan-map-tile-source-file.h"
+#include "hyscan-map-tile-source-pack.h"
+#include "hyscan-gui-marshallers.h"
+
+#define DEFAULT_MAX_JOBS      6                           /* Число параллельных загрузок по умолчанию. */
+#define MAX_JOBS              64                          /* Максимальное число параллельных загрузок. */
+#define PROGRESS_INTERVAL     (G_TIME_SPAN_SECOND / 10)   /* Минимальный интервал между сигналами "progress". */
 
 enum
 {
   SIGNAL_PROGRESS,
+  SIGNAL_SPEED,
   SIGNAL_DONE,
   SIGNAL_LAST,
 };
 
 struct _HyScanMapTileLoaderPrivate
 {
-  gboolean                     busy;       /* Признак того, что идёт загрузка. */
-  gboolean                     stop;       /* Флаг, что надо остановить загрузку. */
-
-  HyScanMapTileSource         *source;     /* Указатель на источник тайлов. */
-  gdouble                      from_x;     /* Координата x начала области загрузки. */
-  gdouble                      to_x;       /* Координата x конца области загрузки. */
-  gdouble                      from_y;     /* Координата y начала области загрузки. */
-  gdouble                      to_y;       /* Координата y конца области загрузки. */
+  gboolean                     busy;          /* Признак того, что идёт загрузка. */
+  guint                        max_jobs;      /* Максимальное число одновременно загружаемых тайлов. */
+  GCancellable                *cancellable;   /* Объект для остановки загрузки. */
+
+  HyScanMapTileSource         *source;        /* Указатель на источник тайлов. */
+  gboolean                     is_cache;      /* Признак того, что источник является кэшем тайлов. */
+  gdouble                      from_x;        /* Координата x начала области загрузки. */
+  gdouble                      to_x;          /* Координата x конца области загрузки. */
+  gdouble                      from_y;        /* Координата y начала области загрузки. */
+  gdouble                      to_y;          /* Координата y конца области загрузки. */
+
+  /* Счётчики изменяются только в потоке загрузки. */
+  guint                        n_queued;      /* Число запущенных заполнений тайлов. */
+  guint                        n_finished;    /* Число завершённых заполнений тайлов. */
+  guint                        n_loaded;      /* Число загруженных тайлов. */
+  guint                        n_skipped;     /* Число тайлов, уже имеющихся в кэше. */
+  guint                        n_failed;      /* Число тайлов, загрузка которых завершилась ошибкой. */
+  guint64                      n_bytes;       /* Объём загруженных данных, байт. */
+
+  guint                        total;         /* Общее число тайлов в области. */
+  gint64                       start_time;    /* Время начала загрузки. */
+  gint64                       progress_time; /* Время отправки последнего сигнала "progress". */
 };
 
+/* Заполнение одного тайла. */
+typedef struct
+{
+  HyScanMapTileLoader         *loader;        /* Загрузчик. */
+  HyScanMapTile               *tile;          /* Заполняемый тайл. */
+} HyScanMapTileLoaderJob;
+
+static void        hyscan_map_tile_loader_object_finalize       (GObject                *object);
+static gboolean    hyscan_map_tile_loader_lookup                (HyScanMapTileSource    *source,
+                                                                 HyScanMapTile          *tile,
+                                                                 goffset                *size);
+static void        hyscan_map_tile_loader_ready                 (GObject                *object,
+                                                                 GAsyncResult           *result,
+                                                                 gpointer                user_data);
+static gboolean    hyscan_map_tile_loader_tick                  (gpointer                data);
+static void        hyscan_map_tile_loader_progress              (HyScanMapTileLoader    *loader,
+                                                                 gboolean                force);
+static void        hyscan_map_tile_loader_wait                  (HyScanMapTileLoader    *loader,
+                                                                 GMainContext           *context,
+                                                                 guint                   max_pending);
+static gpointer    hyscan_map_tile_loader_func                  (gpointer                data);
+
 static guint hyscan_map_tile_loader_signals[SIGNAL_LAST] = {0};
 
 G_DEFINE_TYPE_WITH_PRIVATE (HyScanMapTileLoader, hyscan_map_tile_loader, G_TYPE_OBJECT)
@@ -83,14 +138,18 @@ G_DEFINE_TYPE_WITH_PRIVATE (HyScanMapTileLoader, hyscan_map_tile_loader, G_TYPE_
 static void
 hyscan_map_tile_loader_class_init (HyScanMapTileLoaderClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = hyscan_map_tile_loader_object_finalize;
 
   /**
    * HyScanMapTileLoader::progress:
    * @loader: объект #HyScanMapTileLoader, получивший сигнал
    * @fraction: текущий прогресс от 0.0 до 1.0
    *
-   * Сигнал отправляется после загрузки каждого тайла и сообщает об общем
-   * прогрессе загрузки.
+   * Сигнал сообщает об общем прогрессе загрузки. Он отправляется периодически
+   * по мере загрузки тайлов, но не чаще 10 раз в секунду, и обязательно
+   * отправляется по завершении загрузки.
    */
   hyscan_map_tile_loader_signals[SIGNAL_PROGRESS] =
     g_signal_new ("progress", HYSCAN_TYPE_MAP_TILE_LOADER,
@@ -100,6 +159,29 @@ hyscan_map_tile_loader_class_init (HyScanMapTileLoaderClass *klass)
                   g_cclosure_marshal_VOID__DOUBLE,
                   G_TYPE_NONE, 1, G_TYPE_DOUBLE);
 
+  /**
+   * HyScanMapTileLoader::speed:
+   * @loader: объект #HyScanMapTileLoader, получивший сигнал
+   * @tiles_speed: средняя скорость загрузки, тайлов в секунду
+   * @bytes_speed: средняя скорость загрузки, байт в секунду
+   *
+   * Сигнал сообщает о скорости загрузки. Он отправляется непосредственно перед
+   * каждым сигналом #HyScanMapTileLoader::progress.
+   *
+   * Скорость загрузки рассчитывается с момента запуска загрузки только по
+   * фактически загруженным тайлам, без учёта тайлов, уже имеющихся в кэше.
+   * Объём данных учитывается только для источников #HyScanMapTileSourceFile и
+   * #HyScanMapTileSourcePack и равен размеру сохранённых изображений тайлов,
+   * для других источников он равен нулю.
+   */
+  hyscan_map_tile_loader_signals[SIGNAL_SPEED] =
+    g_signal_new ("speed", HYSCAN_TYPE_MAP_TILE_LOADER,
+                  G_SIGNAL_RUN_FIRST | G_SIGNAL_ACTION,
+                  0,
+                  NULL, NULL,
+                  hyscan_gui_marshal_VOID__DOUBLE_DOUBLE,
+                  G_TYPE_NONE, 2, G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+
   /**
    * HyScanMapTileLoader::done:
    * @loader: объект #HyScanMapTileLoader, получивший сигнал
@@ -120,7 +202,133 @@ hyscan_map_tile_loader_class_init (HyScanMapTileLoaderClass *klass)
 static void
 hyscan_map_tile_loader_init (HyScanMapTileLoader *map_tile_loader)
 {
+  HyScanMapTileLoaderPrivate *priv;
+
   map_tile_loader->priv = hyscan_map_tile_loader_get_instance_private (map_tile_loader);
+  priv = map_tile_loader->priv;
+
+  priv->max_jobs = DEFAULT_MAX_JOBS;
+  priv->cancellable = g_cancellable_new ();
+}
+
+static void
+hyscan_map_tile_loader_object_finalize (GObject *object)
+{
+  HyScanMapTileLoader *map_tile_loader = HYSCAN_MAP_TILE_LOADER (object);
+  HyScanMapTileLoaderPrivate *priv = map_tile_loader->priv;
+
+  g_object_unref (priv->cancellable);
+
+  G_OBJECT_CLASS (hyscan_map_tile_loader_parent_class)->finalize (object);
+}
+
+/* Проверяет наличие тайла в кэширующем источнике и возвращает размер его изображения. */
+static gboolean
+hyscan_map_tile_loader_lookup (HyScanMapTileSource *source,
+                               HyScanMapTile       *tile,
+                               goffset             *size)
+{
+  if (HYSCAN_IS_MAP_TILE_SOURCE_FILE (source))
+    return hyscan_map_tile_source_file_lookup (HYSCAN_MAP_TILE_SOURCE_FILE (source), tile, size);
+
+  if (HYSCAN_IS_MAP_TILE_SOURCE_PACK (source))
+    return hyscan_map_tile_source_pack_lookup (HYSCAN_MAP_TILE_SOURCE_PACK (source), tile, size);
+
+  return FALSE;
+}
+
+/* Обработчик завершения заполнения одного тайла. Выполняется в потоке загрузки. */
+static void
+hyscan_map_tile_loader_ready (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  HyScanMapTileLoaderJob *job = user_data;
+  HyScanMapTileLoaderPrivate *priv = job->loader->priv;
+  HyScanMapTile *tile = job->tile;
+  GError *error = NULL;
+  goffset size = 0;
+
+  if (hyscan_map_tile_source_fill_finish (HYSCAN_MAP_TILE_SOURCE (object), result, &error))
+    {
+      if (priv->is_cache)
+        hyscan_map_tile_loader_lookup (priv->source, tile, &size);
+
+      priv->n_loaded++;
+      priv->n_bytes += size;
+    }
+
+  /* Тайлы, заполнение которых прервано остановкой загрузки, не считаются ошибочными. */
+  else if (!g_cancellable_is_cancelled (priv->cancellable))
+    {
+      g_warning ("HyScanMapTileLoader: failed to load tile %d/%d/%d, %s",
+                 hyscan_map_tile_get_zoom (tile), hyscan_map_tile_get_x (tile), hyscan_map_tile_get_y (tile),
+                 error->message);
+
+      priv->n_failed++;
+    }
+
+  priv->n_finished++;
+
+  g_clear_error (&error);
+  g_object_unref (tile);
+  g_slice_free (HyScanMapTileLoaderJob, job);
+}
+
+/* Пробуждает цикл ожидания загрузки, чтобы периодически отправлять сигнал "progress". */
+static gboolean
+hyscan_map_tile_loader_tick (gpointer data)
+{
+  return G_SOURCE_CONTINUE;
+}
+
+/* Отправляет сигналы "speed" и "progress", если с момента предыдущей отправки прошло
+ * больше PROGRESS_INTERVAL или установлен флаг force. */
+static void
+hyscan_map_tile_loader_progress (HyScanMapTileLoader *loader,
+                                 gboolean             force)
+{
+  HyScanMapTileLoaderPrivate *priv = loader->priv;
+  guint processed, loaded;
+  guint64 bytes;
+  gdouble fraction, elapsed;
+  gdouble tiles_speed, bytes_speed;
+  gint64 time;
+
+  time = g_get_monotonic_time ();
+  if (!force && time - priv->progress_time < PROGRESS_INTERVAL)
+    return;
+
+  priv->progress_time = time;
+
+  processed = priv->n_skipped + priv->n_loaded + priv->n_failed;
+  loaded = priv->n_loaded;
+  bytes = priv->n_bytes;
+
+  fraction = priv->total > 0 ? (gdouble) processed / priv->total : 1.0;
+  elapsed = (gdouble) (time - priv->start_time) / G_TIME_SPAN_SECOND;
+  tiles_speed = elapsed > 0.0 ? loaded / elapsed : 0.0;
+  bytes_speed = elapsed > 0.0 ? bytes / elapsed : 0.0;
+
+  g_signal_emit (loader, hyscan_map_tile_loader_signals[SIGNAL_SPEED], 0, tiles_speed, bytes_speed);
+  g_signal_emit (loader, hyscan_map_tile_loader_signals[SIGNAL_PROGRESS], 0, fraction);
+}
+
+/* Ждёт, пока число незавершённых заполнений не станет меньше или равно max_pending,
+ * обрабатывая их завершение в контексте context. Во время ожидания периодически
+ * сообщает о прогрессе загрузки. */
+static void
+hyscan_map_tile_loader_wait (HyScanMapTileLoader *loader,
+                             GMainContext        *context,
+                             guint                max_pending)
+{
+  HyScanMapTileLoaderPrivate *priv = loader->priv;
+
+  while (priv->n_queued - priv->n_finished > max_pending)
+    {
+      g_main_context_iteration (context, TRUE);
+      hyscan_map_tile_loader_progress (loader, FALSE);
+    }
 }
 
 static gpointer
@@ -130,15 +338,17 @@ hyscan_map_tile_loader_func (gpointer data)
   HyScanMapTileLoaderPrivate *priv = loader->priv;
 
   HyScanMapTileGrid *grid;
+  GMainContext *context;
+  GSource *tick;
   guint min_zoom, max_zoom, zoom;
-
-  guint total = 0, processed = 0, failed = 0;
+  guint max_jobs, failed;
 
   grid = hyscan_map_tile_source_get_grid (priv->source);
 
   hyscan_map_tile_grid_get_zoom_range (grid, &min_zoom, &max_zoom);
 
   /* Определяем объем работы. */
+  priv->total = 0;
   for (zoom = min_zoom; zoom <= max_zoom; zoom++)
     {
       gint x0, y0, xn, yn;
@@ -146,11 +356,31 @@ hyscan_map_tile_loader_func (gpointer data)
       hyscan_map_tile_grid_get_view (grid, zoom, priv->from_x, priv->to_x, priv->from_y, priv->to_y,
                                      &x0, &xn, &y0, &yn);
 
-      total += (xn - x0 + 1) * (yn - y0 + 1);
+      priv->total += (xn - x0 + 1) * (yn - y0 + 1);
     }
 
-  /* Поочерёдно загружаем тайлы. */
-  for (zoom = min_zoom; zoom <= max_zoom; zoom++)
+  priv->n_queued = 0;
+  priv->n_finished = 0;
+  priv->n_loaded = 0;
+  priv->n_skipped = 0;
+  priv->n_failed = 0;
+  priv->n_bytes = 0;
+  priv->start_time = g_get_monotonic_time ();
+  priv->progress_time = 0;
+
+  max_jobs = g_atomic_int_get (&priv->max_jobs);
+
+  /* Завершение заполнения тайлов обрабатывается в собственном контексте потока загрузки. */
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+
+  tick = g_timeout_source_new (PROGRESS_INTERVAL / G_TIME_SPAN_MILLISECOND);
+  g_source_set_callback (tick, hyscan_map_tile_loader_tick, NULL, NULL);
+  g_source_attach (tick, context);
+
+  /* Запускаем заполнение не более max_jobs тайлов одновременно, чтобы
+   * не создавать сразу все тайлы большой области. */
+  for (zoom = min_zoom; zoom <= max_zoom && !g_cancellable_is_cancelled (priv->cancellable); zoom++)
     {
       gint x0, y0, xn, yn;
       gint x, y;
@@ -158,31 +388,48 @@ hyscan_map_tile_loader_func (gpointer data)
       hyscan_map_tile_grid_get_view (grid, zoom, priv->from_x, priv->to_x, priv->from_y, priv->to_y,
                                      &x0, &xn, &y0, &yn);
 
-      for (x = x0; x <= xn; ++x)
-        for (y = y0; y <= yn; ++y)
+      for (x = x0; x <= xn && !g_cancellable_is_cancelled (priv->cancellable); ++x)
+        for (y = y0; y <= yn && !g_cancellable_is_cancelled (priv->cancellable); ++y)
           {
+            HyScanMapTileLoaderJob *job;
             HyScanMapTile *tile;
 
-            if (g_atomic_int_get (&priv->stop))
-              break;
-
             tile = hyscan_map_tile_new (grid, x, y, zoom);
-            if (!hyscan_map_tile_source_fill (priv->source, tile, NULL))
+
+            /* Тайлы, уже сохранённые в кэше, не загружаем повторно. */
+            if (priv->is_cache && hyscan_map_tile_loader_lookup (priv->source, tile, NULL))
               {
-                ++failed;
-                g_warning ("HyScanMapTileLoader: failed to load tile %d/%d/%d", zoom, x, y);
+                priv->n_skipped++;
+
+                g_object_unref (tile);
+                hyscan_map_tile_loader_progress (loader, FALSE);
+                continue;
               }
 
-            ++processed;
-            g_signal_emit (loader, hyscan_map_tile_loader_signals[SIGNAL_PROGRESS], 0,
-                           (gdouble) processed / total);
+            hyscan_map_tile_loader_wait (loader, context, max_jobs - 1);
+
+            job = g_slice_new (HyScanMapTileLoaderJob);
+            job->loader = loader;
+            job->tile = tile;
 
-            g_object_unref (tile);
+            priv->n_queued++;
+            hyscan_map_tile_source_fill_async (priv->source, tile, priv->cancellable,
+                                               hyscan_map_tile_loader_ready, job);
           }
     }
 
+  /* Дожидаемся завершения всех заполнений. */
+  hyscan_map_tile_loader_wait (loader, context, 0);
+
+  g_source_destroy (tick);
+  g_source_unref (tick);
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+
+  hyscan_map_tile_loader_progress (loader, TRUE);
+
   /* Всё необработанное считаем неудавшимся. */
-  failed += total - processed;
+  failed = priv->total - priv->n_loaded - priv->n_skipped;
 
   g_object_unref (grid);
   g_clear_object (&priv->source);
@@ -191,6 +438,8 @@ hyscan_map_tile_loader_func (gpointer data)
 
   g_signal_emit (loader, hyscan_map_tile_loader_signals[SIGNAL_DONE], 0, failed);
 
+  g_object_unref (loader);
+
   return GINT_TO_POINTER (TRUE);
 }
 
@@ -207,6 +456,25 @@ hyscan_map_tile_loader_new (void)
   return g_object_new (HYSCAN_TYPE_MAP_TILE_LOADER, NULL);
 }
 
+/**
+ * hyscan_map_tile_loader_set_max_jobs:
+ * @loader: указатель на #HyScanMapTileLoader
+ * @max_jobs: максимальное число одновременно загружаемых тайлов
+ *
+ * Устанавливает максимальное число тайлов, которые загружаются параллельно.
+ * Значение применяется при следующем запуске загрузки. Для источников
+ * #HyScanMapTileSourceWeb имеет смысл согласовать его с числом соединений
+ * с сервером.
+ */
+void
+hyscan_map_tile_loader_set_max_jobs (HyScanMapTileLoader *loader,
+                                     guint                max_jobs)
+{
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_LOADER (loader));
+
+  g_atomic_int_set (&loader->priv->max_jobs, CLAMP (max_jobs, 1, MAX_JOBS));
+}
+
 /**
  * hyscan_map_tile_loader_start:
  * @loader: указатель на #HyScanMapTileLoader
@@ -240,9 +508,10 @@ hyscan_map_tile_loader_start (HyScanMapTileLoader *loader,
   if (!g_atomic_int_compare_and_exchange (&priv->busy, FALSE, TRUE))
     return NULL;
 
-  g_atomic_int_set (&priv->stop, FALSE);
+  g_cancellable_reset (priv->cancellable);
 
   priv->source = g_object_ref (source);
+  priv->is_cache = HYSCAN_IS_MAP_TILE_SOURCE_FILE (source) || HYSCAN_IS_MAP_TILE_SOURCE_PACK (source);
   priv->from_x = from_x;
   priv->to_x = to_x;
   priv->from_y = from_y;
@@ -257,15 +526,14 @@ hyscan_map_tile_loader_start (HyScanMapTileLoader *loader,
  * hyscan_map_tile_loader_stop:
  * @loader: указатель на #HyScanMapTileLoader
  *
- * Останавливает загрузку тайлов.
+ * Останавливает загрузку тайлов. Загружаемые в данный момент тайлы отменяются,
+ * а оставшиеся в очереди не загружаются. Загрузку можно продолжить, повторно
+ * запустив её функцией hyscan_map_tile_loader_start().
  */
 void
 hyscan_map_tile_loader_stop (HyScanMapTileLoader *loader)
 {
-  HyScanMapTileLoaderPrivate *priv;
-
   g_return_if_fail (HYSCAN_IS_MAP_TILE_LOADER (loader));
-  priv = loader->priv;
 
-  g_atomic_int_set (&priv->stop, TRUE);
+  g_cancellable_cancel (loader->priv->cancellable);
 }
@@ -68,6 +68,10 @@ GType                  hyscan_map_tile_loader_get_type         (void);
 HYSCAN_API
 HyScanMapTileLoader *  hyscan_map_tile_loader_new              (void);
 
+HYSCAN_API
+void                   hyscan_map_tile_loader_set_max_jobs     (HyScanMapTileLoader    *loader,
+                                                                guint                   max_jobs);
+
 HYSCAN_API
 GThread *              hyscan_map_tile_loader_start            (HyScanMapTileLoader    *loader,
                                                                 HyScanMapTileSource    *source,
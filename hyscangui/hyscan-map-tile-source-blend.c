@@ -47,6 +47,13 @@
  * Верхние источники тайлов должны формировать изображение с прозрачностью, чтобы
  * было видно изображение нижних слоёв.
  *
+ * Тайлы всех источников запрашиваются одновременно, а их изображения накладываются
+ * по мере готовности, начиная с верхнего слоя. Если изображение одного из слоёв
+ * полностью непрозрачно, то нижележащие слои не нужны: их загрузка отменяется,
+ * и тайл формируется, не дожидаясь их. Полностью прозрачные изображения при
+ * наложении пропускаются. Поэтому время заполнения тайла определяется самым
+ * медленным из необходимых источников, а не суммой времени всех источников.
+ *
  * Примеры применения композитного источника:
  * - отображения отметок гаваней, маяков и прочих навигационных ориентиров
  *   поверх выбранной карты;
@@ -56,6 +63,7 @@
  */
 
 #include "hyscan-map-tile-source-blend.h"
+#include <string.h>
 
 struct _HyScanMapTileSourceBlendPrivate
 {
@@ -68,6 +76,45 @@ struct _HyScanMapTileSourceBlendPrivate
   guint                              hash;         /* Хэш источника тайлов. */
 };
 
+/* Состояние тайла одного из источников. */
+typedef enum
+{
+  LAYER_PENDING,                                   /* Тайл ещё не заполнен. */
+  LAYER_FAILED,                                    /* Источник не заполнил тайл. */
+  LAYER_EMPTY,                                     /* Изображение полностью прозрачно. */
+  LAYER_TRANSLUCENT,                               /* Изображение частично прозрачно. */
+  LAYER_OPAQUE,                                    /* Изображение полностью непрозрачно. */
+} HyScanMapTileSourceBlendState;
+
+/* Заполнение тайла всеми источниками. Структура разделяется между потоками,
+ * заполняющими тайлы источников, поэтому имеет счётчик ссылок. */
+typedef struct
+{
+  volatile gint                      ref_count;    /* Счётчик ссылок. */
+  GMutex                             lock;         /* Блокировка доступа к состояниям слоёв. */
+  GCond                              cond;         /* Сигнализатор изменения состояния слоя. */
+
+  GCancellable                      *cancellable;  /* Отмена заполнения тайлов источников. */
+  GCancellable                      *parent;       /* Объект отмены заполнения композитного тайла. */
+  gulong                             cancelled_id; /* Обработчик сигнала "cancelled" объекта parent. */
+
+  HyScanMapTile                     *tile;         /* Тайл, который надо заполнить. */
+  HyScanMapTileSource              **sources;      /* Источники, начиная с нижнего. */
+  HyScanMapTile                    **layers;       /* Тайлы каждого из источников. */
+  HyScanMapTileSourceBlendState     *states;       /* Состояния тайлов источников. */
+  gboolean                          *started;      /* Признаки начала заполнения тайлов источников. */
+  guint                              n_layers;     /* Число источников. */
+  gboolean                           returned;     /* Признак того, что результат уже сформирован. */
+} HyScanMapTileSourceBlendJob;
+
+/* Заполнение тайла одного из источников. */
+typedef struct
+{
+  HyScanMapTileSourceBlendJob       *job;          /* Заполнение композитного тайла. */
+  GTask                             *task;         /* Задача асинхронного заполнения тайла. */
+  guint                              index;        /* Номер источника. */
+} HyScanMapTileSourceBlendLayer;
+
 static void hyscan_map_tile_source_blend_interface_init (HyScanMapTileSourceInterface *iface);
 
 static void hyscan_map_tile_source_blend_object_finalize (GObject *object);
@@ -104,57 +151,499 @@ hyscan_map_tile_source_blend_object_finalize (GObject *object)
   G_OBJECT_CLASS (hyscan_map_tile_source_blend_parent_class)->finalize (object);
 }
 
-/* Реализация #HyScanMapTileSourceInterface.fill_tile. */
-static gboolean
-hyscan_map_tile_source_blend_fill_tile (HyScanMapTileSource *source,
-                                        HyScanMapTile       *tile,
-                                        GCancellable        *cancellable)
+/* Передаёт отмену заполнения композитного тайла источникам. */
+static void
+hyscan_map_tile_source_blend_cancelled (GCancellable *parent,
+                                        GCancellable *cancellable)
 {
-  HyScanMapTileSourceBlend *blend = HYSCAN_MAP_TILE_SOURCE_BLEND (source);
-  HyScanMapTileSourceBlendPrivate *priv = blend->priv;
+  g_cancellable_cancel (cancellable);
+}
 
+/* Создаёт задание на заполнение тайла всеми источниками. */
+static HyScanMapTileSourceBlendJob *
+hyscan_map_tile_source_blend_job_new (HyScanMapTileSourceBlendPrivate *priv,
+                                      HyScanMapTile                   *tile,
+                                      GCancellable                    *cancellable)
+{
+  HyScanMapTileSourceBlendJob *job;
   GList *source_l;
+  guint x, y, z;
+  guint i;
+
+  x = hyscan_map_tile_get_x (tile);
+  y = hyscan_map_tile_get_y (tile);
+  z = hyscan_map_tile_get_zoom (tile);
+
+  job = g_slice_new0 (HyScanMapTileSourceBlendJob);
+  job->ref_count = 1;
+  g_mutex_init (&job->lock);
+  g_cond_init (&job->cond);
+
+  job->tile = g_object_ref (tile);
+  job->n_layers = g_list_length (priv->sources);
+  job->sources = g_new (HyScanMapTileSource *, job->n_layers);
+  job->layers = g_new (HyScanMapTile *, job->n_layers);
+  job->states = g_new (HyScanMapTileSourceBlendState, job->n_layers);
+  job->started = g_new0 (gboolean, job->n_layers);
+
+  /* Каждый источник заполняет собственную копию тайла. */
+  for (source_l = priv->sources, i = 0; source_l != NULL; source_l = source_l->next, i++)
+    {
+      job->sources[i] = g_object_ref (source_l->data);
+      job->layers[i] = hyscan_map_tile_new (priv->grid, x, y, z);
+      job->states[i] = LAYER_PENDING;
+    }
+
+  job->cancellable = g_cancellable_new ();
+  if (cancellable != NULL)
+    {
+      job->parent = g_object_ref (cancellable);
+      job->cancelled_id = g_cancellable_connect (cancellable, G_CALLBACK (hyscan_map_tile_source_blend_cancelled),
+                                                 g_object_ref (job->cancellable), g_object_unref);
+    }
+
+  return job;
+}
+
+static HyScanMapTileSourceBlendJob *
+hyscan_map_tile_source_blend_job_ref (HyScanMapTileSourceBlendJob *job)
+{
+  g_atomic_int_inc (&job->ref_count);
+
+  return job;
+}
+
+static void
+hyscan_map_tile_source_blend_job_unref (HyScanMapTileSourceBlendJob *job)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&job->ref_count))
+    return;
+
+  if (job->parent != NULL)
+    {
+      g_cancellable_disconnect (job->parent, job->cancelled_id);
+      g_object_unref (job->parent);
+    }
+
+  for (i = 0; i < job->n_layers; i++)
+    {
+      g_object_unref (job->sources[i]);
+      g_object_unref (job->layers[i]);
+    }
+
+  g_object_unref (job->tile);
+  g_object_unref (job->cancellable);
+  g_free (job->sources);
+  g_free (job->layers);
+  g_free (job->states);
+  g_free (job->started);
+  g_mutex_clear (&job->lock);
+  g_cond_clear (&job->cond);
+  g_slice_free (HyScanMapTileSourceBlendJob, job);
+}
+
+/* Определяет прозрачность изображения тайла. */
+static HyScanMapTileSourceBlendState
+hyscan_map_tile_source_blend_classify (HyScanMapTile *tile)
+{
+  cairo_surface_t *surface;
+  const guint8 *data;
+  gboolean opaque = TRUE;
+  gboolean empty = TRUE;
+  gint width, height, stride;
+  gint x, y;
+
+  surface = hyscan_map_tile_get_surface (tile);
+  if (surface == NULL)
+    return LAYER_FAILED;
+
+  if (cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32)
+    {
+      cairo_surface_destroy (surface);
+      return LAYER_TRANSLUCENT;
+    }
+
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (y = 0; y < height && (opaque || empty); y++)
+    {
+      const guint32 *row = (const guint32 *) (data + y * stride);
+
+      for (x = 0; x < width; x++)
+        {
+          guint32 alpha = row[x] >> 24;
+
+          opaque = opaque && (alpha == 0xff);
+          empty = empty && (alpha == 0);
+          if (!opaque && !empty)
+            break;
+        }
+    }
+
+  cairo_surface_destroy (surface);
+
+  if (opaque)
+    return LAYER_OPAQUE;
+
+  return empty ? LAYER_EMPTY : LAYER_TRANSLUCENT;
+}
+
+/* Проверяет, достаточно ли заполненных слоёв для формирования тайла: все слои
+ * выше верхнего непрозрачного слоя должны быть заполнены. Вызывается под
+ * блокировкой. */
+static gboolean
+hyscan_map_tile_source_blend_job_is_ready (HyScanMapTileSourceBlendJob *job)
+{
+  guint i;
+
+  for (i = job->n_layers; i > 0; i--)
+    {
+      if (job->states[i - 1] == LAYER_PENDING)
+        return FALSE;
+
+      if (job->states[i - 1] == LAYER_OPAQUE)
+        return TRUE;
+    }
+
+  return TRUE;
+}
+
+/* Помечает тайл источника как заполняемый текущим потоком.
+ * Returns: %TRUE, если заполнение тайла ещё не было начато другим потоком. */
+static gboolean
+hyscan_map_tile_source_blend_job_claim (HyScanMapTileSourceBlendJob *job,
+                                        guint                        index)
+{
+  gboolean claimed;
+
+  g_mutex_lock (&job->lock);
+  claimed = !job->started[index];
+  job->started[index] = TRUE;
+  g_mutex_unlock (&job->lock);
+
+  return claimed;
+}
+
+/* Запоминает результат заполнения тайла источника.
+ * Returns: %TRUE, если после этого тайл готов к формированию. */
+static gboolean
+hyscan_map_tile_source_blend_job_set_layer (HyScanMapTileSourceBlendJob *job,
+                                            guint                        index,
+                                            gboolean                     filled)
+{
+  HyScanMapTileSourceBlendState state;
+  gboolean ready;
+
+  state = filled ? hyscan_map_tile_source_blend_classify (job->layers[index]) : LAYER_FAILED;
+
+  g_mutex_lock (&job->lock);
+  job->states[index] = state;
+  ready = hyscan_map_tile_source_blend_job_is_ready (job);
+  g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->lock);
+
+  return ready;
+}
+
+/* Накладывает друг на друга изображения тайлов источников, начиная с верхнего
+ * непрозрачного слоя. Прозрачные слои пропускаются, а если виден только один
+ * слой, то его поверхность используется без копирования. Вызывается, когда
+ * задание готово к формированию тайла. */
+static gboolean
+hyscan_map_tile_source_blend_job_compose (HyScanMapTileSourceBlendJob *job)
+{
+  HyScanMapTileSourceBlendState *states;
   cairo_surface_t *surface;
   cairo_t *cairo = NULL;
+  guint base, i;
+  gint empty = -1;
+  gint n_visible = 0;
 
-  g_return_val_if_fail (priv->sources != NULL, FALSE);
+  g_mutex_lock (&job->lock);
+  states = g_new (HyScanMapTileSourceBlendState, job->n_layers);
+  memcpy (states, job->states, job->n_layers * sizeof (HyScanMapTileSourceBlendState));
+  g_mutex_unlock (&job->lock);
+
+  /* Слои ниже верхнего непрозрачного не видны. */
+  for (base = job->n_layers - 1; base > 0 && states[base] != LAYER_OPAQUE; base--)
+    ;
+
+  for (i = base; i < job->n_layers; i++)
+    {
+      if (states[i] == LAYER_EMPTY && empty < 0)
+        empty = i;
+      else if (states[i] == LAYER_TRANSLUCENT || states[i] == LAYER_OPAQUE)
+        n_visible++;
+    }
+
+  /* Ни один из источников ничего не заполнил - неудача. */
+  if (n_visible == 0 && empty < 0)
+    {
+      g_free (states);
+      return FALSE;
+    }
 
-  /* Получаем поверхности из каждого источника и рисуем их поверх друг друга. */
-  for (source_l = priv->sources; source_l != NULL; source_l = source_l->next)
+  /* Все заполненные слои прозрачны. */
+  if (n_visible == 0)
     {
-      gboolean fill_status;
+      surface = hyscan_map_tile_get_surface (job->layers[empty]);
+      hyscan_map_tile_set_surface (job->tile, surface);
+      cairo_surface_destroy (surface);
+      g_free (states);
+      return TRUE;
+    }
 
-      fill_status = hyscan_map_tile_source_fill (source_l->data, tile, cancellable);
-      if (fill_status == FALSE)
+  for (i = base; i < job->n_layers; i++)
+    {
+      if (states[i] != LAYER_TRANSLUCENT && states[i] != LAYER_OPAQUE)
         continue;
 
-      surface = hyscan_map_tile_get_surface (tile);
-      if (cairo == NULL)
+      surface = hyscan_map_tile_get_surface (job->layers[i]);
+
+      /* Виден только один слой. */
+      if (n_visible == 1)
         {
-          cairo = cairo_create (surface);
+          hyscan_map_tile_set_surface (job->tile, surface);
+          cairo_surface_destroy (surface);
+          break;
         }
-      else
+
+      if (cairo == NULL)
         {
-          cairo_set_source_surface (cairo, surface, 0, 0);
-          cairo_paint (cairo);
+          cairo_surface_t *target;
+
+          target = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                               cairo_image_surface_get_width (surface),
+                                               cairo_image_surface_get_height (surface));
+          cairo = cairo_create (target);
+          cairo_surface_destroy (target);
+          cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
         }
 
-      g_clear_pointer (&surface, cairo_surface_destroy);
-    }
+      cairo_set_source_surface (cairo, surface, 0, 0);
+      cairo_paint (cairo);
+      cairo_set_operator (cairo, CAIRO_OPERATOR_OVER);
 
-  /* Ни один из источников ничерго не заполнил - неудача. */
-  if (cairo == NULL)
-    return FALSE;
+      cairo_surface_destroy (surface);
+    }
 
-  /* Устанавливаем полученное изображение тайла. */
-  hyscan_map_tile_set_surface (tile, cairo_get_target (cairo));
+  if (cairo != NULL)
+    {
+      hyscan_map_tile_set_surface (job->tile, cairo_get_target (cairo));
+      cairo_destroy (cairo);
+    }
 
-  /* Освобождаем память. */
-  cairo_destroy (cairo);
+  g_free (states);
 
   return TRUE;
 }
 
+/* Заполняет тайл одного из источников в пуле потоков. */
+static void
+hyscan_map_tile_source_blend_layer_do (gpointer data,
+                                       gpointer user_data)
+{
+  HyScanMapTileSourceBlendLayer *layer = data;
+  HyScanMapTileSourceBlendJob *job = layer->job;
+  gboolean filled;
+
+  /* Тайл уже заполнил поток, ожидающий композитный тайл. */
+  if (hyscan_map_tile_source_blend_job_claim (job, layer->index))
+    {
+      filled = hyscan_map_tile_source_fill (job->sources[layer->index], job->layers[layer->index], job->cancellable);
+      hyscan_map_tile_source_blend_job_set_layer (job, layer->index, filled);
+    }
+
+  hyscan_map_tile_source_blend_job_unref (job);
+  g_slice_free (HyScanMapTileSourceBlendLayer, layer);
+}
+
+/* Возвращает общий пул потоков для заполнения тайлов источников. Число потоков
+ * равно числу процессоров; вложенные композитные источники не блокируют друг
+ * друга, так как ожидающий поток сам заполняет ещё не начатые тайлы. */
+static GThreadPool *
+hyscan_map_tile_source_blend_get_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (hyscan_map_tile_source_blend_layer_do, NULL,
+                                    g_get_num_processors (), FALSE, NULL);
+      g_once_init_leave (&pool, new_pool);
+    }
+
+  return pool;
+}
+
+/* Реализация #HyScanMapTileSourceInterface.fill_tile.
+ * Нижние слои заполняются в пуле потоков, верхний - в текущем потоке. Пока
+ * тайл не готов, текущий поток заполняет нижние слои, не начатые пулом. */
+static gboolean
+hyscan_map_tile_source_blend_fill_tile (HyScanMapTileSource *source,
+                                        HyScanMapTile       *tile,
+                                        GCancellable        *cancellable)
+{
+  HyScanMapTileSourceBlend *blend = HYSCAN_MAP_TILE_SOURCE_BLEND (source);
+  HyScanMapTileSourceBlendPrivate *priv = blend->priv;
+  HyScanMapTileSourceBlendJob *job;
+  GThreadPool *pool;
+  gboolean filled;
+  guint top, i;
+
+  g_return_val_if_fail (priv->sources != NULL, FALSE);
+
+  job = hyscan_map_tile_source_blend_job_new (priv, tile, cancellable);
+  top = job->n_layers - 1;
+  job->started[top] = TRUE;
+
+  pool = hyscan_map_tile_source_blend_get_pool ();
+  for (i = 0; i < top; i++)
+    {
+      HyScanMapTileSourceBlendLayer *layer;
+
+      layer = g_slice_new (HyScanMapTileSourceBlendLayer);
+      layer->job = hyscan_map_tile_source_blend_job_ref (job);
+      layer->task = NULL;
+      layer->index = i;
+      g_thread_pool_push (pool, layer, NULL);
+    }
+
+  filled = hyscan_map_tile_source_fill (job->sources[top], job->layers[top], job->cancellable);
+  hyscan_map_tile_source_blend_job_set_layer (job, top, filled);
+
+  /* Заполняем слои, до которых ещё не дошла очередь пула. */
+  for (i = top; i > 0; i--)
+    {
+      gboolean ready;
+
+      g_mutex_lock (&job->lock);
+      ready = hyscan_map_tile_source_blend_job_is_ready (job);
+      g_mutex_unlock (&job->lock);
+      if (ready)
+        break;
+
+      if (!hyscan_map_tile_source_blend_job_claim (job, i - 1))
+        continue;
+
+      filled = hyscan_map_tile_source_fill (job->sources[i - 1], job->layers[i - 1], job->cancellable);
+      hyscan_map_tile_source_blend_job_set_layer (job, i - 1, filled);
+    }
+
+  /* Ждём слои, без которых тайл сформировать нельзя. */
+  g_mutex_lock (&job->lock);
+  while (!hyscan_map_tile_source_blend_job_is_ready (job))
+    g_cond_wait (&job->cond, &job->lock);
+  g_mutex_unlock (&job->lock);
+
+  /* Остальные слои больше не нужны. */
+  g_cancellable_cancel (job->cancellable);
+
+  filled = !g_cancellable_is_cancelled (cancellable) && hyscan_map_tile_source_blend_job_compose (job);
+  hyscan_map_tile_source_blend_job_unref (job);
+
+  return filled;
+}
+
+/* Обработчик завершения заполнения тайла одного из источников. */
+static void
+hyscan_map_tile_source_blend_layer_ready (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data)
+{
+  HyScanMapTileSourceBlendLayer *layer = user_data;
+  HyScanMapTileSourceBlendJob *job = layer->job;
+  GTask *task = layer->task;
+  guint index = layer->index;
+  gboolean filled;
+
+  filled = hyscan_map_tile_source_fill_finish (HYSCAN_MAP_TILE_SOURCE (object), result, NULL);
+  g_slice_free (HyScanMapTileSourceBlendLayer, layer);
+
+  /* Ждём ответа источников, без которых тайл сформировать нельзя. */
+  if (!hyscan_map_tile_source_blend_job_set_layer (job, index, filled) || job->returned)
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  /* Остальные слои больше не нужны. */
+  job->returned = TRUE;
+  g_cancellable_cancel (job->cancellable);
+
+  if (!g_task_return_error_if_cancelled (task))
+    {
+      if (hyscan_map_tile_source_blend_job_compose (job))
+        g_task_return_boolean (task, TRUE);
+      else
+        g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "no tile source filled the tile");
+    }
+
+  g_object_unref (task);
+}
+
+/* Реализация #HyScanMapTileSourceInterface.fill_tile_async.
+ * Запрашивает тайл у всех источников одновременно. */
+static void
+hyscan_map_tile_source_blend_fill_tile_async (HyScanMapTileSource *source,
+                                              HyScanMapTile       *tile,
+                                              GCancellable        *cancellable,
+                                              GAsyncReadyCallback  callback,
+                                              gpointer             user_data)
+{
+  HyScanMapTileSourceBlend *blend = HYSCAN_MAP_TILE_SOURCE_BLEND (source);
+  HyScanMapTileSourceBlendPrivate *priv = blend->priv;
+  HyScanMapTileSourceBlendJob *job;
+  GTask *task;
+  guint i;
+
+  task = g_task_new (source, cancellable, callback, user_data);
+  g_task_set_source_tag (task, hyscan_map_tile_source_blend_fill_tile_async);
+
+  if (priv->sources == NULL)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED, "no tile sources");
+      g_object_unref (task);
+      return;
+    }
+
+  job = hyscan_map_tile_source_blend_job_new (priv, tile, cancellable);
+  g_task_set_task_data (task, job, (GDestroyNotify) hyscan_map_tile_source_blend_job_unref);
+
+  for (i = 0; i < job->n_layers; i++)
+    {
+      HyScanMapTileSourceBlendLayer *layer;
+
+      layer = g_slice_new (HyScanMapTileSourceBlendLayer);
+      layer->job = job;
+      layer->task = g_object_ref (task);
+      layer->index = i;
+      hyscan_map_tile_source_fill_async (job->sources[i], job->layers[i], job->cancellable,
+                                         hyscan_map_tile_source_blend_layer_ready, layer);
+    }
+
+  g_object_unref (task);
+}
+
+/* Реализация #HyScanMapTileSourceInterface.fill_tile_finish. */
+static gboolean
+hyscan_map_tile_source_blend_fill_tile_finish (HyScanMapTileSource  *source,
+                                               GAsyncResult         *result,
+                                               GError              **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, source), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /* Реализация #HyScanMapTileSourceInterface.get_grid. */
 static HyScanMapTileGrid *
 hyscan_map_tile_source_blend_get_grid (HyScanMapTileSource *source)
@@ -191,6 +680,8 @@ hyscan_map_tile_source_blend_interface_init (HyScanMapTileSourceInterface *iface
   iface->get_projection = hyscan_map_tile_source_blend_get_projection;
   iface->get_grid = hyscan_map_tile_source_blend_get_grid;
   iface->fill_tile = hyscan_map_tile_source_blend_fill_tile;
+  iface->fill_tile_async = hyscan_map_tile_source_blend_fill_tile_async;
+  iface->fill_tile_finish = hyscan_map_tile_source_blend_fill_tile_finish;
   iface->hash = hyscan_map_tile_source_blend_hash;
 }
 
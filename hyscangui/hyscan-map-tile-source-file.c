@@ -47,9 +47,15 @@
  * затем сохранят загруженный тайл в каталоге. Таким образом класс может быть
  * использован в качестве кэша тайлов для других источников.
  *
+ * При асинхронном заполнении тайла чтение файла и загрузка из запасного
+ * источника также выполняются асинхронно, а сохранение загруженного тайла
+ * происходит в отдельном потоке. Заполнение завершается после сохранения, чтобы
+ * тайл не изменялся, пока его изображение записывается на диск.
+ *
  */
 
 #include "hyscan-map-tile-source-file.h"
+#include <glib/gstdio.h>
 
 enum
 {
@@ -58,6 +64,13 @@ enum
   PROP_FALLBACK_SOURCE,
 };
 
+/* Данные асинхронного заполнения тайла. */
+typedef struct
+{
+  HyScanMapTile               *tile;              /* Тайл, который надо заполнить. */
+  gchar                       *tile_path;         /* Путь к файлу с тайлом. */
+} HyScanMapTileSourceFileAsync;
+
 struct _HyScanMapTileSourceFilePrivate
 {
   gchar                       *source_dir;        /* Каталог для хранения тайлов. */
@@ -169,19 +182,18 @@ static gboolean
 hyscan_map_tile_source_file_fill_from_file (HyScanMapTile *tile,
                                             const gchar   *tile_path)
 {
-  GdkPixbuf *pixbuf;
+  GBytes *image;
+  gchar *contents;
+  gsize length;
   gboolean success;
 
-  if (!g_file_test (tile_path, G_FILE_TEST_EXISTS))
-    return FALSE;
-
   /* Если файл существует, то загружаем поверхность тайла из него. */
-  pixbuf = gdk_pixbuf_new_from_file (tile_path, NULL);
-  if (pixbuf == NULL)
+  if (!g_file_get_contents (tile_path, &contents, &length, NULL))
     return FALSE;
 
-  success = hyscan_map_tile_set_pixbuf (tile, pixbuf);
-  g_object_unref (pixbuf);
+  image = g_bytes_new_take (contents, length);
+  success = hyscan_map_tile_set_image (tile, image);
+  g_bytes_unref (image);
 
   return success;
 }
@@ -193,6 +205,7 @@ hyscan_map_tile_source_file_save (HyScanMapTile *tile,
 {
   gchar *tile_dir;
   gchar *tile_path_locale;
+  gchar *part_path_locale;
   cairo_surface_t *surface;
   cairo_status_t status;
 
@@ -210,10 +223,22 @@ hyscan_map_tile_source_file_save (HyScanMapTile *tile,
 
   g_free (tile_dir);
 
-  /* Записываем PNG-файл с тайлом. */
+  /* Записываем PNG-файл с тайлом во временный файл и затем переименовываем его, чтобы
+   * при прерывании записи в каталоге не остался недописанный тайл. Имя временного
+   * файла уникально для потока, т.к. один тайл могут одновременно сохранять
+   * несколько потоков. */
+  part_path_locale = g_strdup_printf ("%s.%p.part", tile_path_locale, (gpointer) g_thread_self ());
   surface = hyscan_map_tile_get_surface (tile);
-  status = cairo_surface_write_to_png (surface, tile_path_locale);
+  status = cairo_surface_write_to_png (surface, part_path_locale);
   cairo_surface_destroy (surface);
+
+  if (status == CAIRO_STATUS_SUCCESS && g_rename (part_path_locale, tile_path_locale) != 0)
+    status = CAIRO_STATUS_WRITE_ERROR;
+
+  if (status != CAIRO_STATUS_SUCCESS)
+    g_unlink (part_path_locale);
+
+  g_free (part_path_locale);
   g_free (tile_path_locale);
 
   if (status != CAIRO_STATUS_SUCCESS)
@@ -225,6 +250,18 @@ hyscan_map_tile_source_file_save (HyScanMapTile *tile,
   return TRUE;
 }
 
+/* Формирует путь к файлу с тайлом. Для удаления g_free(). */
+static gchar *
+hyscan_map_tile_source_file_get_path (HyScanMapTileSourceFilePrivate *priv,
+                                      HyScanMapTile                  *tile)
+{
+  return g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d.png",
+                          priv->source_dir,
+                          hyscan_map_tile_get_zoom (tile),
+                          hyscan_map_tile_get_x (tile),
+                          hyscan_map_tile_get_y (tile));
+}
+
 /* Ищет указанный тайл и загружает его изображение.
    Реализация #HyScanMapTileSourceInterface.fill_tile. */
 static gboolean
@@ -242,20 +279,13 @@ hyscan_map_tile_source_file_fill_tile (HyScanMapTileSource *source,
     return FALSE;
 
   /* Путь к файлу с тайлом. */
-  tile_path = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d.png",
-                               priv->source_dir,
-                               hyscan_map_tile_get_zoom (tile),
-                               hyscan_map_tile_get_x (tile),
-                               hyscan_map_tile_get_y (tile));
+  tile_path = hyscan_map_tile_source_file_get_path (priv, tile);
 
   /* Пробуем загрузить из файла. */
   success = hyscan_map_tile_source_file_fill_from_file (tile, tile_path);
 
-  if (!g_atomic_int_get (&priv->fallback_enabled))
-    return success;
-
   /* Если файл отсутствует, то загружаем поверхность из запасного источника. */
-  if (!success && priv->fallback_source != NULL)
+  if (!success && priv->fallback_source != NULL && g_atomic_int_get (&priv->fallback_enabled))
     {
       success = hyscan_map_tile_source_fill (priv->fallback_source, tile, cancellable);
       if (success)
@@ -267,6 +297,200 @@ hyscan_map_tile_source_file_fill_tile (HyScanMapTileSource *source,
   return success;
 }
 
+static HyScanMapTileSourceFileAsync *
+hyscan_map_tile_source_file_async_new (HyScanMapTile *tile,
+                                       const gchar   *tile_path)
+{
+  HyScanMapTileSourceFileAsync *async;
+
+  async = g_slice_new (HyScanMapTileSourceFileAsync);
+  async->tile = g_object_ref (tile);
+  async->tile_path = g_strdup (tile_path);
+
+  return async;
+}
+
+static void
+hyscan_map_tile_source_file_async_free (HyScanMapTileSourceFileAsync *async)
+{
+  g_object_unref (async->tile);
+  g_free (async->tile_path);
+  g_slice_free (HyScanMapTileSourceFileAsync, async);
+}
+
+/* Сохраняет тайл на диск в потоке GTask. */
+static void
+hyscan_map_tile_source_file_save_thread (GTask        *task,
+                                         gpointer      source_object,
+                                         gpointer      task_data,
+                                         GCancellable *cancellable)
+{
+  HyScanMapTileSourceFileAsync *async = task_data;
+
+  g_task_return_boolean (task, hyscan_map_tile_source_file_save (async->tile, async->tile_path));
+}
+
+/* Обработчик завершения записи тайла на диск. Заполнение тайла завершается
+ * только после записи, т.к. до этого поток записи читает поверхность тайла. */
+static void
+hyscan_map_tile_source_file_save_ready (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+
+  /* Ошибка записи не мешает использовать заполненный тайл. */
+  g_task_propagate_boolean (G_TASK (result), NULL);
+
+  g_task_return_boolean (task, TRUE);
+  g_object_unref (task);
+}
+
+/* Обработчик завершения заполнения тайла запасным источником. */
+static void
+hyscan_map_tile_source_file_fallback_ready (GObject      *object,
+                                            GAsyncResult *result,
+                                            gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  HyScanMapTileSourceFileAsync *async = g_task_get_task_data (task);
+  GTask *save_task;
+  GError *error = NULL;
+
+  if (!hyscan_map_tile_source_fill_finish (HYSCAN_MAP_TILE_SOURCE (object), result, &error))
+    {
+      g_task_return_error (task, error);
+      g_object_unref (task);
+      return;
+    }
+
+  /* Сохраняем тайл в отдельном потоке и завершаем заполнение по окончании записи. */
+  save_task = g_task_new (g_task_get_source_object (task), NULL,
+                          hyscan_map_tile_source_file_save_ready, task);
+  g_task_set_task_data (save_task,
+                        hyscan_map_tile_source_file_async_new (async->tile, async->tile_path),
+                        (GDestroyNotify) hyscan_map_tile_source_file_async_free);
+  g_task_run_in_thread (save_task, hyscan_map_tile_source_file_save_thread);
+  g_object_unref (save_task);
+}
+
+/* Загружает тайл из запасного источника, если файл с тайлом не удалось прочитать. */
+static void
+hyscan_map_tile_source_file_fallback_async (GTask *task)
+{
+  HyScanMapTileSourceFile *fsource = g_task_get_source_object (task);
+  HyScanMapTileSourceFilePrivate *priv = fsource->priv;
+  HyScanMapTileSourceFileAsync *async = g_task_get_task_data (task);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  if (!g_atomic_int_get (&priv->fallback_enabled) || priv->fallback_source == NULL)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "tile file not found");
+      g_object_unref (task);
+      return;
+    }
+
+  hyscan_map_tile_source_fill_async (priv->fallback_source, async->tile, g_task_get_cancellable (task),
+                                     hyscan_map_tile_source_file_fallback_ready, task);
+}
+
+/* Обработчик завершения декодирования изображения из файла. */
+static void
+hyscan_map_tile_source_file_pixbuf_ready (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  HyScanMapTileSourceFileAsync *async = g_task_get_task_data (task);
+  GdkPixbuf *pixbuf;
+  gboolean success;
+
+  pixbuf = gdk_pixbuf_new_from_stream_finish (result, NULL);
+  success = (pixbuf != NULL) && hyscan_map_tile_set_pixbuf (async->tile, pixbuf);
+  g_clear_object (&pixbuf);
+
+  if (!success)
+    {
+      hyscan_map_tile_source_file_fallback_async (task);
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+  g_object_unref (task);
+}
+
+/* Обработчик открытия файла с тайлом. */
+static void
+hyscan_map_tile_source_file_read_ready (GObject      *object,
+                                        GAsyncResult *result,
+                                        gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  GFileInputStream *stream;
+
+  stream = g_file_read_finish (G_FILE (object), result, NULL);
+  if (stream == NULL)
+    {
+      hyscan_map_tile_source_file_fallback_async (task);
+      return;
+    }
+
+  gdk_pixbuf_new_from_stream_async (G_INPUT_STREAM (stream), g_task_get_cancellable (task),
+                                    hyscan_map_tile_source_file_pixbuf_ready, task);
+  g_object_unref (stream);
+}
+
+/* Реализация #HyScanMapTileSourceInterface.fill_tile_async. */
+static void
+hyscan_map_tile_source_file_fill_tile_async (HyScanMapTileSource *source,
+                                             HyScanMapTile       *tile,
+                                             GCancellable        *cancellable,
+                                             GAsyncReadyCallback  callback,
+                                             gpointer             user_data)
+{
+  HyScanMapTileSourceFile *fsource = HYSCAN_MAP_TILE_SOURCE_FILE (source);
+  HyScanMapTileSourceFilePrivate *priv = fsource->priv;
+  HyScanMapTileSourceFileAsync *async;
+  GFile *file;
+  gchar *tile_path;
+  GTask *task;
+
+  task = g_task_new (source, cancellable, callback, user_data);
+  g_task_set_source_tag (task, hyscan_map_tile_source_file_fill_tile_async);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  tile_path = hyscan_map_tile_source_file_get_path (priv, tile);
+  async = hyscan_map_tile_source_file_async_new (tile, tile_path);
+  g_task_set_task_data (task, async, (GDestroyNotify) hyscan_map_tile_source_file_async_free);
+
+  file = g_file_new_for_path (tile_path);
+  g_file_read_async (file, G_PRIORITY_DEFAULT, cancellable, hyscan_map_tile_source_file_read_ready, task);
+
+  g_object_unref (file);
+  g_free (tile_path);
+}
+
+/* Реализация #HyScanMapTileSourceInterface.fill_tile_finish. */
+static gboolean
+hyscan_map_tile_source_file_fill_tile_finish (HyScanMapTileSource  *source,
+                                              GAsyncResult         *result,
+                                              GError              **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, source), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /* Реализация #HyScanMapTileSourceInterface.get_grid. */
 static HyScanMapTileGrid *
 hyscan_map_tile_source_file_get_grid (HyScanMapTileSource *source)
@@ -301,6 +525,8 @@ static void
 hyscan_map_tile_source_file_interface_init (HyScanMapTileSourceInterface *iface)
 {
   iface->fill_tile = hyscan_map_tile_source_file_fill_tile;
+  iface->fill_tile_async = hyscan_map_tile_source_file_fill_tile_async;
+  iface->fill_tile_finish = hyscan_map_tile_source_file_fill_tile_finish;
   iface->get_grid = hyscan_map_tile_source_file_get_grid;
   iface->get_projection = hyscan_map_tile_source_file_get_projection;
   iface->hash = hyscan_map_tile_source_file_hash;
@@ -356,3 +582,36 @@ hyscan_map_tile_source_file_fb_enable (HyScanMapTileSourceFile *fs_source,
 
   g_atomic_int_set (&fs_source->priv->fallback_enabled, enable);
 }
+
+/**
+ * hyscan_map_tile_source_file_lookup:
+ * @fs_source: указатель на #HyScanMapTileSourceFile
+ * @tile: тайл
+ * @size: (out) (optional): размер файла с тайлом в байтах
+ *
+ * Проверяет наличие файла с тайлом @tile в каталоге тайлов. Функция не
+ * загружает изображение тайла и не обращается к запасному источнику, поэтому
+ * может быть использована для быстрой проверки содержимого кэша.
+ *
+ * Returns: %TRUE, если файл с тайлом существует.
+ */
+gboolean
+hyscan_map_tile_source_file_lookup (HyScanMapTileSourceFile *fs_source,
+                                    HyScanMapTile           *tile,
+                                    goffset                 *size)
+{
+  GStatBuf stat_buf;
+  gchar *tile_path;
+  gboolean found;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_SOURCE_FILE (fs_source), FALSE);
+
+  tile_path = hyscan_map_tile_source_file_get_path (fs_source->priv, tile);
+  found = (g_stat (tile_path, &stat_buf) == 0);
+  g_free (tile_path);
+
+  if (size != NULL)
+    *size = found ? stat_buf.st_size : 0;
+
+  return found;
+}
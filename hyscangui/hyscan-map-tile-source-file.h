@@ -73,6 +73,11 @@ HYSCAN_API
 void                       hyscan_map_tile_source_file_fb_enable (HyScanMapTileSourceFile  *fs_source,
                                                                   gboolean                  enable);
 
+HYSCAN_API
+gboolean                   hyscan_map_tile_source_file_lookup    (HyScanMapTileSourceFile  *fs_source,
+                                                                  HyScanMapTile            *tile,
+                                                                  goffset                  *size);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_MAP_TILE_SOURCE_FILE_H__ */
@@ -0,0 +1,1162 @@
+/* hyscan-map-tile-source-pack.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+/**
+ * SECTION: hyscan-map-tile-source-pack
+ * @Short_description: Источник тайлов в едином файле
+ * @Title: HyScanMapTileSourcePack
+ * @See_also: #HyScanMapTileSource, #HyScanMapTileSourceFile
+ *
+ * Класс реализует интерфейс загрузки тайлов, храня изображения всех тайлов в
+ * одном файле-контейнере. Класс является альтернативой #HyScanMapTileSourceFile:
+ * вместо множества мелких файлов в каталоге используется один файл, который
+ * проще копировать, а поиск тайла не требует обращений к файловой системе.
+ *
+ * Файл состоит из заголовка, индекса и области данных. Индекс представляет
+ * собой хэш-таблицу с открытой адресацией по координатам тайла и заполнен
+ * не более чем наполовину, поэтому поиск тайла выполняется за постоянное
+ * время. Файл отображается в память, так что поиск по индексу и чтение
+ * изображения тайла выполняются без системных вызовов.
+ *
+ * Запись в файл выполняется только добавлением: данные нового тайла дописываются
+ * в конец файла, после чего заполняется ячейка индекса. Когда индекс
+ * заполняется наполовину, в конец файла записывается новый индекс вдвое
+ * большего размера. Освободить место, занимаемое старыми индексами и
+ * недописанными данными, можно функцией hyscan_map_tile_source_pack_compact().
+ *
+ * Если класс не находит тайл в контейнере, то он загружает тайл из источника
+ * @fb_source и дописывает его в контейнер. Таким образом класс может быть
+ * использован в качестве кэша тайлов для других источников. Для переноса уже
+ * имеющегося кэша #HyScanMapTileSourceFile используется функция
+ * hyscan_map_tile_source_pack_import().
+ *
+ */
+
+#include "hyscan-map-tile-source-pack.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define PACK_MAGIC            "HSTPACK1"    /* Сигнатура файла. */
+#define PACK_VERSION          1             /* Версия формата файла. */
+#define INDEX_CAPACITY_MIN    4096          /* Минимальное число ячеек индекса. */
+#define PENDING_MAX           256           /* Число добавленных тайлов, после которого файл отображается заново. */
+#define SLOT_NONE             G_MAXUINT32   /* В индексе нет свободной ячейки. */
+#define PACK_ALIGN(x)         (((x) + 7) & ~((guint64) 7))
+
+enum
+{
+  PROP_O,
+  PROP_PATH,
+  PROP_FALLBACK_SOURCE,
+};
+
+/* Заголовок файла. Все числа в файле записываются в порядке байтов little-endian. */
+typedef struct
+{
+  gchar                        magic[8];          /* Сигнатура PACK_MAGIC. */
+  guint32                      version;           /* Версия формата. */
+  guint32                      index_capacity;    /* Число ячеек индекса, степень двойки. */
+  guint64                      index_offset;      /* Смещение индекса от начала файла. */
+  guint64                      data_end;          /* Смещение конца записанных данных. */
+  guint32                      n_tiles;           /* Число тайлов в файле. */
+  guint32                      reserved[3];       /* Зарезервировано. */
+} HyScanMapTileSourcePackHeader;
+
+/* Ячейка индекса. */
+typedef struct
+{
+  guint64                      offset;            /* Смещение изображения тайла, 0 - пустая ячейка. */
+  guint32                      size;              /* Размер изображения тайла. */
+  guint32                      zoom;              /* Масштаб. */
+  guint32                      x;                 /* Номер тайла по x. */
+  guint32                      y;                 /* Номер тайла по y. */
+} HyScanMapTileSourcePackSlot;
+
+/* Заголовок записи перед изображением тайла, позволяет восстановить индекс по данным. */
+typedef struct
+{
+  guint32                      zoom;              /* Масштаб. */
+  guint32                      x;                 /* Номер тайла по x. */
+  guint32                      y;                 /* Номер тайла по y. */
+  guint32                      size;              /* Размер изображения тайла. */
+} HyScanMapTileSourcePackRecord;
+
+/* Тайл, добавленный в файл после его отображения в память. */
+typedef struct
+{
+  guint32                      zoom;              /* Масштаб. */
+  guint32                      x;                 /* Номер тайла по x. */
+  guint32                      y;                 /* Номер тайла по y. */
+  GBytes                      *data;              /* Изображение тайла. */
+} HyScanMapTileSourcePackPending;
+
+struct _HyScanMapTileSourcePackPrivate
+{
+  gchar                       *path;              /* Путь к файлу-контейнеру. */
+  HyScanMapTileSource         *fallback_source;   /* Источник тайлов на случай, если тайла нет в контейнере. */
+  gboolean                     fallback_enabled;  /* Признак того, что fallback-источник можно использовать. */
+  guint                        hash;              /* Хэш источника тайлов. */
+
+  GRWLock                      lock;              /* Блокировка доступа к файлу. */
+  GFileIOStream               *stream;            /* Поток для записи в файл. */
+  HyScanMapTileSourcePackHeader header;           /* Текущий заголовок файла, в порядке байтов хоста. */
+
+  GBytes                      *map;               /* Отображение файла в память. */
+  const HyScanMapTileSourcePackSlot *index;       /* Индекс в отображении файла. */
+  guint32                      index_capacity;    /* Число ячеек индекса в отображении файла. */
+  GHashTable                  *pending;           /* Тайлы, добавленные после отображения: номер ячейки -> тайл. */
+};
+
+static void       hyscan_map_tile_source_pack_interface_init           (HyScanMapTileSourceInterface    *iface);
+static void       hyscan_map_tile_source_pack_set_property             (GObject                         *object,
+                                                                        guint                            prop_id,
+                                                                        const GValue                    *value,
+                                                                        GParamSpec                      *pspec);
+static void       hyscan_map_tile_source_pack_object_constructed       (GObject                         *object);
+static void       hyscan_map_tile_source_pack_object_finalize          (GObject                         *object);
+static void       hyscan_map_tile_source_pack_pending_free             (gpointer                         data);
+static gboolean   hyscan_map_tile_source_pack_open                     (HyScanMapTileSourcePackPrivate  *priv);
+static void       hyscan_map_tile_source_pack_close                    (HyScanMapTileSourcePackPrivate  *priv);
+static gboolean   hyscan_map_tile_source_pack_remap                    (HyScanMapTileSourcePackPrivate  *priv);
+static gboolean   hyscan_map_tile_source_pack_find                     (HyScanMapTileSourcePackPrivate  *priv,
+                                                                        guint32                          zoom,
+                                                                        guint32                          x,
+                                                                        guint32                          y,
+                                                                        guint32                         *slot_index,
+                                                                        GBytes                         **data);
+static gboolean   hyscan_map_tile_source_pack_put                      (HyScanMapTileSourcePackPrivate  *priv,
+                                                                        guint32                          zoom,
+                                                                        guint32                          x,
+                                                                        guint32                          y,
+                                                                        gconstpointer                    data,
+                                                                        gsize                            size);
+
+G_DEFINE_TYPE_WITH_CODE (HyScanMapTileSourcePack, hyscan_map_tile_source_pack, G_TYPE_OBJECT,
+                         G_ADD_PRIVATE (HyScanMapTileSourcePack)
+                         G_IMPLEMENT_INTERFACE (HYSCAN_TYPE_MAP_TILE_SOURCE, hyscan_map_tile_source_pack_interface_init))
+
+static void
+hyscan_map_tile_source_pack_class_init (HyScanMapTileSourcePackClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = hyscan_map_tile_source_pack_set_property;
+
+  object_class->constructed = hyscan_map_tile_source_pack_object_constructed;
+  object_class->finalize = hyscan_map_tile_source_pack_object_finalize;
+
+  g_object_class_install_property (object_class, PROP_FALLBACK_SOURCE,
+    g_param_spec_object ("fallback-source", "Fallback tile source", "HyScanMapTileSource",
+                         HYSCAN_TYPE_MAP_TILE_SOURCE,
+                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+  g_object_class_install_property (object_class, PROP_PATH,
+    g_param_spec_string ("path", "Pack path", "Path to the tile container file", NULL,
+                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+}
+
+static void
+hyscan_map_tile_source_pack_init (HyScanMapTileSourcePack *pack)
+{
+  pack->priv = hyscan_map_tile_source_pack_get_instance_private (pack);
+}
+
+static void
+hyscan_map_tile_source_pack_set_property (GObject      *object,
+                                          guint         prop_id,
+                                          const GValue *value,
+                                          GParamSpec   *pspec)
+{
+  HyScanMapTileSourcePack *pack = HYSCAN_MAP_TILE_SOURCE_PACK (object);
+  HyScanMapTileSourcePackPrivate *priv = pack->priv;
+
+  switch (prop_id)
+    {
+    case PROP_PATH:
+      priv->path = g_value_dup_string (value);
+      break;
+
+    case PROP_FALLBACK_SOURCE:
+      priv->fallback_source = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+hyscan_map_tile_source_pack_object_constructed (GObject *object)
+{
+  HyScanMapTileSourcePack *pack = HYSCAN_MAP_TILE_SOURCE_PACK (object);
+  HyScanMapTileSourcePackPrivate *priv = pack->priv;
+  gchar *hash_str;
+  guint hash_fb;
+
+  G_OBJECT_CLASS (hyscan_map_tile_source_pack_parent_class)->constructed (object);
+
+  g_rw_lock_init (&priv->lock);
+  priv->pending = g_hash_table_new_full (NULL, NULL, NULL, hyscan_map_tile_source_pack_pending_free);
+
+  hash_fb = priv->fallback_source != NULL ? hyscan_map_tile_source_hash (priv->fallback_source) : 0;
+  hash_str = g_strdup_printf ("pack:%u:%s", hash_fb, priv->path);
+  priv->hash = g_str_hash (hash_str);
+  g_free (hash_str);
+
+  if (priv->path != NULL && !hyscan_map_tile_source_pack_open (priv))
+    hyscan_map_tile_source_pack_close (priv);
+}
+
+static void
+hyscan_map_tile_source_pack_object_finalize (GObject *object)
+{
+  HyScanMapTileSourcePack *pack = HYSCAN_MAP_TILE_SOURCE_PACK (object);
+  HyScanMapTileSourcePackPrivate *priv = pack->priv;
+
+  hyscan_map_tile_source_pack_close (priv);
+  g_hash_table_destroy (priv->pending);
+  g_rw_lock_clear (&priv->lock);
+
+  g_clear_object (&priv->fallback_source);
+  g_free (priv->path);
+
+  G_OBJECT_CLASS (hyscan_map_tile_source_pack_parent_class)->finalize (object);
+}
+
+static void
+hyscan_map_tile_source_pack_pending_free (gpointer data)
+{
+  HyScanMapTileSourcePackPending *pending = data;
+
+  g_bytes_unref (pending->data);
+  g_slice_free (HyScanMapTileSourcePackPending, pending);
+}
+
+/* Хэш координат тайла. */
+static inline guint32
+hyscan_map_tile_source_pack_slot_hash (guint32 zoom,
+                                       guint32 x,
+                                       guint32 y)
+{
+  guint32 hash;
+
+  hash = x * 0x9e3779b1u ^ y * 0x85ebca77u ^ zoom * 0xc2b2ae3du;
+  hash ^= hash >> 16;
+  hash *= 0x7feb352du;
+  hash ^= hash >> 15;
+
+  return hash;
+}
+
+/* Записывает данные в файл по указанному смещению. */
+static gboolean
+hyscan_map_tile_source_pack_pwrite (GFileIOStream *stream,
+                                    guint64        offset,
+                                    gconstpointer  data,
+                                    gsize          size)
+{
+  GOutputStream *output = g_io_stream_get_output_stream (G_IO_STREAM (stream));
+
+  return g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL, NULL) &&
+         g_output_stream_write_all (output, data, size, NULL, NULL, NULL);
+}
+
+/* Считывает данные из файла по указанному смещению. */
+static gboolean
+hyscan_map_tile_source_pack_pread (GFileIOStream *stream,
+                                   guint64        offset,
+                                   gpointer       data,
+                                   gsize          size)
+{
+  GInputStream *input = g_io_stream_get_input_stream (G_IO_STREAM (stream));
+  gsize bytes_read;
+
+  return g_seekable_seek (G_SEEKABLE (stream), offset, G_SEEK_SET, NULL, NULL) &&
+         g_input_stream_read_all (input, data, size, &bytes_read, NULL, NULL) &&
+         bytes_read == size;
+}
+
+/* Записывает заголовок в файл. */
+static gboolean
+hyscan_map_tile_source_pack_write_header (GFileIOStream                       *stream,
+                                          const HyScanMapTileSourcePackHeader *header)
+{
+  HyScanMapTileSourcePackHeader le_header = { { 0 } };
+
+  memcpy (le_header.magic, PACK_MAGIC, sizeof (le_header.magic));
+  le_header.version = GUINT32_TO_LE (header->version);
+  le_header.index_capacity = GUINT32_TO_LE (header->index_capacity);
+  le_header.index_offset = GUINT64_TO_LE (header->index_offset);
+  le_header.data_end = GUINT64_TO_LE (header->data_end);
+  le_header.n_tiles = GUINT32_TO_LE (header->n_tiles);
+
+  return hyscan_map_tile_source_pack_pwrite (stream, 0, &le_header, sizeof (le_header));
+}
+
+/* Добавляет ячейку в индекс, находящийся в памяти. */
+static void
+hyscan_map_tile_source_pack_index_insert (HyScanMapTileSourcePackSlot       *index,
+                                          guint32                            capacity,
+                                          const HyScanMapTileSourcePackSlot *slot)
+{
+  guint32 mask = capacity - 1;
+  guint32 i;
+
+  i = hyscan_map_tile_source_pack_slot_hash (GUINT32_FROM_LE (slot->zoom),
+                                             GUINT32_FROM_LE (slot->x),
+                                             GUINT32_FROM_LE (slot->y));
+
+  for (i &= mask; index[i].offset != 0; i = (i + 1) & mask)
+    ;
+
+  index[i] = *slot;
+}
+
+/* Открывает файл-контейнер или создаёт новый, если файла нет. */
+static gboolean
+hyscan_map_tile_source_pack_open (HyScanMapTileSourcePackPrivate *priv)
+{
+  HyScanMapTileSourcePackHeader *header = &priv->header;
+  GError *error = NULL;
+  GFile *file;
+
+  file = g_file_new_for_path (priv->path);
+  priv->stream = g_file_open_readwrite (file, NULL, &error);
+
+  /* Создаём новый файл с пустым индексом. */
+  if (priv->stream == NULL && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    {
+      HyScanMapTileSourcePackSlot *index;
+      gboolean status;
+
+      g_clear_error (&error);
+      priv->stream = g_file_create_readwrite (file, G_FILE_CREATE_NONE, NULL, &error);
+      if (priv->stream != NULL)
+        {
+          header->version = PACK_VERSION;
+          header->index_capacity = INDEX_CAPACITY_MIN;
+          header->index_offset = sizeof (HyScanMapTileSourcePackHeader);
+          header->data_end = header->index_offset + header->index_capacity * sizeof (HyScanMapTileSourcePackSlot);
+          header->n_tiles = 0;
+
+          index = g_new0 (HyScanMapTileSourcePackSlot, header->index_capacity);
+          status = hyscan_map_tile_source_pack_write_header (priv->stream, header) &&
+                   hyscan_map_tile_source_pack_pwrite (priv->stream, header->index_offset, index,
+                                                       header->index_capacity * sizeof (HyScanMapTileSourcePackSlot));
+          g_free (index);
+
+          if (!status)
+            g_warning ("HyScanMapTileSourcePack: failed to create %s", priv->path);
+
+          g_object_unref (file);
+
+          return status && hyscan_map_tile_source_pack_remap (priv);
+        }
+    }
+
+  g_object_unref (file);
+
+  if (priv->stream == NULL)
+    {
+      g_warning ("HyScanMapTileSourcePack: %s", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  /* Считываем заголовок существующего файла. */
+  if (!hyscan_map_tile_source_pack_pread (priv->stream, 0, header, sizeof (*header)) ||
+      memcmp (header->magic, PACK_MAGIC, sizeof (header->magic)) != 0 ||
+      GUINT32_FROM_LE (header->version) != PACK_VERSION)
+    {
+      g_warning ("HyScanMapTileSourcePack: %s is not a tile pack", priv->path);
+      return FALSE;
+    }
+
+  header->version = GUINT32_FROM_LE (header->version);
+  header->index_capacity = GUINT32_FROM_LE (header->index_capacity);
+  header->index_offset = GUINT64_FROM_LE (header->index_offset);
+  header->data_end = GUINT64_FROM_LE (header->data_end);
+  header->n_tiles = GUINT32_FROM_LE (header->n_tiles);
+
+  return hyscan_map_tile_source_pack_remap (priv);
+}
+
+/* Закрывает файл-контейнер. */
+static void
+hyscan_map_tile_source_pack_close (HyScanMapTileSourcePackPrivate *priv)
+{
+  g_hash_table_remove_all (priv->pending);
+  g_clear_pointer (&priv->map, g_bytes_unref);
+  priv->index = NULL;
+  priv->index_capacity = 0;
+
+  if (priv->stream != NULL)
+    g_io_stream_close (G_IO_STREAM (priv->stream), NULL, NULL);
+  g_clear_object (&priv->stream);
+}
+
+/* Заново отображает файл в память. После этого все добавленные тайлы
+ * доступны через отображение и список pending очищается. */
+static gboolean
+hyscan_map_tile_source_pack_remap (HyScanMapTileSourcePackPrivate *priv)
+{
+  GMappedFile *mapped;
+  GError *error = NULL;
+  gsize index_size;
+
+  g_output_stream_flush (g_io_stream_get_output_stream (G_IO_STREAM (priv->stream)), NULL, NULL);
+
+  mapped = g_mapped_file_new (priv->path, FALSE, &error);
+  if (mapped == NULL)
+    {
+      g_warning ("HyScanMapTileSourcePack: %s", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  g_clear_pointer (&priv->map, g_bytes_unref);
+  priv->map = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+  g_hash_table_remove_all (priv->pending);
+
+  index_size = priv->header.index_capacity * sizeof (HyScanMapTileSourcePackSlot);
+  if (priv->header.index_capacity == 0 ||
+      (priv->header.index_capacity & (priv->header.index_capacity - 1)) != 0 ||
+      priv->header.index_offset % 8 != 0 ||
+      priv->header.index_offset + index_size > g_bytes_get_size (priv->map) ||
+      priv->header.n_tiles > priv->header.index_capacity / 2)
+    {
+      g_warning ("HyScanMapTileSourcePack: %s has broken index", priv->path);
+      priv->index = NULL;
+      priv->index_capacity = 0;
+      return FALSE;
+    }
+
+  priv->index = (const HyScanMapTileSourcePackSlot *) ((const guint8 *) g_bytes_get_data (priv->map, NULL) +
+                                                       priv->header.index_offset);
+  priv->index_capacity = priv->header.index_capacity;
+
+  return TRUE;
+}
+
+/* Ищет тайл в индексе. Если тайл найден, возвращает его изображение в @data.
+ * Если не найден, возвращает в @slot_index номер свободной ячейки для него или
+ * SLOT_NONE, если свободных ячеек в индексе нет. Вызывается под блокировкой. */
+static gboolean
+hyscan_map_tile_source_pack_find (HyScanMapTileSourcePackPrivate  *priv,
+                                  guint32                          zoom,
+                                  guint32                          x,
+                                  guint32                          y,
+                                  guint32                         *slot_index,
+                                  GBytes                         **data)
+{
+  guint32 mask, i, n;
+
+  if (slot_index != NULL)
+    *slot_index = SLOT_NONE;
+
+  if (priv->index == NULL)
+    return FALSE;
+
+  mask = priv->index_capacity - 1;
+  i = hyscan_map_tile_source_pack_slot_hash (zoom, x, y) & mask;
+
+  /* Просматриваем не больше ячеек, чем есть в индексе: в повреждённом
+   * файле индекс может оказаться заполненным полностью. */
+  for (n = 0; n < priv->index_capacity; n++, i = (i + 1) & mask)
+    {
+      const HyScanMapTileSourcePackSlot *slot = &priv->index[i];
+      HyScanMapTileSourcePackPending *pending;
+      guint64 offset;
+      guint32 size;
+
+      offset = GUINT64_FROM_LE (slot->offset);
+      size = GUINT32_FROM_LE (slot->size);
+
+      if (offset != 0)
+        {
+          if (GUINT32_FROM_LE (slot->zoom) != zoom ||
+              GUINT32_FROM_LE (slot->x) != x ||
+              GUINT32_FROM_LE (slot->y) != y)
+            {
+              continue;
+            }
+
+          if (offset + size <= g_bytes_get_size (priv->map))
+            {
+              if (data != NULL)
+                *data = g_bytes_new_from_bytes (priv->map, offset, size);
+
+              return TRUE;
+            }
+        }
+
+      /* Ячейки, заполненные после отображения файла, ищем среди добавленных тайлов. */
+      pending = g_hash_table_lookup (priv->pending, GUINT_TO_POINTER (i));
+      if (pending != NULL)
+        {
+          if (pending->zoom != zoom || pending->x != x || pending->y != y)
+            continue;
+
+          if (data != NULL)
+            *data = g_bytes_ref (pending->data);
+
+          return TRUE;
+        }
+
+      if (offset == 0)
+        {
+          if (slot_index != NULL)
+            *slot_index = i;
+
+          return FALSE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* Записывает индекс вдвое большего размера в конец файла. Вызывается под блокировкой. */
+static gboolean
+hyscan_map_tile_source_pack_grow (HyScanMapTileSourcePackPrivate *priv)
+{
+  HyScanMapTileSourcePackHeader header = priv->header;
+  HyScanMapTileSourcePackSlot *old_index, *new_index;
+  gboolean status;
+  guint32 i;
+
+  /* Старый индекс считываем из файла, т.к. в отображении может не быть последних тайлов. */
+  old_index = g_new (HyScanMapTileSourcePackSlot, header.index_capacity);
+  if (!hyscan_map_tile_source_pack_pread (priv->stream, header.index_offset, old_index,
+                                          header.index_capacity * sizeof (HyScanMapTileSourcePackSlot)))
+    {
+      g_free (old_index);
+      return FALSE;
+    }
+
+  new_index = g_new0 (HyScanMapTileSourcePackSlot, 2 * header.index_capacity);
+  for (i = 0; i < header.index_capacity; i++)
+    {
+      if (old_index[i].offset != 0)
+        hyscan_map_tile_source_pack_index_insert (new_index, 2 * header.index_capacity, &old_index[i]);
+    }
+
+  header.index_offset = PACK_ALIGN (header.data_end);
+  header.index_capacity *= 2;
+  header.data_end = header.index_offset + header.index_capacity * sizeof (HyScanMapTileSourcePackSlot);
+
+  status = hyscan_map_tile_source_pack_pwrite (priv->stream, header.index_offset, new_index,
+                                               header.index_capacity * sizeof (HyScanMapTileSourcePackSlot)) &&
+           hyscan_map_tile_source_pack_write_header (priv->stream, &header);
+
+  g_free (old_index);
+  g_free (new_index);
+
+  if (!status)
+    return FALSE;
+
+  priv->header = header;
+
+  return hyscan_map_tile_source_pack_remap (priv);
+}
+
+/* Добавляет изображение тайла в конец файла. Вызывается под блокировкой на запись. */
+static gboolean
+hyscan_map_tile_source_pack_put (HyScanMapTileSourcePackPrivate *priv,
+                                 guint32                         zoom,
+                                 guint32                         x,
+                                 guint32                         y,
+                                 gconstpointer                   data,
+                                 gsize                           size)
+{
+  HyScanMapTileSourcePackHeader *header = &priv->header;
+  HyScanMapTileSourcePackRecord record;
+  HyScanMapTileSourcePackSlot slot;
+  HyScanMapTileSourcePackPending *pending;
+  guint32 slot_index;
+  guint64 offset;
+
+  if (priv->stream == NULL || priv->index == NULL || size > G_MAXUINT32)
+    return FALSE;
+
+  /* Тайл уже есть в файле. */
+  if (hyscan_map_tile_source_pack_find (priv, zoom, x, y, &slot_index, NULL))
+    return TRUE;
+
+  /* Индекс заполняется не более чем наполовину. Если число тайлов в заголовке
+   * не соответствует индексу и свободной ячейки нет, индекс также увеличивается. */
+  if (2 * (header->n_tiles + 1) > header->index_capacity || slot_index == SLOT_NONE)
+    {
+      if (header->index_capacity > G_MAXUINT32 / 2 || !hyscan_map_tile_source_pack_grow (priv))
+        return FALSE;
+
+      hyscan_map_tile_source_pack_find (priv, zoom, x, y, &slot_index, NULL);
+      if (slot_index == SLOT_NONE)
+        {
+          g_warning ("HyScanMapTileSourcePack: %s has no free index slots", priv->path);
+          return FALSE;
+        }
+    }
+
+  /* Сначала записываем данные, затем ячейку индекса и заголовок. */
+  offset = header->data_end;
+  record.zoom = GUINT32_TO_LE (zoom);
+  record.x = GUINT32_TO_LE (x);
+  record.y = GUINT32_TO_LE (y);
+  record.size = GUINT32_TO_LE (size);
+
+  slot.offset = GUINT64_TO_LE (offset + sizeof (record));
+  slot.size = record.size;
+  slot.zoom = record.zoom;
+  slot.x = record.x;
+  slot.y = record.y;
+
+  if (!hyscan_map_tile_source_pack_pwrite (priv->stream, offset, &record, sizeof (record)) ||
+      !hyscan_map_tile_source_pack_pwrite (priv->stream, offset + sizeof (record), data, size) ||
+      !hyscan_map_tile_source_pack_pwrite (priv->stream,
+                                           header->index_offset + slot_index * sizeof (HyScanMapTileSourcePackSlot),
+                                           &slot, sizeof (slot)))
+    {
+      g_warning ("HyScanMapTileSourcePack: failed to write tile %u/%u/%u", zoom, x, y);
+      return FALSE;
+    }
+
+  header->data_end = offset + sizeof (record) + size;
+  header->n_tiles++;
+  hyscan_map_tile_source_pack_write_header (priv->stream, header);
+
+  pending = g_slice_new (HyScanMapTileSourcePackPending);
+  pending->zoom = zoom;
+  pending->x = x;
+  pending->y = y;
+  pending->data = g_bytes_new (data, size);
+  g_hash_table_insert (priv->pending, GUINT_TO_POINTER (slot_index), pending);
+
+  if (g_hash_table_size (priv->pending) >= PENDING_MAX)
+    hyscan_map_tile_source_pack_remap (priv);
+
+  return TRUE;
+}
+
+/* Функция записи PNG-изображения в массив для cairo_surface_write_to_png_stream(). */
+static cairo_status_t
+hyscan_map_tile_source_pack_png_write (void                *closure,
+                                       const unsigned char *data,
+                                       unsigned int         length)
+{
+  g_byte_array_append (closure, data, length);
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Ищет указанный тайл и загружает его изображение.
+   Реализация #HyScanMapTileSourceInterface.fill_tile. */
+static gboolean
+hyscan_map_tile_source_pack_fill_tile (HyScanMapTileSource *source,
+                                       HyScanMapTile       *tile,
+                                       GCancellable        *cancellable)
+{
+  HyScanMapTileSourcePack *pack = HYSCAN_MAP_TILE_SOURCE_PACK (source);
+  HyScanMapTileSourcePackPrivate *priv = pack->priv;
+  guint32 zoom, x, y;
+  GBytes *data = NULL;
+  gboolean success = FALSE;
+
+  if (g_cancellable_is_cancelled (cancellable))
+    return FALSE;
+
+  zoom = hyscan_map_tile_get_zoom (tile);
+  x = hyscan_map_tile_get_x (tile);
+  y = hyscan_map_tile_get_y (tile);
+
+  /* Пробуем загрузить из контейнера. */
+  g_rw_lock_reader_lock (&priv->lock);
+  hyscan_map_tile_source_pack_find (priv, zoom, x, y, NULL, &data);
+  g_rw_lock_reader_unlock (&priv->lock);
+
+  if (data != NULL)
+    {
+      success = hyscan_map_tile_set_image (tile, data);
+      g_bytes_unref (data);
+    }
+
+  /* Если тайла нет, то загружаем его из запасного источника и дописываем в контейнер. */
+  if (!success && priv->fallback_source != NULL && g_atomic_int_get (&priv->fallback_enabled))
+    {
+      success = hyscan_map_tile_source_fill (priv->fallback_source, tile, cancellable);
+      if (success)
+        {
+          cairo_surface_t *surface;
+          GByteArray *png;
+
+          png = g_byte_array_new ();
+          surface = hyscan_map_tile_get_surface (tile);
+          if (surface != NULL &&
+              cairo_surface_write_to_png_stream (surface, hyscan_map_tile_source_pack_png_write, png) == CAIRO_STATUS_SUCCESS)
+            {
+              g_rw_lock_writer_lock (&priv->lock);
+              hyscan_map_tile_source_pack_put (priv, zoom, x, y, png->data, png->len);
+              g_rw_lock_writer_unlock (&priv->lock);
+            }
+
+          g_clear_pointer (&surface, cairo_surface_destroy);
+          g_byte_array_unref (png);
+        }
+    }
+
+  return success;
+}
+
+/* Реализация #HyScanMapTileSourceInterface.get_grid. */
+static HyScanMapTileGrid *
+hyscan_map_tile_source_pack_get_grid (HyScanMapTileSource *source)
+{
+  HyScanMapTileSourcePackPrivate *priv = HYSCAN_MAP_TILE_SOURCE_PACK (source)->priv;
+
+  g_return_val_if_fail (priv->fallback_source != NULL, NULL);
+
+  return hyscan_map_tile_source_get_grid (priv->fallback_source);
+}
+
+/* Реализация #HyScanMapTileSourceInterface.get_projection. */
+static HyScanGeoProjection *
+hyscan_map_tile_source_pack_get_projection (HyScanMapTileSource *source)
+{
+  HyScanMapTileSourcePackPrivate *priv = HYSCAN_MAP_TILE_SOURCE_PACK (source)->priv;
+
+  g_return_val_if_fail (priv->fallback_source != NULL, NULL);
+
+  return hyscan_map_tile_source_get_projection (priv->fallback_source);
+}
+
+static guint
+hyscan_map_tile_source_pack_hash (HyScanMapTileSource *source)
+{
+  HyScanMapTileSourcePackPrivate *priv = HYSCAN_MAP_TILE_SOURCE_PACK (source)->priv;
+
+  return priv->hash;
+}
+
+static void
+hyscan_map_tile_source_pack_interface_init (HyScanMapTileSourceInterface *iface)
+{
+  iface->fill_tile = hyscan_map_tile_source_pack_fill_tile;
+  iface->get_grid = hyscan_map_tile_source_pack_get_grid;
+  iface->get_projection = hyscan_map_tile_source_pack_get_projection;
+  iface->hash = hyscan_map_tile_source_pack_hash;
+}
+
+/* Сравнивает ячейки индекса для сортировки тайлов при уплотнении файла. */
+static gint
+hyscan_map_tile_source_pack_slot_compare (gconstpointer a,
+                                          gconstpointer b)
+{
+  const HyScanMapTileSourcePackSlot *slot_a = a;
+  const HyScanMapTileSourcePackSlot *slot_b = b;
+
+  if (slot_a->zoom != slot_b->zoom)
+    return slot_a->zoom < slot_b->zoom ? -1 : 1;
+
+  if (slot_a->y != slot_b->y)
+    return slot_a->y < slot_b->y ? -1 : 1;
+
+  if (slot_a->x != slot_b->x)
+    return slot_a->x < slot_b->x ? -1 : 1;
+
+  return 0;
+}
+
+/* Записывает уплотнённую копию контейнера в файл path. Вызывается под блокировкой
+ * на запись после того, как все тайлы доступны через отображение файла. */
+static gboolean
+hyscan_map_tile_source_pack_write_compact (HyScanMapTileSourcePackPrivate *priv,
+                                           const gchar                    *path)
+{
+  HyScanMapTileSourcePackHeader header = { { 0 } };
+  HyScanMapTileSourcePackSlot *index;
+  GFileIOStream *stream;
+  GArray *slots;
+  GFile *file;
+  const guint8 *map_data;
+  guint64 map_size;
+  guint64 offset;
+  gboolean status = TRUE;
+  guint32 i;
+
+  file = g_file_new_for_path (path);
+  g_file_delete (file, NULL, NULL);
+  stream = g_file_create_readwrite (file, G_FILE_CREATE_NONE, NULL, NULL);
+  g_object_unref (file);
+  if (stream == NULL)
+    return FALSE;
+
+  /* Тайлы в новом файле упорядочены по масштабу и строкам, чтобы соседние тайлы
+   * находились рядом. Ячейки храним в порядке байтов хоста. */
+  slots = g_array_sized_new (FALSE, FALSE, sizeof (HyScanMapTileSourcePackSlot), priv->header.n_tiles);
+  map_size = g_bytes_get_size (priv->map);
+  for (i = 0; i < priv->index_capacity; i++)
+    {
+      HyScanMapTileSourcePackSlot slot;
+
+      if (priv->index[i].offset == 0)
+        continue;
+
+      slot.offset = GUINT64_FROM_LE (priv->index[i].offset);
+      slot.size = GUINT32_FROM_LE (priv->index[i].size);
+
+      /* Тайлы за пределами файла, как и в hyscan_map_tile_source_pack_find(),
+       * считаются отсутствующими. */
+      if (slot.offset > map_size || slot.size > map_size - slot.offset)
+        continue;
+
+      slot.zoom = GUINT32_FROM_LE (priv->index[i].zoom);
+      slot.x = GUINT32_FROM_LE (priv->index[i].x);
+      slot.y = GUINT32_FROM_LE (priv->index[i].y);
+      g_array_append_val (slots, slot);
+    }
+  g_array_sort (slots, hyscan_map_tile_source_pack_slot_compare);
+
+  header.version = PACK_VERSION;
+  header.index_capacity = INDEX_CAPACITY_MIN;
+  while (header.index_capacity < 2 * slots->len)
+    header.index_capacity *= 2;
+  header.index_offset = sizeof (HyScanMapTileSourcePackHeader);
+  header.n_tiles = slots->len;
+
+  /* Копируем данные тайлов и строим новый индекс. */
+  index = g_new0 (HyScanMapTileSourcePackSlot, header.index_capacity);
+  map_data = g_bytes_get_data (priv->map, NULL);
+  offset = header.index_offset + header.index_capacity * sizeof (HyScanMapTileSourcePackSlot);
+  for (i = 0; status && i < slots->len; i++)
+    {
+      HyScanMapTileSourcePackSlot *slot = &g_array_index (slots, HyScanMapTileSourcePackSlot, i);
+      HyScanMapTileSourcePackSlot le_slot;
+      HyScanMapTileSourcePackRecord record;
+
+      record.zoom = GUINT32_TO_LE (slot->zoom);
+      record.x = GUINT32_TO_LE (slot->x);
+      record.y = GUINT32_TO_LE (slot->y);
+      record.size = GUINT32_TO_LE (slot->size);
+
+      status = hyscan_map_tile_source_pack_pwrite (stream, offset, &record, sizeof (record)) &&
+               hyscan_map_tile_source_pack_pwrite (stream, offset + sizeof (record),
+                                                   map_data + slot->offset, slot->size);
+
+      le_slot.offset = GUINT64_TO_LE (offset + sizeof (record));
+      le_slot.size = record.size;
+      le_slot.zoom = record.zoom;
+      le_slot.x = record.x;
+      le_slot.y = record.y;
+      hyscan_map_tile_source_pack_index_insert (index, header.index_capacity, &le_slot);
+
+      offset += sizeof (record) + slot->size;
+    }
+  header.data_end = offset;
+
+  status = status &&
+           hyscan_map_tile_source_pack_pwrite (stream, header.index_offset, index,
+                                               header.index_capacity * sizeof (HyScanMapTileSourcePackSlot)) &&
+           hyscan_map_tile_source_pack_write_header (stream, &header);
+
+  status = g_io_stream_close (G_IO_STREAM (stream), NULL, NULL) && status;
+
+  g_object_unref (stream);
+  g_array_unref (slots);
+  g_free (index);
+
+  return status;
+}
+
+/**
+ * hyscan_map_tile_source_pack_new:
+ * @path: путь к файлу-контейнеру
+ * @fb_source: запасной источник тайлов #HyScanMapTileSource
+ *
+ * Создаёт новый источник тайлов, хранящий тайлы в файле @path. Если файл не
+ * существует, то он будет создан. Если тайла не окажется в контейнере, то он
+ * будет загружен из источника @fb_source и дописан в контейнер.
+ *
+ * Returns: новый объект #HyScanMapTileSourcePack. Для удаления g_object_unref()
+ */
+HyScanMapTileSourcePack *
+hyscan_map_tile_source_pack_new (const gchar         *path,
+                                 HyScanMapTileSource *fb_source)
+{
+  HyScanMapTileSourcePack *pack;
+
+  pack = g_object_new (HYSCAN_TYPE_MAP_TILE_SOURCE_PACK,
+                       "path", path,
+                       "fallback-source", fb_source,
+                       NULL);
+
+  hyscan_map_tile_source_pack_fb_enable (pack, TRUE);
+
+  return pack;
+}
+
+/**
+ * hyscan_map_tile_source_pack_fb_enable:
+ * @pack: указатель на #HyScanMapTileSourcePack
+ * @enable: признак того, можно ли использовать fallback-источник
+ *
+ * Определяет возможность использования запасного источника "fallback-source",
+ * указанного при создании объекта. Если @enable = %FALSE, то при отсутствии
+ * тайла в контейнере источник вернёт %FALSE.
+ */
+void
+hyscan_map_tile_source_pack_fb_enable (HyScanMapTileSourcePack *pack,
+                                       gboolean                 enable)
+{
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_SOURCE_PACK (pack));
+
+  g_atomic_int_set (&pack->priv->fallback_enabled, enable);
+}
+
+/**
+ * hyscan_map_tile_source_pack_lookup:
+ * @pack: указатель на #HyScanMapTileSourcePack
+ * @tile: тайл
+ * @size: (out) (optional): размер изображения тайла в байтах
+ *
+ * Проверяет наличие тайла @tile в контейнере без загрузки его изображения.
+ *
+ * Returns: %TRUE, если тайл есть в контейнере.
+ */
+gboolean
+hyscan_map_tile_source_pack_lookup (HyScanMapTileSourcePack *pack,
+                                    HyScanMapTile           *tile,
+                                    goffset                 *size)
+{
+  HyScanMapTileSourcePackPrivate *priv;
+  GBytes *data = NULL;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_SOURCE_PACK (pack), FALSE);
+  priv = pack->priv;
+
+  g_rw_lock_reader_lock (&priv->lock);
+  hyscan_map_tile_source_pack_find (priv,
+                                    hyscan_map_tile_get_zoom (tile),
+                                    hyscan_map_tile_get_x (tile),
+                                    hyscan_map_tile_get_y (tile),
+                                    NULL, &data);
+  g_rw_lock_reader_unlock (&priv->lock);
+
+  if (size != NULL)
+    *size = data != NULL ? (goffset) g_bytes_get_size (data) : 0;
+
+  if (data == NULL)
+    return FALSE;
+
+  g_bytes_unref (data);
+
+  return TRUE;
+}
+
+/* Разбирает неотрицательное число в начале строки. */
+static gboolean
+hyscan_map_tile_source_pack_parse_number (const gchar  *str,
+                                          guint32      *value,
+                                          const gchar **end)
+{
+  gchar *number_end;
+  guint64 number;
+
+  if (!g_ascii_isdigit (*str))
+    return FALSE;
+
+  number = g_ascii_strtoull (str, &number_end, 10);
+  if (number > G_MAXUINT32)
+    return FALSE;
+
+  *value = number;
+  *end = number_end;
+
+  return TRUE;
+}
+
+/**
+ * hyscan_map_tile_source_pack_import:
+ * @pack: указатель на #HyScanMapTileSourcePack
+ * @dir: каталог с тайлами
+ *
+ * Добавляет в контейнер тайлы из каталога @dir, имеющего структуру кэша
+ * #HyScanMapTileSourceFile: @dir/zoom/x/y.png. Изображения копируются без
+ * перекодирования, тайлы, которые уже есть в контейнере, пропускаются.
+ *
+ * Returns: число добавленных тайлов.
+ */
+guint
+hyscan_map_tile_source_pack_import (HyScanMapTileSourcePack *pack,
+                                    const gchar             *dir)
+{
+  HyScanMapTileSourcePackPrivate *priv;
+  GDir *zoom_dir;
+  const gchar *zoom_name;
+  guint n_imported = 0;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_SOURCE_PACK (pack), 0);
+  priv = pack->priv;
+
+  zoom_dir = g_dir_open (dir, 0, NULL);
+  if (zoom_dir == NULL)
+    {
+      g_warning ("HyScanMapTileSourcePack: failed to open %s", dir);
+      return 0;
+    }
+
+  while ((zoom_name = g_dir_read_name (zoom_dir)) != NULL)
+    {
+      const gchar *x_name, *end;
+      gchar *zoom_path;
+      GDir *x_dir;
+      guint32 zoom;
+
+      if (!hyscan_map_tile_source_pack_parse_number (zoom_name, &zoom, &end) || *end != '\0')
+        continue;
+
+      zoom_path = g_build_filename (dir, zoom_name, NULL);
+      x_dir = g_dir_open (zoom_path, 0, NULL);
+
+      while (x_dir != NULL && (x_name = g_dir_read_name (x_dir)) != NULL)
+        {
+          const gchar *y_name;
+          gchar *x_path;
+          GDir *y_dir;
+          guint32 x;
+
+          if (!hyscan_map_tile_source_pack_parse_number (x_name, &x, &end) || *end != '\0')
+            continue;
+
+          x_path = g_build_filename (zoom_path, x_name, NULL);
+          y_dir = g_dir_open (x_path, 0, NULL);
+
+          while (y_dir != NULL && (y_name = g_dir_read_name (y_dir)) != NULL)
+            {
+              gchar *tile_path;
+              gchar *contents;
+              gsize length;
+              guint32 y;
+
+              /* Временные файлы HyScanMapTileSourceFile имеют другое расширение и пропускаются. */
+              if (!hyscan_map_tile_source_pack_parse_number (y_name, &y, &end) || g_strcmp0 (end, ".png") != 0)
+                continue;
+
+              tile_path = g_build_filename (x_path, y_name, NULL);
+              if (g_file_get_contents (tile_path, &contents, &length, NULL))
+                {
+                  g_rw_lock_writer_lock (&priv->lock);
+                  if (!hyscan_map_tile_source_pack_find (priv, zoom, x, y, NULL, NULL) &&
+                      hyscan_map_tile_source_pack_put (priv, zoom, x, y, contents, length))
+                    {
+                      n_imported++;
+                    }
+                  g_rw_lock_writer_unlock (&priv->lock);
+
+                  g_free (contents);
+                }
+
+              g_free (tile_path);
+            }
+
+          if (y_dir != NULL)
+            g_dir_close (y_dir);
+
+          g_free (x_path);
+        }
+
+      if (x_dir != NULL)
+        g_dir_close (x_dir);
+
+      g_free (zoom_path);
+    }
+
+  g_dir_close (zoom_dir);
+
+  return n_imported;
+}
+
+/**
+ * hyscan_map_tile_source_pack_compact:
+ * @pack: указатель на #HyScanMapTileSourcePack
+ *
+ * Уплотняет файл-контейнер: переписывает его, удаляя старые индексы и
+ * недописанные данные, и упорядочивает тайлы по масштабу и положению.
+ * На время уплотнения доступ к контейнеру блокируется.
+ *
+ * Returns: %TRUE, если файл успешно уплотнён.
+ */
+gboolean
+hyscan_map_tile_source_pack_compact (HyScanMapTileSourcePack *pack)
+{
+  HyScanMapTileSourcePackPrivate *priv;
+  gchar *compact_path;
+  gboolean status;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_SOURCE_PACK (pack), FALSE);
+  priv = pack->priv;
+
+  g_rw_lock_writer_lock (&priv->lock);
+
+  if (priv->stream == NULL || !hyscan_map_tile_source_pack_remap (priv))
+    {
+      g_rw_lock_writer_unlock (&priv->lock);
+      return FALSE;
+    }
+
+  /* Записываем уплотнённую копию рядом и заменяем ею исходный файл. */
+  compact_path = g_strconcat (priv->path, ".compact", NULL);
+  status = hyscan_map_tile_source_pack_write_compact (priv, compact_path);
+
+  hyscan_map_tile_source_pack_close (priv);
+  if (status && g_rename (compact_path, priv->path) != 0)
+    {
+      g_warning ("HyScanMapTileSourcePack: failed to replace %s", priv->path);
+      status = FALSE;
+    }
+
+  if (!status)
+    g_unlink (compact_path);
+
+  if (!hyscan_map_tile_source_pack_open (priv))
+    {
+      hyscan_map_tile_source_pack_close (priv);
+      status = FALSE;
+    }
+
+  g_rw_lock_writer_unlock (&priv->lock);
+  g_free (compact_path);
+
+  return status;
+}
@@ -0,0 +1,91 @@
+/* hyscan-map-tile-source-pack.h
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+
+#ifndef __HYSCAN_MAP_TILE_SOURCE_PACK_H__
+#define __HYSCAN_MAP_TILE_SOURCE_PACK_H__
+
+#include <hyscan-map-tile-source.h>
+
+G_BEGIN_DECLS
+
+#define HYSCAN_TYPE_MAP_TILE_SOURCE_PACK             (hyscan_map_tile_source_pack_get_type ())
+#define HYSCAN_MAP_TILE_SOURCE_PACK(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), HYSCAN_TYPE_MAP_TILE_SOURCE_PACK, HyScanMapTileSourcePack))
+#define HYSCAN_IS_MAP_TILE_SOURCE_PACK(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HYSCAN_TYPE_MAP_TILE_SOURCE_PACK))
+#define HYSCAN_MAP_TILE_SOURCE_PACK_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), HYSCAN_TYPE_MAP_TILE_SOURCE_PACK, HyScanMapTileSourcePackClass))
+#define HYSCAN_IS_MAP_TILE_SOURCE_PACK_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_MAP_TILE_SOURCE_PACK))
+#define HYSCAN_MAP_TILE_SOURCE_PACK_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_MAP_TILE_SOURCE_PACK, HyScanMapTileSourcePackClass))
+
+typedef struct _HyScanMapTileSourcePack HyScanMapTileSourcePack;
+typedef struct _HyScanMapTileSourcePackPrivate HyScanMapTileSourcePackPrivate;
+typedef struct _HyScanMapTileSourcePackClass HyScanMapTileSourcePackClass;
+
+struct _HyScanMapTileSourcePack
+{
+  GObject parent_instance;
+
+  HyScanMapTileSourcePackPrivate *priv;
+};
+
+struct _HyScanMapTileSourcePackClass
+{
+  GObjectClass parent_class;
+};
+
+HYSCAN_API
+GType                      hyscan_map_tile_source_pack_get_type  (void);
+
+HYSCAN_API
+HyScanMapTileSourcePack *  hyscan_map_tile_source_pack_new       (const gchar              *path,
+                                                                  HyScanMapTileSource      *fb_source);
+
+HYSCAN_API
+void                       hyscan_map_tile_source_pack_fb_enable (HyScanMapTileSourcePack  *pack,
+                                                                  gboolean                  enable);
+
+HYSCAN_API
+gboolean                   hyscan_map_tile_source_pack_lookup    (HyScanMapTileSourcePack  *pack,
+                                                                  HyScanMapTile            *tile,
+                                                                  goffset                  *size);
+
+HYSCAN_API
+guint                      hyscan_map_tile_source_pack_import    (HyScanMapTileSourcePack  *pack,
+                                                                  const gchar              *dir);
+
+HYSCAN_API
+gboolean                   hyscan_map_tile_source_pack_compact   (HyScanMapTileSourcePack  *pack);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_MAP_TILE_SOURCE_PACK_H__ */
@@ -58,6 +58,15 @@
  * Существует возможность передавать в запросе к серверу дополнительные HTTP-заголовоки.
  * Указать заголовки запроса можно при помощи функции hyscan_map_tile_source_add_header().
  *
+ * Источник поддерживает асинхронное заполнение тайлов hyscan_map_tile_source_fill_async(),
+ * при котором запросы и декодирование изображений выполняются в основном цикле
+ * вызывающего потока без создания дополнительных потоков.
+ *
+ * Все запросы источника выполняются через одну HTTP-сессию, поэтому установленные
+ * соединения с сервером переиспользуются (keep-alive). Максимальное число
+ * одновременных соединений с одним сервером задаётся свойством
+ * #HyScanMapTileSourceWeb:max-conns-per-host.
+ *
  */
 
 #include "hyscan-map-tile-source-web.h"
@@ -68,6 +77,7 @@
 
 #define USER_AGENT     "Mozilla/5.0 (X11; Linux x86_64; rv:60.0) " \
                        "Gecko/20100101 Firefox/60.0"                      /* Заголовок "User-agent" для HTTP-запросов. */
+#define IDLE_TIMEOUT   60                                                 /* Время удержания неактивного соединения, с. */
 
 /* Вспомогательный класс HyScanMapTileSourceWebTask - задача по загрузке тайла. */
 #define HYSCAN_TYPE_MAP_TILE_SOURCE_WEB_TASK        (hyscan_map_tile_source_web_task_get_type ())
@@ -94,7 +104,7 @@ typedef struct
   GCancellable             *cancellable;       /* Объект для отмена задачи. */
   GCancellable             *soup_cancellable;  /* Объект для отмены, передаваемый в libsoup. */
   gulong                    handler_id;        /* Хэндлер обработчика сигнала от cancellable. */
-  SoupSession              *soup_session;      /* HTTP-клиент, который загружает изображения тайлов. */
+  SoupSession              *soup_session;      /* HTTP-клиент источника, который загружает изображения тайлов. */
   SoupMessage              *soup_msg;          /* Запрос на сервер. */
 } HyScanMapTileSourceWebTask;
 
@@ -103,6 +113,14 @@ typedef struct
   GObjectClass parent_class;
 } HyScanMapTileSourceWebTaskClass;
 
+/* Данные асинхронной загрузки тайла. */
+typedef struct
+{
+  HyScanMapTile            *tile;              /* Тайл, который надо заполнить. */
+  SoupMessage              *msg;               /* Запрос на сервер. */
+  gchar                    *url;               /* URL тайла. */
+} HyScanMapTileSourceWebAsync;
+
 enum
 {
   PROP_O,
@@ -110,6 +128,7 @@ enum
   PROP_URL_FORMAT,
   PROP_MIN_ZOOM,
   PROP_MAX_ZOOM,
+  PROP_MAX_CONNS_PER_HOST,
 };
 
 typedef enum
@@ -133,6 +152,8 @@ struct _HyScanMapTileSourceWebPrivate
   HyScanMapTileGrid              *grid;          /* Параметры тайловой сетки. */
   HyScanGeoProjection            *projection;    /* Картографическая проекция источника тайлов. */
 
+  guint                           max_conns;     /* Максимальное число соединений с одним сервером. */
+  SoupSession                    *soup_session;  /* HTTP-клиент, общий для всех задач по загрузке тайлов. */
   GThreadPool                    *thread_pool;   /* Пул потоков, обрабатывающих задачи по загрузке тайлов. */
 };
 
@@ -221,6 +242,10 @@ hyscan_map_tile_source_web_class_init (HyScanMapTileSourceWebClass *klass)
   g_object_class_install_property (object_class, PROP_MAX_ZOOM,
     g_param_spec_uint ("max-zoom", "Max zoom", "Maximum zoom", 0, G_MAXUINT, 19,
                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+  g_object_class_install_property (object_class, PROP_MAX_CONNS_PER_HOST,
+    g_param_spec_uint ("max-conns-per-host", "Max connections per host",
+                       "Maximum number of simultaneous connections to one tile server", 1, 64, 6,
+                        G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
@@ -256,6 +281,10 @@ hyscan_map_tile_source_web_set_property (GObject      *object,
       priv->max_zoom = g_value_get_uint (value);
       break;
 
+    case PROP_MAX_CONNS_PER_HOST:
+      priv->max_conns = g_value_get_uint (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -270,7 +299,8 @@ hyscan_map_tile_source_web_task_do (gpointer data,
   HyScanMapTileSourceWebTask *task = data;
 
   GInputStream *input_stream = NULL;
-  GdkPixbuf *pixbuf = NULL;
+  GOutputStream *output_stream = NULL;
+  GBytes *image = NULL;
 
   GError *error = NULL;
 
@@ -287,16 +317,27 @@ hyscan_map_tile_source_web_task_do (gpointer data,
       goto error;
     }
 
-  /* Из тела ответа формируем изображение pixbuf. */
-  pixbuf = gdk_pixbuf_new_from_stream (input_stream, task->cancellable, &error);
-  if (error != NULL)
+  /* Страница с ошибкой сервера не является изображением тайла. */
+  if (!SOUP_STATUS_IS_SUCCESSFUL (task->soup_msg->status_code))
+    {
+      g_debug ("HyScanMapTileSourceWeb: failed to read \"%s\" (HTTP %u %s)",
+               task->url, task->soup_msg->status_code, task->soup_msg->reason_phrase);
+      task->status = STATUS_FAILED;
+      goto exit;
+    }
+
+  /* Читаем тело ответа в память. */
+  output_stream = g_memory_output_stream_new_resizable ();
+  if (g_output_stream_splice (output_stream, input_stream, G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                              task->cancellable, &error) < 0)
     {
       task->status = STATUS_FAILED;
       goto error;
     }
 
-  /* Устанавливаем загруженную поверхность в тайл. */
-  if (hyscan_map_tile_set_pixbuf (task->tile, pixbuf))
+  /* Декодируем изображение и устанавливаем его в тайл. */
+  image = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
+  if (hyscan_map_tile_set_image (task->tile, image))
     task->status = STATUS_OK;
   else
     task->status = STATUS_FAILED;
@@ -312,7 +353,8 @@ error:
 
 exit:
   g_clear_object (&input_stream);
-  g_clear_object (&pixbuf);
+  g_clear_object (&output_stream);
+  g_clear_pointer (&image, g_bytes_unref);
   g_cond_signal (&task->cond);
   g_mutex_unlock (&task->mutex);
   g_object_unref (task);
@@ -353,6 +395,16 @@ hyscan_map_tile_source_web_object_constructed (GObject *object)
   priv->hash = g_str_hash (hash_str);
   g_free (hash_str);
 
+  /* Одна сессия на все запросы: соединения с сервером и их TLS-сессии переиспользуются. */
+  priv->soup_session = soup_session_new_with_options (SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_SNIFFER,
+                                                      SOUP_SESSION_USER_AGENT, USER_AGENT,
+                                                      SOUP_SESSION_MAX_CONNS_PER_HOST, priv->max_conns,
+                                                      SOUP_SESSION_MAX_CONNS, MAX (priv->max_conns, 10u),
+                                                      SOUP_SESSION_IDLE_TIMEOUT, IDLE_TIMEOUT,
+                                                      /* На windows не базы данных сертификатов, поэтому отключаем их проверку. */
+                                                      SOUP_SESSION_SSL_STRICT, FALSE,
+                                                      NULL);
+
   priv->thread_pool = g_thread_pool_new (hyscan_map_tile_source_web_task_do, nw_source, -1, FALSE, NULL);
 }
 
@@ -365,6 +417,8 @@ hyscan_map_tile_source_web_object_finalize (GObject *object)
   g_free (priv->url_format);
   g_list_free_full (priv->headers, g_free);
   g_thread_pool_free (priv->thread_pool, FALSE, TRUE);
+  soup_session_abort (priv->soup_session);
+  g_clear_object (&priv->soup_session);
   g_clear_object (&priv->grid);
   g_clear_object (&priv->projection);
 
@@ -503,17 +557,13 @@ hyscan_map_tile_source_web_propagate_cancel (GCancellable               *cancell
 
 }
 
-/* Формирует URL тайла и помещает его в буфер url длины max_length. */
-static HyScanMapTileSourceWebTask *
-hyscan_map_tile_source_web_task_new (HyScanMapTileSourceWebPrivate *priv,
-                                     HyScanMapTile                 *tile,
-                                     GCancellable                  *cancellable)
+/* Формирует URL тайла. Для удаления g_free(). */
+static gchar *
+hyscan_map_tile_source_web_get_url (HyScanMapTileSourceWebPrivate *priv,
+                                    HyScanMapTile                 *tile)
 {
   gchar *quad_key;
   guint x, y, z;
-  HyScanMapTileSourceWebTask *task;
-  GList *link;
-
   gchar *url;
 
   switch (priv->url_type)
@@ -537,13 +587,21 @@ hyscan_map_tile_source_web_task_new (HyScanMapTileSourceWebPrivate *priv,
       break;
     }
 
-  if (url == NULL)
+  return url;
+}
+
+/* Формирует HTTP-запрос к серверу тайлов. */
+static SoupMessage *
+hyscan_map_tile_source_web_message_new (HyScanMapTileSourceWebPrivate *priv,
+                                        const gchar                   *url)
+{
+  SoupMessage *msg;
+  GList *link;
+
+  msg = soup_message_new ("GET", url);
+  if (msg == NULL)
     return NULL;
 
-  task = g_object_new (HYSCAN_TYPE_MAP_TILE_SOURCE_WEB_TASK, NULL);
-  task->tile = g_object_ref (tile);
-  task->url = url;
-  task->soup_msg = soup_message_new ("GET", task->url);
   link = priv->headers;
   while (link != NULL)
     {
@@ -552,14 +610,38 @@ hyscan_map_tile_source_web_task_new (HyScanMapTileSourceWebPrivate *priv,
       link = link->next;
       hdr_value = link->data;
       link = link->next;
-      soup_message_headers_append (task->soup_msg->request_headers, hdr_name, hdr_value);
+      soup_message_headers_append (msg->request_headers, hdr_name, hdr_value);
     }
 
-  task->soup_session = soup_session_new_with_options (SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_SNIFFER,
-                                                      SOUP_SESSION_USER_AGENT, USER_AGENT,
-                                                      /* На windows не базы данных сертификатов, поэтому отключаем их проверку. */
-                                                      SOUP_SESSION_SSL_STRICT, FALSE,
-                                                      NULL);
+  return msg;
+}
+
+/* Создаёт задачу по загрузке тайла. */
+static HyScanMapTileSourceWebTask *
+hyscan_map_tile_source_web_task_new (HyScanMapTileSourceWebPrivate *priv,
+                                     HyScanMapTile                 *tile,
+                                     GCancellable                  *cancellable)
+{
+  HyScanMapTileSourceWebTask *task;
+  SoupMessage *msg;
+  gchar *url;
+
+  url = hyscan_map_tile_source_web_get_url (priv, tile);
+  if (url == NULL)
+    return NULL;
+
+  msg = hyscan_map_tile_source_web_message_new (priv, url);
+  if (msg == NULL)
+    {
+      g_free (url);
+      return NULL;
+    }
+
+  task = g_object_new (HYSCAN_TYPE_MAP_TILE_SOURCE_WEB_TASK, NULL);
+  task->tile = g_object_ref (tile);
+  task->url = url;
+  task->soup_msg = msg;
+  task->soup_session = g_object_ref (priv->soup_session);
 
   /* Делаем HTTP-запрос с отдельным GCancellable,
    * потому что soup_session_send() может сделать g_cancellable_reset(). */
@@ -613,6 +695,144 @@ hyscan_map_tile_source_web_fill_tile (HyScanMapTileSource *source,
   return status_ok;
 }
 
+/* Обработчик завершения декодирования изображения тайла. */
+static void
+hyscan_map_tile_source_web_pixbuf_ready (GObject      *object,
+                                         GAsyncResult *result,
+                                         gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  HyScanMapTileSourceWebAsync *async = g_task_get_task_data (task);
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+
+  pixbuf = gdk_pixbuf_new_from_stream_finish (result, &error);
+  if (pixbuf == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("HyScanMapTileSourceWeb: failed to read \"%s\" (%s)", async->url, error->message);
+
+      g_task_return_error (task, error);
+    }
+  else if (!hyscan_map_tile_set_pixbuf (async->tile, pixbuf))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "wrong tile image size");
+    }
+  else
+    {
+      g_task_return_boolean (task, TRUE);
+    }
+
+  g_clear_object (&pixbuf);
+  g_object_unref (task);
+}
+
+/* Обработчик получения ответа сервера. */
+static void
+hyscan_map_tile_source_web_sent (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  HyScanMapTileSourceWebAsync *async = g_task_get_task_data (task);
+  GInputStream *input_stream;
+  GError *error = NULL;
+
+  input_stream = soup_session_send_finish (SOUP_SESSION (object), result, &error);
+  if (input_stream == NULL)
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug ("HyScanMapTileSourceWeb: failed to read \"%s\" (%s)", async->url, error->message);
+
+      g_task_return_error (task, error);
+      g_object_unref (task);
+      return;
+    }
+
+  /* Страница с ошибкой сервера не является изображением тайла. */
+  if (!SOUP_STATUS_IS_SUCCESSFUL (async->msg->status_code))
+    {
+      g_debug ("HyScanMapTileSourceWeb: failed to read \"%s\" (HTTP %u %s)",
+               async->url, async->msg->status_code, async->msg->reason_phrase);
+
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP error %u: %s",
+                               async->msg->status_code, async->msg->reason_phrase);
+      g_object_unref (input_stream);
+      g_object_unref (task);
+      return;
+    }
+
+  /* Из тела ответа формируем изображение pixbuf. */
+  gdk_pixbuf_new_from_stream_async (input_stream, g_task_get_cancellable (task),
+                                    hyscan_map_tile_source_web_pixbuf_ready, task);
+  g_object_unref (input_stream);
+}
+
+/* Освобождает память, занятую структурой HyScanMapTileSourceWebAsync. */
+static void
+hyscan_map_tile_source_web_async_free (HyScanMapTileSourceWebAsync *async)
+{
+  g_object_unref (async->tile);
+  g_object_unref (async->msg);
+  g_free (async->url);
+  g_slice_free (HyScanMapTileSourceWebAsync, async);
+}
+
+/* Реализация функции fill_tile_async интерфейса HyScanMapTileSource.
+ * Запрос выполняется в общей HTTP-сессии, не занимая отдельный поток. */
+static void
+hyscan_map_tile_source_web_fill_tile_async (HyScanMapTileSource *source,
+                                            HyScanMapTile       *tile,
+                                            GCancellable        *cancellable,
+                                            GAsyncReadyCallback  callback,
+                                            gpointer             user_data)
+{
+  HyScanMapTileSourceWeb *nw_source = HYSCAN_MAP_TILE_SOURCE_WEB (source);
+  HyScanMapTileSourceWebPrivate *priv = nw_source->priv;
+  HyScanMapTileSourceWebAsync *async;
+  SoupMessage *msg;
+  GTask *task;
+  gchar *url;
+
+  task = g_task_new (source, cancellable, callback, user_data);
+  g_task_set_source_tag (task, hyscan_map_tile_source_web_fill_tile_async);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  url = hyscan_map_tile_source_web_get_url (priv, tile);
+  msg = (url != NULL) ? hyscan_map_tile_source_web_message_new (priv, url) : NULL;
+  if (msg == NULL)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "invalid tile url");
+      g_object_unref (task);
+      g_free (url);
+      return;
+    }
+
+  async = g_slice_new (HyScanMapTileSourceWebAsync);
+  async->tile = g_object_ref (tile);
+  async->msg = msg;
+  async->url = url;
+  g_task_set_task_data (task, async, (GDestroyNotify) hyscan_map_tile_source_web_async_free);
+
+  soup_session_send_async (priv->soup_session, msg, cancellable, hyscan_map_tile_source_web_sent, task);
+}
+
+/* Реализация функции fill_tile_finish интерфейса HyScanMapTileSource. */
+static gboolean
+hyscan_map_tile_source_web_fill_tile_finish (HyScanMapTileSource  *source,
+                                             GAsyncResult         *result,
+                                             GError              **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, source), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /* Реализация функции get_grid интерфейса HyScanMapTileSource.*/
 static HyScanMapTileGrid *
 hyscan_map_tile_source_web_get_grid (HyScanMapTileSource *source)
@@ -651,6 +871,8 @@ static void
 hyscan_map_tile_source_web_interface_init (HyScanMapTileSourceInterface *iface)
 {
   iface->fill_tile = hyscan_map_tile_source_web_fill_tile;
+  iface->fill_tile_async = hyscan_map_tile_source_web_fill_tile_async;
+  iface->fill_tile_finish = hyscan_map_tile_source_web_fill_tile_finish;
   iface->get_grid = hyscan_map_tile_source_web_get_grid;
   iface->get_projection = hyscan_map_tile_source_web_get_projection;
   iface->hash = hyscan_map_tile_source_web_hash;
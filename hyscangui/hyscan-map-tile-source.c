@@ -57,10 +57,25 @@
  * Если оба параметра у двух источников совпадают, то источники будут изображать на
  * тайле одну и ту же область местности.
  *
+ * Кроме блокирующей функции hyscan_map_tile_source_fill() источник предоставляет
+ * асинхронную пару hyscan_map_tile_source_fill_async() и hyscan_map_tile_source_fill_finish().
+ * Асинхронное заполнение не занимает поток на время ожидания данных, поэтому
+ * позволяет одновременно загружать большое число тайлов. Функция обратного вызова
+ * выполняется в основном контексте #GMainContext потока, из которого было запущено
+ * заполнение, поэтому в этом потоке должен работать цикл #GMainLoop.
+ *
+ * Если источник не реализует асинхронное заполнение, то hyscan_map_tile_source_fill()
+ * выполняется в отдельном потоке.
+ *
  */
 
 #include "hyscan-map-tile-source.h"
 
+static void    hyscan_map_tile_source_fill_thread    (GTask               *task,
+                                                      gpointer             source_object,
+                                                      gpointer             task_data,
+                                                      GCancellable        *cancellable);
+
 G_DEFINE_INTERFACE (HyScanMapTileSource, hyscan_map_tile_source, G_TYPE_OBJECT)
 
 static void
@@ -94,6 +109,88 @@ hyscan_map_tile_source_fill (HyScanMapTileSource *source,
   return FALSE;
 }
 
+/* Заполняет тайл в потоке GTask, если источник не реализует асинхронное заполнение. */
+static void
+hyscan_map_tile_source_fill_thread (GTask        *task,
+                                    gpointer      source_object,
+                                    gpointer      task_data,
+                                    GCancellable *cancellable)
+{
+  HyScanMapTileSource *source = source_object;
+  HyScanMapTile *tile = task_data;
+
+  if (hyscan_map_tile_source_fill (source, tile, cancellable))
+    g_task_return_boolean (task, TRUE);
+  else if (!g_task_return_error_if_cancelled (task))
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "failed to fill tile");
+}
+
+/**
+ * hyscan_map_tile_source_fill_async:
+ * @source: указатель на #HyScanMapTileSource
+ * @tile: тайл
+ * @cancellable: #GCancellable для отмены заполнения тайла
+ * @callback: функция, вызываемая по завершении заполнения
+ * @user_data: пользовательские данные для @callback
+ *
+ * Асинхронно заполняет тайл @tile его изображением. По завершении заполнения
+ * будет вызвана функция @callback, в которой необходимо получить результат
+ * с помощью hyscan_map_tile_source_fill_finish().
+ */
+void
+hyscan_map_tile_source_fill_async (HyScanMapTileSource *source,
+                                   HyScanMapTile       *tile,
+                                   GCancellable        *cancellable,
+                                   GAsyncReadyCallback  callback,
+                                   gpointer             user_data)
+{
+  HyScanMapTileSourceInterface *iface;
+  GTask *task;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE_SOURCE (source));
+
+  iface = HYSCAN_MAP_TILE_SOURCE_GET_IFACE (source);
+  if (iface->fill_tile_async != NULL)
+    {
+      (* iface->fill_tile_async) (source, tile, cancellable, callback, user_data);
+      return;
+    }
+
+  task = g_task_new (source, cancellable, callback, user_data);
+  g_task_set_source_tag (task, hyscan_map_tile_source_fill_async);
+  g_task_set_task_data (task, g_object_ref (tile), g_object_unref);
+  g_task_run_in_thread (task, hyscan_map_tile_source_fill_thread);
+  g_object_unref (task);
+}
+
+/**
+ * hyscan_map_tile_source_fill_finish:
+ * @source: указатель на #HyScanMapTileSource
+ * @result: результат асинхронной операции #GAsyncResult
+ * @error: (nullable): указатель для записи ошибки
+ *
+ * Завершает заполнение тайла, начатое функцией hyscan_map_tile_source_fill_async().
+ *
+ * Returns: %TRUE, если тайл успешно заполнен
+ */
+gboolean
+hyscan_map_tile_source_fill_finish (HyScanMapTileSource  *source,
+                                    GAsyncResult         *result,
+                                    GError              **error)
+{
+  HyScanMapTileSourceInterface *iface;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE_SOURCE (source), FALSE);
+
+  if (g_async_result_is_tagged (result, hyscan_map_tile_source_fill_async))
+    return g_task_propagate_boolean (G_TASK (result), error);
+
+  iface = HYSCAN_MAP_TILE_SOURCE_GET_IFACE (source);
+  g_return_val_if_fail (iface->fill_tile_finish != NULL, FALSE);
+
+  return (* iface->fill_tile_finish) (source, result, error);
+}
+
 /**
  * hyscan_map_tile_source_get_grid:
  * @source: указатель на #HyScanMapTileSource
@@ -35,7 +35,7 @@
 #ifndef __HYSCAN_MAP_TILE_SOURCE_H__
 #define __HYSCAN_MAP_TILE_SOURCE_H__
 
-#include <glib-object.h>
+#include <gio/gio.h>
 #include <cairo.h>
 #include <hyscan-api.h>
 #include <hyscan-map-tile.h>
@@ -53,6 +53,8 @@ typedef struct _HyScanMapTileSourceInterface HyScanMapTileSourceInterface;
 /**
  * HyScanMapTileSourceInterface:
  * @fill_tile: заполняет тайл изображением
+ * @fill_tile_async: асинхронно заполняет тайл изображением
+ * @fill_tile_finish: завершает асинхронное заполнение тайла
  * @get_grid: возвращает тайловую сетку источника
  * @get_projection: возвращает картографическую проекцию источника
  * @hash: возвращает хэш источника
@@ -65,6 +67,16 @@ struct _HyScanMapTileSourceInterface
                                                      HyScanMapTile              *tile,
                                                      GCancellable               *cancellable);
 
+  void                   (*fill_tile_async)         (HyScanMapTileSource        *source,
+                                                     HyScanMapTile              *tile,
+                                                     GCancellable               *cancellable,
+                                                     GAsyncReadyCallback         callback,
+                                                     gpointer                    user_data);
+
+  gboolean               (*fill_tile_finish)        (HyScanMapTileSource        *source,
+                                                     GAsyncResult               *result,
+                                                     GError                    **error);
+
   HyScanMapTileGrid *    (*get_grid)                (HyScanMapTileSource        *source);
 
   HyScanGeoProjection *  (*get_projection)          (HyScanMapTileSource        *source);
@@ -86,6 +98,18 @@ gboolean                hyscan_map_tile_source_fill                      (HyScan
                                                                           HyScanMapTile       *tile,
                                                                           GCancellable        *cancellable);
 
+HYSCAN_API
+void                    hyscan_map_tile_source_fill_async                (HyScanMapTileSource *source,
+                                                                          HyScanMapTile       *tile,
+                                                                          GCancellable        *cancellable,
+                                                                          GAsyncReadyCallback  callback,
+                                                                          gpointer             user_data);
+
+HYSCAN_API
+gboolean                hyscan_map_tile_source_fill_finish               (HyScanMapTileSource *source,
+                                                                          GAsyncResult        *result,
+                                                                          GError             **error);
+
 HYSCAN_API
 guint                   hyscan_map_tile_source_hash                      (HyScanMapTileSource *source);
 
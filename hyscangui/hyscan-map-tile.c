@@ -85,9 +85,21 @@
  * - hyscan_map_tile_set_surface_data(),
  * - hyscan_map_tile_set_pixbuf().
  *
+ * Если изображение тайла доступно в закодированном виде (PNG, JPEG и т.п.), то
+ * лучше использовать функцию hyscan_map_tile_set_image(): PNG-изображения
+ * декодируются сразу в буфер поверхности без промежуточного #GdkPixbuf.
+ * Перевод #GdkPixbuf в формат cairo в hyscan_map_tile_set_pixbuf() выполняется
+ * векторными инструкциями SSE2/AVX2, если процессор их поддерживает.
+ *
  * Для получения изображения используется функция:
  * - hyscan_map_tile_get_surface().
  *
+ * Для поиска тайлов в кэшах предназначен двоичный ключ фиксированного размера
+ * #HyScanMapTileKey, который заполняется функцией hyscan_map_tile_key_init().
+ * Ключ можно использовать в #GHashTable с функциями hyscan_map_tile_key_hash()
+ * и hyscan_map_tile_key_equal(), а для кэшей со строковыми ключами - перевести
+ * в строку фиксированной длины функцией hyscan_map_tile_key_to_string().
+ *
  * Чтобы обойти тайлы, покрывающие некотороую область, можно использовать
  * итератор #HyScanMapTileIter. Для этого доступны функции:
  * - hyscan_map_tile_iter_init(),
@@ -105,6 +117,37 @@
 #include <string.h>
 #include <math.h>
 
+/* SSE2 есть на всех процессорах x86-64, наличие SSSE3 и AVX2 проверяется при выполнении. */
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#define HYSCAN_MAP_TILE_SSE2
+#endif
+#if defined (HYSCAN_MAP_TILE_SSE2) && defined (__GNUC__)
+#include <immintrin.h>
+#define HYSCAN_MAP_TILE_CPU_DETECT
+#define HYSCAN_MAP_TILE_TARGET(isa) __attribute__ ((target (isa)))
+#endif
+
+/* Функция перевода строки изображения GdkPixbuf в формат CAIRO_FORMAT_ARGB32. */
+typedef void (*HyScanMapTileConvertFunc) (guint32       *dst,
+                                          const guint8  *src,
+                                          guint          width);
+
+/* Функции перевода, выбранные для текущего процессора. */
+typedef struct
+{
+  HyScanMapTileConvertFunc     rgba;           /* Перевод изображения с альфа-каналом. */
+  HyScanMapTileConvertFunc     rgb;            /* Перевод изображения без альфа-канала. */
+} HyScanMapTileConverters;
+
+/* Состояние чтения PNG-изображения из памяти. */
+typedef struct
+{
+  const guint8                *data;           /* Данные изображения. */
+  gsize                        size;           /* Размер данных. */
+  gsize                        offset;         /* Текущее смещение. */
+} HyScanMapTileReader;
+
 enum
 {
   PROP_O,
@@ -672,12 +715,278 @@ hyscan_map_tile_set_surface_data (HyScanMapTile *tile,
   cairo_surface_destroy (surface);
 }
 
+/* Умножает компоненту цвета @c на альфа-канал @a, так же как это делают
+ * GDK и cairo. */
+static inline guint32
+hyscan_map_tile_premultiply (guint32 c,
+                             guint32 a)
+{
+  guint32 t = c * a + 0x80;
+
+  return ((t >> 8) + t) >> 8;
+}
+
+/* Переводит строку RGBA-пикселей в ARGB32 с умножением на альфа-канал. */
+static void
+hyscan_map_tile_convert_rgba (guint32      *dst,
+                              const guint8 *src,
+                              guint         width)
+{
+  guint i;
+
+  for (i = 0; i < width; i++, src += 4)
+    {
+      guint32 a = src[3];
+
+      if (a == 0xff)
+        {
+          dst[i] = 0xff000000 | ((guint32) src[0] << 16) | ((guint32) src[1] << 8) | src[2];
+        }
+      else if (a == 0)
+        {
+          dst[i] = 0;
+        }
+      else
+        {
+          dst[i] = (a << 24) |
+                   (hyscan_map_tile_premultiply (src[0], a) << 16) |
+                   (hyscan_map_tile_premultiply (src[1], a) << 8) |
+                   hyscan_map_tile_premultiply (src[2], a);
+        }
+    }
+}
+
+/* Переводит строку RGB-пикселей в ARGB32. */
+static void
+hyscan_map_tile_convert_rgb (guint32      *dst,
+                             const guint8 *src,
+                             guint         width)
+{
+  guint i;
+
+  for (i = 0; i < width; i++, src += 3)
+    dst[i] = 0xff000000 | ((guint32) src[0] << 16) | ((guint32) src[1] << 8) | src[2];
+}
+
+#ifdef HYSCAN_MAP_TILE_SSE2
+/* Умножает на альфа-канал два пикселя, распакованных в 16-битные компоненты,
+ * и переставляет компоненты в порядке BGRA. Альфа-канал умножается на 255,
+ * т.е. не изменяется. */
+static inline __m128i
+hyscan_map_tile_premultiply_sse2 (__m128i px)
+{
+  const __m128i alpha = _mm_set_epi16 (0xff, 0, 0, 0, 0xff, 0, 0, 0);
+  const __m128i round = _mm_set1_epi16 (0x80);
+  __m128i a, t;
+
+  a = _mm_shufflelo_epi16 (px, _MM_SHUFFLE (3, 3, 3, 3));
+  a = _mm_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+  a = _mm_or_si128 (a, alpha);
+
+  t = _mm_add_epi16 (_mm_mullo_epi16 (px, a), round);
+  t = _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+
+  t = _mm_shufflelo_epi16 (t, _MM_SHUFFLE (3, 0, 1, 2));
+  t = _mm_shufflehi_epi16 (t, _MM_SHUFFLE (3, 0, 1, 2));
+
+  return t;
+}
+
+/* Переводит строку RGBA-пикселей в ARGB32 по 4 пикселя за итерацию. */
+static void
+hyscan_map_tile_convert_rgba_sse2 (guint32      *dst,
+                                   const guint8 *src,
+                                   guint         width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  guint i;
+
+  for (i = 0; i + 4 <= width; i += 4)
+    {
+      __m128i px, lo, hi;
+
+      px = _mm_loadu_si128 ((const __m128i *) (src + 4 * i));
+      lo = hyscan_map_tile_premultiply_sse2 (_mm_unpacklo_epi8 (px, zero));
+      hi = hyscan_map_tile_premultiply_sse2 (_mm_unpackhi_epi8 (px, zero));
+      _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, hi));
+    }
+
+  hyscan_map_tile_convert_rgba (dst + i, src + 4 * i, width - i);
+}
+#endif /* HYSCAN_MAP_TILE_SSE2 */
+
+#ifdef HYSCAN_MAP_TILE_CPU_DETECT
+/* Вариант hyscan_map_tile_premultiply_sse2() для 256-битных регистров. */
+HYSCAN_MAP_TILE_TARGET ("avx2")
+static inline __m256i
+hyscan_map_tile_premultiply_avx2 (__m256i px)
+{
+  const __m256i alpha = _mm256_set_epi16 (0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0);
+  const __m256i round = _mm256_set1_epi16 (0x80);
+  __m256i a, t;
+
+  a = _mm256_shufflelo_epi16 (px, _MM_SHUFFLE (3, 3, 3, 3));
+  a = _mm256_shufflehi_epi16 (a, _MM_SHUFFLE (3, 3, 3, 3));
+  a = _mm256_or_si256 (a, alpha);
+
+  t = _mm256_add_epi16 (_mm256_mullo_epi16 (px, a), round);
+  t = _mm256_srli_epi16 (_mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8)), 8);
+
+  t = _mm256_shufflelo_epi16 (t, _MM_SHUFFLE (3, 0, 1, 2));
+  t = _mm256_shufflehi_epi16 (t, _MM_SHUFFLE (3, 0, 1, 2));
+
+  return t;
+}
+
+/* Переводит строку RGBA-пикселей в ARGB32 по 8 пикселей за итерацию. Распаковка
+ * и упаковка выполняются внутри 128-битных половин регистра, поэтому порядок
+ * пикселей сохраняется. */
+HYSCAN_MAP_TILE_TARGET ("avx2")
+static void
+hyscan_map_tile_convert_rgba_avx2 (guint32      *dst,
+                                   const guint8 *src,
+                                   guint         width)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  guint i;
+
+  for (i = 0; i + 8 <= width; i += 8)
+    {
+      __m256i px, lo, hi;
+
+      px = _mm256_loadu_si256 ((const __m256i *) (src + 4 * i));
+      lo = hyscan_map_tile_premultiply_avx2 (_mm256_unpacklo_epi8 (px, zero));
+      hi = hyscan_map_tile_premultiply_avx2 (_mm256_unpackhi_epi8 (px, zero));
+      _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_packus_epi16 (lo, hi));
+    }
+
+  hyscan_map_tile_convert_rgba (dst + i, src + 4 * i, width - i);
+}
+
+/* Переводит строку RGB-пикселей в ARGB32 по 4 пикселя за итерацию. Читается
+ * 16 байт, поэтому цикл останавливается, когда до конца строки остаётся
+ * меньше 6 пикселей. */
+HYSCAN_MAP_TILE_TARGET ("ssse3")
+static void
+hyscan_map_tile_convert_rgb_ssse3 (guint32      *dst,
+                                   const guint8 *src,
+                                   guint         width)
+{
+  const __m128i shuffle = _mm_setr_epi8 (2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+  guint i;
+
+  for (i = 0; i + 6 <= width; i += 4)
+    {
+      __m128i px;
+
+      px = _mm_loadu_si128 ((const __m128i *) (src + 3 * i));
+      px = _mm_or_si128 (_mm_shuffle_epi8 (px, shuffle), alpha);
+      _mm_storeu_si128 ((__m128i *) (dst + i), px);
+    }
+
+  hyscan_map_tile_convert_rgb (dst + i, src + 3 * i, width - i);
+}
+#endif /* HYSCAN_MAP_TILE_CPU_DETECT */
+
+/* Выбирает функции перевода пикселей для текущего процессора. */
+static const HyScanMapTileConverters *
+hyscan_map_tile_get_converters (void)
+{
+  static HyScanMapTileConverters converters;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      converters.rgba = hyscan_map_tile_convert_rgba;
+      converters.rgb = hyscan_map_tile_convert_rgb;
+
+#ifdef HYSCAN_MAP_TILE_SSE2
+      converters.rgba = hyscan_map_tile_convert_rgba_sse2;
+#endif
+
+#ifdef HYSCAN_MAP_TILE_CPU_DETECT
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        converters.rgba = hyscan_map_tile_convert_rgba_avx2;
+      if (__builtin_cpu_supports ("ssse3"))
+        converters.rgb = hyscan_map_tile_convert_rgb_ssse3;
+#endif
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return &converters;
+}
+
+/* Функция чтения PNG-изображения из памяти для cairo_image_surface_create_from_png_stream(). */
+static cairo_status_t
+hyscan_map_tile_png_read (void          *closure,
+                          unsigned char *data,
+                          unsigned int   length)
+{
+  HyScanMapTileReader *reader = closure;
+
+  if (reader->size - reader->offset < length)
+    return CAIRO_STATUS_READ_ERROR;
+
+  memcpy (data, reader->data + reader->offset, length);
+  reader->offset += length;
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+/* Декодирует PNG-изображение сразу в поверхность cairo. Изображения без
+ * альфа-канала cairo загружает в формате CAIRO_FORMAT_RGB24 с альфа-байтом,
+ * равным 0xff, поэтому их пиксели без копирования представляются в формате
+ * CAIRO_FORMAT_ARGB32. Для прочих форматов возвращает %NULL. */
+static cairo_surface_t *
+hyscan_map_tile_decode_png (const guint8 *data,
+                            gsize         size)
+{
+  static cairo_user_data_key_t source_key;
+  HyScanMapTileReader reader;
+  cairo_surface_t *surface, *argb32;
+
+  reader.data = data;
+  reader.size = size;
+  reader.offset = 0;
+
+  surface = cairo_image_surface_create_from_png_stream (hyscan_map_tile_png_read, &reader);
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+    goto fail;
+
+  switch (cairo_image_surface_get_format (surface))
+    {
+    case CAIRO_FORMAT_ARGB32:
+      return surface;
+
+    case CAIRO_FORMAT_RGB24:
+      argb32 = cairo_image_surface_create_for_data (cairo_image_surface_get_data (surface),
+                                                    CAIRO_FORMAT_ARGB32,
+                                                    cairo_image_surface_get_width (surface),
+                                                    cairo_image_surface_get_height (surface),
+                                                    cairo_image_surface_get_stride (surface));
+      cairo_surface_set_user_data (argb32, &source_key, surface, (cairo_destroy_func_t) cairo_surface_destroy);
+      return argb32;
+
+    default:
+      break;
+    }
+
+fail:
+  cairo_surface_destroy (surface);
+
+  return NULL;
+}
+
 /**
  * hyscan_map_tile_set_pixbuf:
  * @tile: указатель на #HyScanMapTile
  * @pixbuf: изображение тайла
  *
- * Устанавливает изображение @pixbuf на поверхность тайла.
+ * Устанавливает изображение @pixbuf на поверхность тайла. Размер изображения
+ * должен совпадать с размером тайла.
  *
  * Returns: %TRUE в случае успеха.
  */
@@ -685,9 +994,15 @@ gboolean
 hyscan_map_tile_set_pixbuf (HyScanMapTile *tile,
                             GdkPixbuf     *pixbuf)
 {
-  cairo_t *cairo;
+  const HyScanMapTileConverters *converters;
+  HyScanMapTileConvertFunc convert;
   cairo_surface_t *surface;
+  const guint8 *src;
+  guint8 *dst;
+  gint src_stride, dst_stride;
+  gint n_channels;
   guint tile_size;
+  guint i;
 
   g_return_val_if_fail (HYSCAN_IS_MAP_TILE (tile), FALSE);
   g_return_val_if_fail (pixbuf != NULL, FALSE);
@@ -700,19 +1015,95 @@ hyscan_map_tile_set_pixbuf (HyScanMapTile *tile,
       return FALSE;
     }
 
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+      (n_channels != 3 && n_channels != 4) ||
+      gdk_pixbuf_get_has_alpha (pixbuf) != (n_channels == 4))
+    {
+      return FALSE;
+    }
+
+  converters = hyscan_map_tile_get_converters ();
+  convert = (n_channels == 4) ? converters->rgba : converters->rgb;
+
   surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tile_size, tile_size);
-  cairo = cairo_create (surface);
-  gdk_cairo_set_source_pixbuf (cairo, pixbuf, 0, 0);
-  cairo_paint (cairo);
+  cairo_surface_flush (surface);
+
+  src = gdk_pixbuf_read_pixels (pixbuf);
+  src_stride = gdk_pixbuf_get_rowstride (pixbuf);
+  dst = cairo_image_surface_get_data (surface);
+  dst_stride = cairo_image_surface_get_stride (surface);
+  for (i = 0; i < tile_size; i++)
+    convert ((guint32 *) (dst + i * dst_stride), src + i * src_stride, tile_size);
 
+  cairo_surface_mark_dirty (surface);
   hyscan_map_tile_set_surface (tile, surface);
 
   cairo_surface_destroy (surface);
-  cairo_destroy (cairo);
 
   return TRUE;
 }
 
+/**
+ * hyscan_map_tile_set_image:
+ * @tile: указатель на #HyScanMapTile
+ * @image: закодированное изображение тайла
+ *
+ * Декодирует изображение @image и устанавливает его на поверхность тайла.
+ * Поддерживаются форматы, доступные #GdkPixbuf. PNG-изображения декодируются
+ * сразу в буфер поверхности, минуя #GdkPixbuf.
+ *
+ * Returns: %TRUE в случае успеха.
+ */
+gboolean
+hyscan_map_tile_set_image (HyScanMapTile *tile,
+                           GBytes        *image)
+{
+  static const guint8 png_signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  const guint8 *data;
+  gsize size;
+  GInputStream *stream;
+  GdkPixbuf *pixbuf;
+  gboolean success;
+
+  g_return_val_if_fail (HYSCAN_IS_MAP_TILE (tile), FALSE);
+  g_return_val_if_fail (image != NULL, FALSE);
+
+  data = g_bytes_get_data (image, &size);
+  if (size >= sizeof (png_signature) && memcmp (data, png_signature, sizeof (png_signature)) == 0)
+    {
+      cairo_surface_t *surface;
+      guint tile_size;
+
+      surface = hyscan_map_tile_decode_png (data, size);
+      if (surface != NULL)
+        {
+          tile_size = hyscan_map_tile_get_size (tile);
+          success = (cairo_image_surface_get_width (surface) == (gint) tile_size &&
+                     cairo_image_surface_get_height (surface) == (gint) tile_size);
+          if (success)
+            hyscan_map_tile_set_surface (tile, surface);
+
+          cairo_surface_destroy (surface);
+
+          return success;
+        }
+    }
+
+  /* Прочие форматы декодируем с помощью GdkPixbuf. */
+  stream = g_memory_input_stream_new_from_bytes (image);
+  pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
+  g_object_unref (stream);
+
+  if (pixbuf == NULL)
+    return FALSE;
+
+  success = hyscan_map_tile_set_pixbuf (tile, pixbuf);
+  g_object_unref (pixbuf);
+
+  return success;
+}
+
 /**
  * hyscan_map_tile_set_surface:
  * @tile: указатель на #HyScanMapTile
@@ -783,6 +1174,99 @@ hyscan_map_tile_compare (HyScanMapTile *a,
     return 1;
 }
 
+/**
+ * hyscan_map_tile_key_init:
+ * @key: указатель на #HyScanMapTileKey
+ * @source_hash: хэш источника тайлов
+ * @tile: указатель на #HyScanMapTile
+ *
+ * Заполняет ключ тайла @tile из источника с хэшем @source_hash.
+ */
+void
+hyscan_map_tile_key_init (HyScanMapTileKey *key,
+                          guint             source_hash,
+                          HyScanMapTile    *tile)
+{
+  HyScanMapTilePrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_MAP_TILE (tile));
+  priv = tile->priv;
+
+  key->hi = ((guint64) source_hash << 32) |
+            ((guint64) (priv->zoom & 0xff) << 24) |
+            (hyscan_map_tile_grid_get_tile_size (priv->grid) & 0xffffff);
+  key->lo = ((guint64) priv->x << 32) | priv->y;
+}
+
+/**
+ * hyscan_map_tile_key_hash:
+ * @key: указатель на #HyScanMapTileKey
+ *
+ * Функция хэширования ключа тайла для #GHashTable.
+ *
+ * Returns: хэш ключа
+ */
+guint
+hyscan_map_tile_key_hash (gconstpointer key)
+{
+  const HyScanMapTileKey *k = key;
+  guint64 hash;
+
+  /* Перемешивание битов по схеме MurmurHash3 fmix64. */
+  hash = k->hi ^ (k->lo * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+  hash ^= hash >> 33;
+  hash *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  hash ^= hash >> 33;
+  hash *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+  hash ^= hash >> 33;
+
+  return (guint) hash;
+}
+
+/**
+ * hyscan_map_tile_key_equal:
+ * @a: указатель на #HyScanMapTileKey
+ * @b: указатель на #HyScanMapTileKey
+ *
+ * Функция сравнения ключей тайлов для #GHashTable.
+ *
+ * Returns: %TRUE, если ключи совпадают
+ */
+gboolean
+hyscan_map_tile_key_equal (gconstpointer a,
+                           gconstpointer b)
+{
+  const HyScanMapTileKey *ka = a;
+  const HyScanMapTileKey *kb = b;
+
+  return ka->hi == kb->hi && ka->lo == kb->lo;
+}
+
+/**
+ * hyscan_map_tile_key_to_string:
+ * @key: указатель на #HyScanMapTileKey
+ * @str: буфер размером не менее HYSCAN_MAP_TILE_KEY_STRLEN + 1 байт
+ *
+ * Записывает в @str шестнадцатеричное представление ключа фиксированной длины
+ * HYSCAN_MAP_TILE_KEY_STRLEN с завершающим нулём. Функция предназначена для
+ * кэшей со строковыми ключами и работает без разбора формата.
+ */
+void
+hyscan_map_tile_key_to_string (const HyScanMapTileKey *key,
+                               gchar                  *str)
+{
+  static const gchar digits[] = "0123456789abcdef";
+  gint i;
+
+  for (i = 0; i < 16; i++)
+    {
+      str[i] = digits[(key->hi >> (60 - 4 * i)) & 0xf];
+      str[16 + i] = digits[(key->lo >> (60 - 4 * i)) & 0xf];
+    }
+
+  str[HYSCAN_MAP_TILE_KEY_STRLEN] = '\0';
+}
+
 /**
  * hyscan_map_tile_grid_get_view:
  * @grid: указатель на #HyScanMapTileGrid
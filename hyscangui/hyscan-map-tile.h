@@ -65,6 +65,29 @@ typedef struct _HyScanMapTileGrid HyScanMapTileGrid;
 typedef struct _HyScanMapTileGridPrivate HyScanMapTileGridPrivate;
 typedef struct _HyScanMapTileGridClass HyScanMapTileGridClass;
 typedef struct _HyScanMapTileIter HyScanMapTileIter;
+typedef struct _HyScanMapTileKey HyScanMapTileKey;
+
+/**
+ * HYSCAN_MAP_TILE_KEY_STRLEN:
+ *
+ * Длина строкового представления ключа #HyScanMapTileKey без завершающего нуля.
+ */
+#define HYSCAN_MAP_TILE_KEY_STRLEN 32
+
+/**
+ * HyScanMapTileKey:
+ * @hi: хэш источника тайлов, зум и размер тайла
+ * @lo: координаты тайла
+ *
+ * Двоичный ключ тайла фиксированного размера (128 бит). Используется для поиска
+ * тайлов в кэшах вместо строковых ключей. Заполняется функцией
+ * hyscan_map_tile_key_init().
+ */
+struct _HyScanMapTileKey
+{
+  guint64 hi;
+  guint64 lo;
+};
 
 /**
  * HyScanMapTileIter:
@@ -234,6 +257,10 @@ HYSCAN_API
 gboolean               hyscan_map_tile_set_pixbuf             (HyScanMapTile        *tile,
                                                                GdkPixbuf            *pixbuf);
 
+HYSCAN_API
+gboolean               hyscan_map_tile_set_image              (HyScanMapTile        *tile,
+                                                               GBytes               *image);
+
 HYSCAN_API
 void                   hyscan_map_tile_set_surface            (HyScanMapTile        *tile,
                                                                cairo_surface_t      *surface);
@@ -245,6 +272,22 @@ HYSCAN_API
 gint                   hyscan_map_tile_compare                (HyScanMapTile        *a,
                                                                HyScanMapTile        *b);
 
+HYSCAN_API
+void                   hyscan_map_tile_key_init               (HyScanMapTileKey     *key,
+                                                               guint                 source_hash,
+                                                               HyScanMapTile        *tile);
+
+HYSCAN_API
+guint                  hyscan_map_tile_key_hash               (gconstpointer         key);
+
+HYSCAN_API
+gboolean               hyscan_map_tile_key_equal              (gconstpointer         a,
+                                                               gconstpointer         b);
+
+HYSCAN_API
+void                   hyscan_map_tile_key_to_string          (const HyScanMapTileKey *key,
+                                                               gchar                *str);
+
 HYSCAN_API
 void                   hyscan_map_tile_iter_init              (HyScanMapTileIter    *iter,
                                                                guint                 from_x,
@@ -0,0 +1,206 @@
+#include <hyscan-cairo.h>
+#include <math.h>
+
+#define N_PINGS          50000     /* Число зондирований синтетического галса. */
+#define PING_STEP        0.2       /* Расстояние между зондированиями, м. */
+#define BEAM_LENGTH      100.0     /* Длина луча, м. */
+#define NEAR_LENGTH      20.0      /* Длина ближней зоны, м. */
+#define BEAM_ANGLE       0.01      /* Половина ширины диаграммы направленности в дальней зоне, рад. */
+#define APERTURE         0.5       /* Апертура антенны, м. */
+#define SURFACE_SIZE     1024      /* Размер изображения. */
+#define MAX_MISMATCH     0.01      /* Допустимая доля несовпадающих закрашенных пикселей. */
+
+/* Многоугольники покрытия одного зондирования: ближняя и дальняя зоны. */
+typedef struct
+{
+  gdouble near[8];
+  gdouble far[8];
+} Ping;
+
+/* Создаёт покрытие галса, идущего по дуге, в масштабе scale м/пиксель. */
+static Ping *
+make_pings (gdouble scale)
+{
+  Ping *pings;
+  guint i;
+
+  pings = g_new (Ping, N_PINGS);
+  for (i = 0; i < N_PINGS; i++)
+    {
+      gdouble angle = 0.3 * i / N_PINGS;
+      gdouble x, y, bx, by, ax, ay;
+      gdouble s0, s1;
+
+      /* Положение судна, направление луча (bx, by) и направление движения (ax, ay). */
+      x = 20.0 + i * PING_STEP * cos (angle) / scale;
+      y = 20.0 + i * PING_STEP * sin (angle) / scale;
+      bx = -sin (angle);
+      by = cos (angle);
+      ax = cos (angle);
+      ay = sin (angle);
+
+      /* Ближняя зона. */
+      s0 = 0.0;
+      s1 = NEAR_LENGTH / scale;
+      pings[i].near[0] = x + s0 * bx + APERTURE / 2.0 / scale * ax;
+      pings[i].near[1] = y + s0 * by + APERTURE / 2.0 / scale * ay;
+      pings[i].near[2] = x + s1 * bx + APERTURE / 2.0 / scale * ax;
+      pings[i].near[3] = y + s1 * by + APERTURE / 2.0 / scale * ay;
+      pings[i].near[4] = x + s1 * bx - APERTURE / 2.0 / scale * ax;
+      pings[i].near[5] = y + s1 * by - APERTURE / 2.0 / scale * ay;
+      pings[i].near[6] = x + s0 * bx - APERTURE / 2.0 / scale * ax;
+      pings[i].near[7] = y + s0 * by - APERTURE / 2.0 / scale * ay;
+
+      /* Дальняя зона расходится на угол BEAM_ANGLE. */
+      s0 = NEAR_LENGTH / scale;
+      s1 = BEAM_LENGTH / scale;
+      pings[i].far[0] = x + s0 * (bx + BEAM_ANGLE * ax);
+      pings[i].far[1] = y + s0 * (by + BEAM_ANGLE * ay);
+      pings[i].far[2] = x + s1 * (bx + BEAM_ANGLE * ax);
+      pings[i].far[3] = y + s1 * (by + BEAM_ANGLE * ay);
+      pings[i].far[4] = x + s1 * (bx - BEAM_ANGLE * ax);
+      pings[i].far[5] = y + s1 * (by - BEAM_ANGLE * ay);
+      pings[i].far[6] = x + s0 * (bx - BEAM_ANGLE * ax);
+      pings[i].far[7] = y + s0 * (by - BEAM_ANGLE * ay);
+    }
+
+  return pings;
+}
+
+/* Закрашивает многоугольник через cairo. */
+static void
+fill_cairo (cairo_t       *cairo,
+            const gdouble *points)
+{
+  cairo_move_to (cairo, points[0], points[1]);
+  cairo_line_to (cairo, points[2], points[3]);
+  cairo_line_to (cairo, points[4], points[5]);
+  cairo_line_to (cairo, points[6], points[7]);
+  cairo_close_path (cairo);
+  cairo_fill (cairo);
+}
+
+/* Рисует покрытие через cairo и напрямую в данных изображения, сравнивает время и результат. */
+static void
+test_scale (gdouble scale)
+{
+  cairo_surface_t *surface1, *surface2;
+  cairo_t *cairo;
+  GTimer *timer;
+  Ping *pings;
+  guchar *data1, *data2;
+  gdouble cairo_time, raster_time;
+  guint32 pixel = 0x80402010;
+  guint n_filled = 0, n_mismatch = 0;
+  gint stride;
+  guint i, j;
+
+  pings = make_pings (scale);
+  surface1 = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, SURFACE_SIZE, SURFACE_SIZE);
+  surface2 = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, SURFACE_SIZE, SURFACE_SIZE);
+  timer = g_timer_new ();
+
+  /* Рисование через cairo, как в HyScanGtkMapTrackDrawBeam. */
+  cairo = cairo_create (surface1);
+  cairo_set_operator (cairo, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba (cairo, 0.25, 0.125, 0.0625, 0.5);
+  cairo_set_antialias (cairo, CAIRO_ANTIALIAS_NONE);
+  g_timer_start (timer);
+  for (i = 0; i < N_PINGS; i++)
+    {
+      fill_cairo (cairo, pings[i].near);
+      fill_cairo (cairo, pings[i].far);
+    }
+  cairo_surface_flush (surface1);
+  cairo_time = g_timer_elapsed (timer, NULL);
+  cairo_destroy (cairo);
+
+  /* Закрашивание напрямую в данных изображения. */
+  cairo_surface_flush (surface2);
+  data2 = cairo_image_surface_get_data (surface2);
+  stride = cairo_image_surface_get_stride (surface2);
+  g_timer_start (timer);
+  for (i = 0; i < N_PINGS; i++)
+    {
+      hyscan_cairo_fill_convex (data2, stride, SURFACE_SIZE, SURFACE_SIZE, pings[i].near, 4, pixel);
+      hyscan_cairo_fill_convex (data2, stride, SURFACE_SIZE, SURFACE_SIZE, pings[i].far, 4, pixel);
+    }
+  raster_time = g_timer_elapsed (timer, NULL);
+  cairo_surface_mark_dirty (surface2);
+
+  /* Сравниваем закрашенные области. */
+  data1 = cairo_image_surface_get_data (surface1);
+  for (j = 0; j < SURFACE_SIZE; j++)
+    {
+      guint32 *line1 = (guint32 *) (data1 + j * stride);
+      guint32 *line2 = (guint32 *) (data2 + j * stride);
+
+      for (i = 0; i < SURFACE_SIZE; i++)
+        {
+          gboolean filled1 = (line1[i] != 0), filled2 = (line2[i] != 0);
+
+          n_filled += (filled1 || filled2) ? 1 : 0;
+          n_mismatch += (filled1 != filled2) ? 1 : 0;
+        }
+    }
+
+  g_message ("Scale %5.2f m/px, %u pixels: cairo %.1f ms, raster %.1f ms, %u pixels differ",
+             scale, n_filled, 1e3 * cairo_time, 1e3 * raster_time, n_mismatch);
+
+  g_assert_cmpuint (n_filled, >, 0);
+  g_assert_cmpfloat ((gdouble) n_mismatch / n_filled, <, MAX_MISMATCH);
+
+  g_timer_destroy (timer);
+  cairo_surface_destroy (surface1);
+  cairo_surface_destroy (surface2);
+  g_free (pings);
+}
+
+/* Проверяет закрашивание многоугольников на границах изображения и вырожденных случаев. */
+static void
+test_edges (void)
+{
+  cairo_surface_t *surface;
+  guchar *data;
+  gint stride;
+  gint i, j;
+
+  gdouble outside[] = { -1e6, -1e6, -1e5, -1e6, -1e5, -1e5 };
+  gdouble degenerate[] = { 10.0, 10.0, 20.0, 20.0, 30.0, 30.0 };
+  gdouble invalid[] = { 10.0, 10.0, NAN, 20.0, 30.0, 30.0 };
+  gdouble square[] = { -10.0, -10.0, 8.0, -10.0, 8.0, 8.0, -10.0, 8.0 };
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 16, 16);
+  data = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  hyscan_cairo_fill_convex (data, stride, 16, 16, outside, 3, 1);
+  hyscan_cairo_fill_convex (data, stride, 16, 16, degenerate, 3, 1);
+  hyscan_cairo_fill_convex (data, stride, 16, 16, invalid, 3, 1);
+  hyscan_cairo_fill_convex (data, stride, 16, 16, square, 4, 1);
+
+  /* Закрашен только квадрат 8x8 в углу изображения. */
+  for (j = 0; j < 16; j++)
+    {
+      guint32 *line = (guint32 *) (data + j * stride);
+
+      for (i = 0; i < 16; i++)
+        g_assert_cmpuint (line[i], ==, (i < 8 && j < 8) ? 1 : 0);
+    }
+
+  cairo_surface_destroy (surface);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  test_edges ();
+  test_scale (10.0);
+  test_scale (1.0);
+  test_scale (0.1);
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+/* Контекст OpenGL без окна для тестов индикатора кругового обзора. */
+
+#ifndef __GLIKO_GL_CONTEXT_H__
+#define __GLIKO_GL_CONTEXT_H__
+
+#include <epoxy/egl.h>
+#include <epoxy/gl.h>
+#include <glib.h>
+
+/* Создаёт контекст OpenGL 3.3 без окна (EGL surfaceless) и буфер кадра для рисования.
+ * Возвращает FALSE, если такой контекст создать нельзя. */
+static gboolean
+gliko_gl_context_create (gint        width,
+                         gint        height,
+                         EGLDisplay *display,
+                         EGLContext *context)
+{
+  static const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  static const EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint n_configs;
+  GLuint framebuffer, renderbuffer;
+
+  if (!epoxy_has_egl_extension (EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+    return FALSE;
+
+  *display = eglGetPlatformDisplayEXT (EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (*display == EGL_NO_DISPLAY || !eglInitialize (*display, NULL, NULL))
+    return FALSE;
+
+  if (!epoxy_has_egl_extension (*display, "EGL_KHR_surfaceless_context") ||
+      !eglBindAPI (EGL_OPENGL_API) ||
+      !eglChooseConfig (*display, config_attribs, &config, 1, &n_configs) ||
+      n_configs < 1)
+    {
+      eglTerminate (*display);
+      return FALSE;
+    }
+
+  *context = eglCreateContext (*display, config, EGL_NO_CONTEXT, context_attribs);
+  if (*context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent (*display, EGL_NO_SURFACE, EGL_NO_SURFACE, *context))
+    {
+      eglTerminate (*display);
+      return FALSE;
+    }
+
+  glGenRenderbuffers (1, &renderbuffer);
+  glBindRenderbuffer (GL_RENDERBUFFER, renderbuffer);
+  glRenderbufferStorage (GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+  glGenFramebuffers (1, &framebuffer);
+  glBindFramebuffer (GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+  glViewport (0, 0, width, height);
+
+  if (glCheckFramebufferStatus (GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+      eglMakeCurrent (*display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      eglDestroyContext (*display, *context);
+      eglTerminate (*display);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Освобождает контекст, созданный gliko_gl_context_create (). */
+static void
+gliko_gl_context_destroy (EGLDisplay display,
+                          EGLContext context)
+{
+  eglMakeCurrent (display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext (display, context);
+  eglTerminate (display);
+}
+
+#endif /* __GLIKO_GL_CONTEXT_H__ */
@@ -0,0 +1,246 @@
+#include <hyscan-gtk-gliko-kernels.h>
+#include <string.h>
+
+#define MAX_LENGTH       1100      /* Максимальная длина строки в тесте корректности. */
+#define BENCH_LENGTH     8192      /* Длина строки в тесте скорости. */
+#define BENCH_ROWS       20000     /* Число строк в тесте скорости. */
+#define BENCH_LEVELS     6         /* Число уровней детализации в тесте скорости. */
+#define GUARD            8         /* Число отсчётов после конца строки, которые не должны меняться. */
+#define GUARD_VALUE      -7.0f     /* Значение отсчётов после конца строки. */
+
+/* Заполняет строку случайными отсчётами, в том числе большими единицы. */
+static void
+random_row (gfloat *row,
+            guint   length)
+{
+  guint i;
+
+  for (i = 0; i < length; i++)
+    row[i] = g_random_double_range (0.0, 1.5);
+}
+
+/* Сравнивает функции прореживания со скалярным вариантом для разных длин и смещений строк. */
+static void
+test_resample2 (const HyScanGtkGlikoKernels *scalar,
+                const HyScanGtkGlikoKernels *kernels)
+{
+  gfloat *src, *expected, *result;
+  guint length, offset;
+
+  src = g_new (gfloat, 2 * MAX_LENGTH + 4);
+  expected = g_new (gfloat, MAX_LENGTH + GUARD + 4);
+  result = g_new (gfloat, MAX_LENGTH + GUARD + 4);
+
+  for (length = 0; length <= MAX_LENGTH; length += (length < 64) ? 1 : 37)
+    for (offset = 0; offset < 4; offset++)
+      {
+        guint i;
+
+        random_row (src, 2 * length + offset);
+        for (i = 0; i < length + GUARD + offset; i++)
+          expected[i] = result[i] = GUARD_VALUE;
+
+        scalar->resample2 (expected + offset, src + offset, length);
+        kernels->resample2 (result + offset, src + offset, length);
+
+        g_assert_true (memcmp (expected, result, (length + GUARD + offset) * sizeof (gfloat)) == 0);
+      }
+
+  g_free (result);
+  g_free (expected);
+  g_free (src);
+}
+
+/* Сравнивает функции наложения со скалярным вариантом для разных длин строк и коэффициентов. */
+static void
+test_blend (const HyScanGtkGlikoKernels *scalar,
+            const HyScanGtkGlikoKernels *kernels)
+{
+  const gfloat coefs[] = { 0.0f, 0.25f, 0.5f, 0.999f, 1.0f };
+  gfloat *src, *expected, *result;
+  guint length, offset, k;
+
+  src = g_new (gfloat, MAX_LENGTH + 4);
+  expected = g_new (gfloat, MAX_LENGTH + GUARD + 4);
+  result = g_new (gfloat, MAX_LENGTH + GUARD + 4);
+
+  for (length = 0; length <= MAX_LENGTH; length += (length < 64) ? 1 : 37)
+    for (offset = 0; offset < 4; offset++)
+      for (k = 0; k < G_N_ELEMENTS (coefs); k++)
+        {
+          guint i;
+
+          random_row (src, length + offset);
+          random_row (expected, length + offset);
+          for (i = length + offset; i < length + GUARD + offset; i++)
+            expected[i] = GUARD_VALUE;
+          memcpy (result, expected, (length + GUARD + offset) * sizeof (gfloat));
+
+          scalar->blend (expected + offset, src + offset, coefs[k], length);
+          kernels->blend (result + offset, src + offset, coefs[k], length);
+
+          for (i = 0; i < length + GUARD + offset; i++)
+            g_assert_cmpfloat_with_epsilon (expected[i], result[i], 1e-6);
+        }
+
+  g_free (result);
+  g_free (expected);
+  g_free (src);
+}
+
+/* Проверяет преобразование в half float на известных значениях. */
+static void
+test_half_values (const HyScanGtkGlikoKernels *kernels)
+{
+  const gfloat values[] = { 0.0f, -0.0f, 1.0f, 0.5f, -2.0f, 65504.0f, 65520.0f, 1e10f,
+                            6.103515625e-05f, 5.9604645e-08f, 2.9802322e-08f, 1e-10f,
+                            1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f, 0.1f };
+  const guint16 expected[] = { 0x0000, 0x8000, 0x3c00, 0x3800, 0xc000, 0x7bff, 0x7c00, 0x7c00,
+                               0x0400, 0x0001, 0x0000, 0x0000,
+                               0x3c00, 0x3c02, 0x2e66 };
+  guint16 result[G_N_ELEMENTS (values)];
+  guint i;
+
+  kernels->pack_half (result, values, G_N_ELEMENTS (values));
+  for (i = 0; i < G_N_ELEMENTS (values); i++)
+    g_assert_cmpuint (result[i], ==, expected[i]);
+}
+
+/* Сравнивает функции преобразования со скалярным вариантом для разных длин строк. */
+static void
+test_pack (const HyScanGtkGlikoKernels *scalar,
+           const HyScanGtkGlikoKernels *kernels)
+{
+  const gfloat gains[] = { 1.0f, 4.0f, 100.0f };
+  const gfloat offsets[] = { 0.0f, 0.1f, -0.5f };
+  gfloat *src;
+  guint16 *half_expected, *half_result;
+  guint8 *unorm_expected, *unorm_result;
+  guint length, k;
+
+  src = g_new (gfloat, MAX_LENGTH);
+  half_expected = g_new (guint16, MAX_LENGTH);
+  half_result = g_new (guint16, MAX_LENGTH);
+  unorm_expected = g_new (guint8, MAX_LENGTH);
+  unorm_result = g_new (guint8, MAX_LENGTH);
+
+  for (length = 0; length <= MAX_LENGTH; length += (length < 64) ? 1 : 37)
+    {
+      random_row (src, length);
+
+      scalar->pack_half (half_expected, src, length);
+      kernels->pack_half (half_result, src, length);
+      g_assert_true (memcmp (half_expected, half_result, length * sizeof (guint16)) == 0);
+
+      for (k = 0; k < G_N_ELEMENTS (gains); k++)
+        {
+          scalar->pack_unorm8 (unorm_expected, src, gains[k], offsets[k], length);
+          kernels->pack_unorm8 (unorm_result, src, gains[k], offsets[k], length);
+          g_assert_true (memcmp (unorm_expected, unorm_result, length) == 0);
+        }
+    }
+
+  /* Границы диапазона, округление и NaN. */
+  src[0] = 0.0f;
+  src[1] = 1.0f;
+  src[2] = -1.0f;
+  src[3] = 2.0f;
+  src[4] = 0.5f / 255.0f;
+  src[5] = 127.5f / 255.0f;
+  src[6] = 254.0f / 255.0f;
+  src[7] = 0.0f / 0.0f;
+  for (length = 8; length < 32; length++)
+    src[length] = src[length % 8];
+
+  kernels->pack_unorm8 (unorm_result, src, 1.0f, 0.0f, 32);
+  for (length = 0; length < 32; length += 8)
+    {
+      g_assert_cmpuint (unorm_result[length + 0], ==, 0);
+      g_assert_cmpuint (unorm_result[length + 1], ==, 255);
+      g_assert_cmpuint (unorm_result[length + 2], ==, 0);
+      g_assert_cmpuint (unorm_result[length + 3], ==, 255);
+      g_assert_cmpuint (unorm_result[length + 4], ==, 1);
+      g_assert_cmpuint (unorm_result[length + 5], ==, 128);
+      g_assert_cmpuint (unorm_result[length + 6], ==, 254);
+      g_assert_cmpuint (unorm_result[length + 7], ==, 0);
+    }
+
+  g_free (unorm_result);
+  g_free (unorm_expected);
+  g_free (half_result);
+  g_free (half_expected);
+  g_free (src);
+}
+
+/* Измеряет скорость обработки строк так же, как при поступлении строки
+ * в HyScanGtkGlikoArea: наложение и построение уровней детализации. */
+static void
+bench_kernels (const HyScanGtkGlikoKernels *kernels)
+{
+  gfloat *src, *levels[BENCH_LEVELS];
+  GTimer *timer;
+  gdouble blend_time, resample_time;
+  guint i, j, length;
+
+  src = g_new (gfloat, BENCH_LENGTH);
+  random_row (src, BENCH_LENGTH);
+  for (j = 0, length = BENCH_LENGTH; j < BENCH_LEVELS; j++, length >>= 1)
+    {
+      levels[j] = g_new (gfloat, length);
+      random_row (levels[j], length);
+    }
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < BENCH_ROWS; i++)
+    kernels->blend (levels[0], src, 0.5f, BENCH_LENGTH);
+  blend_time = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_ROWS; i++)
+    for (j = 1, length = BENCH_LENGTH >> 1; j < BENCH_LEVELS; j++, length >>= 1)
+      kernels->resample2 (levels[j], levels[j - 1], length);
+  resample_time = g_timer_elapsed (timer, NULL);
+
+  g_message ("%-6s %d-sample rows: blend %.2f us, mip pyramid %.2f us, %.0f rows/s",
+             kernels->name, BENCH_LENGTH,
+             1e6 * blend_time / BENCH_ROWS,
+             1e6 * resample_time / BENCH_ROWS,
+             BENCH_ROWS / (blend_time + resample_time));
+
+  g_timer_destroy (timer);
+  for (j = 0; j < BENCH_LEVELS; j++)
+    g_free (levels[j]);
+  g_free (src);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const HyScanGtkGlikoKernels **kernels;
+  const HyScanGtkGlikoKernels *scalar;
+  guint n_kernels, i;
+
+  scalar = hyscan_gtk_gliko_kernels_get_scalar ();
+  kernels = hyscan_gtk_gliko_kernels_list (&n_kernels);
+
+  g_assert_cmpuint (n_kernels, >, 0);
+  g_assert_true (kernels[0] == scalar);
+  g_assert_true (hyscan_gtk_gliko_kernels_get () == kernels[n_kernels - 1]);
+
+  for (i = 0; i < n_kernels; i++)
+    {
+      test_resample2 (scalar, kernels[i]);
+      test_blend (scalar, kernels[i]);
+      test_half_values (kernels[i]);
+      test_pack (scalar, kernels[i]);
+    }
+
+  for (i = 0; i < n_kernels; i++)
+    bench_kernels (kernels[i]);
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,530 @@
+/*
+Тест скорости обработки данных индикатора кругового обзора без вывода на экран
+
+Воспроизводит проект, сформированный программой gen-gliko-test-data, по тем же
+этапам, что и HyScanGtkGliko: разбор показаний датчика угла $HYRA, поиск строк
+акустических данных, чтение амплитуд и передача строк в HyScanGtkGlikoArea.
+Разбор, вычисление угла и передача строк выполняются функциями HyScanGtkGlikoFeed,
+которые использует и виджет. Изображение рисуется в контексте OpenGL без окна
+(EGL surfaceless). HyScanGtkGlikoArea принимает строки только после создания
+текстур, поэтому без OpenGL измеряется лишь чтение данных.
+
+$ cd ~/hyscan/bin
+$ ./gen-gliko-test-data file:///tmp/
+$ ./gliko-pipeline-test file:///tmp/
+
+*/
+
+#include <hyscan-acoustic-data.h>
+#include <hyscan-cached.h>
+#include <hyscan-gtk-gliko-area.h>
+#include <hyscan-gtk-gliko-feed.h>
+#include <hyscan-gtk-gliko-grid.h>
+#include <hyscan-nmea-data.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gliko-gl-context.h"
+
+#define SENSOR_CHANNEL 1
+
+/* Этапы обработки. */
+enum
+{
+  STAGE_NMEA,      /* Чтение и разбор показания датчика угла. */
+  STAGE_INDEX,     /* Определение размера и времени строки. */
+  STAGE_AMPLITUDE, /* Чтение амплитуд строки. */
+  STAGE_SET_DATA,  /* Передача строки в индикатор. */
+  STAGE_RENDER,    /* Рисование кадра. */
+  N_STAGES
+};
+
+/* Подсчитываемые вызовы OpenGL. */
+enum
+{
+  GL_CALL_TEX_SUB_IMAGE_2D,
+  GL_CALL_TEX_SUB_IMAGE_3D,
+  GL_CALL_BUFFER_SUB_DATA,
+  GL_CALL_GET_UNIFORM_LOCATION,
+  GL_CALL_UNIFORM,
+  GL_CALL_DRAW,
+  N_GL_CALLS
+};
+
+static const gchar *stage_names[N_STAGES] = { "nmea", "index", "amplitude", "set-data", "render" };
+static const gchar *gl_call_names[N_GL_CALLS] = { "glTexSubImage2D", "glTexSubImage3D", "glBufferSubData",
+                                                  "glGetUniformLocation", "glUniform*", "glDraw*" };
+
+static guint64 gl_calls[N_GL_CALLS];
+
+/* Показание датчика угла. */
+typedef struct
+{
+  gint64  time;
+  gdouble value;
+} Angle;
+
+/* Канал акустических данных. */
+typedef struct
+{
+  HyScanSourceType   source;
+  HyScanAcousticData *data;
+  guint32            first;
+  guint32            last;
+  guint32            length;
+  gdouble            data_rate;
+  guint              angle_index;
+  HyScanGtkGlikoFeed feed;
+} Channel;
+
+static PFNGLTEXSUBIMAGE2DPROC real_tex_sub_image_2d;
+static PFNGLTEXSUBIMAGE3DPROC real_tex_sub_image_3d;
+static PFNGLBUFFERSUBDATAPROC real_buffer_sub_data;
+static PFNGLGETUNIFORMLOCATIONPROC real_get_uniform_location;
+static PFNGLUNIFORM1FPROC real_uniform_1f;
+static PFNGLUNIFORM1IPROC real_uniform_1i;
+static PFNGLUNIFORM4FPROC real_uniform_4f;
+static PFNGLUNIFORM4FVPROC real_uniform_4fv;
+static PFNGLDRAWARRAYSPROC real_draw_arrays;
+static PFNGLDRAWARRAYSINSTANCEDPROC real_draw_arrays_instanced;
+static PFNGLDRAWELEMENTSPROC real_draw_elements;
+
+static void GLAPIENTRY
+hook_tex_sub_image_2d (GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                       GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels)
+{
+  gl_calls[GL_CALL_TEX_SUB_IMAGE_2D]++;
+  real_tex_sub_image_2d (target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+static void GLAPIENTRY
+hook_tex_sub_image_3d (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+                       GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+{
+  gl_calls[GL_CALL_TEX_SUB_IMAGE_3D]++;
+  real_tex_sub_image_3d (target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
+
+static void GLAPIENTRY
+hook_buffer_sub_data (GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+  gl_calls[GL_CALL_BUFFER_SUB_DATA]++;
+  real_buffer_sub_data (target, offset, size, data);
+}
+
+static GLint GLAPIENTRY
+hook_get_uniform_location (GLuint program, const GLchar *name)
+{
+  gl_calls[GL_CALL_GET_UNIFORM_LOCATION]++;
+  return real_get_uniform_location (program, name);
+}
+
+static void GLAPIENTRY
+hook_uniform_1f (GLint location, GLfloat v0)
+{
+  gl_calls[GL_CALL_UNIFORM]++;
+  real_uniform_1f (location, v0);
+}
+
+static void GLAPIENTRY
+hook_uniform_1i (GLint location, GLint v0)
+{
+  gl_calls[GL_CALL_UNIFORM]++;
+  real_uniform_1i (location, v0);
+}
+
+static void GLAPIENTRY
+hook_uniform_4f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+  gl_calls[GL_CALL_UNIFORM]++;
+  real_uniform_4f (location, v0, v1, v2, v3);
+}
+
+static void GLAPIENTRY
+hook_uniform_4fv (GLint location, GLsizei count, const GLfloat *value)
+{
+  gl_calls[GL_CALL_UNIFORM]++;
+  real_uniform_4fv (location, count, value);
+}
+
+static void GLAPIENTRY
+hook_draw_arrays (GLenum mode, GLint first, GLsizei count)
+{
+  gl_calls[GL_CALL_DRAW]++;
+  real_draw_arrays (mode, first, count);
+}
+
+static void GLAPIENTRY
+hook_draw_arrays_instanced (GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+{
+  gl_calls[GL_CALL_DRAW]++;
+  real_draw_arrays_instanced (mode, first, count, instancecount);
+}
+
+static void GLAPIENTRY
+hook_draw_elements (GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+  gl_calls[GL_CALL_DRAW]++;
+  real_draw_elements (mode, count, type, indices);
+}
+
+/* Подменяет функции OpenGL счётчиками вызовов. Указатели libepoxy заполняются
+ * при первом вызове функции, поэтому подмена выполняется после первого кадра. */
+static void
+install_gl_hooks (void)
+{
+  real_tex_sub_image_2d = epoxy_glTexSubImage2D;
+  real_tex_sub_image_3d = epoxy_glTexSubImage3D;
+  real_buffer_sub_data = epoxy_glBufferSubData;
+  real_get_uniform_location = epoxy_glGetUniformLocation;
+  real_uniform_1f = epoxy_glUniform1f;
+  real_uniform_1i = epoxy_glUniform1i;
+  real_uniform_4f = epoxy_glUniform4f;
+  real_uniform_4fv = epoxy_glUniform4fv;
+  real_draw_arrays = epoxy_glDrawArrays;
+  real_draw_arrays_instanced = epoxy_glDrawArraysInstanced;
+  real_draw_elements = epoxy_glDrawElements;
+
+  epoxy_glTexSubImage2D = hook_tex_sub_image_2d;
+  epoxy_glTexSubImage3D = hook_tex_sub_image_3d;
+  epoxy_glBufferSubData = hook_buffer_sub_data;
+  epoxy_glGetUniformLocation = hook_get_uniform_location;
+  epoxy_glUniform1f = hook_uniform_1f;
+  epoxy_glUniform1i = hook_uniform_1i;
+  epoxy_glUniform4f = hook_uniform_4f;
+  epoxy_glUniform4fv = hook_uniform_4fv;
+  epoxy_glDrawArrays = hook_draw_arrays;
+  epoxy_glDrawArraysInstanced = hook_draw_arrays_instanced;
+  epoxy_glDrawElements = hook_draw_elements;
+
+  memset (gl_calls, 0, sizeof (gl_calls));
+}
+
+/* Добавляет длительность этапа, начавшегося в момент start, мкс. */
+static void
+stage_add (GArray *stage,
+           gint64  start)
+{
+  gdouble elapsed = g_get_monotonic_time () - start;
+
+  g_array_append_val (stage, elapsed);
+}
+
+static gint
+compare_double (gconstpointer a,
+                gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a;
+  gdouble db = *(const gdouble *) b;
+
+  return (da > db) - (da < db);
+}
+
+/* Выводит процентили длительности этапа. */
+static void
+stage_print (const gchar *name,
+             GArray      *stage)
+{
+  gdouble *values = (gdouble *) stage->data;
+  guint n = stage->len;
+
+  if (n == 0)
+    return;
+
+  g_array_sort (stage, compare_double);
+  g_print ("  %-10s %8u calls, p50 %8.1f us, p90 %8.1f us, p99 %8.1f us, max %8.1f us\n",
+           name, n, values[n / 2], values[n * 9 / 10], values[n * 99 / 100], values[n - 1]);
+}
+
+/* Угол поворота в момент time между соседними показаниями датчика. */
+static gdouble
+angle_at (GArray  *angles,
+          guint   *index,
+          gint64   time)
+{
+  const Angle *a = (const Angle *) angles->data;
+
+  while (*index + 2 < angles->len && a[*index + 1].time <= time)
+    (*index)++;
+
+  return hyscan_gtk_gliko_feed_interpolate (a[*index].time, a[*index].value,
+                                            a[*index + 1].time, a[*index + 1].value, time);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gchar *db_uri = "file:///tmp/";
+  gchar *project_name = "testko";
+  gchar *track_name = "testko";
+  gint num_azimuthes = 1024;
+  gint frame_rows = 4;
+  gint width = 1024;
+  gint height = 1024;
+  gboolean no_gl = FALSE;
+
+  HyScanDB *db;
+  HyScanCache *cache;
+  HyScanNmeaData *nmea;
+  HyScanGtkGlikoArea *area;
+  HyScanGtkGlikoGrid *grid;
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  gboolean use_gl;
+  Channel channel[2];
+  GArray *angles;
+  GArray *stages[N_STAGES];
+  guint32 first, last, index;
+  guint32 iko_length;
+  guint n_rows = 0, n_frames = 0;
+  gdouble ingest_time = 0.0, total_time;
+  gint64 start_time;
+  gint i, c;
+
+  {
+    gchar **args;
+    GError *error = NULL;
+    GOptionContext *option_context;
+    GOptionEntry entries[] = {
+      { "project", 'p', 0, G_OPTION_ARG_STRING, &project_name, "Project name (default testko)", NULL },
+      { "track", 't', 0, G_OPTION_ARG_STRING, &track_name, "Track name (default testko)", NULL },
+      { "azimuthes", 'a', 0, G_OPTION_ARG_INT, &num_azimuthes, "Number of azimuthes (default 1024)", NULL },
+      { "frame-rows", 'f', 0, G_OPTION_ARG_INT, &frame_rows, "Rows per channel between frames (default 4)", NULL },
+      { "width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width (default 1024)", NULL },
+      { "height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height (default 1024)", NULL },
+      { "no-gl", 0, 0, G_OPTION_ARG_NONE, &no_gl, "Do not render frames", NULL },
+      { NULL }
+    };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+    option_context = g_option_context_new ("<db-uri>");
+    g_option_context_set_help_enabled (option_context, TRUE);
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse_strv (option_context, &args, &error))
+      {
+        g_print ("%s\n", error->message);
+        return -1;
+      }
+
+    if (g_strv_length (args) == 2)
+      db_uri = g_strdup (args[1]);
+
+    g_option_context_free (option_context);
+    g_strfreev (args);
+  }
+
+  if (frame_rows < 1)
+    frame_rows = 1;
+
+  db = hyscan_db_new (db_uri);
+  if (db == NULL)
+    g_error ("can't open db %s", db_uri);
+
+  cache = HYSCAN_CACHE (hyscan_cached_new (512));
+
+  for (i = 0; i < N_STAGES; i++)
+    stages[i] = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  /* Показания датчика угла. */
+  nmea = hyscan_nmea_data_new (db, cache, project_name, track_name, SENSOR_CHANNEL);
+  if (nmea == NULL || !hyscan_nmea_data_get_range (nmea, &first, &last))
+    g_error ("can't open nmea data, run gen-gliko-test-data first");
+
+  angles = g_array_new (FALSE, FALSE, sizeof (Angle));
+  start_time = g_get_monotonic_time ();
+  for (index = first; index <= last; index++)
+    {
+      const gchar *sentence;
+      gint64 stage_start;
+      Angle angle;
+
+      stage_start = g_get_monotonic_time ();
+      sentence = hyscan_nmea_data_get (nmea, index, &angle.time);
+      if (hyscan_gtk_gliko_feed_parse_angle (sentence, &angle.value))
+        g_array_append_val (angles, angle);
+      stage_add (stages[STAGE_NMEA], stage_start);
+    }
+  ingest_time += 1e-6 * (g_get_monotonic_time () - start_time);
+
+  if (angles->len < 2)
+    g_error ("not enough rotation data");
+
+  /* Каналы акустических данных. */
+  channel[0].source = HYSCAN_SOURCE_SIDE_SCAN_STARBOARD;
+  channel[1].source = HYSCAN_SOURCE_SIDE_SCAN_PORT;
+  for (c = 0; c < 2; c++)
+    {
+      Channel *ch = &channel[c];
+      gint64 time;
+
+      ch->data = hyscan_acoustic_data_new (db, cache, project_name, track_name, ch->source, 1, FALSE);
+      if (ch->data == NULL || !hyscan_acoustic_data_get_range (ch->data, &ch->first, &ch->last))
+        g_error ("can't open acoustic data, run gen-gliko-test-data first");
+
+      hyscan_acoustic_data_get_size_time (ch->data, ch->first, &ch->length, &time);
+      ch->data_rate = hyscan_acoustic_data_get_info (ch->data).data_rate;
+      ch->angle_index = 0;
+    }
+
+  /* Индикатор настраивается по каналу с максимальной дальностью. */
+  iko_length = MAX (channel[0].length, channel[1].length);
+
+  area = hyscan_gtk_gliko_area_new ();
+  grid = hyscan_gtk_gliko_grid_new ();
+
+  for (c = 0; c < 2; c++)
+    {
+      Channel *ch = &channel[c];
+
+      ch->feed.area = area;
+      ch->feed.channel = c;
+      ch->feed.num_azimuthes = num_azimuthes;
+      ch->feed.length = iko_length;
+      ch->feed.buffer = g_malloc0 (iko_length * sizeof (gfloat));
+      ch->feed.azimuth = 0;
+      ch->feed.azimuth_displayed = FALSE;
+    }
+
+  use_gl = !no_gl && gliko_gl_context_create (width, height, &display, &context);
+  if (!no_gl && !use_gl)
+    g_message ("Surfaceless EGL context is not available");
+  if (!use_gl)
+    g_message ("Indicator textures are not created, only data reading is measured");
+
+  if (use_gl)
+    {
+      hyscan_gtk_gliko_layer_realize (HYSCAN_GTK_GLIKO_LAYER (area));
+      hyscan_gtk_gliko_layer_realize (HYSCAN_GTK_GLIKO_LAYER (grid));
+      hyscan_gtk_gliko_layer_resize (HYSCAN_GTK_GLIKO_LAYER (area), width, height);
+      hyscan_gtk_gliko_layer_resize (HYSCAN_GTK_GLIKO_LAYER (grid), width, height);
+    }
+
+  hyscan_gtk_gliko_area_init_dimension (area, num_azimuthes, iko_length);
+  if (channel[0].length >= channel[1].length)
+    g_object_set (area, "gliko-freq1", 1.0f, "gliko-freq2", (gfloat) (channel[0].data_rate / channel[1].data_rate), NULL);
+  else
+    g_object_set (area, "gliko-freq1", (gfloat) (channel[1].data_rate / channel[0].data_rate), "gliko-freq2", 1.0f, NULL);
+
+  /* Первый кадр создаёт текстуры и заполняет указатели функций OpenGL. */
+  if (use_gl)
+    {
+      hyscan_gtk_gliko_layer_render (HYSCAN_GTK_GLIKO_LAYER (area), NULL);
+      hyscan_gtk_gliko_layer_render (HYSCAN_GTK_GLIKO_LAYER (grid), NULL);
+      glFinish ();
+      install_gl_hooks ();
+    }
+
+  /* Воспроизведение строк обоих каналов в порядке записи. */
+  start_time = g_get_monotonic_time ();
+  for (index = 0; ; index++)
+    {
+      gboolean done = TRUE;
+
+      for (c = 0; c < 2; c++)
+        {
+          Channel *ch = &channel[c];
+          const gfloat *amplitudes;
+          guint32 length;
+          gint64 time, stage_start;
+
+          if (ch->first + index > ch->last)
+            continue;
+          done = FALSE;
+
+          stage_start = g_get_monotonic_time ();
+          if (!hyscan_acoustic_data_get_size_time (ch->data, ch->first + index, &length, &time))
+            continue;
+          stage_add (stages[STAGE_INDEX], stage_start);
+
+          stage_start = g_get_monotonic_time ();
+          amplitudes = hyscan_acoustic_data_get_amplitude (ch->data, NULL, ch->first + index, &length, &time);
+          stage_add (stages[STAGE_AMPLITUDE], stage_start);
+          if (amplitudes == NULL)
+            continue;
+
+          n_rows++;
+
+          /* Без текстур индикатор отбрасывает строки, время их передачи не показательно. */
+          if (!use_gl)
+            continue;
+
+          stage_start = g_get_monotonic_time ();
+          hyscan_gtk_gliko_feed_put (&ch->feed, angle_at (angles, &ch->angle_index, time), amplitudes, length);
+          stage_add (stages[STAGE_SET_DATA], stage_start);
+        }
+
+      if (done)
+        break;
+
+      if (use_gl && (index + 1) % frame_rows == 0)
+        {
+          gint64 stage_start;
+
+          ingest_time += 1e-6 * (g_get_monotonic_time () - start_time);
+
+          stage_start = g_get_monotonic_time ();
+          hyscan_gtk_gliko_area_fade (area);
+          hyscan_gtk_gliko_layer_render (HYSCAN_GTK_GLIKO_LAYER (area), NULL);
+          hyscan_gtk_gliko_layer_render (HYSCAN_GTK_GLIKO_LAYER (grid), NULL);
+          glFinish ();
+          stage_add (stages[STAGE_RENDER], stage_start);
+          n_frames++;
+
+          start_time = g_get_monotonic_time ();
+        }
+    }
+  ingest_time += 1e-6 * (g_get_monotonic_time () - start_time);
+
+  total_time = ingest_time;
+  for (i = 0; i < (gint) stages[STAGE_RENDER]->len; i++)
+    total_time += 1e-6 * g_array_index (stages[STAGE_RENDER], gdouble, i);
+
+  g_print ("Project %s, track %s: %u rows of %u samples, %d azimuthes\n",
+           project_name, track_name, n_rows, iko_length, num_azimuthes);
+  if (use_gl)
+    {
+      g_print ("Ingest: %.1f rows/s; with rendering of %u frames: %.1f rows/s\n",
+               n_rows / ingest_time, n_frames, n_rows / total_time);
+    }
+  else
+    {
+      g_print ("Read: %.1f rows/s; ingest into the indicator is not measured without OpenGL\n",
+               n_rows / ingest_time);
+    }
+
+  g_print ("Stage latency:\n");
+  for (i = 0; i < N_STAGES; i++)
+    stage_print (stage_names[i], stages[i]);
+
+  if (n_frames > 0)
+    {
+      g_print ("GL calls per frame:\n");
+      for (i = 0; i < N_GL_CALLS; i++)
+        g_print ("  %-20s %8.1f\n", gl_call_names[i], (gdouble) gl_calls[i] / n_frames);
+    }
+
+  g_object_unref (grid);
+  g_object_unref (area);
+  if (use_gl)
+    gliko_gl_context_destroy (display, context);
+
+  for (c = 0; c < 2; c++)
+    {
+      g_object_unref (channel[c].data);
+      g_free (channel[c].feed.buffer);
+    }
+  for (i = 0; i < N_STAGES; i++)
+    g_array_free (stages[i], TRUE);
+  g_array_free (angles, TRUE);
+  g_object_unref (nmea);
+  g_object_unref (cache);
+  g_object_unref (db);
+
+  return 0;
+}
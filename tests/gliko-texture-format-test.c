@@ -0,0 +1,229 @@
+/*
+Тест форматов хранения амплитуд в текстурах индикатора кругового обзора
+
+Рисует одни и те же данные в HyScanGtkGlikoArea с текстурами GL_R32F, GL_R16F
+и GL_R8 в контексте OpenGL без окна (EGL surfaceless) и сравнивает полученные
+изображения с изображением для GL_R32F. Изображения рисуются на разных уровнях
+детализации; для GL_R8 второй канал хранится с масштабом больше единицы.
+
+$ cd ~/hyscan/bin
+$ LIBGL_ALWAYS_SOFTWARE=1 ./gliko-texture-format-test
+
+Шум в данных воспроизводим: по умолчанию используется начальное значение
+DEFAULT_SEED, другое значение задаётся параметром --seed.
+
+$ LIBGL_ALWAYS_SOFTWARE=1 ./gliko-texture-format-test --seed 7
+
+*/
+
+#include <hyscan-gtk-gliko-area.h>
+#include <math.h>
+#include <string.h>
+
+#include "gliko-gl-context.h"
+
+#define N_AZIMUTHES      1024      /* Число азимутов. */
+#define N_DISTANCES      2000      /* Число отсчётов в строке. */
+#define FRAME_SIZE       512       /* Размер изображения. */
+#define GAIN2            4.0f      /* Масштаб амплитуд второго канала в 8-битных текстурах. */
+#define MAX_AMPLITUDE2   0.25f     /* Максимальная амплитуда второго канала. */
+#define DEFAULT_SEED     1         /* Начальное значение генератора шума по умолчанию. */
+
+/* Допустимое отличие цвета пикселя от изображения GL_R32F: ошибка округления
+ * GL_R16F и GL_R8 даёт до единицы в цвете от каждого из двух каналов. На llvmpipe
+ * наблюдаются отличия до 1 для GL_R16F и до 2 для GL_R8. */
+static const gint tolerance[] = { 0, 1, 2 };
+static const gchar *format_names[] = { "R32F", "R16F", "R8" };
+static const gint sample_sizes[] = { 4, 2, 1 };
+
+/* Масштабы изображения, при которых используются разные уровни детализации. */
+static const gfloat scales[] = { 0.1f, 0.2f, 1.0f };
+
+/* Записывает в индикатор строки с плавно меняющимися амплитудами и шумом.
+ * Второй канал записывается только в половину азимутов, чтобы на изображении
+ * был виден и первый канал. */
+static void
+fill_area (HyScanGtkGlikoArea *area,
+           guint32             seed)
+{
+  GRand *rand;
+  gfloat *row;
+  guint a, d;
+
+  rand = g_rand_new_with_seed (seed);
+  row = g_new (gfloat, N_DISTANCES);
+
+  for (a = 0; a < N_AZIMUTHES; a++)
+    {
+      for (d = 0; d < N_DISTANCES; d++)
+        {
+          gdouble v = 0.5 + 0.3 * sin (0.01 * d + 0.02 * a) + 0.2 * g_rand_double_range (rand, -1.0, 1.0);
+
+          row[d] = CLAMP (v, 0.0, 1.0);
+        }
+      hyscan_gtk_gliko_area_set_data (area, 0, a, row);
+
+      if (a >= N_AZIMUTHES / 2)
+        continue;
+
+      for (d = 0; d < N_DISTANCES; d++)
+        row[d] *= MAX_AMPLITUDE2;
+      hyscan_gtk_gliko_area_set_data (area, 1, a, row);
+    }
+
+  g_free (row);
+  g_rand_free (rand);
+}
+
+/* Рисует изображение и считывает его из буфера кадра. */
+static void
+render (HyScanGtkGlikoArea *area,
+        guint8             *pixels)
+{
+  glClearColor (0.0f, 0.0f, 0.0f, 1.0f);
+  glClear (GL_COLOR_BUFFER_BIT);
+  hyscan_gtk_gliko_layer_render (HYSCAN_GTK_GLIKO_LAYER (area), NULL);
+  glReadPixels (0, 0, FRAME_SIZE, FRAME_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  g_assert_cmpuint (glGetError (), ==, GL_NO_ERROR);
+}
+
+/* Доля пикселей изображения, отличающихся от чёрного фона. */
+static gdouble
+lit_fraction (const guint8 *pixels)
+{
+  guint i, n_lit = 0;
+
+  for (i = 0; i < FRAME_SIZE * FRAME_SIZE; i++)
+    n_lit += (pixels[4 * i] | pixels[4 * i + 1] | pixels[4 * i + 2]) != 0 ? 1 : 0;
+
+  return (gdouble) n_lit / (FRAME_SIZE * FRAME_SIZE);
+}
+
+/* Объём памяти текстур амплитуд обоих каналов со всеми уровнями детализации, МБ. */
+static gdouble
+texture_memory (gint sample_size)
+{
+  gsize size = 0;
+  guint na, nd, j;
+
+  for (na = 1; na < N_AZIMUTHES; na <<= 1)
+    ;
+  for (nd = 1; nd < N_DISTANCES; nd <<= 1)
+    ;
+  for (j = nd; j > 256; j >>= 1)
+    size += (gsize) na * j;
+
+  return 2.0 * size * sample_size / (1024.0 * 1024.0);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanGtkGlikoArea *area;
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  guint8 *expected, *result;
+  gdouble lit;
+  guint i, s;
+  gint format;
+  gint seed = DEFAULT_SEED;
+
+  {
+    gchar **args;
+    GError *error = NULL;
+    GOptionContext *option_context;
+    GOptionEntry entries[] = {
+      { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Noise seed (default 1)", NULL },
+      { NULL }
+    };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+    option_context = g_option_context_new (NULL);
+    g_option_context_set_help_enabled (option_context, TRUE);
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse_strv (option_context, &args, &error))
+      {
+        g_print ("%s\n", error->message);
+        return -1;
+      }
+
+    g_option_context_free (option_context);
+    g_strfreev (args);
+  }
+
+  if (!gliko_gl_context_create (FRAME_SIZE, FRAME_SIZE, &display, &context))
+    {
+      g_message ("Surfaceless EGL context is not available, test skipped");
+      return 0;
+    }
+
+  g_message ("GL renderer: %s, noise seed %d", glGetString (GL_RENDERER), seed);
+
+  area = hyscan_gtk_gliko_area_new ();
+  hyscan_gtk_gliko_layer_realize (HYSCAN_GTK_GLIKO_LAYER (area));
+  hyscan_gtk_gliko_layer_resize (HYSCAN_GTK_GLIKO_LAYER (area), FRAME_SIZE, FRAME_SIZE);
+  hyscan_gtk_gliko_area_init_dimension (area, N_AZIMUTHES, N_DISTANCES);
+  g_object_set (area,
+                "gliko-color1-rgb", "#FF8000",
+                "gliko-color2-rgb", "#00FF80",
+                "gliko-texture-gain2", GAIN2,
+                NULL);
+
+  /* Первый кадр создаёт текстуры, после этого индикатор принимает строки. */
+  expected = g_malloc (4 * FRAME_SIZE * FRAME_SIZE);
+  result = g_malloc (4 * FRAME_SIZE * FRAME_SIZE);
+  render (area, expected);
+  fill_area (area, seed);
+
+  for (s = 0; s < G_N_ELEMENTS (scales); s++)
+    {
+      g_object_set (area, "gliko-scale", scales[s], "gliko-texture-format", HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32, NULL);
+      render (area, expected);
+      lit = lit_fraction (expected);
+      g_message ("scale %.1f: %.1f%% of pixels are lit", scales[s], 100.0 * lit);
+      g_assert_cmpfloat (lit, >, 0.5);
+
+      for (format = HYSCAN_GTK_GLIKO_TEXTURE_FLOAT16; format <= HYSCAN_GTK_GLIKO_TEXTURE_UNORM8; format++)
+        {
+          guint n_different = 0;
+          gint max_diff = 0;
+
+          g_object_set (area, "gliko-texture-format", format, NULL);
+          render (area, result);
+
+          for (i = 0; i < 4 * FRAME_SIZE * FRAME_SIZE; i++)
+            {
+              gint diff = ABS ((gint) expected[i] - (gint) result[i]);
+
+              max_diff = MAX (max_diff, diff);
+              n_different += (diff > 0) ? 1 : 0;
+            }
+
+          g_message ("scale %.1f, %-4s: max difference %d, %.2f%% of color components differ",
+                     scales[s], format_names[format], max_diff,
+                     100.0 * n_different / (4 * FRAME_SIZE * FRAME_SIZE));
+
+          g_assert_cmpint (max_diff, <=, tolerance[format]);
+        }
+    }
+
+  for (format = HYSCAN_GTK_GLIKO_TEXTURE_FLOAT32; format <= HYSCAN_GTK_GLIKO_TEXTURE_UNORM8; format++)
+    {
+      g_message ("%-4s: texture memory %.1f MB for %d azimuthes, %d samples",
+                 format_names[format], texture_memory (sample_sizes[format]), N_AZIMUTHES, N_DISTANCES);
+    }
+
+  g_object_unref (area);
+  gliko_gl_context_destroy (display, context);
+  g_free (result);
+  g_free (expected);
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,240 @@
+/* gtk-map-tiled-test.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Тест производительности отрисовки тайлового слоя HyScanGtkMapTiled.
+ *
+ * Заполняет кэш слоя заданным числом тайлов, после чего многократно рисует
+ * видимую область и выводит среднее время отрисовки одного кадра. */
+
+#include <hyscan-gtk-map.h>
+#include <hyscan-gtk-map-tiled.h>
+
+#define WINDOW_WIDTH     1024      /* Ширина окна. */
+#define WINDOW_HEIGHT    768       /* Высота окна. */
+#define TILE_SIZE        256       /* Размер тайла, совпадает с размером в HyScanGtkMapTiled. */
+#define FILL_IDLE        0.02      /* Время без новых тайлов, после которого заполнение считается завершённым, с. */
+
+/* Тайловый слой, заливающий тайлы сплошным цветом. */
+typedef HyScanGtkMapTiled BenchTiled;
+typedef HyScanGtkMapTiledClass BenchTiledClass;
+
+G_DEFINE_TYPE (BenchTiled, bench_tiled, HYSCAN_TYPE_GTK_MAP_TILED)
+
+static gint fill_count = 0;        /* Число заполненных тайлов. */
+
+static void
+bench_tiled_fill_tile (HyScanGtkMapTiled *tiled_layer,
+                       HyScanMapTile     *tile,
+                       GCancellable      *cancellable)
+{
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  guint tile_size;
+
+  tile_size = hyscan_map_tile_get_size (tile);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tile_size, tile_size);
+  cairo = cairo_create (surface);
+  cairo_set_source_rgba (cairo, 0.2, 0.4, 0.8, 0.5);
+  cairo_paint (cairo);
+  cairo_destroy (cairo);
+
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
+  g_atomic_int_inc (&fill_count);
+}
+
+static void
+bench_tiled_class_init (BenchTiledClass *klass)
+{
+  klass->fill_tile = bench_tiled_fill_tile;
+}
+
+static void
+bench_tiled_init (BenchTiled *tiled)
+{
+}
+
+/* Обрабатывает накопившиеся события GTK. */
+static void
+process_events (void)
+{
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+}
+
+/* Рисует слой и ждёт, пока прекратится заполнение тайлов видимой области. */
+static void
+fill_view (HyScanGtkMapTiled *layer,
+           cairo_t           *cairo)
+{
+  GTimer *timer;
+  gint count;
+
+  hyscan_gtk_map_tiled_draw (layer, cairo);
+
+  timer = g_timer_new ();
+  count = g_atomic_int_get (&fill_count);
+  while (g_timer_elapsed (timer, NULL) < FILL_IDLE)
+    {
+      g_usleep (1000);
+      if (count == g_atomic_int_get (&fill_count))
+        continue;
+
+      count = g_atomic_int_get (&fill_count);
+      g_timer_start (timer);
+    }
+
+  g_timer_destroy (timer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanGeoPoint center = { .lat = 55.0, .lon = 38.0 };
+  GtkWidget *window;
+  GtkWidget *map;
+  HyScanGtkMapTiled *layer;
+  GtkCifroArea *carea;
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  GTimer *timer;
+
+  gdouble *scales;
+  gint scales_len;
+  gdouble from_x, to_x, from_y, to_y;
+  gdouble scale_x, scale_y;
+  gdouble step_x, step_y;
+  guint view_x, view_y, views_x, views_y;
+  guint i;
+
+  guint n_tiles = 10000;
+  guint n_frames = 100;
+
+  {
+    gchar **args;
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] =
+      {
+        { "tiles",  't', 0, G_OPTION_ARG_INT, &n_tiles,  "Number of tiles in cache", NULL },
+        { "frames", 'f', 0, G_OPTION_ARG_INT, &n_frames, "Number of frames to draw", NULL },
+        { NULL }
+      };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+
+    context = g_option_context_new ("");
+    g_option_context_set_summary (context, "Benchmark of HyScanGtkMapTiled drawing with full tile cache");
+    g_option_context_set_help_enabled (context, TRUE);
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_set_ignore_unknown_options (context, FALSE);
+
+    if (!g_option_context_parse_strv (context, &args, &error))
+      {
+        g_message ("%s", error->message);
+        return -1;
+      }
+
+    g_option_context_free (context);
+    g_strfreev (args);
+  }
+
+  if (!gtk_init_check (&argc, &argv))
+    {
+      g_print ("Display is not available, benchmark skipped\n");
+      return 0;
+    }
+
+  /* Карта в окне за пределами экрана. */
+  map = hyscan_gtk_map_new (center);
+  scales = hyscan_gtk_map_create_scales2 (1.0 / 1000, HYSCAN_GTK_MAP_EQUATOR_LENGTH / 1000, 4, &scales_len);
+  hyscan_gtk_map_set_scales_meter (HYSCAN_GTK_MAP (map), scales, scales_len);
+  g_free (scales);
+
+  layer = g_object_new (bench_tiled_get_type (), "cache-size", n_tiles, NULL);
+  hyscan_gtk_layer_container_add (HYSCAN_GTK_LAYER_CONTAINER (map), HYSCAN_GTK_LAYER (layer), "tiled");
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), WINDOW_WIDTH, WINDOW_HEIGHT);
+  gtk_container_add (GTK_CONTAINER (window), map);
+  gtk_widget_show_all (window);
+  process_events ();
+
+  carea = GTK_CIFRO_AREA (map);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, WINDOW_WIDTH, WINDOW_HEIGHT);
+  cairo = cairo_create (surface);
+
+  /* Сдвигаем видимую область на её размер, пока в кэше не окажется n_tiles тайлов. */
+  gtk_cifro_area_get_view (carea, &from_x, &to_x, &from_y, &to_y);
+  gtk_cifro_area_get_scale (carea, &scale_x, &scale_y);
+  views_x = WINDOW_WIDTH / TILE_SIZE;
+  views_y = WINDOW_HEIGHT / TILE_SIZE;
+  step_x = views_x * TILE_SIZE * scale_x;
+  step_y = views_y * TILE_SIZE * scale_y;
+
+  timer = g_timer_new ();
+  for (view_y = 0; (guint) g_atomic_int_get (&fill_count) < n_tiles; ++view_y)
+    {
+      for (view_x = 0; view_x < 10 && (guint) g_atomic_int_get (&fill_count) < n_tiles; ++view_x)
+        {
+          gtk_cifro_area_set_view (carea,
+                                   from_x + view_x * step_x, to_x + view_x * step_x,
+                                   from_y + view_y * step_y, to_y + view_y * step_y);
+          fill_view (layer, cairo);
+        }
+    }
+  g_print ("Filled %d tiles in %.3f s\n", g_atomic_int_get (&fill_count), g_timer_elapsed (timer, NULL));
+
+  /* Рисуем последнюю видимую область, все её тайлы уже есть в кэше. */
+  process_events ();
+  g_timer_start (timer);
+  for (i = 0; i < n_frames; ++i)
+    hyscan_gtk_map_tiled_draw (layer, cairo);
+
+  g_print ("Cache size %u tiles, average draw time %.3f ms\n",
+           n_tiles, 1e3 * g_timer_elapsed (timer, NULL) / n_frames);
+
+  g_timer_destroy (timer);
+  cairo_destroy (cairo);
+  cairo_surface_destroy (surface);
+  gtk_widget_destroy (window);
+
+  return 0;
+}
@@ -0,0 +1,216 @@
+/* Тест производительности рисования галсов HyScanGtkMapTrackDraw.
+ *
+ * Загружает галсы из базы данных и рисует тайлы, покрывающие их область,
+ * в нескольких масштабах - от обзорного до детального. Выводит среднее время
+ * рисования одного тайла для каждого способа рисования. Окно не создаётся,
+ * тайлы рисуются на поверхности cairo в памяти. */
+
+#include <hyscan-cached.h>
+#include <hyscan-proj.h>
+#include <hyscan-gtk-map-track-draw-bar.h>
+#include <hyscan-gtk-map-track-draw-beam.h>
+#include <math.h>
+
+#define TILE_SIZE        256       /* Размер тайла. */
+#define MAX_TILES        1024      /* Максимальное число тайлов в одном масштабе. */
+#define N_LEVELS         5         /* Число масштабов, каждый следующий в 4 раза крупнее. */
+#define LOAD_TIMEOUT     30.0      /* Время ожидания загрузки галсов, с. */
+
+/* Ждёт загрузки галсов и определяет их общую область. */
+static gboolean
+wait_tracks (HyScanMapTrackModel  *model,
+             gchar               **track_names,
+             HyScanGeoCartesian2D *from,
+             HyScanGeoCartesian2D *to)
+{
+  GTimer *timer;
+  gboolean loaded = FALSE;
+
+  timer = g_timer_new ();
+  while (!loaded && g_timer_elapsed (timer, NULL) < LOAD_TIMEOUT)
+    {
+      guint i;
+
+      from->x = from->y = G_MAXDOUBLE;
+      to->x = to->y = -G_MAXDOUBLE;
+
+      loaded = TRUE;
+      for (i = 0; loaded && track_names[i] != NULL; i++)
+        {
+          HyScanMapTrackModelInfo *info;
+          HyScanGeoCartesian2D track_from, track_to;
+
+          info = hyscan_map_track_model_lock (model, track_names[i]);
+          if (info == NULL)
+            {
+              loaded = FALSE;
+              break;
+            }
+
+          loaded = hyscan_map_track_view (info->track, &track_from, &track_to);
+          hyscan_map_track_model_unlock (info);
+
+          from->x = MIN (from->x, MIN (track_from.x, track_to.x));
+          from->y = MIN (from->y, MIN (track_from.y, track_to.y));
+          to->x = MAX (to->x, MAX (track_from.x, track_to.x));
+          to->y = MAX (to->y, MAX (track_from.y, track_to.y));
+        }
+
+      if (!loaded)
+        g_usleep (G_USEC_PER_SEC / 10);
+    }
+
+  g_timer_destroy (timer);
+
+  return loaded;
+}
+
+/* Рисует тайлы области from - to с размером тайла tile_length единиц карты. */
+static void
+bench_level (HyScanGtkMapTrackDraw *track_draw,
+             const gchar           *draw_name,
+             gchar                **track_names,
+             HyScanGeoCartesian2D  *from,
+             HyScanGeoCartesian2D  *to,
+             gdouble                tile_length)
+{
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  GTimer *timer;
+  gdouble scale;
+  guint n_x, n_y, n_tiles, step;
+  guint n_drawn = 0;
+  guint i, j;
+
+  scale = tile_length / TILE_SIZE;
+  n_x = (guint) ceil ((to->x - from->x) / tile_length);
+  n_y = (guint) ceil ((to->y - from->y) / tile_length);
+  n_x = MAX (n_x, 1);
+  n_y = MAX (n_y, 1);
+  n_tiles = n_x * n_y;
+
+  /* При большом числе тайлов рисуем только каждый step-ый. */
+  step = (n_tiles + MAX_TILES - 1) / MAX_TILES;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, TILE_SIZE, TILE_SIZE);
+  cairo = cairo_create (surface);
+
+  timer = g_timer_new ();
+  for (i = 0; i < n_tiles; i += step)
+    {
+      HyScanGeoCartesian2D tile_from, tile_to;
+
+      /* Вершины тайла в том же порядке, что и в HyScanMapTile. */
+      tile_from.x = from->x + (i % n_x) * tile_length;
+      tile_from.y = from->y + (i / n_x + 1) * tile_length;
+      tile_to.x = tile_from.x + tile_length;
+      tile_to.y = tile_from.y - tile_length;
+
+      cairo_set_operator (cairo, CAIRO_OPERATOR_CLEAR);
+      cairo_paint (cairo);
+      cairo_set_operator (cairo, CAIRO_OPERATOR_OVER);
+
+      for (j = 0; track_names[j] != NULL; j++)
+        hyscan_gtk_map_track_draw_region (track_draw, track_names[j], cairo, scale, &tile_from, &tile_to, NULL);
+
+      n_drawn++;
+    }
+  cairo_surface_flush (surface);
+
+  g_print ("%-5s %4u x %-4u tiles, scale %10.3f m/px: %5u tiles drawn, %.3f ms per tile\n",
+           draw_name, n_x, n_y, scale, n_drawn, 1e3 * g_timer_elapsed (timer, NULL) / n_drawn);
+
+  g_timer_destroy (timer);
+  cairo_destroy (cairo);
+  cairo_surface_destroy (surface);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  gchar *db_uri = NULL;
+  gchar *project_name = NULL;
+  gchar **track_names = NULL;
+
+  HyScanDB *db;
+  HyScanCache *cache;
+  HyScanGeoProjection *projection;
+  HyScanMapTrackModel *track_model;
+  HyScanGtkMapTrackDraw *draw_bar, *draw_beam;
+  HyScanGeoCartesian2D from, to;
+  gdouble tile_length;
+  guint i;
+
+  /* Разбор командной строки. */
+  {
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] =
+      {
+        { "db-uri",          'd', 0, G_OPTION_ARG_STRING, &db_uri,            "Database uri", NULL},
+        { "tracks",          't', 0, G_OPTION_ARG_STRING_ARRAY, &track_names, "Track names", NULL},
+        { "project-name",    'p', 0, G_OPTION_ARG_STRING, &project_name,      "Project name", NULL},
+        { NULL }
+      };
+
+    context = g_option_context_new ("");
+    g_option_context_set_summary (context, "Benchmark of map track drawing");
+    g_option_context_set_help_enabled (context, TRUE);
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_set_ignore_unknown_options (context, FALSE);
+
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+      {
+        g_message ("%s", error->message);
+        return -1;
+      }
+
+    if (db_uri == NULL || project_name == NULL || track_names == NULL)
+      {
+        g_print ("%s", g_option_context_get_help (context, FALSE, NULL));
+        return 0;
+      }
+
+    g_option_context_free (context);
+  }
+
+  db = hyscan_db_new (db_uri);
+  if (db == NULL)
+    g_error ("Failed to open database %s", db_uri);
+
+  cache = HYSCAN_CACHE (hyscan_cached_new (500));
+  projection = hyscan_proj_new (HYSCAN_PROJ_WEBMERC);
+
+  track_model = hyscan_map_track_model_new (db, cache);
+  hyscan_map_track_model_set_projection (track_model, projection);
+  hyscan_map_track_model_set_project (track_model, project_name);
+  hyscan_map_track_model_set_tracks (track_model, track_names);
+
+  draw_bar = hyscan_gtk_map_track_draw_bar_new (track_model);
+  draw_beam = hyscan_gtk_map_track_draw_beam_new (track_model);
+
+  if (!wait_tracks (track_model, track_names, &from, &to))
+    g_error ("Failed to load tracks");
+
+  /* Обзорный масштаб: вся область галсов помещается в один тайл. */
+  tile_length = MAX (to.x - from.x, to.y - from.y);
+  for (i = 0; i < N_LEVELS; i++)
+    {
+      bench_level (draw_bar, "bar", track_names, &from, &to, tile_length);
+      bench_level (draw_beam, "beam", track_names, &from, &to, tile_length);
+      tile_length /= 4.0;
+    }
+
+  g_object_unref (draw_bar);
+  g_object_unref (draw_beam);
+  g_object_unref (track_model);
+  g_object_unref (projection);
+  g_object_unref (cache);
+  g_object_unref (db);
+  g_free (db_uri);
+  g_free (project_name);
+  g_strfreev (track_names);
+
+  return 0;
+}
@@ -0,0 +1,484 @@
+/* gtk-map-wfmark-test.c
+ *
+ * Copyright 2019 Screen LLC, Alexey Sakhnov <alexsakhnov@gmail.com>
+ *
+ * This file is part of HyScanGui library.
+ *
+ * HyScanGui is dual-licensed: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HyScanGui is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Alternatively, you can license this code under a commercial license.
+ * Contact the Screen LLC in this case - <info@screen-co.ru>.
+ */
+
+/* HyScanGui имеет двойную лицензию.
+ *
+ * Во-первых, вы можете распространять HyScanGui на условиях Стандартной
+ * Общественной Лицензии GNU версии 3, либо по любой более поздней версии
+ * лицензии (по вашему выбору). Полные положения лицензии GNU приведены в
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Во-вторых, этот программный код можно использовать по коммерческой
+ * лицензии. Для этого свяжитесь с ООО Экран - <info@screen-co.ru>.
+ */
+
+/* Тест производительности отрисовки слоя меток водопада HyScanGtkMapWfmark.
+ *
+ * При указании галса добавляет в проект заданное число меток, равномерно
+ * распределённых по галсу. Затем показывает все метки проекта, дожидается
+ * генерации их акустических изображений и выводит среднее время отрисовки
+ * кадра без кэша изображений меток и с ним. По завершении теста добавленные
+ * метки удаляются из проекта. */
+
+#include <hyscan-gtk-map.h>
+#include <hyscan-gtk-map-wfmark.h>
+#include <hyscan-cached.h>
+#include <hyscan-object-model.h>
+#include <hyscan-object-data-wfmark.h>
+#include <hyscan-acoustic-data.h>
+#include <hyscan-cartesian.h>
+
+#define WINDOW_WIDTH     1024      /* Ширина окна. */
+#define WINDOW_HEIGHT    768       /* Высота окна. */
+#define MARK_SIZE        10.0      /* Размер метки, м. */
+#define LOAD_TIMEOUT     30.0      /* Максимальное время загрузки меток, с. */
+#define FILL_IDLE        0.5       /* Время без перерисовок, после которого генерация изображений считается завершённой, с. */
+
+static gint draw_count = 0;        /* Число отрисовок карты. */
+
+/* Считает отрисовки карты. */
+static void
+count_draw (void)
+{
+  draw_count++;
+}
+
+/* Обрабатывает накопившиеся события GTK. */
+static void
+process_events (void)
+{
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+}
+
+/* Определяет идентификатор галса. */
+static gchar *
+get_track_id (HyScanDB    *db,
+              const gchar *project,
+              const gchar *track)
+{
+  HyScanParamList *list;
+  gchar *track_id_str = NULL;
+  gint32 project_id, track_id, param_id;
+
+  project_id = hyscan_db_project_open (db, project);
+  track_id = project_id > 0 ? hyscan_db_track_open (db, project_id, track) : -1;
+  param_id = track_id > 0 ? hyscan_db_track_param_open (db, track_id) : -1;
+
+  list = hyscan_param_list_new ();
+  hyscan_param_list_add (list, "/id");
+  if (param_id > 0 && hyscan_db_param_get (db, param_id, NULL, list))
+    track_id_str = hyscan_param_list_dup_string (list, "/id");
+
+  g_object_unref (list);
+  if (param_id > 0)
+    hyscan_db_close (db, param_id);
+  if (track_id > 0)
+    hyscan_db_close (db, track_id);
+  if (project_id > 0)
+    hyscan_db_close (db, project_id);
+
+  return track_id_str;
+}
+
+/* Добавляет n_marks меток, равномерно распределённых по галсу. Метки записываются
+ * в базу данных в фоне, поэтому модель должна существовать до их загрузки.
+ * Названия меток начинаются с prefix. */
+static HyScanObjectModel *
+add_marks (HyScanDB    *db,
+           HyScanCache *cache,
+           const gchar *project_name,
+           const gchar *track_name,
+           const gchar *prefix,
+           guint        n_marks)
+{
+  HyScanObjectModel *model;
+  HyScanAcousticData *data;
+  gchar *track_id;
+  guint32 first, last;
+  guint i;
+
+  track_id = get_track_id (db, project_name, track_name);
+  if (track_id == NULL)
+    g_error ("Can't get id of track %s", track_name);
+
+  data = hyscan_acoustic_data_new (db, cache, project_name, track_name,
+                                   HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, 1, FALSE);
+  if (data == NULL || !hyscan_acoustic_data_get_range (data, &first, &last))
+    g_error ("Can't open starboard data of track %s", track_name);
+
+  model = hyscan_object_model_new ();
+  hyscan_object_model_set_types (model, 1, HYSCAN_TYPE_OBJECT_DATA_WFMARK);
+  hyscan_object_model_set_project (model, db, project_name);
+
+  for (i = 0; i < n_marks; i++)
+    {
+      HyScanMarkWaterfall *mark;
+      guint32 index, n_points;
+      gchar *name;
+
+      index = first + (guint64) (last - first) * i / n_marks;
+      if (!hyscan_acoustic_data_get_size_time (data, index, &n_points, NULL))
+        continue;
+
+      name = g_strdup_printf ("%s #%u", prefix, i);
+      mark = hyscan_mark_waterfall_new ();
+      hyscan_mark_set_text ((HyScanMark *) mark, name, "", "");
+      hyscan_mark_set_ctime ((HyScanMark *) mark, g_get_real_time ());
+      hyscan_mark_set_mtime ((HyScanMark *) mark, g_get_real_time ());
+      hyscan_mark_set_size ((HyScanMark *) mark, MARK_SIZE, MARK_SIZE);
+      hyscan_mark_waterfall_set_center_by_type (mark, HYSCAN_SOURCE_SIDE_SCAN_STARBOARD, index, n_points / 2);
+      hyscan_mark_waterfall_set_track (mark, track_id);
+
+      hyscan_object_store_add (HYSCAN_OBJECT_STORE (model), (const HyScanObject *) mark, NULL);
+      hyscan_mark_waterfall_free (mark);
+      g_free (name);
+    }
+
+  g_object_unref (data);
+  g_free (track_id);
+
+  return model;
+}
+
+/* Ждёт загрузки меток и возвращает их число. */
+static guint
+wait_marks (HyScanMarkLocModel *model,
+            guint               n_marks)
+{
+  GTimer *timer;
+  GHashTable *marks = NULL;
+  guint n_loaded = 0;
+
+  timer = g_timer_new ();
+  while (g_timer_elapsed (timer, NULL) < LOAD_TIMEOUT)
+    {
+      process_events ();
+      g_usleep (10000);
+
+      g_clear_pointer (&marks, g_hash_table_unref);
+      marks = hyscan_mark_loc_model_get (model);
+      if (marks != NULL && g_hash_table_size (marks) >= n_marks)
+        break;
+    }
+
+  if (marks != NULL)
+    {
+      n_loaded = g_hash_table_size (marks);
+      g_hash_table_unref (marks);
+    }
+
+  g_timer_destroy (timer);
+
+  return n_loaded;
+}
+
+/* Удаляет метки, названия которых начинаются с prefix, и ждёт их удаления из базы данных. */
+static void
+remove_marks (HyScanObjectModel  *mark_model,
+              HyScanMarkLocModel *model,
+              const gchar        *prefix)
+{
+  GHashTable *marks;
+  GHashTableIter iter;
+  HyScanMarkLocation *location;
+  const gchar *id;
+  GTimer *timer;
+  guint n_left = 0;
+
+  marks = hyscan_mark_loc_model_get (model);
+  if (marks == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, marks);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &id, (gpointer *) &location))
+    {
+      if (location->mark == NULL || !g_str_has_prefix (location->mark->name, prefix))
+        continue;
+
+      hyscan_object_store_remove (HYSCAN_OBJECT_STORE (mark_model), HYSCAN_TYPE_MARK_WATERFALL, id);
+      n_left++;
+    }
+  g_hash_table_unref (marks);
+
+  /* Метки удаляются в фоне, поэтому ждём, пока они пропадут из модели. */
+  timer = g_timer_new ();
+  do
+    {
+      process_events ();
+      g_usleep (10000);
+
+      marks = hyscan_mark_loc_model_get (model);
+      if (marks == NULL)
+        continue;
+
+      n_left = 0;
+      g_hash_table_iter_init (&iter, marks);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
+        {
+          if (location->mark != NULL && g_str_has_prefix (location->mark->name, prefix))
+            n_left++;
+        }
+      g_hash_table_unref (marks);
+    }
+  while (n_left > 0 && g_timer_elapsed (timer, NULL) < LOAD_TIMEOUT);
+
+  if (n_left > 0)
+    g_warning ("%u benchmark marks are not removed", n_left);
+
+  g_timer_destroy (timer);
+}
+
+/* Устанавливает видимую область так, чтобы были видны все метки. */
+static void
+view_marks (HyScanGtkMap       *map,
+            HyScanMarkLocModel *model)
+{
+  GHashTable *marks;
+  GHashTableIter iter;
+  HyScanMarkLocation *location;
+  HyScanGeoCartesian2D from = { G_MAXDOUBLE, G_MAXDOUBLE }, to = { -G_MAXDOUBLE, -G_MAXDOUBLE };
+
+  marks = hyscan_mark_loc_model_get (model);
+  g_hash_table_iter_init (&iter, marks);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &location))
+    {
+      HyScanGeoCartesian2D point;
+
+      if (!location->loaded)
+        continue;
+
+      hyscan_gtk_map_geo_to_value (map, location->center_geo, &point);
+      from.x = MIN (from.x, point.x);
+      from.y = MIN (from.y, point.y);
+      to.x = MAX (to.x, point.x);
+      to.y = MAX (to.y, point.y);
+    }
+  g_hash_table_unref (marks);
+
+  if (from.x > to.x)
+    return;
+
+  gtk_cifro_area_set_view (GTK_CIFRO_AREA (map), from.x, to.x, from.y, to.y);
+}
+
+/* Перерисовывает карту, пока не прекратится генерация изображений меток. */
+static void
+wait_images (GtkWidget *map,
+             cairo_t   *cairo)
+{
+  GTimer *timer;
+  gint count;
+
+  gtk_widget_draw (map, cairo);
+
+  timer = g_timer_new ();
+  count = draw_count;
+  while (g_timer_elapsed (timer, NULL) < FILL_IDLE)
+    {
+      g_usleep (10000);
+      process_events ();
+      if (count == draw_count)
+        continue;
+
+      count = draw_count;
+      g_timer_start (timer);
+    }
+
+  g_timer_destroy (timer);
+}
+
+/* Возвращает среднее время отрисовки кадра в мс. Если clear = TRUE, перед
+ * каждым кадром кэш изображений меток слоя очищается. */
+static gdouble
+bench_draw (GtkWidget          *map,
+            HyScanGtkMapWfmark *layer,
+            cairo_t            *cairo,
+            guint               n_frames,
+            gboolean            clear)
+{
+  GTimer *timer;
+  gdouble elapsed = 0.0;
+  guint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < n_frames; ++i)
+    {
+      /* Уровни по умолчанию, их установка только сбрасывает кэш. */
+      if (clear)
+        hyscan_gtk_map_wfmark_set_levels (layer, 0.0, 0.454545, 1.0);
+
+      g_timer_start (timer);
+      gtk_widget_draw (map, cairo);
+      elapsed += g_timer_elapsed (timer, NULL);
+    }
+  g_timer_destroy (timer);
+
+  return 1e3 * elapsed / n_frames;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanGeoPoint center = { .lat = 55.0, .lon = 38.0 };
+  HyScanDB *db;
+  HyScanCache *cache;
+  HyScanUnits *units;
+  HyScanObjectModel *mark_model = NULL;
+  HyScanMarkLocModel *model;
+  HyScanGtkLayer *layer;
+  GtkWidget *window;
+  GtkWidget *map;
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  gdouble *scales;
+  gint scales_len;
+  guint n_loaded;
+  gdouble uncached, cached;
+
+  gchar *prefix;
+
+  gchar *db_uri = NULL;
+  gchar *project_name = NULL;
+  gchar *track_name = NULL;
+  guint n_marks = 1000;
+  guint n_frames = 20;
+
+  {
+    gchar **args;
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] =
+      {
+        { "db",      'd', 0, G_OPTION_ARG_STRING, &db_uri,       "Database uri", NULL },
+        { "project", 'p', 0, G_OPTION_ARG_STRING, &project_name, "Project name", NULL },
+        { "track",   't', 0, G_OPTION_ARG_STRING, &track_name,   "Add marks to this track before benchmark", NULL },
+        { "marks",   'm', 0, G_OPTION_ARG_INT,    &n_marks,      "Number of marks", NULL },
+        { "frames",  'f', 0, G_OPTION_ARG_INT,    &n_frames,     "Number of frames to draw", NULL },
+        { NULL }
+      };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+
+    context = g_option_context_new ("");
+    g_option_context_set_summary (context, "Benchmark of HyScanGtkMapWfmark drawing");
+    g_option_context_set_help_enabled (context, TRUE);
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_set_ignore_unknown_options (context, FALSE);
+
+    if (!g_option_context_parse_strv (context, &args, &error))
+      {
+        g_message ("%s", error->message);
+        return -1;
+      }
+
+    if (db_uri == NULL || project_name == NULL)
+      {
+        g_print ("%s", g_option_context_get_help (context, FALSE, NULL));
+        return 0;
+      }
+
+    g_option_context_free (context);
+    g_strfreev (args);
+  }
+
+  if (!gtk_init_check (&argc, &argv))
+    {
+      g_print ("Display is not available, benchmark skipped\n");
+      return 0;
+    }
+
+  db = hyscan_db_new (db_uri);
+  if (db == NULL)
+    g_error ("Can't open db %s", db_uri);
+
+  cache = HYSCAN_CACHE (hyscan_cached_new (512));
+  units = hyscan_units_new ();
+
+  /* Метки этого запуска отличаются от остальных меток проекта по названию. */
+  prefix = g_strdup_printf ("Benchmark %" G_GINT64_FORMAT, g_get_real_time ());
+  if (track_name != NULL)
+    mark_model = add_marks (db, cache, project_name, track_name, prefix, n_marks);
+
+  /* Карта со слоем меток в окне за пределами экрана. */
+  map = hyscan_gtk_map_new (center);
+  scales = hyscan_gtk_map_create_scales2 (1.0 / 1000, HYSCAN_GTK_MAP_EQUATOR_LENGTH / 1000, 4, &scales_len);
+  hyscan_gtk_map_set_scales_meter (HYSCAN_GTK_MAP (map), scales, scales_len);
+  g_free (scales);
+
+  model = hyscan_mark_loc_model_new (db, cache);
+  hyscan_mark_loc_model_set_project (model, project_name);
+
+  layer = hyscan_gtk_map_wfmark_new (model, db, cache, units);
+  hyscan_gtk_map_wfmark_set_project (HYSCAN_GTK_MAP_WFMARK (layer), project_name);
+  hyscan_gtk_layer_container_add (HYSCAN_GTK_LAYER_CONTAINER (map), layer, "wfmark");
+  g_signal_connect (map, "visible-draw", G_CALLBACK (count_draw), NULL);
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), WINDOW_WIDTH, WINDOW_HEIGHT);
+  gtk_container_add (GTK_CONTAINER (window), map);
+  gtk_widget_show_all (window);
+  process_events ();
+
+  n_loaded = wait_marks (model, n_marks);
+  if (n_loaded < n_marks)
+    g_warning ("Only %u of %u marks are loaded", n_loaded, n_marks);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, WINDOW_WIDTH, WINDOW_HEIGHT);
+  cairo = cairo_create (surface);
+
+  /* Показываем все метки и ждём генерации их изображений. */
+  view_marks (HYSCAN_GTK_MAP (map), model);
+  process_events ();
+  wait_images (map, cairo);
+
+  uncached = bench_draw (map, HYSCAN_GTK_MAP_WFMARK (layer), cairo, n_frames, TRUE);
+  cached = bench_draw (map, HYSCAN_GTK_MAP_WFMARK (layer), cairo, n_frames, FALSE);
+
+  g_print ("Marks %u, average draw time: %.3f ms without thumbnail cache, %.3f ms with thumbnail cache\n",
+           n_loaded, uncached, cached);
+
+  cairo_destroy (cairo);
+  cairo_surface_destroy (surface);
+  gtk_widget_destroy (window);
+
+  if (mark_model != NULL)
+    remove_marks (mark_model, model, prefix);
+
+  g_clear_object (&mark_model);
+  g_object_unref (model);
+  g_object_unref (units);
+  g_object_unref (cache);
+  g_object_unref (db);
+  g_free (prefix);
+  g_free (db_uri);
+  g_free (project_name);
+  g_free (track_name);
+
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include <hyscan-map-rtree.h>
+#include <hyscan-cartesian.h>
+#include <math.h>
+
+#define N_ITEMS          2000      /* Число элементов в тесте корректности. */
+#define N_OPERATIONS     50000     /* Число операций добавления и удаления. */
+#define N_QUERIES        200       /* Число проверочных запросов. */
+#define AREA_SIZE        1000.0    /* Размер области, в которой находятся элементы. */
+#define ITEM_SIZE        10.0      /* Максимальный размер элемента. */
+
+#define BENCH_MARKS      10000     /* Число меток в тесте скорости. */
+#define BENCH_MOTIONS    10000     /* Число перемещений указателя мыши в тесте скорости. */
+#define MARK_SIZE        5.0       /* Половина размера метки в тесте скорости. */
+
+/* Метка в тесте скорости, повторяет поля HyScanGtkMapWfmarkLocation, используемые при поиске. */
+typedef struct
+{
+  HyScanGeoCartesian2D center;
+  HyScanGeoCartesian2D rect_from;
+  HyScanGeoCartesian2D rect_to;
+  HyScanGeoCartesian2D extent_from;
+  HyScanGeoCartesian2D extent_to;
+  gdouble              angle;
+} BenchMark;
+
+/* Параметры поиска метки под курсором. */
+typedef struct
+{
+  HyScanGeoCartesian2D cursor;
+  const BenchMark     *hover;
+  gdouble              min_distance;
+} HoverSearch;
+
+static HyScanGeoCartesian2D from[N_ITEMS];
+static HyScanGeoCartesian2D to[N_ITEMS];
+static gboolean present[N_ITEMS];
+static guint found[N_ITEMS];
+
+/* Отмечает найденный элемент. */
+static void
+mark_found (gpointer item,
+            gpointer user_data)
+{
+  found[GPOINTER_TO_UINT (item) - 1]++;
+}
+
+/* Проверяет пересечение элемента index с областью запроса. */
+static gboolean
+intersects (guint                       index,
+            const HyScanGeoCartesian2D *query_from,
+            const HyScanGeoCartesian2D *query_to)
+{
+  return from[index].x <= query_to->x && query_from->x <= to[index].x &&
+         from[index].y <= query_to->y && query_from->y <= to[index].y;
+}
+
+/* Сравнивает результаты поиска в индексе с полным перебором. */
+static void
+check_queries (HyScanMapRTree *rtree)
+{
+  guint n_present = 0;
+  guint i, j;
+
+  for (i = 0; i < N_ITEMS; i++)
+    n_present += present[i] ? 1 : 0;
+
+  g_assert_cmpuint (hyscan_map_rtree_get_size (rtree), ==, n_present);
+
+  for (j = 0; j < N_QUERIES; j++)
+    {
+      HyScanGeoCartesian2D query_from, query_to;
+      guint n_found, n_expected = 0;
+
+      query_from.x = g_random_double_range (0, AREA_SIZE);
+      query_from.y = g_random_double_range (0, AREA_SIZE);
+      query_to.x = query_from.x + g_random_double_range (0, 10 * ITEM_SIZE);
+      query_to.y = query_from.y + g_random_double_range (0, 10 * ITEM_SIZE);
+
+      memset (found, 0, sizeof (found));
+      n_found = hyscan_map_rtree_search (rtree, &query_from, &query_to, mark_found, NULL);
+
+      for (i = 0; i < N_ITEMS; i++)
+        {
+          guint expected = (present[i] && intersects (i, &query_from, &query_to)) ? 1 : 0;
+
+          g_assert_cmpuint (found[i], ==, expected);
+          n_expected += expected;
+        }
+
+      g_assert_cmpuint (n_found, ==, n_expected);
+    }
+}
+
+/* Проверяет результаты поиска при случайных добавлениях, обновлениях и удалениях. */
+static void
+test_random (void)
+{
+  HyScanMapRTree *rtree;
+  guint i;
+
+  rtree = hyscan_map_rtree_new ();
+
+  for (i = 0; i < N_OPERATIONS; i++)
+    {
+      guint index = g_random_int_range (0, N_ITEMS);
+      gpointer item = GUINT_TO_POINTER (index + 1);
+
+      if (g_random_int_range (0, 3) > 0)
+        {
+          /* Вершины задаются в произвольном порядке. */
+          from[index].x = g_random_double_range (0, AREA_SIZE);
+          from[index].y = g_random_double_range (0, AREA_SIZE);
+          to[index].x = from[index].x + g_random_double_range (0, ITEM_SIZE);
+          to[index].y = from[index].y + g_random_double_range (0, ITEM_SIZE);
+          if (g_random_boolean ())
+            hyscan_map_rtree_insert (rtree, item, &from[index], &to[index]);
+          else
+            hyscan_map_rtree_insert (rtree, item, &to[index], &from[index]);
+
+          present[index] = TRUE;
+        }
+      else
+        {
+          g_assert_true (hyscan_map_rtree_remove (rtree, item) == present[index]);
+          present[index] = FALSE;
+        }
+
+      if (i % (N_OPERATIONS / 10) == 0)
+        check_queries (rtree);
+    }
+
+  check_queries (rtree);
+
+  /* Удаляем все элементы по одному. */
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      if (present[i])
+        g_assert_true (hyscan_map_rtree_remove (rtree, GUINT_TO_POINTER (i + 1)));
+
+      present[i] = FALSE;
+    }
+  check_queries (rtree);
+
+  /* Очистка индекса. */
+  for (i = 0; i < N_ITEMS; i++)
+    hyscan_map_rtree_insert (rtree, GUINT_TO_POINTER (i + 1), &from[i], &to[i]);
+  g_assert_cmpuint (hyscan_map_rtree_get_size (rtree), ==, N_ITEMS);
+  hyscan_map_rtree_clear (rtree);
+  check_queries (rtree);
+
+  g_object_unref (rtree);
+}
+
+/* Проверяет, что курсор внутри повёрнутой метки, и запоминает ближайшую к курсору метку. */
+static void
+hover_check (gpointer item,
+             gpointer user_data)
+{
+  const BenchMark *mark = item;
+  HoverSearch *search = user_data;
+  HyScanGeoCartesian2D rotated;
+  gdouble distance;
+
+  hyscan_cartesian_rotate (&search->cursor, &mark->center, mark->angle, &rotated);
+  if (!hyscan_cartesian_is_point_inside (&rotated, &mark->rect_from, &mark->rect_to))
+    return;
+
+  distance = hyscan_cartesian_distance (&mark->center, &search->cursor);
+  if (distance < search->min_distance)
+    {
+      search->min_distance = distance;
+      search->hover = mark;
+    }
+}
+
+/* Сравнивает время поиска метки под курсором полным перебором и с помощью индекса. */
+static void
+bench_hover (void)
+{
+  HyScanMapRTree *rtree;
+  BenchMark *marks;
+  HyScanGeoCartesian2D *cursors;
+  GTimer *timer;
+  gdouble linear_time, rtree_time;
+  guint n_hits = 0;
+  guint i, j;
+
+  marks = g_new (BenchMark, BENCH_MARKS);
+  cursors = g_new (HyScanGeoCartesian2D, BENCH_MOTIONS);
+  rtree = hyscan_map_rtree_new ();
+
+  for (i = 0; i < BENCH_MARKS; i++)
+    {
+      BenchMark *mark = &marks[i];
+      HyScanGeoCartesian2D mark_from, mark_to;
+
+      mark->center.x = g_random_double_range (0, AREA_SIZE);
+      mark->center.y = g_random_double_range (0, AREA_SIZE);
+      mark->angle = g_random_double_range (0, 2 * G_PI);
+      mark->rect_from.x = mark->center.x - MARK_SIZE;
+      mark->rect_from.y = mark->center.y - MARK_SIZE;
+      mark->rect_to.x = mark->center.x + MARK_SIZE;
+      mark->rect_to.y = mark->center.y + MARK_SIZE;
+
+      mark_from = mark->rect_from;
+      mark_to = mark->rect_to;
+      hyscan_cartesian_rotate_area (&mark_from, &mark_to, &mark->center, mark->angle,
+                                    &mark->extent_from, &mark->extent_to);
+      hyscan_map_rtree_insert (rtree, mark, &mark->extent_from, &mark->extent_to);
+    }
+
+  for (i = 0; i < BENCH_MOTIONS; i++)
+    {
+      cursors[i].x = g_random_double_range (0, AREA_SIZE);
+      cursors[i].y = g_random_double_range (0, AREA_SIZE);
+    }
+
+  timer = g_timer_new ();
+
+  /* Полный перебор, как при хранении меток в хэш-таблице. */
+  for (i = 0; i < BENCH_MOTIONS; i++)
+    {
+      HoverSearch search = { cursors[i], NULL, G_MAXDOUBLE };
+
+      for (j = 0; j < BENCH_MARKS; j++)
+        hover_check (&marks[j], &search);
+
+      n_hits += (search.hover != NULL) ? 1 : 0;
+    }
+  linear_time = g_timer_elapsed (timer, NULL);
+
+  /* Поиск кандидатов в индексе. */
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_MOTIONS; i++)
+    {
+      HoverSearch search = { cursors[i], NULL, G_MAXDOUBLE };
+
+      hyscan_map_rtree_search (rtree, &cursors[i], &cursors[i], hover_check, &search);
+
+      n_hits -= (search.hover != NULL) ? 1 : 0;
+    }
+  rtree_time = g_timer_elapsed (timer, NULL);
+
+  /* Оба способа должны найти метки под курсором в одних и тех же случаях. */
+  g_assert_cmpuint (n_hits, ==, 0);
+
+  g_message ("Hover lookup among %d marks: linear %.2f us, r-tree %.2f us per motion event",
+             BENCH_MARKS, 1e6 * linear_time / BENCH_MOTIONS, 1e6 * rtree_time / BENCH_MOTIONS);
+
+  g_timer_destroy (timer);
+  g_object_unref (rtree);
+  g_free (cursors);
+  g_free (marks);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  test_random ();
+  bench_hover ();
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+#include <hyscan-gtk-map-track-index.h>
+#include <hyscan-cartesian.h>
+#include <string.h>
+#include <math.h>
+
+#define N_POINTS         20000     /* Число точек галса. */
+#define STEP             0.5       /* Расстояние между соседними точками галса. */
+#define BEAM_LENGTH      50.0      /* Длина луча. */
+
+static HyScanMapTrackPoint nav[N_POINTS];
+static HyScanMapTrackPoint side[N_POINTS];
+
+/* Создаёт галс в виде случайного блуждания. */
+static void
+make_track (void)
+{
+  gdouble angle = 0.0, dist_along = 0.0;
+  guint i;
+
+  for (i = 0; i < N_POINTS; i++)
+    {
+      HyScanMapTrackPoint *point = &nav[i];
+      gdouble dx, dy;
+
+      angle += g_random_double_range (-0.05, 0.05);
+      dx = STEP * cos (angle);
+      dy = STEP * sin (angle);
+
+      point->ship_c2d.x = (i > 0) ? nav[i - 1].ship_c2d.x + dx : 0.0;
+      point->ship_c2d.y = (i > 0) ? nav[i - 1].ship_c2d.y + dy : 0.0;
+      point->dist_along = dist_along;
+      point->index = i;
+
+      /* Луч левого борта, несколько точек без данных. */
+      side[i] = *point;
+      side[i].b_dist = (i % 1000 < 990) ? BEAM_LENGTH : 0.0;
+      side[i].aperture = 0.1;
+      side[i].start_c2d = point->ship_c2d;
+      side[i].nr_c2d.x = point->ship_c2d.x - 5.0 * dy / STEP;
+      side[i].nr_c2d.y = point->ship_c2d.y + 5.0 * dx / STEP;
+      side[i].fr_c2d.x = point->ship_c2d.x - BEAM_LENGTH * dy / STEP;
+      side[i].fr_c2d.y = point->ship_c2d.y + BEAM_LENGTH * dx / STEP;
+      side[i].fr1_c2d = side[i].fr_c2d;
+      side[i].fr2_c2d = side[i].fr_c2d;
+
+      dist_along += STEP;
+    }
+}
+
+/* Создаёт список из n_points точек массива points. */
+static GList *
+make_list (HyScanMapTrackPoint *points,
+           guint                first,
+           guint                n_points)
+{
+  GList *list = NULL;
+  guint i;
+
+  for (i = first + n_points; i > first; i--)
+    list = g_list_prepend (list, &points[i - 1]);
+
+  return list;
+}
+
+/* Проверяет, что каждая точка находится внутри прямоугольника своего участка и предыдущего. */
+static void
+check_chunks (const HyScanGtkMapTrackChunks *chunks,
+              gboolean                       side)
+{
+  guint k, i;
+
+  g_assert_cmpuint (chunks->n_chunks, ==, (chunks->n_points + 63) / 64);
+
+  for (k = 0; k < chunks->n_chunks; k++)
+    {
+      const HyScanGtkMapTrackChunk *chunk = &chunks->chunks[k];
+      guint last = MIN (chunk->first + chunk->n_points, chunks->n_points - 1);
+
+      g_assert_cmpuint (chunk->first, ==, (k > 0) ? chunks->chunks[k - 1].first + chunks->chunks[k - 1].n_points : 0);
+
+      for (i = chunk->first; i <= last; i++)
+        {
+          const HyScanMapTrackPoint *point = &chunks->points[i];
+          const HyScanGeoCartesian2D *coord = &point->ship_c2d;
+
+          /* Точки бортов без данных не рисуются и могут не попасть в участок. */
+          if (side && point->b_dist <= 0)
+            continue;
+
+          if (side)
+            coord = &point->fr_c2d;
+
+          g_assert_true (hyscan_gtk_map_track_chunk_is_visible (chunk, coord, coord, 0.0));
+        }
+    }
+}
+
+/* Проверяет, что каждая точка полного списка находится рядом с точкой уровня детализации. */
+static void
+check_level (const HyScanGtkMapTrackChunks *full,
+             const HyScanGtkMapTrackChunks *level,
+             gdouble                        tolerance)
+{
+  guint i, j = 0;
+
+  g_assert_cmpuint (level->n_points, >, 0);
+  g_assert_cmpuint (level->n_points, <=, full->n_points);
+  g_assert_cmpfloat (level->points[0].ship_c2d.x, ==, full->points[0].ship_c2d.x);
+  g_assert_cmpfloat (level->points[level->n_points - 1].ship_c2d.x, ==, full->points[full->n_points - 1].ship_c2d.x);
+
+  for (i = 0; i < full->n_points; i++)
+    {
+      /* Переходим к последней точке уровня, которая не дальше точки i. */
+      while (j + 1 < level->n_points && level->points[j + 1].index <= full->points[i].index)
+        j++;
+
+      g_assert_cmpfloat (hyscan_cartesian_distance (&full->points[i].ship_c2d, &level->points[j].ship_c2d), <, tolerance);
+    }
+}
+
+/* Сравнивает участки двух индексов. */
+static void
+compare_chunks (const HyScanGtkMapTrackChunks *chunks1,
+                const HyScanGtkMapTrackChunks *chunks2)
+{
+  g_assert_cmpuint (chunks1->n_points, ==, chunks2->n_points);
+  g_assert_cmpuint (chunks1->n_chunks, ==, chunks2->n_chunks);
+  g_assert_true (memcmp (chunks1->points, chunks2->points, chunks1->n_points * sizeof (HyScanMapTrackPoint)) == 0);
+  g_assert_true (memcmp (chunks1->chunks, chunks2->chunks, chunks1->n_chunks * sizeof (HyScanGtkMapTrackChunk)) == 0);
+}
+
+/* Проверяет участки и уровни детализации, а также их обновление при добавлении точек. */
+static void
+test_index (void)
+{
+  HyScanGtkMapTrackIndex *index, *fresh;
+  const HyScanGtkMapTrackIndexData *chunks, *fresh_chunks;
+  HyScanMapTrackData data;
+  gdouble scales[] = { 0.0, 4.0, 16.0, 256.0 };
+  guint i;
+
+  memset (&data, 0, sizeof (data));
+  data.nav = make_list (nav, 0, N_POINTS / 2);
+  data.port = make_list (side, 0, N_POINTS / 2);
+
+  /* Строим индекс по первой половине галса. */
+  index = hyscan_gtk_map_track_index_new ();
+  for (i = 0; i < G_N_ELEMENTS (scales); i++)
+    hyscan_gtk_map_track_index_get (index, "track", &data, scales[i]);
+
+  /* Добавляем вторую половину галса, начало списков не меняется. */
+  data.nav = g_list_concat (data.nav, make_list (nav, N_POINTS / 2, N_POINTS - N_POINTS / 2));
+  data.port = g_list_concat (data.port, make_list (side, N_POINTS / 2, N_POINTS - N_POINTS / 2));
+  hyscan_gtk_map_track_index_invalidate (index);
+
+  fresh = hyscan_gtk_map_track_index_new ();
+  for (i = 0; i < G_N_ELEMENTS (scales); i++)
+    {
+      const HyScanGtkMapTrackIndexData *full;
+
+      chunks = hyscan_gtk_map_track_index_get (index, "track", &data, scales[i]);
+      fresh_chunks = hyscan_gtk_map_track_index_get (fresh, "track", &data, scales[i]);
+      full = hyscan_gtk_map_track_index_get (fresh, "track", &data, 0.0);
+
+      /* Обновлённый индекс совпадает с построенным заново. */
+      compare_chunks (&chunks->nav, &fresh_chunks->nav);
+      compare_chunks (&chunks->port, &fresh_chunks->port);
+      compare_chunks (&chunks->starboard, &fresh_chunks->starboard);
+
+      check_chunks (&chunks->nav, FALSE);
+      check_chunks (&chunks->port, TRUE);
+      g_assert_cmpuint (chunks->starboard.n_points, ==, 0);
+
+      if (scales[i] == 0.0)
+        {
+          g_assert_cmpuint (chunks->nav.n_points, ==, N_POINTS);
+          g_assert_cmpuint (chunks->port.n_points, ==, N_POINTS);
+        }
+      else
+        {
+          check_level (&full->nav, &chunks->nav, scales[i]);
+          g_assert_cmpuint (chunks->nav.n_points, <, full->nav.n_points);
+          g_assert_cmpuint (chunks->port.n_points, <, full->port.n_points);
+        }
+
+      g_message ("Scale %6.1f: %5u nav points, %5u port points",
+                 scales[i], chunks->nav.n_points, chunks->port.n_points);
+    }
+
+  g_object_unref (fresh);
+  g_object_unref (index);
+  g_list_free (data.nav);
+  g_list_free (data.port);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  make_track ();
+  test_index ();
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
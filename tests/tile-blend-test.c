@@ -0,0 +1,357 @@
+#include <hyscan-map-tile-source-blend.h>
+#include <hyscan-proj.h>
+
+#define TILE_SIZE        256       /* Размер тайла. */
+#define DELAY            200       /* Время заполнения тайла медленным источником, мс. */
+#define SLOW_DELAY       2000      /* Время заполнения тайла очень медленным источником, мс. */
+
+static HyScanMapTileGrid *grid;
+static HyScanGeoProjection *projection;
+
+/* Источник тайлов, заливающий тайл цветом с задержкой. */
+typedef struct
+{
+  GObject parent_instance;
+
+  guint   delay;                   /* Задержка заполнения тайла, мс. */
+  gdouble color[4];                /* Цвет тайла RGBA. */
+  gboolean fail;                   /* Признак того, что источник не заполняет тайл. */
+} DelayTileSource;
+
+typedef struct
+{
+  GObjectClass parent_class;
+} DelayTileSourceClass;
+
+static gboolean
+delay_tile_source_fill_tile (HyScanMapTileSource *source,
+                             HyScanMapTile       *tile,
+                             GCancellable        *cancellable)
+{
+  DelayTileSource *delay_source = (DelayTileSource *) source;
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  gint64 end_time;
+
+  /* Ждём, проверяя отмену. */
+  end_time = g_get_monotonic_time () + delay_source->delay * G_TIME_SPAN_MILLISECOND;
+  while (g_get_monotonic_time () < end_time)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        return FALSE;
+
+      g_usleep (G_TIME_SPAN_MILLISECOND);
+    }
+
+  if (delay_source->fail)
+    return FALSE;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, TILE_SIZE, TILE_SIZE);
+  cairo = cairo_create (surface);
+  cairo_set_source_rgba (cairo, delay_source->color[0], delay_source->color[1],
+                         delay_source->color[2], delay_source->color[3]);
+  cairo_paint (cairo);
+  cairo_destroy (cairo);
+
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
+  return TRUE;
+}
+
+static HyScanMapTileGrid *
+delay_tile_source_get_grid (HyScanMapTileSource *source)
+{
+  return g_object_ref (grid);
+}
+
+static HyScanGeoProjection *
+delay_tile_source_get_projection (HyScanMapTileSource *source)
+{
+  return g_object_ref (projection);
+}
+
+static guint
+delay_tile_source_hash (HyScanMapTileSource *source)
+{
+  return GPOINTER_TO_UINT (source);
+}
+
+static void
+delay_tile_source_interface_init (HyScanMapTileSourceInterface *iface)
+{
+  iface->fill_tile = delay_tile_source_fill_tile;
+  iface->get_grid = delay_tile_source_get_grid;
+  iface->get_projection = delay_tile_source_get_projection;
+  iface->hash = delay_tile_source_hash;
+}
+
+static void
+delay_tile_source_class_init (DelayTileSourceClass *klass)
+{
+
+}
+
+static void
+delay_tile_source_init (DelayTileSource *source)
+{
+
+}
+
+G_DEFINE_TYPE_WITH_CODE (DelayTileSource, delay_tile_source, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (HYSCAN_TYPE_MAP_TILE_SOURCE, delay_tile_source_interface_init))
+
+/* Создаёт источник тайлов с указанными задержкой и цветом. */
+static HyScanMapTileSource *
+delay_tile_source_new (guint   delay,
+                       gdouble red,
+                       gdouble green,
+                       gdouble blue,
+                       gdouble alpha)
+{
+  DelayTileSource *source;
+
+  source = g_object_new (delay_tile_source_get_type (), NULL);
+  source->delay = delay;
+  source->color[0] = red;
+  source->color[1] = green;
+  source->color[2] = blue;
+  source->color[3] = alpha;
+
+  return HYSCAN_MAP_TILE_SOURCE (source);
+}
+
+/* Создаёт композитный источник из массива источников, начиная с нижнего. */
+static HyScanMapTileSource *
+create_blend (HyScanMapTileSource **sources,
+              guint                 n_sources)
+{
+  HyScanMapTileSourceBlend *blend;
+  guint i;
+
+  blend = hyscan_map_tile_source_blend_new ();
+  for (i = 0; i < n_sources; i++)
+    {
+      g_assert_true (hyscan_map_tile_source_blend_append (blend, sources[i]));
+      g_object_unref (sources[i]);
+    }
+
+  return HYSCAN_MAP_TILE_SOURCE (blend);
+}
+
+/* Возвращает пиксель изображения тайла. */
+static guint32
+tile_pixel (HyScanMapTile *tile)
+{
+  cairo_surface_t *surface;
+  guint32 pixel;
+
+  surface = hyscan_map_tile_get_surface (tile);
+  g_assert_nonnull (surface);
+  cairo_surface_flush (surface);
+  pixel = *(guint32 *) cairo_image_surface_get_data (surface);
+  cairo_surface_destroy (surface);
+
+  return pixel;
+}
+
+/* Возвращает пиксель, полученный наложением цветов средствами cairo. */
+static guint32
+blend_pixel (const gdouble (*colors)[4],
+             guint          n_colors)
+{
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  guint32 pixel;
+  guint i;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 1, 1);
+  cairo = cairo_create (surface);
+  for (i = 0; i < n_colors; i++)
+    {
+      cairo_set_source_rgba (cairo, colors[i][0], colors[i][1], colors[i][2], colors[i][3]);
+      cairo_paint (cairo);
+    }
+  cairo_destroy (cairo);
+
+  cairo_surface_flush (surface);
+  pixel = *(guint32 *) cairo_image_surface_get_data (surface);
+  cairo_surface_destroy (surface);
+
+  return pixel;
+}
+
+/* Заполняет тайл и возвращает время заполнения, мс. */
+static gdouble
+fill_tile (HyScanMapTileSource *source,
+           HyScanMapTile       *tile,
+           gboolean             expected)
+{
+  gint64 start_time;
+
+  start_time = g_get_monotonic_time ();
+  g_assert_true (hyscan_map_tile_source_fill (source, tile, NULL) == expected);
+
+  return (gdouble) (g_get_monotonic_time () - start_time) / G_TIME_SPAN_MILLISECOND;
+}
+
+/* Все слои полупрозрачные: слои заполняются одновременно. */
+static void
+test_parallel (void)
+{
+  const gdouble colors[][4] = { { 1.0, 0.0, 0.0, 0.5 }, { 0.0, 1.0, 0.0, 0.5 }, { 0.0, 0.0, 1.0, 0.5 } };
+  HyScanMapTileSource *sources[G_N_ELEMENTS (colors)];
+  HyScanMapTileSource *blend;
+  HyScanMapTile *tile;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (colors); i++)
+    sources[i] = delay_tile_source_new (DELAY, colors[i][0], colors[i][1], colors[i][2], colors[i][3]);
+
+  blend = create_blend (sources, G_N_ELEMENTS (sources));
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+
+  elapsed = fill_tile (blend, tile, TRUE);
+  g_message ("Three translucent layers of %d ms: %.1f ms", DELAY, elapsed);
+  g_assert_cmpfloat (elapsed, <, 2 * DELAY);
+  g_assert_cmphex (tile_pixel (tile), ==, blend_pixel (colors, G_N_ELEMENTS (colors)));
+
+  g_object_unref (tile);
+  g_object_unref (blend);
+}
+
+/* Верхний слой непрозрачный: нижние слои не ждём. */
+static void
+test_opaque_top (void)
+{
+  const gdouble colors[][4] = { { 1.0, 0.0, 0.0, 1.0 }, { 0.0, 1.0, 0.0, 0.5 }, { 0.0, 0.0, 1.0, 1.0 } };
+  HyScanMapTileSource *sources[G_N_ELEMENTS (colors)];
+  HyScanMapTileSource *blend;
+  HyScanMapTile *tile;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (colors); i++)
+    {
+      sources[i] = delay_tile_source_new (i + 1 < G_N_ELEMENTS (colors) ? SLOW_DELAY : 0,
+                                          colors[i][0], colors[i][1], colors[i][2], colors[i][3]);
+    }
+
+  blend = create_blend (sources, G_N_ELEMENTS (sources));
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+
+  elapsed = fill_tile (blend, tile, TRUE);
+  g_message ("Opaque top layer over slow layers of %d ms: %.1f ms", SLOW_DELAY, elapsed);
+  g_assert_cmpfloat (elapsed, <, SLOW_DELAY / 4);
+  g_assert_cmphex (tile_pixel (tile), ==, blend_pixel (colors + 2, 1));
+
+  g_object_unref (tile);
+  g_object_unref (blend);
+}
+
+/* Прозрачные слои пропускаются, а неудачные не мешают остальным. */
+static void
+test_empty_layers (void)
+{
+  const gdouble colors[][4] = { { 0.2, 0.4, 0.6, 1.0 }, { 0.0, 1.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0, 0.0 } };
+  HyScanMapTileSource *sources[G_N_ELEMENTS (colors) + 1];
+  HyScanMapTileSource *blend;
+  HyScanMapTile *tile;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (colors); i++)
+    sources[i] = delay_tile_source_new (0, colors[i][0], colors[i][1], colors[i][2], colors[i][3]);
+
+  sources[i] = delay_tile_source_new (0, 0.0, 0.0, 0.0, 1.0);
+  ((DelayTileSource *) sources[i])->fail = TRUE;
+
+  blend = create_blend (sources, G_N_ELEMENTS (sources));
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+
+  fill_tile (blend, tile, TRUE);
+  g_assert_cmphex (tile_pixel (tile), ==, blend_pixel (colors, 1));
+
+  g_object_unref (tile);
+  g_object_unref (blend);
+
+  /* Ни один источник не заполнил тайл. */
+  sources[0] = delay_tile_source_new (0, 0.0, 0.0, 0.0, 1.0);
+  ((DelayTileSource *) sources[0])->fail = TRUE;
+  blend = create_blend (sources, 1);
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+
+  fill_tile (blend, tile, FALSE);
+
+  g_object_unref (tile);
+  g_object_unref (blend);
+}
+
+/* Обработчик завершения асинхронного заполнения тайла. */
+static void
+fill_ready (GObject      *object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+  GMainLoop *loop = user_data;
+
+  g_assert_true (hyscan_map_tile_source_fill_finish (HYSCAN_MAP_TILE_SOURCE (object), result, NULL));
+  g_main_loop_quit (loop);
+}
+
+/* Асинхронное заполнение: слои заполняются одновременно. */
+static void
+test_async (void)
+{
+  const gdouble colors[][4] = { { 1.0, 0.0, 0.0, 0.5 }, { 0.0, 1.0, 0.0, 0.5 }, { 0.0, 0.0, 1.0, 0.5 } };
+  HyScanMapTileSource *sources[G_N_ELEMENTS (colors)];
+  HyScanMapTileSource *blend;
+  HyScanMapTile *tile;
+  GMainLoop *loop;
+  gint64 start_time;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (colors); i++)
+    sources[i] = delay_tile_source_new (DELAY, colors[i][0], colors[i][1], colors[i][2], colors[i][3]);
+
+  blend = create_blend (sources, G_N_ELEMENTS (sources));
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+  loop = g_main_loop_new (NULL, FALSE);
+
+  start_time = g_get_monotonic_time ();
+  hyscan_map_tile_source_fill_async (blend, tile, NULL, fill_ready, loop);
+  g_main_loop_run (loop);
+  elapsed = (gdouble) (g_get_monotonic_time () - start_time) / G_TIME_SPAN_MILLISECOND;
+
+  g_message ("Asynchronous fill of three translucent layers of %d ms: %.1f ms", DELAY, elapsed);
+  g_assert_cmpfloat (elapsed, <, 2 * DELAY);
+  g_assert_cmphex (tile_pixel (tile), ==, blend_pixel (colors, G_N_ELEMENTS (colors)));
+
+  g_main_loop_unref (loop);
+  g_object_unref (tile);
+  g_object_unref (blend);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  guint xnums[] = { 1, 2, 4 };
+
+  grid = hyscan_map_tile_grid_new (-1.0, 1.0, -1.0, 1.0, 0, TILE_SIZE);
+  hyscan_map_tile_grid_set_xnums (grid, xnums, G_N_ELEMENTS (xnums));
+  projection = hyscan_proj_new (HYSCAN_PROJ_WEBMERC);
+
+  test_parallel ();
+  test_opaque_top ();
+  test_empty_layers ();
+  test_async ();
+
+  g_object_unref (projection);
+  g_object_unref (grid);
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <hyscan-map-tile-cache.h>
+
+#define TILE_SIZE        256                               /* Размер тайла. */
+#define TILE_BYTES       (TILE_SIZE * TILE_SIZE * 4)       /* Размер изображения тайла. */
+#define CACHE_TILES      4                                 /* Число тайлов, помещающихся в кэш. */
+#define SOURCE_HASH      0x1234                            /* Хэш источника тайлов. */
+
+static HyScanMapTileGrid *grid;
+
+/* Создаёт тайл с поверхностью. */
+static HyScanMapTile *
+create_tile (guint x)
+{
+  HyScanMapTile *tile;
+  cairo_surface_t *surface;
+
+  tile = hyscan_map_tile_new (grid, x, 0, 3);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, TILE_SIZE, TILE_SIZE);
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
+  return tile;
+}
+
+/* Проверяет наличие тайла в кэше. */
+static gboolean
+lookup (HyScanMapTileCache *cache,
+        guint               source_hash,
+        guint               x)
+{
+  HyScanMapTile *tile;
+  gboolean found;
+
+  tile = hyscan_map_tile_new (grid, x, 0, 3);
+  found = hyscan_map_tile_cache_get (cache, source_hash, tile);
+  if (found)
+    {
+      cairo_surface_t *surface;
+
+      surface = hyscan_map_tile_get_surface (tile);
+      g_assert_nonnull (surface);
+      g_assert_cmpint (cairo_image_surface_get_width (surface), ==, TILE_SIZE);
+      cairo_surface_destroy (surface);
+    }
+
+  g_object_unref (tile);
+
+  return found;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanMapTileCache *cache, *default_cache;
+  HyScanMapTileCacheStats stats;
+  guint i;
+
+  grid = hyscan_map_tile_grid_new (-1.0, 1.0, -1.0, 1.0, 0, TILE_SIZE);
+
+  cache = hyscan_map_tile_cache_new (CACHE_TILES * TILE_BYTES);
+
+  /* Помещаем в кэш больше тайлов, чем он вмещает; при этом тайл 1 используется. */
+  for (i = 0; i < CACHE_TILES + 2; i++)
+    {
+      HyScanMapTile *tile;
+
+      tile = create_tile (i);
+      hyscan_map_tile_cache_set (cache, SOURCE_HASH, tile);
+      g_object_unref (tile);
+
+      if (i > 1)
+        g_assert_true (lookup (cache, SOURCE_HASH, 1));
+    }
+
+  /* Вытеснены тайлы 0 и 2, тайл 1 сохранился как недавно использованный. */
+  hyscan_map_tile_cache_get_stats (cache, &stats);
+  g_assert_cmpuint (stats.evictions, ==, 2);
+  g_assert_cmpuint (stats.n_tiles, ==, CACHE_TILES);
+  g_assert_cmpuint (stats.size, <=, stats.max_size);
+
+  g_assert_false (lookup (cache, SOURCE_HASH, 0));
+  g_assert_true (lookup (cache, SOURCE_HASH, 1));
+  g_assert_false (lookup (cache, SOURCE_HASH, 2));
+  for (i = 3; i < CACHE_TILES + 2; i++)
+    g_assert_true (lookup (cache, SOURCE_HASH, i));
+
+  /* Тайлы другого источника не найдены. */
+  g_assert_false (lookup (cache, SOURCE_HASH + 1, 1));
+
+  hyscan_map_tile_cache_get_stats (cache, &stats);
+  g_message ("hits %" G_GUINT64_FORMAT ", misses %" G_GUINT64_FORMAT ", evictions %" G_GUINT64_FORMAT,
+             stats.hits, stats.misses, stats.evictions);
+  g_assert_cmpuint (stats.hits, ==, 2 * CACHE_TILES);
+  g_assert_cmpuint (stats.misses, ==, 3);
+
+  /* Уменьшение объёма вытесняет лишние тайлы. */
+  hyscan_map_tile_cache_set_max_size (cache, TILE_BYTES);
+  hyscan_map_tile_cache_get_stats (cache, &stats);
+  g_assert_cmpuint (stats.n_tiles, ==, 1);
+
+  hyscan_map_tile_cache_clear (cache);
+  hyscan_map_tile_cache_get_stats (cache, &stats);
+  g_assert_cmpuint (stats.n_tiles, ==, 0);
+  g_assert_cmpuint (stats.size, ==, 0);
+
+  /* Общий кэш один на процесс. */
+  default_cache = hyscan_map_tile_cache_get_default ();
+  g_assert_true (default_cache == hyscan_map_tile_cache_get_default ());
+  g_object_unref (default_cache);
+  g_object_unref (default_cache);
+
+  g_object_unref (cache);
+  g_object_unref (grid);
+
+  g_message ("Test done successfully!");
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <hyscan-map-tile.h>
+#include <string.h>
+
+#define TILE_SIZE        256       /* Размер тайла. */
+#define MAX_ZOOM         6         /* Максимальный зум в проверке уникальности ключей. */
+#define BENCH_ZOOM       12        /* Зум тайлов в тесте скорости. */
+#define BENCH_TILES      4096      /* Число тайлов в тесте скорости. */
+#define BENCH_LOOKUPS    2000000   /* Число поисков в тесте скорости. */
+#define SOURCE_HASH      0x9abc1234
+
+/* Строковый ключ в формате, который использовался до появления HyScanMapTileKey. */
+static void
+string_key (HyScanMapTile *tile,
+            guint          source_hash,
+            gchar         *key,
+            gsize          key_length)
+{
+  g_snprintf (key, key_length,
+              "HyScanGtkMapBase.t.%u.%u.%u.%u.%u",
+              hyscan_map_tile_get_zoom (tile),
+              hyscan_map_tile_get_x (tile),
+              hyscan_map_tile_get_y (tile),
+              hyscan_map_tile_get_size (tile),
+              source_hash);
+}
+
+/* Проверяет, что разные тайлы имеют разные ключи, а одинаковые - одинаковые. */
+static void
+test_unique (HyScanMapTileGrid *grid)
+{
+  GHashTable *keys, *strings;
+  guint n_tiles = 0;
+  guint zoom, x, y, s;
+
+  keys = g_hash_table_new_full (hyscan_map_tile_key_hash, hyscan_map_tile_key_equal, g_free, NULL);
+  strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (s = 0; s < 2; s++)
+    for (zoom = 0; zoom <= MAX_ZOOM; zoom++)
+      for (x = 0; x < (1u << zoom); x++)
+        for (y = 0; y < (1u << zoom); y++)
+          {
+            HyScanMapTile *tile, *same_tile;
+            HyScanMapTileKey *key, same_key;
+            gchar str[HYSCAN_MAP_TILE_KEY_STRLEN + 1];
+
+            tile = hyscan_map_tile_new (grid, x, y, zoom);
+            same_tile = hyscan_map_tile_new (grid, x, y, zoom);
+
+            key = g_new (HyScanMapTileKey, 1);
+            hyscan_map_tile_key_init (key, SOURCE_HASH + s, tile);
+            hyscan_map_tile_key_init (&same_key, SOURCE_HASH + s, same_tile);
+            g_assert_true (hyscan_map_tile_key_equal (key, &same_key));
+            g_assert_cmpuint (hyscan_map_tile_key_hash (key), ==, hyscan_map_tile_key_hash (&same_key));
+
+            hyscan_map_tile_key_to_string (key, str);
+            g_assert_cmpuint (strlen (str), ==, HYSCAN_MAP_TILE_KEY_STRLEN);
+
+            g_hash_table_add (keys, key);
+            g_hash_table_add (strings, g_strdup (str));
+            n_tiles++;
+
+            g_object_unref (same_tile);
+            g_object_unref (tile);
+          }
+
+  g_assert_cmpuint (g_hash_table_size (keys), ==, n_tiles);
+  g_assert_cmpuint (g_hash_table_size (strings), ==, n_tiles);
+
+  g_hash_table_destroy (strings);
+  g_hash_table_destroy (keys);
+}
+
+/* Сравнивает скорость поиска тайлов по строковым и двоичным ключам. */
+static void
+bench_lookup (HyScanMapTileGrid *grid)
+{
+  HyScanMapTile *tiles[BENCH_TILES];
+  HyScanMapTileKey keys[BENCH_TILES];
+  GHashTable *string_table, *hex_table, *binary_table;
+  GTimer *timer;
+  gdouble string_time, hex_time, binary_time;
+  guint n_found;
+  guint i;
+
+  string_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  hex_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  binary_table = g_hash_table_new (hyscan_map_tile_key_hash, hyscan_map_tile_key_equal);
+
+  for (i = 0; i < BENCH_TILES; i++)
+    {
+      gchar key[255];
+
+      tiles[i] = hyscan_map_tile_new (grid, 1000 + i % 64, 2000 + i / 64, BENCH_ZOOM);
+
+      string_key (tiles[i], SOURCE_HASH, key, sizeof (key));
+      g_hash_table_insert (string_table, g_strdup (key), tiles[i]);
+
+      hyscan_map_tile_key_init (&keys[i], SOURCE_HASH, tiles[i]);
+      hyscan_map_tile_key_to_string (&keys[i], key);
+      g_hash_table_insert (hex_table, g_strdup (key), tiles[i]);
+      g_hash_table_insert (binary_table, &keys[i], tiles[i]);
+    }
+
+  timer = g_timer_new ();
+
+  /* Строковый ключ с форматированием через g_snprintf(). */
+  n_found = 0;
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+      gchar key[255];
+
+      string_key (tiles[i % BENCH_TILES], SOURCE_HASH, key, sizeof (key));
+      n_found += g_hash_table_lookup (string_table, key) != NULL ? 1 : 0;
+    }
+  string_time = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (n_found, ==, BENCH_LOOKUPS);
+
+  /* Строковый ключ фиксированной длины из двоичного ключа, как для HyScanCache. */
+  n_found = 0;
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+      HyScanMapTileKey key;
+      gchar str[HYSCAN_MAP_TILE_KEY_STRLEN + 1];
+
+      hyscan_map_tile_key_init (&key, SOURCE_HASH, tiles[i % BENCH_TILES]);
+      hyscan_map_tile_key_to_string (&key, str);
+      n_found += g_hash_table_lookup (hex_table, str) != NULL ? 1 : 0;
+    }
+  hex_time = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (n_found, ==, BENCH_LOOKUPS);
+
+  /* Двоичный ключ, как в HyScanMapTileCache. */
+  n_found = 0;
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+      HyScanMapTileKey key;
+
+      hyscan_map_tile_key_init (&key, SOURCE_HASH, tiles[i % BENCH_TILES]);
+      n_found += g_hash_table_lookup (binary_table, &key) != NULL ? 1 : 0;
+    }
+  binary_time = g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (n_found, ==, BENCH_LOOKUPS);
+
+  g_message ("Lookups per second: formatted string %.2fM, fixed-length string %.2fM, binary key %.2fM",
+             1e-6 * BENCH_LOOKUPS / string_time,
+             1e-6 * BENCH_LOOKUPS / hex_time,
+             1e-6 * BENCH_LOOKUPS / binary_time);
+
+  g_timer_destroy (timer);
+  g_hash_table_destroy (binary_table);
+  g_hash_table_destroy (hex_table);
+  g_hash_table_destroy (string_table);
+  for (i = 0; i < BENCH_TILES; i++)
+    g_object_unref (tiles[i]);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanMapTileGrid *grid;
+
+  grid = hyscan_map_tile_grid_new (-1.0, 1.0, -1.0, 1.0, 0, TILE_SIZE);
+
+  test_unique (grid);
+  bench_lookup (grid);
+
+  g_object_unref (grid);
+
+  g_message ("Tests done successfully!");
+
+  return 0;
+}
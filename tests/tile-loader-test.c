@@ -1,9 +1,12 @@
 #include <hyscan-map-tile-loader.h>
+#include <hyscan-map-tile-source-file.h>
+#include <glib/gstdio.h>
 
 static HyScanMapTileGrid *grid;          /* Сетка тайлов. */
 static guint xnums[] = { 1, 2, 4, 10 };     /* Масштабы сетки. */
 
 static gdouble loader_fraction;
+static guint loader_failed;
 
 static int filled_count   = 0;
 static int expected_count = 121;            /* Количество тайлов на всех масштабах: 1*1 + 2*2 + 4*4 + 10 * 10. */
@@ -23,6 +26,14 @@ dummy_tile_source_fill_tile (HyScanMapTileSource *source,
                              HyScanMapTile       *tile,
                              GCancellable        *cancellable)
 {
+  cairo_surface_t *surface;
+  guint tile_size;
+
+  tile_size = hyscan_map_tile_get_size (tile);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, tile_size, tile_size);
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
   g_atomic_int_inc (&filled_count);
 
   return TRUE;
@@ -64,34 +75,105 @@ loader_progress (HyScanMapTileLoader *loader,
   loader_fraction = fraction;
 }
 
+static void
+loader_done (HyScanMapTileLoader *loader,
+             guint                failed)
+{
+  loader_failed = failed;
+}
+
+/* Загружает все тайлы из источника и проверяет, что загрузка прошла успешно. */
+static void
+run_loader (HyScanMapTileSource *source,
+            guint                max_jobs)
+{
+  HyScanMapTileLoader *loader;
+  GThread *thread;
+
+  loader_fraction = 0.0;
+  loader_failed = G_MAXUINT;
+
+  loader = hyscan_map_tile_loader_new ();
+  hyscan_map_tile_loader_set_max_jobs (loader, max_jobs);
+  g_signal_connect (loader, "progress", G_CALLBACK (loader_progress), NULL);
+  g_signal_connect (loader, "done", G_CALLBACK (loader_done), NULL);
+
+  thread = hyscan_map_tile_loader_start (loader, source, -0.99, 0.99, -0.99, 0.99);
+  g_object_unref (loader);
+  g_thread_join (thread);
+
+  g_assert_cmpuint (loader_failed, ==, 0);
+  g_assert_cmpfloat (loader_fraction, ==, 1.0);
+}
+
+/* Удаляет каталог вместе с содержимым. */
+static void
+remove_dir (const gchar *path)
+{
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_dir (child);
+      else
+        g_unlink (child);
+
+      g_free (child);
+    }
+
+  g_dir_close (dir);
+  g_rmdir (path);
+}
+
 int
 main (int argc,
       char **argv)
 {
-  HyScanMapTileLoader *loader;
+  HyScanMapTileSourceFile *file_source;
   HyScanMapTileSource *source;
-  GThread *thread;
+  gchar *cache_dir;
 
   /* Создаем dummy-источник тайлов. */
   grid = hyscan_map_tile_grid_new (-1.0, 1.0, -1.0, 1.0, 0, 256);
   hyscan_map_tile_grid_set_xnums (grid, xnums, G_N_ELEMENTS (xnums));
   source = g_object_new (dummy_tile_source_get_type (), NULL);
 
-  /* Создаем загрузчик. */
-  loader = hyscan_map_tile_loader_new ();
-  g_signal_connect (loader, "progress", G_CALLBACK (loader_progress), NULL);
-
-  /* Запускаем загрузку. */
-  thread = hyscan_map_tile_loader_start (loader, source, -0.99, 0.99, -0.99, 0.99);
+  /* Проверяем, что все тайлы загрузились одним и несколькими потоками. */
+  run_loader (source, 1);
+  g_assert_cmpint (filled_count, ==, expected_count);
 
-  g_object_unref (source);
-  g_object_unref (loader);
+  filled_count = 0;
+  run_loader (source, 8);
+  g_assert_cmpint (filled_count, ==, expected_count);
 
-  g_thread_join (thread);
+  /* При загрузке через файловый кэш повторный запуск не должен обращаться к
+   * исходному источнику: все тайлы уже сохранены в каталоге. */
+  cache_dir = g_dir_make_tmp ("tile-loader-test-XXXXXX", NULL);
+  g_assert_nonnull (cache_dir);
+  file_source = hyscan_map_tile_source_file_new (cache_dir, source);
 
-  /* Проверяем, что все тайлы загрузились. */
+  filled_count = 0;
+  run_loader (HYSCAN_MAP_TILE_SOURCE (file_source), 8);
   g_assert_cmpint (filled_count, ==, expected_count);
-  g_assert_cmpfloat (loader_fraction, ==, 1.0);
+
+  filled_count = 0;
+  run_loader (HYSCAN_MAP_TILE_SOURCE (file_source), 8);
+  g_assert_cmpint (filled_count, ==, 0);
+
+  g_object_unref (file_source);
+  remove_dir (cache_dir);
+  g_free (cache_dir);
+
+  g_object_unref (source);
+  g_object_unref (grid);
 
   g_message ("Test done successfully!");
 
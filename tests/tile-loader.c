@@ -3,6 +3,17 @@
 
 static gdouble loader_fraction;
 static gint64 loader_time;
+static gdouble loader_tiles_speed;
+static gdouble loader_bytes_speed;
+
+static void
+loader_speed (HyScanMapTileLoader *loader,
+              gdouble              tiles_speed,
+              gdouble              bytes_speed)
+{
+  loader_tiles_speed = tiles_speed;
+  loader_bytes_speed = bytes_speed;
+}
 
 static void
 loader_progress (HyScanMapTileLoader *loader,
@@ -25,7 +36,8 @@ loader_progress (HyScanMapTileLoader *loader,
   min = sec / 60;
   sec -= min * 60;
 
-  g_print ("\rSpeed: %f Progress: %.4f%% TTG: %02d:%02d:%02d", speed, fraction * 100.0, hour, min, sec);
+  g_print ("\rSpeed: %.1f tiles/s, %.1f KiB/s Progress: %.4f%% TTG: %02d:%02d:%02d",
+           loader_tiles_speed, loader_bytes_speed / 1024.0, fraction * 100.0, hour, min, sec);
 
   /* Сбрасываем счётчик средней скорости загрузки каждые 20 секунд. */
   if (dtime > 20)
@@ -86,6 +98,7 @@ main (int argc,
   HyScanGeoProjection *projection;
   HyScanProfileMap *profile;
   gchar **headers;
+  guint jobs = 6;
   HyScanGeoPoint from, to;
   HyScanGeoCartesian2D from_c2d, to_c2d;
 
@@ -104,6 +117,7 @@ main (int argc,
         { "from",    'a', 0, G_OPTION_ARG_STRING,       &from_str,   "Coordinates from, LAT,LON", NULL },
         { "to",      'b', 0, G_OPTION_ARG_STRING,       &to_str,     "Coordinates to, LAT,LON", NULL },
         { "headers", 'r', 0, G_OPTION_ARG_STRING_ARRAY, &headers,    "Request headers", NULL },
+        { "jobs",    'j', 0, G_OPTION_ARG_INT,          &jobs,       "Number of parallel downloads", NULL },
         { NULL }
       };
 
@@ -156,6 +170,8 @@ main (int argc,
 
   /* Создаем загрузчик. */
   loader = hyscan_map_tile_loader_new ();
+  hyscan_map_tile_loader_set_max_jobs (loader, jobs);
+  g_signal_connect (loader, "speed", G_CALLBACK (loader_speed), NULL);
   g_signal_connect (loader, "progress", G_CALLBACK (loader_progress), NULL);
 
   /* Запускаем загрузку. */
@@ -0,0 +1,306 @@
+#include <hyscan-map-tile-source-pack.h>
+#include <hyscan-map-tile-source-file.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define TILE_SIZE        64        /* Размер тайла. */
+#define FULL_CAPACITY    4096      /* Число ячеек полностью заполненного индекса. */
+
+static HyScanMapTileGrid *grid;                /* Сетка тайлов. */
+static guint xnums[] = { 1, 2, 4, 16, 64 };    /* Масштабы сетки. */
+
+static gint filled_count = 0;                  /* Число тайлов, заполненных dummy-источником. */
+
+typedef struct
+{
+  GObject parent_instance;
+} DummyTileSource;
+
+typedef struct
+{
+  GObjectClass parent_class;
+} DummyTileSourceClass;
+
+/* Цвет тайла, однозначно определяемый его координатами. */
+static guint32
+tile_color (HyScanMapTile *tile)
+{
+  return 0xff000000 |
+         (hyscan_map_tile_get_x (tile) & 0xff) << 16 |
+         (hyscan_map_tile_get_y (tile) & 0xff) << 8 |
+         (hyscan_map_tile_get_zoom (tile) * 16);
+}
+
+static gboolean
+dummy_tile_source_fill_tile (HyScanMapTileSource *source,
+                             HyScanMapTile       *tile,
+                             GCancellable        *cancellable)
+{
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+  guint32 color;
+
+  color = tile_color (tile);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, TILE_SIZE, TILE_SIZE);
+  cairo = cairo_create (surface);
+  cairo_set_source_rgb (cairo,
+                        ((color >> 16) & 0xff) / 255.0,
+                        ((color >> 8) & 0xff) / 255.0,
+                        (color & 0xff) / 255.0);
+  cairo_paint (cairo);
+  cairo_destroy (cairo);
+
+  hyscan_map_tile_set_surface (tile, surface);
+  cairo_surface_destroy (surface);
+
+  g_atomic_int_inc (&filled_count);
+
+  return TRUE;
+}
+
+static HyScanMapTileGrid *
+dummy_tile_source_get_grid (HyScanMapTileSource *source)
+{
+  return g_object_ref (grid);
+}
+
+static void
+dummy_tile_source_interface_init (HyScanMapTileSourceInterface *iface)
+{
+  iface->fill_tile = dummy_tile_source_fill_tile;
+  iface->get_grid = dummy_tile_source_get_grid;
+}
+
+static void
+dummy_tile_source_class_init (DummyTileSourceClass *klass)
+{
+
+}
+
+static void
+dummy_tile_source_init (DummyTileSource *source)
+{
+
+}
+
+G_DEFINE_TYPE_WITH_CODE (DummyTileSource, dummy_tile_source, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (HYSCAN_TYPE_MAP_TILE_SOURCE, dummy_tile_source_interface_init))
+
+/* Заполняет все тайлы масштабов от 0 до max_zoom и проверяет их изображения.
+ * Возвращает число заполненных тайлов. */
+static guint
+fill_all (HyScanMapTileSource *source,
+          guint                max_zoom)
+{
+  guint zoom, x, y;
+  guint n_tiles = 0;
+
+  for (zoom = 0; zoom <= max_zoom; zoom++)
+    for (x = 0; x < xnums[zoom]; x++)
+      for (y = 0; y < xnums[zoom]; y++)
+        {
+          HyScanMapTile *tile;
+          cairo_surface_t *surface;
+          guint32 *data;
+
+          tile = hyscan_map_tile_new (grid, x, y, zoom);
+          g_assert_true (hyscan_map_tile_source_fill (source, tile, NULL));
+
+          surface = hyscan_map_tile_get_surface (tile);
+          cairo_surface_flush (surface);
+          data = (guint32 *) cairo_image_surface_get_data (surface);
+          g_assert_cmphex (data[0], ==, tile_color (tile));
+          cairo_surface_destroy (surface);
+
+          g_object_unref (tile);
+          n_tiles++;
+        }
+
+  return n_tiles;
+}
+
+/* Удаляет каталог вместе с содержимым. */
+static void
+remove_dir (const gchar *path)
+{
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *child = g_build_filename (path, name, NULL);
+
+      if (g_file_test (child, G_FILE_TEST_IS_DIR))
+        remove_dir (child);
+      else
+        g_unlink (child);
+
+      g_free (child);
+    }
+
+  g_dir_close (dir);
+  g_rmdir (path);
+}
+
+/* Создаёт повреждённый контейнер, все ячейки индекса которого заняты тайлами
+ * несуществующего масштаба размером tile_size, а число тайлов в заголовке
+ * равно нулю. Формат заголовка и ячеек повторяет hyscan-map-tile-source-pack.c. */
+static void
+write_full_index (const gchar *path,
+                  guint32      tile_size)
+{
+  guint8 header[48] = { 0 };
+  guint8 *contents, *slot;
+  guint32 u32;
+  guint64 u64;
+  gsize size;
+  guint i;
+
+  size = sizeof (header) + FULL_CAPACITY * 24;
+  contents = g_malloc0 (size);
+
+  memcpy (header, "HSTPACK1", 8);
+  u32 = GUINT32_TO_LE (1);
+  memcpy (header + 8, &u32, 4);
+  u32 = GUINT32_TO_LE (FULL_CAPACITY);
+  memcpy (header + 12, &u32, 4);
+  u64 = GUINT64_TO_LE (sizeof (header));
+  memcpy (header + 16, &u64, 8);
+  u64 = GUINT64_TO_LE (size);
+  memcpy (header + 24, &u64, 8);
+  memcpy (contents, header, sizeof (header));
+
+  for (i = 0; i < FULL_CAPACITY; i++)
+    {
+      slot = contents + sizeof (header) + 24 * i;
+      u64 = GUINT64_TO_LE (sizeof (header));
+      memcpy (slot, &u64, 8);
+      u32 = GUINT32_TO_LE (tile_size);
+      memcpy (slot + 8, &u32, 4);
+      u32 = GUINT32_TO_LE (G_N_ELEMENTS (xnums) + 1);
+      memcpy (slot + 12, &u32, 4);
+      u32 = GUINT32_TO_LE (i);
+      memcpy (slot + 16, &u32, 4);
+    }
+
+  g_assert_true (g_file_set_contents (path, (const gchar *) contents, size, NULL));
+  g_free (contents);
+}
+
+/* Возвращает размер файла. */
+static goffset
+file_size (const gchar *path)
+{
+  GStatBuf stat_buf;
+
+  g_assert_cmpint (g_stat (path, &stat_buf), ==, 0);
+
+  return stat_buf.st_size;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanMapTileSource *source;
+  HyScanMapTileSourcePack *pack;
+  HyScanMapTileSourceFile *file_source;
+  HyScanMapTile *tile;
+  gchar *test_dir, *pack_path, *import_path, *cache_dir, *full_path;
+  guint max_zoom = G_N_ELEMENTS (xnums) - 1;
+  guint n_tiles;
+  goffset size;
+  GTimer *timer;
+
+  grid = hyscan_map_tile_grid_new (-1.0, 1.0, -1.0, 1.0, 0, TILE_SIZE);
+  hyscan_map_tile_grid_set_xnums (grid, xnums, G_N_ELEMENTS (xnums));
+  source = g_object_new (dummy_tile_source_get_type (), NULL);
+
+  test_dir = g_dir_make_tmp ("tile-pack-test-XXXXXX", NULL);
+  g_assert_nonnull (test_dir);
+  pack_path = g_build_filename (test_dir, "tiles.pack", NULL);
+  import_path = g_build_filename (test_dir, "import.pack", NULL);
+  cache_dir = g_build_filename (test_dir, "cache", NULL);
+  full_path = g_build_filename (test_dir, "full.pack", NULL);
+
+  /* Первое обращение заполняет контейнер из запасного источника, при этом
+   * индекс несколько раз увеличивается. */
+  pack = hyscan_map_tile_source_pack_new (pack_path, source);
+  n_tiles = fill_all (HYSCAN_MAP_TILE_SOURCE (pack), max_zoom);
+  g_assert_cmpint (filled_count, ==, n_tiles);
+
+  /* Повторное обращение не использует запасной источник. */
+  timer = g_timer_new ();
+  fill_all (HYSCAN_MAP_TILE_SOURCE (pack), max_zoom);
+  g_assert_cmpint (filled_count, ==, n_tiles);
+  g_message ("Read %u tiles in %.3f s", n_tiles, g_timer_elapsed (timer, NULL));
+  g_object_unref (pack);
+
+  /* После повторного открытия все тайлы читаются из файла. */
+  pack = hyscan_map_tile_source_pack_new (pack_path, source);
+  hyscan_map_tile_source_pack_fb_enable (pack, FALSE);
+  fill_all (HYSCAN_MAP_TILE_SOURCE (pack), max_zoom);
+
+  /* Уплотнение удаляет старые индексы и сохраняет все тайлы. */
+  size = file_size (pack_path);
+  g_assert_true (hyscan_map_tile_source_pack_compact (pack));
+  g_assert_cmpint (file_size (pack_path), <, size);
+  fill_all (HYSCAN_MAP_TILE_SOURCE (pack), max_zoom);
+  g_assert_cmpint (filled_count, ==, n_tiles);
+  g_object_unref (pack);
+
+  /* Импорт каталога с тайлами HyScanMapTileSourceFile. */
+  file_source = hyscan_map_tile_source_file_new (cache_dir, source);
+  n_tiles = fill_all (HYSCAN_MAP_TILE_SOURCE (file_source), max_zoom - 1);
+  g_object_unref (file_source);
+
+  pack = hyscan_map_tile_source_pack_new (import_path, source);
+  hyscan_map_tile_source_pack_fb_enable (pack, FALSE);
+  g_assert_cmpuint (hyscan_map_tile_source_pack_import (pack, cache_dir), ==, n_tiles);
+  g_assert_cmpuint (hyscan_map_tile_source_pack_import (pack, cache_dir), ==, 0);
+  fill_all (HYSCAN_MAP_TILE_SOURCE (pack), max_zoom - 1);
+  g_object_unref (pack);
+
+  /* Поиск в полностью заполненном индексе завершается, а при добавлении
+   * тайла индекс увеличивается. */
+  write_full_index (full_path, 0);
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+  pack = hyscan_map_tile_source_pack_new (full_path, source);
+  hyscan_map_tile_source_pack_fb_enable (pack, FALSE);
+  g_assert_false (hyscan_map_tile_source_fill (HYSCAN_MAP_TILE_SOURCE (pack), tile, NULL));
+  hyscan_map_tile_source_pack_fb_enable (pack, TRUE);
+  g_assert_true (hyscan_map_tile_source_fill (HYSCAN_MAP_TILE_SOURCE (pack), tile, NULL));
+  g_object_unref (pack);
+
+  pack = hyscan_map_tile_source_pack_new (full_path, source);
+  hyscan_map_tile_source_pack_fb_enable (pack, FALSE);
+  g_assert_true (hyscan_map_tile_source_fill (HYSCAN_MAP_TILE_SOURCE (pack), tile, NULL));
+  g_object_unref (pack);
+
+  /* Уплотнение пропускает тайлы, выходящие за пределы файла. */
+  write_full_index (full_path, G_MAXUINT32);
+  pack = hyscan_map_tile_source_pack_new (full_path, source);
+  hyscan_map_tile_source_pack_fb_enable (pack, FALSE);
+  g_assert_true (hyscan_map_tile_source_pack_compact (pack));
+  g_assert_false (hyscan_map_tile_source_fill (HYSCAN_MAP_TILE_SOURCE (pack), tile, NULL));
+  g_object_unref (pack);
+  g_object_unref (tile);
+
+  remove_dir (test_dir);
+  g_timer_destroy (timer);
+  g_free (test_dir);
+  g_free (pack_path);
+  g_free (import_path);
+  g_free (cache_dir);
+  g_free (full_path);
+  g_object_unref (source);
+  g_object_unref (grid);
+
+  g_message ("Test done successfully!");
+
+  return 0;
+}
@@ -1,35 +1,172 @@
 #include <hyscan-map-tile-source-web.h>
 #include <hyscan-proj.h>
+#include <libsoup/soup.h>
+
+#define TILE_SIZE        256       /* Размер тайла. */
+#define N_TILES          512       /* Число тайлов в тесте скорости загрузки. */
+#define N_THREADS        8         /* Число потоков, одновременно загружающих тайлы. */
 
 struct
 {
-  const gchar *url_format;
+  const gchar *url_path;
   guint        min_zoom;
   guint        max_zoom;
   gboolean     valid;
 } test_data[] = {
-  { "https://c.tile.openstreetmap.org/{z}/{x}/{y}.png",  0, 19, TRUE},
-  { "https://c.tile.openstreetmap.org/12/{x}/{y}.png",   0, 19, FALSE},
+  { "/{z}/{x}/{y}.png",  0, 19, TRUE},
+  { "/12/{x}/{y}.png",   0, 19, FALSE},
 };
 
-int
-main (int    argc,
-      char **argv)
+static GBytes *tile_png;           /* Изображение тайла, которое отдаёт тестовый сервер. */
+static gchar *server_url;          /* Адрес тестового сервера. */
+static GMainLoop *loop;            /* Цикл обработки запросов к тестовому серверу. */
+static gint n_loaded;              /* Число загруженных тайлов. */
+static GHashTable *client_ports;   /* Порты клиентов, подключавшихся к тестовому серверу. */
+G_LOCK_DEFINE_STATIC (client_ports);
+
+/* Обработчик запросов тестового сервера: на любой путь отвечает изображением тайла. */
+static void
+server_callback (SoupServer        *server,
+                 SoupMessage       *msg,
+                 const char        *path,
+                 GHashTable        *query,
+                 SoupClientContext *client,
+                 gpointer           user_data)
+{
+  GSocketAddress *address;
+  gconstpointer data;
+  gsize size;
+
+  /* Каждое TCP-соединение клиента имеет собственный порт. */
+  address = soup_client_context_get_remote_address (client);
+  if (G_IS_INET_SOCKET_ADDRESS (address))
+    {
+      guint port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address));
+
+      G_LOCK (client_ports);
+      g_hash_table_add (client_ports, GUINT_TO_POINTER (port));
+      G_UNLOCK (client_ports);
+    }
+
+  if (msg->method != SOUP_METHOD_GET)
+    {
+      soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+      return;
+    }
+
+  data = g_bytes_get_data (tile_png, &size);
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_set_response (msg, "image/png", SOUP_MEMORY_COPY, data, size);
+}
+
+/* Создаёт PNG-изображение тайла. */
+static GBytes *
+create_tile_png (void)
+{
+  GdkPixbuf *pixbuf;
+  gchar *buffer;
+  gsize size;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, TILE_SIZE, TILE_SIZE);
+  gdk_pixbuf_fill (pixbuf, 0x3366ccff);
+  if (!gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &size, "png", NULL, NULL))
+    g_error ("Failed to create tile image");
+
+  g_object_unref (pixbuf);
+
+  return g_bytes_new_take (buffer, size);
+}
+
+/* Сбрасывает счётчик соединений с тестовым сервером. */
+static void
+reset_connections (void)
+{
+  G_LOCK (client_ports);
+  g_hash_table_remove_all (client_ports);
+  G_UNLOCK (client_ports);
+}
+
+/* Возвращает число соединений с тестовым сервером после reset_connections(). */
+static guint
+count_connections (void)
+{
+  guint n_connections;
+
+  G_LOCK (client_ports);
+  n_connections = g_hash_table_size (client_ports);
+  G_UNLOCK (client_ports);
+
+  return n_connections;
+}
+
+/* Загружает тайл так же, как источник загружал его до появления общей HTTP-сессии:
+ * для каждого тайла создаётся отдельная сессия и, следовательно, новое соединение. */
+static void
+load_tile_own_session (gpointer data,
+                       gpointer user_data)
+{
+  HyScanMapTile *tile = data;
+  const gchar *base_url = user_data;
+  SoupSession *session;
+  SoupMessage *msg;
+  GInputStream *stream;
+  GdkPixbuf *pixbuf = NULL;
+  gchar *url;
+
+  url = g_strdup_printf ("%s/%u/%u/%u.png", base_url,
+                         hyscan_map_tile_get_zoom (tile), hyscan_map_tile_get_x (tile), hyscan_map_tile_get_y (tile));
+  session = soup_session_new_with_options (SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_SNIFFER,
+                                           SOUP_SESSION_SSL_STRICT, FALSE,
+                                           NULL);
+  msg = soup_message_new (SOUP_METHOD_GET, url);
+
+  stream = soup_session_send (session, msg, NULL, NULL);
+  if (stream != NULL && SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+    pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
+
+  if (pixbuf != NULL && hyscan_map_tile_set_pixbuf (tile, pixbuf))
+    g_atomic_int_inc (&n_loaded);
+
+  g_clear_object (&pixbuf);
+  g_clear_object (&stream);
+  g_object_unref (msg);
+  g_object_unref (session);
+  g_free (url);
+  g_object_unref (tile);
+}
+
+/* Загружает тайл в пуле потоков. */
+static void
+load_tile (gpointer data,
+           gpointer user_data)
+{
+  HyScanMapTile *tile = data;
+  HyScanMapTileSource *source = user_data;
+
+  if (hyscan_map_tile_source_fill (source, tile, NULL))
+    g_atomic_int_inc (&n_loaded);
+
+  g_object_unref (tile);
+}
+
+/* Проверяет формат URL. */
+static void
+test_url_format (HyScanGeoProjection *mercator)
 {
   HyScanMapTileSourceWeb *source;
-  HyScanGeoProjection *mercator;
   HyScanMapTileGrid *grid;
   HyScanMapTile *tile;
   gsize i;
 
-  mercator = hyscan_proj_new (HYSCAN_PROJ_WEBMERC);
   for (i = 0; i < G_N_ELEMENTS (test_data); i++)
     {
       gboolean result;
+      gchar *url_format;
 
-      g_message ("Test data %lu: %s", i, test_data[i].url_format);
+      url_format = g_strconcat (server_url, test_data[i].url_path, NULL);
+      g_message ("Test data %lu: %s", i, url_format);
 
-      source = hyscan_map_tile_source_web_new (test_data[i].url_format, mercator,
+      source = hyscan_map_tile_source_web_new (url_format, mercator,
                                                test_data[i].min_zoom,
                                                test_data[i].max_zoom);
 
@@ -42,9 +179,224 @@ main (int    argc,
       g_clear_object (&grid);
       g_clear_object (&tile);
       g_clear_object (&source);
+      g_free (url_format);
     }
+}
+
+/* Измеряет скорость загрузки тайлов с отдельной HTTP-сессией для каждого тайла. */
+static gdouble
+test_own_sessions (HyScanGeoProjection *mercator)
+{
+  HyScanMapTileSourceWeb *source;
+  HyScanMapTileGrid *grid;
+  GThreadPool *pool;
+  GTimer *timer;
+  gchar *url_format;
+  gdouble elapsed;
+  guint i;
 
+  /* Источник нужен только для получения тайловой сетки. */
+  url_format = g_strconcat (server_url, "/{z}/{x}/{y}.png", NULL);
+  source = hyscan_map_tile_source_web_new (url_format, mercator, 0, 19);
+  grid = hyscan_map_tile_source_get_grid (HYSCAN_MAP_TILE_SOURCE (source));
+  g_object_unref (source);
+  g_free (url_format);
+
+  g_atomic_int_set (&n_loaded, 0);
+  reset_connections ();
+  pool = g_thread_pool_new (load_tile_own_session, server_url, N_THREADS, TRUE, NULL);
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_TILES; i++)
+    g_thread_pool_push (pool, hyscan_map_tile_new (grid, i % 64, i / 64, 10), NULL);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_message ("Session per tile:        %d tiles in %.3f s, %.1f tiles/s, %u connections",
+             g_atomic_int_get (&n_loaded), elapsed, g_atomic_int_get (&n_loaded) / elapsed, count_connections ());
+  g_assert_cmpint (g_atomic_int_get (&n_loaded), ==, N_TILES);
+
+  g_timer_destroy (timer);
+  g_object_unref (grid);
+
+  return g_atomic_int_get (&n_loaded) / elapsed;
+}
+
+/* Измеряет скорость загрузки тайлов. */
+static gdouble
+test_throughput (HyScanGeoProjection *mercator,
+                 guint                max_conns)
+{
+  HyScanMapTileSourceWeb *source;
+  HyScanMapTileGrid *grid;
+  GThreadPool *pool;
+  GTimer *timer;
+  gchar *url_format;
+  gdouble elapsed;
+  guint i;
+
+  url_format = g_strconcat (server_url, "/{z}/{x}/{y}.png", NULL);
+  source = g_object_new (HYSCAN_TYPE_MAP_TILE_SOURCE_WEB,
+                         "url-format", url_format,
+                         "projection", mercator,
+                         "min-zoom", 0,
+                         "max-zoom", 19,
+                         "max-conns-per-host", max_conns,
+                         NULL);
+  grid = hyscan_map_tile_source_get_grid (HYSCAN_MAP_TILE_SOURCE (source));
+
+  g_atomic_int_set (&n_loaded, 0);
+  reset_connections ();
+  pool = g_thread_pool_new (load_tile, source, N_THREADS, TRUE, NULL);
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_TILES; i++)
+    g_thread_pool_push (pool, hyscan_map_tile_new (grid, i % 64, i / 64, 10), NULL);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_message ("Connections per host %2u: %d tiles in %.3f s, %.1f tiles/s, %u connections",
+             max_conns, g_atomic_int_get (&n_loaded), elapsed, g_atomic_int_get (&n_loaded) / elapsed,
+             count_connections ());
+  g_assert_cmpint (g_atomic_int_get (&n_loaded), ==, N_TILES);
+
+  /* Соединения общей сессии используются повторно. */
+  g_assert_cmpuint (count_connections (), <=, max_conns);
+
+  g_timer_destroy (timer);
+  g_object_unref (grid);
+  g_object_unref (source);
+  g_free (url_format);
+
+  return g_atomic_int_get (&n_loaded) / elapsed;
+}
+
+/* Обработчик завершения асинхронного заполнения тайла. */
+static void
+load_tile_ready (GObject      *object,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  GMainLoop *async_loop = user_data;
+  static gint n_done = 0;
+
+  if (hyscan_map_tile_source_fill_finish (HYSCAN_MAP_TILE_SOURCE (object), result, NULL))
+    g_atomic_int_inc (&n_loaded);
+
+  if (++n_done == N_TILES)
+    {
+      n_done = 0;
+      g_main_loop_quit (async_loop);
+    }
+}
+
+/* Измеряет скорость асинхронной загрузки тайлов одним потоком. */
+static void
+test_async (HyScanGeoProjection *mercator)
+{
+  HyScanMapTileSourceWeb *source;
+  HyScanMapTileGrid *grid;
+  GMainContext *context;
+  GMainLoop *async_loop;
+  GTimer *timer;
+  gchar *url_format;
+  gdouble elapsed;
+  guint i;
+
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+  async_loop = g_main_loop_new (context, FALSE);
+
+  url_format = g_strconcat (server_url, "/{z}/{x}/{y}.png", NULL);
+  source = hyscan_map_tile_source_web_new (url_format, mercator, 0, 19);
+  grid = hyscan_map_tile_source_get_grid (HYSCAN_MAP_TILE_SOURCE (source));
+
+  g_atomic_int_set (&n_loaded, 0);
+  timer = g_timer_new ();
+  for (i = 0; i < N_TILES; i++)
+    {
+      HyScanMapTile *tile;
+
+      tile = hyscan_map_tile_new (grid, i % 64, i / 64, 10);
+      hyscan_map_tile_source_fill_async (HYSCAN_MAP_TILE_SOURCE (source), tile, NULL, load_tile_ready, async_loop);
+      g_object_unref (tile);
+    }
+
+  g_main_loop_run (async_loop);
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_message ("Asynchronous fill: %d tiles in %.3f s, %.1f tiles/s",
+             g_atomic_int_get (&n_loaded), elapsed, g_atomic_int_get (&n_loaded) / elapsed);
+  g_assert_cmpint (g_atomic_int_get (&n_loaded), ==, N_TILES);
+
+  g_timer_destroy (timer);
+  g_object_unref (grid);
+  g_object_unref (source);
+  g_free (url_format);
+
+  g_main_loop_unref (async_loop);
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+}
+
+/* Поток с тестами. Сервер работает в основном потоке. */
+static gpointer
+test_thread (gpointer data)
+{
+  HyScanGeoProjection *mercator = data;
+  gdouble own_sessions, shared_session;
+
+  test_url_format (mercator);
+  own_sessions = test_own_sessions (mercator);
+  test_throughput (mercator, 1);
+  shared_session = test_throughput (mercator, N_THREADS);
+  test_async (mercator);
+
+  g_message ("Shared session is %.1f times faster than session per tile", shared_session / own_sessions);
+
+  g_main_loop_quit (loop);
+
+  return NULL;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanGeoProjection *mercator;
+  SoupServer *server;
+  GSList *uris;
+  GThread *thread;
+  GError *error = NULL;
+
+  /* Локальный HTTP-сервер, заменяющий сервер тайлов. */
+  tile_png = create_tile_png ();
+  client_ports = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server = soup_server_new (SOUP_SERVER_SERVER_HEADER, "tile-source-test", NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  if (!soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error))
+    g_error ("Failed to start server: %s", error->message);
+
+  uris = soup_server_get_uris (server);
+  server_url = g_strdup_printf ("http://127.0.0.1:%u", soup_uri_get_port (uris->data));
+  g_slist_free_full (uris, (GDestroyNotify) soup_uri_free);
+
+  mercator = hyscan_proj_new (HYSCAN_PROJ_WEBMERC);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  thread = g_thread_new ("tile-source-test", test_thread, mercator);
+  g_main_loop_run (loop);
+  g_thread_join (thread);
+
+  g_main_loop_unref (loop);
   g_object_unref (mercator);
+  g_object_unref (server);
+  g_bytes_unref (tile_png);
+  g_hash_table_unref (client_ports);
+  g_free (server_url);
+
   g_message ("Tests done successfully!");
 
   return 0;
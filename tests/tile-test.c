@@ -33,6 +33,9 @@
  */
 
 #include <hyscan-map-tile.h>
+#include <string.h>
+
+#define BENCH_PIXELS     (256 * 256 * 200)      /* Число пикселей, обрабатываемых в тесте скорости. */
 
 typedef struct {
   guint   zoom;
@@ -108,6 +111,203 @@ test_iter (guint from_x,
   g_free (tiles);
 }
 
+/* Создаёт изображение с различными значениями цвета и прозрачности. */
+GdkPixbuf *
+create_pixbuf (guint    size,
+               gboolean has_alpha)
+{
+  GdkPixbuf *pixbuf;
+  guint8 *pixels;
+  gint n_channels, rowstride;
+  guint x, y;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, size, size);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  for (y = 0; y < size; y++)
+    {
+      for (x = 0; x < size; x++)
+        {
+          guint8 *pixel = pixels + y * rowstride + x * n_channels;
+
+          pixel[0] = x * 7 + y;
+          pixel[1] = x ^ y;
+          pixel[2] = x * y;
+          if (has_alpha)
+            pixel[3] = (x % 3 == 0) ? 0xff : (x % 5 == 0) ? 0 : x + y * 3;
+        }
+    }
+
+  return pixbuf;
+}
+
+/* Переводит изображение в поверхность cairo средствами GDK. */
+cairo_surface_t *
+pixbuf_to_surface (GdkPixbuf *pixbuf)
+{
+  cairo_surface_t *surface;
+  cairo_t *cairo;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        gdk_pixbuf_get_width (pixbuf),
+                                        gdk_pixbuf_get_height (pixbuf));
+  cairo = cairo_create (surface);
+  gdk_cairo_set_source_pixbuf (cairo, pixbuf, 0, 0);
+  cairo_paint (cairo);
+  cairo_destroy (cairo);
+  cairo_surface_flush (surface);
+
+  return surface;
+}
+
+/* Кодирует изображение в PNG. */
+GBytes *
+pixbuf_to_png (GdkPixbuf *pixbuf)
+{
+  gchar *buffer;
+  gsize size;
+
+  if (!gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &size, "png", NULL, NULL))
+    g_error ("Failed to encode tile image");
+
+  return g_bytes_new_take (buffer, size);
+}
+
+/* Сравнивает поверхность тайла с эталонной. */
+void
+assert_tile_surface (HyScanMapTile   *tile,
+                     cairo_surface_t *expected)
+{
+  cairo_surface_t *surface;
+  const guint8 *data, *expected_data;
+  gint stride, height, y;
+
+  surface = hyscan_map_tile_get_surface (tile);
+  g_assert_nonnull (surface);
+  cairo_surface_flush (surface);
+
+  stride = cairo_image_surface_get_stride (surface);
+  height = cairo_image_surface_get_height (surface);
+  g_assert_cmpint (stride, ==, cairo_image_surface_get_stride (expected));
+  g_assert_cmpint (height, ==, cairo_image_surface_get_height (expected));
+
+  data = cairo_image_surface_get_data (surface);
+  expected_data = cairo_image_surface_get_data (expected);
+  for (y = 0; y < height; y++)
+    g_assert_cmpmem (data + y * stride, 4 * cairo_image_surface_get_width (surface),
+                     expected_data + y * stride, 4 * cairo_image_surface_get_width (expected));
+
+  cairo_surface_destroy (surface);
+}
+
+/* Проверяет перевод изображений в поверхность тайла. */
+void
+test_convert (guint tile_size)
+{
+  HyScanMapTileGrid *grid;
+  HyScanMapTile *tile;
+  gboolean has_alpha;
+
+  grid = hyscan_map_tile_grid_new (-100.0, 100.0, -100.0, 100.0, 0, tile_size);
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+
+  for (has_alpha = FALSE; has_alpha <= TRUE; has_alpha++)
+    {
+      GdkPixbuf *pixbuf;
+      cairo_surface_t *expected;
+      GBytes *png;
+
+      pixbuf = create_pixbuf (tile_size, has_alpha);
+      expected = pixbuf_to_surface (pixbuf);
+      png = pixbuf_to_png (pixbuf);
+
+      g_assert_true (hyscan_map_tile_set_pixbuf (tile, pixbuf));
+      assert_tile_surface (tile, expected);
+
+      g_assert_true (hyscan_map_tile_set_image (tile, png));
+      assert_tile_surface (tile, expected);
+
+      g_bytes_unref (png);
+      cairo_surface_destroy (expected);
+      g_object_unref (pixbuf);
+    }
+
+  g_object_unref (tile);
+  g_object_unref (grid);
+}
+
+/* Измеряет скорость установки изображения тайла разными способами. */
+void
+bench_convert (guint tile_size)
+{
+  HyScanMapTileGrid *grid;
+  HyScanMapTile *tile;
+  GdkPixbuf *pixbuf;
+  GBytes *png;
+  GTimer *timer;
+  guint n_tiles, i;
+  gdouble t_cairo, t_pixbuf, t_decode, t_image;
+
+  grid = hyscan_map_tile_grid_new (-100.0, 100.0, -100.0, 100.0, 0, tile_size);
+  tile = hyscan_map_tile_new (grid, 0, 0, 0);
+  pixbuf = create_pixbuf (tile_size, TRUE);
+  png = pixbuf_to_png (pixbuf);
+  n_tiles = MAX (1, BENCH_PIXELS / (tile_size * tile_size));
+  timer = g_timer_new ();
+
+  /* Перевод средствами GDK и cairo. */
+  g_timer_start (timer);
+  for (i = 0; i < n_tiles; i++)
+    cairo_surface_destroy (pixbuf_to_surface (pixbuf));
+  t_cairo = g_timer_elapsed (timer, NULL);
+
+  /* Перевод в hyscan_map_tile_set_pixbuf(). */
+  g_timer_start (timer);
+  for (i = 0; i < n_tiles; i++)
+    hyscan_map_tile_set_pixbuf (tile, pixbuf);
+  t_pixbuf = g_timer_elapsed (timer, NULL);
+
+  /* Декодирование PNG через GdkPixbuf. */
+  g_timer_start (timer);
+  for (i = 0; i < n_tiles; i++)
+    {
+      GInputStream *stream;
+      GdkPixbuf *decoded;
+
+      stream = g_memory_input_stream_new_from_bytes (png);
+      decoded = gdk_pixbuf_new_from_stream (stream, NULL, NULL);
+      hyscan_map_tile_set_pixbuf (tile, decoded);
+      g_object_unref (decoded);
+      g_object_unref (stream);
+    }
+  t_decode = g_timer_elapsed (timer, NULL);
+
+  /* Декодирование PNG сразу в поверхность тайла. */
+  g_timer_start (timer);
+  for (i = 0; i < n_tiles; i++)
+    hyscan_map_tile_set_image (tile, png);
+  t_image = g_timer_elapsed (timer, NULL);
+
+  g_print ("Tile size %u px, %u tiles, Mpx/s:\n"
+           "  gdk_cairo_set_source_pixbuf  %8.1f\n"
+           "  hyscan_map_tile_set_pixbuf   %8.1f\n"
+           "  PNG via GdkPixbuf            %8.1f\n"
+           "  hyscan_map_tile_set_image    %8.1f\n",
+           tile_size, n_tiles,
+           1e-6 * n_tiles * tile_size * tile_size / t_cairo,
+           1e-6 * n_tiles * tile_size * tile_size / t_pixbuf,
+           1e-6 * n_tiles * tile_size * tile_size / t_decode,
+           1e-6 * n_tiles * tile_size * tile_size / t_image);
+
+  g_timer_destroy (timer);
+  g_bytes_unref (png);
+  g_object_unref (pixbuf);
+  g_object_unref (tile);
+  g_object_unref (grid);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -146,6 +346,13 @@ main (int    argc,
   test_iter (0, 5, 0, 5);
   test_iter (102, 110, 99, 103);
 
+  test_convert (100);
+  test_convert (256);
+  test_convert (512);
+
+  bench_convert (256);
+  bench_convert (512);
+
   g_print ("Test finished successfully");
 
   return 0;